@@ -9059,6 +9059,106 @@ static void test_managed_buffer(void)
     DestroyWindow(window);
 }
 
+static void test_dynamic_buffer_map(void)
+{
+    static const unsigned int vertex_count = 65536, iteration_count = 128;
+    unsigned int half = vertex_count / 2;
+    IDirect3DVertexBuffer9 *buffer;
+    IDirect3DDevice9 *device;
+    struct vec3 *ptr, *ptr2;
+    unsigned int i, j;
+    IDirect3D9 *d3d9;
+    UINT refcount;
+    HWND window;
+    HRESULT hr;
+
+    window = CreateWindowA("static", "d3d9_test", WS_OVERLAPPEDWINDOW,
+            0, 0, 640, 480, 0, 0, 0, 0);
+    d3d9 = Direct3DCreate9(D3D_SDK_VERSION);
+    ok(!!d3d9, "Failed to create a D3D object.\n");
+    if (!(device = create_device(d3d9, window, NULL)))
+    {
+        skip("Failed to create a D3D device, skipping tests.\n");
+        IDirect3D9_Release(d3d9);
+        DestroyWindow(window);
+        return;
+    }
+
+    hr = IDirect3DDevice9_CreateVertexBuffer(device, vertex_count * sizeof(*ptr),
+            D3DUSAGE_DYNAMIC, 0, D3DPOOL_DEFAULT, &buffer, NULL);
+    ok(SUCCEEDED(hr), "Failed to create buffer, hr %#x.\n", hr);
+    hr = IDirect3DDevice9_SetFVF(device, D3DFVF_XYZ);
+    ok(SUCCEEDED(hr), "Failed to set fvf, hr %#x.\n", hr);
+    hr = IDirect3DDevice9_SetStreamSource(device, 0, buffer, 0, sizeof(*ptr));
+    ok(SUCCEEDED(hr), "Failed to set stream source, hr %#x.\n", hr);
+
+    /* Enough DISCARD maps to wrap around any buffer space the driver
+     * reserves for renaming several times. */
+    for (i = 0; i < iteration_count; ++i)
+    {
+        hr = IDirect3DVertexBuffer9_Lock(buffer, 0, 0, (void **)&ptr, D3DLOCK_DISCARD);
+        ok(SUCCEEDED(hr), "Failed to lock buffer, hr %#x.\n", hr);
+        for (j = 0; j < half; ++j)
+        {
+            ptr[j].x = i * 1.0f;
+            ptr[j].y = j * 1.0f;
+            ptr[j].z = 0.0f;
+        }
+        hr = IDirect3DVertexBuffer9_Unlock(buffer);
+        ok(SUCCEEDED(hr), "Failed to unlock buffer, hr %#x.\n", hr);
+
+        hr = IDirect3DVertexBuffer9_Lock(buffer, half * sizeof(*ptr), half * sizeof(*ptr),
+                (void **)&ptr, D3DLOCK_NOOVERWRITE);
+        ok(SUCCEEDED(hr), "Failed to lock buffer, hr %#x.\n", hr);
+        for (j = 0; j < half; ++j)
+        {
+            ptr[j].x = i * 1.0f;
+            ptr[j].y = (half + j) * 1.0f;
+            ptr[j].z = 1.0f;
+        }
+        hr = IDirect3DVertexBuffer9_Unlock(buffer);
+        ok(SUCCEEDED(hr), "Failed to unlock buffer, hr %#x.\n", hr);
+
+        hr = IDirect3DDevice9_BeginScene(device);
+        ok(SUCCEEDED(hr), "Failed to begin scene, hr %#x.\n", hr);
+        hr = IDirect3DDevice9_DrawPrimitive(device, D3DPT_TRIANGLELIST, 0, 1);
+        ok(SUCCEEDED(hr), "Failed to draw, hr %#x.\n", hr);
+        hr = IDirect3DDevice9_DrawPrimitive(device, D3DPT_TRIANGLELIST, half, 1);
+        ok(SUCCEEDED(hr), "Failed to draw, hr %#x.\n", hr);
+        hr = IDirect3DDevice9_EndScene(device);
+        ok(SUCCEEDED(hr), "Failed to end scene, hr %#x.\n", hr);
+
+        if (i % 32 != 31)
+            continue;
+
+        hr = IDirect3DVertexBuffer9_Lock(buffer, 0, 0, (void **)&ptr, D3DLOCK_READONLY);
+        ok(SUCCEEDED(hr), "Failed to lock buffer, hr %#x.\n", hr);
+        for (j = 0; j < vertex_count; ++j)
+        {
+            if (ptr[j].x != i * 1.0f || ptr[j].y != j * 1.0f || ptr[j].z != (j < half ? 0.0f : 1.0f))
+            {
+                ok(FALSE, "Iteration %u: got unexpected vertex %u {%.8e, %.8e, %.8e}.\n",
+                        i, j, ptr[j].x, ptr[j].y, ptr[j].z);
+                break;
+            }
+        }
+
+        /* A NOOVERWRITE map nested in a regular map. */
+        hr = IDirect3DVertexBuffer9_Lock(buffer, 0, 0, (void **)&ptr2, D3DLOCK_NOOVERWRITE);
+        ok(SUCCEEDED(hr), "Failed to lock buffer, hr %#x.\n", hr);
+        hr = IDirect3DVertexBuffer9_Unlock(buffer);
+        ok(SUCCEEDED(hr), "Failed to unlock buffer, hr %#x.\n", hr);
+        hr = IDirect3DVertexBuffer9_Unlock(buffer);
+        ok(SUCCEEDED(hr), "Failed to unlock buffer, hr %#x.\n", hr);
+    }
+
+    IDirect3DVertexBuffer9_Release(buffer);
+    refcount = IDirect3DDevice9_Release(device);
+    ok(!refcount, "Device has %u references left.\n", refcount);
+    IDirect3D9_Release(d3d9);
+    DestroyWindow(window);
+}
+
 static void test_npot_textures(void)
 {
     IDirect3DDevice9 *device = NULL;
@@ -11803,6 +11903,7 @@ START_TEST(device)
     test_set_palette();
     test_swvp_buffer();
     test_managed_buffer();
+    test_dynamic_buffer_map();
     test_npot_textures();
     test_vidmem_accounting();
     test_volume_locking();
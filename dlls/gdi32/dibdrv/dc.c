@@ -286,6 +286,12 @@ int get_clipped_rects( const dib_info *dib, const RECT *rc, HRGN clip, struct cl
     for (i = region_find_pt( region, rect.left, rect.top, NULL ); i < region->numRects; i++)
     {
         if (region->rects[i].top >= rect.bottom) break;
+        if (region->rects[i].left >= rect.right)
+        {
+            /* nothing else in this band can intersect, skip to the next one */
+            i = region_band_end( region, i ) - 1;
+            continue;
+        }
         if (!intersect_rect( out, &rect, &region->rects[i] )) continue;
         out++;
         if (out == &clip_rects->buffer[sizeof(clip_rects->buffer) / sizeof(RECT)])
@@ -408,6 +408,29 @@ static inline int region_find_pt( const WINEREGION *rgn, int x, int y, BOOL *hit
     return h ? i : start;
 }
 
+/**********************************************************
+ *     region_band_end
+ *
+ * Return the index of the first rectangle following the band that contains
+ * rectangle 'index'.  Bands are contiguous and sorted, so this is a binary
+ * search on the top coordinate.
+ */
+static inline int region_band_end( const WINEREGION *rgn, int index )
+{
+    int i, top = rgn->rects[index].top, start = index + 1, end = rgn->numRects - 1;
+
+    /* most bands are short, check the immediate successor first */
+    if (start > end || rgn->rects[start].top != top) return start;
+
+    while (start <= end)
+    {
+        i = (start + end) / 2;
+        if (rgn->rects[i].top <= top) start = i + 1;
+        else end = i - 1;
+    }
+    return start;
+}
+
 /* null driver entry points */
 extern BOOL nulldrv_AbortPath( PHYSDEV dev ) DECLSPEC_HIDDEN;
 extern BOOL nulldrv_AlphaBlend( PHYSDEV dst_dev, struct bitblt_coords *dst,
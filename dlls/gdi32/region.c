@@ -125,6 +125,66 @@ static inline BOOL overlapping( const RECT *r1, const RECT *r2 )
             r1->bottom > r2->top && r1->top < r2->bottom);
 }
 
+/*
+ * Combining regions always builds the result in a freshly allocated array and
+ * then frees the destination's previous one.  To avoid going through the heap
+ * for every CombineRgn, the largest recently released array is kept around
+ * and handed out again to the next region that needs one.
+ */
+#define RGN_SCRATCH_MAX_RECTS 8192
+
+static RECT *scratch_rects;
+static INT scratch_size;
+
+static CRITICAL_SECTION scratch_section;
+static CRITICAL_SECTION_DEBUG scratch_section_debug =
+{
+    0, 0, &scratch_section,
+    { &scratch_section_debug.ProcessLocksList, &scratch_section_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": scratch_section") }
+};
+static CRITICAL_SECTION scratch_section = { &scratch_section_debug, -1, 0, 0, 0, 0 };
+
+/* allocate an array of at least *size rectangles, updating *size to the actual size */
+static RECT *alloc_rects( INT *size )
+{
+    RECT *rects = NULL;
+
+    if (*size <= RGN_SCRATCH_MAX_RECTS)
+    {
+        EnterCriticalSection( &scratch_section );
+        if (scratch_rects && scratch_size >= *size)
+        {
+            rects = scratch_rects;
+            *size = scratch_size;
+            scratch_rects = NULL;
+            scratch_size = 0;
+        }
+        LeaveCriticalSection( &scratch_section );
+        if (rects) return rects;
+    }
+    return HeapAlloc( GetProcessHeap(), 0, *size * sizeof(RECT) );
+}
+
+/* release an array returned by alloc_rects, possibly keeping it for reuse */
+static void free_rects( RECT *rects, INT size )
+{
+    if (!rects) return;
+    if (size <= RGN_SCRATCH_MAX_RECTS)
+    {
+        EnterCriticalSection( &scratch_section );
+        if (size > scratch_size)
+        {
+            RECT *old = scratch_rects;
+            scratch_rects = rects;
+            scratch_size = size;
+            rects = old;
+        }
+        LeaveCriticalSection( &scratch_section );
+    }
+    HeapFree( GetProcessHeap(), 0, rects );
+}
+
 static BOOL grow_region( WINEREGION *rgn, int size )
 {
     RECT *new_rects;
@@ -167,6 +227,13 @@ static inline void empty_region( WINEREGION *reg )
     reg->extents.left = reg->extents.top = reg->extents.right = reg->extents.bottom = 0;
 }
 
+/* Check if r1 entirely contains r2. */
+static inline BOOL contains_rect( const RECT *r1, const RECT *r2 )
+{
+    return (r1->left <= r2->left && r1->top <= r2->top &&
+            r1->right >= r2->right && r1->bottom >= r2->bottom);
+}
+
 static inline BOOL is_in_rect( const RECT *rect, int x, int y )
 {
     return (rect->right > x && rect->left <= x && rect->bottom > y && rect->top <= y);
@@ -452,7 +519,7 @@ static BOOL init_region( WINEREGION *pReg, INT n )
 
     if (n > RGN_DEFAULT_RECTS)
     {
-        if (!(pReg->rects = HeapAlloc( GetProcessHeap(), 0, n * sizeof( RECT ) )))
+        if (!(pReg->rects = alloc_rects( &n )))
             return FALSE;
     }
     else
@@ -469,7 +536,7 @@ static BOOL init_region( WINEREGION *pReg, INT n )
 static void destroy_region( WINEREGION *pReg )
 {
     if (pReg->rects != pReg->rects_buf)
-        HeapFree( GetProcessHeap(), 0, pReg->rects );
+        free_rects( pReg->rects, pReg->size );
 }
 
 /***********************************************************************
@@ -1077,7 +1144,10 @@ BOOL WINAPI PtInRegion( HRGN hrgn, INT x, INT y )
     if ((obj = GDI_GetObjPtr( hrgn, OBJ_REGION )))
     {
         if (obj->numRects > 0 && is_in_rect( &obj->extents, x, y ))
-            region_find_pt( obj, x, y, &ret );
+        {
+            if (obj->numRects == 1) ret = TRUE;
+            else region_find_pt( obj, x, y, &ret );
+        }
 	GDI_ReleaseObj( hrgn );
     }
     return ret;
@@ -1102,7 +1172,7 @@ BOOL WINAPI RectInRegion( HRGN hrgn, const RECT *rect )
     WINEREGION *obj;
     BOOL ret = FALSE;
     RECT rc;
-    int i;
+    int i, y;
 
     /* swap the coordinates to make right >= left and bottom >= top */
     /* (region building rectangles are normalized the same way) */
@@ -1113,21 +1183,28 @@ BOOL WINAPI RectInRegion( HRGN hrgn, const RECT *rect )
     {
 	if ((obj->numRects > 0) && overlapping(&obj->extents, &rc))
 	{
-	    for (i = region_find_pt( obj, rc.left, rc.top, &ret ); !ret && i < obj->numRects; i++ )
+            /* Visit each band crossed by the rectangle once.  region_find_pt returns
+             * either a rectangle of the band containing y that ends right of
+             * rc.left, or the first rectangle of a band below y. */
+            y = rc.top;
+            if (obj->numRects == 1) ret = TRUE;
+	    else for (i = region_find_pt( obj, rc.left, y, &ret ); !ret && i < obj->numRects; )
 	    {
-	        if (obj->rects[i].bottom <= rc.top)
-		    continue;             /* not far enough down yet */
-
 		if (obj->rects[i].top >= rc.bottom)
 		    break;                /* too far down */
 
-		if (obj->rects[i].right <= rc.left)
-		    continue;              /* not far enough over yet */
-
-		if (obj->rects[i].left >= rc.right)
+		if (obj->rects[i].top > y)
+		{
+		    /* entered a new band, look up its first candidate */
+		    y = obj->rects[i].top;
+		    i = region_find_pt( obj, rc.left, y, &ret );
 		    continue;
+		}
 
-		ret = TRUE;
+		if (obj->rects[i].left < rc.right)
+		    ret = TRUE;
+		else
+		    i = region_band_end( obj, i );  /* rest of the band is too far over */
 	    }
 	}
 	GDI_ReleaseObj(hrgn);
@@ -1970,6 +2047,22 @@ static BOOL REGION_IntersectRegion(WINEREGION *newReg, WINEREGION *reg1,
     if ( (!(reg1->numRects)) || (!(reg2->numRects))  ||
 	(!overlapping(&reg1->extents, &reg2->extents)))
 	newReg->numRects = 0;
+    /* clipping against a single rectangle that contains the other region */
+    else if (reg1->numRects == 1 && contains_rect( &reg1->extents, &reg2->extents ))
+        return REGION_CopyRegion( newReg, reg2 );
+    else if (reg2->numRects == 1 && contains_rect( &reg2->extents, &reg1->extents ))
+        return REGION_CopyRegion( newReg, reg1 );
+    else if (reg1->numRects == 1 && reg2->numRects == 1)
+    {
+        /* the rectangles overlap, so the intersection is never empty */
+        newReg->extents.left   = max( reg1->extents.left, reg2->extents.left );
+        newReg->extents.top    = max( reg1->extents.top, reg2->extents.top );
+        newReg->extents.right  = min( reg1->extents.right, reg2->extents.right );
+        newReg->extents.bottom = min( reg1->extents.bottom, reg2->extents.bottom );
+        newReg->rects[0] = newReg->extents;
+        newReg->numRects = 1;
+        return TRUE;
+    }
     else
 	if (!REGION_RegionOp (newReg, reg1, reg2, REGION_IntersectO, NULL, NULL)) return FALSE;
 
@@ -2294,6 +2387,13 @@ static BOOL REGION_SubtractRegion(WINEREGION *regD, WINEREGION *regM, WINEREGION
 	(!overlapping(&regM->extents, &regS->extents)) )
 	return REGION_CopyRegion(regD, regM);
 
+    /* subtracting a rectangle that covers everything */
+    if (regS->numRects == 1 && contains_rect( &regS->extents, &regM->extents ))
+    {
+        empty_region( regD );
+        return TRUE;
+    }
+
     if (!REGION_RegionOp (regD, regM, regS, REGION_SubtractO, REGION_SubtractNonO1, NULL))
         return FALSE;
 
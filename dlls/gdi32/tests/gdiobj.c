@@ -285,6 +285,7 @@ static void test_region(void)
     HRGN hrgn = CreateRectRgn(10, 10, 20, 20);
     RECT rc = { 5, 5, 15, 15 };
     BOOL ret = RectInRegion( hrgn, &rc);
+    int x, y;
     ok( ret, "RectInRegion should return TRUE\n");
     /* swap left and right */
     SetRect( &rc, 15, 5, 5, 15 );
@@ -317,6 +318,42 @@ static void test_region(void)
     ret = RectInRegion( hrgn, &rc);
     ok( ret, "RectInRegion should return TRUE\n");
     DeleteObject(hrgn);
+
+    /* checkerboard region with many bands */
+    hrgn = CreateRectRgn( 0, 0, 0, 0 );
+    for (y = 0; y < 8; y++)
+    {
+        for (x = y % 2; x < 8; x += 2)
+        {
+            HRGN tmp = CreateRectRgn( x * 10, y * 10, x * 10 + 10, y * 10 + 10 );
+            CombineRgn( hrgn, hrgn, tmp, RGN_OR );
+            DeleteObject( tmp );
+        }
+    }
+    for (y = 0; y < 8; y++)
+    {
+        for (x = 0; x < 8; x++)
+        {
+            BOOL expect = (x + y) % 2 == 0;
+
+            ret = PtInRegion( hrgn, x * 10 + 5, y * 10 + 5 );
+            ok( ret == expect, "%d,%d: PtInRegion returned %d\n", x, y, ret );
+            SetRect( &rc, x * 10 + 1, y * 10 + 1, x * 10 + 9, y * 10 + 9 );
+            ret = RectInRegion( hrgn, &rc );
+            ok( ret == expect, "%d,%d: RectInRegion returned %d\n", x, y, ret );
+        }
+    }
+    /* rectangle spanning several bands, only touching the last one */
+    SetRect( &rc, 11, 1, 19, 29 );
+    ret = RectInRegion( hrgn, &rc );
+    ok( ret, "RectInRegion should return TRUE\n");
+    SetRect( &rc, 71, 1, 79, 9 );
+    ret = RectInRegion( hrgn, &rc );
+    ok( !ret, "RectInRegion should return FALSE\n");
+    SetRect( &rc, 80, 0, 90, 80 );
+    ret = RectInRegion( hrgn, &rc );
+    ok( !ret, "RectInRegion should return FALSE\n");
+    DeleteObject(hrgn);
 }
 
 static void test_handles_on_win64(void)
@@ -308,24 +308,102 @@ NTSTATUS WINAPI RtlPinAtomInAtomTable( RTL_ATOM_TABLE table, RTL_ATOM atom )
  *        Global handle table management
  *************************************************/
 
+/* cache of the pinned global atoms; they can never be deleted, so the entries
+ * stay valid and lookups can be done without a server call. The global table
+ * may change with the window station, entries from a previous one are ignored. */
+struct pinned_atom
+{
+    struct pinned_atom *next;
+    RTL_ATOM            atom;
+    LONG                generation; /* cache generation the atom was added in */
+    ULONG               len;  /* name length in WCHARs */
+    WCHAR               name[1];
+};
+
+#define PINNED_ATOM_BUCKETS 64
+
+static struct pinned_atom *pinned_atoms[PINNED_ATOM_BUCKETS];
+static LONG pinned_atom_generation;
+
+static unsigned int pinned_atom_hash( const WCHAR *name, ULONG len )
+{
+    unsigned int i, hash = 0;
+    for (i = 0; i < len; i++) hash ^= toupperW(name[i]) + i;
+    return hash % PINNED_ATOM_BUCKETS;
+}
+
+static BOOL find_pinned_atom( const WCHAR *name, ULONG len, RTL_ATOM *atom )
+{
+    struct pinned_atom *entry;
+
+    LONG generation = pinned_atom_generation;
+
+    for (entry = pinned_atoms[pinned_atom_hash( name, len )]; entry; entry = entry->next)
+    {
+        if (entry->generation != generation) continue;
+        if (entry->len != len || memicmpW( entry->name, name, len )) continue;
+        *atom = entry->atom;
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/* entries are only ever added, so readers don't need any locking; the generation
+ * is the one read before asking the server, so that a flush in the meantime wins */
+static void add_pinned_atom( const WCHAR *name, ULONG len, RTL_ATOM atom, LONG generation )
+{
+    struct pinned_atom *entry, **head = &pinned_atoms[pinned_atom_hash( name, len )];
+
+    if (generation != pinned_atom_generation) return;
+    if (!(entry = RtlAllocateHeap( GetProcessHeap(), 0, FIELD_OFFSET( struct pinned_atom, name[len] ))))
+        return;
+    entry->atom = atom;
+    entry->generation = generation;
+    entry->len  = len;
+    memcpy( entry->name, name, len * sizeof(WCHAR) );
+    do entry->next = *head;
+    while (interlocked_cmpxchg_ptr( (void **)head, entry, entry->next ) != entry->next);
+}
+
+/******************************************************************
+ *		__wine_flush_atom_cache (NTDLL.@)
+ *
+ * Forget the cached pinned atoms, called when the process switches to
+ * another window station. The entries can't be freed since lookups don't
+ * take any lock, but they are never matched again.
+ */
+void CDECL __wine_flush_atom_cache(void)
+{
+    interlocked_xchg_add( &pinned_atom_generation, 1 );
+}
+
 /******************************************************************
  *		NtAddAtom (NTDLL.@)
  */
 NTSTATUS WINAPI NtAddAtom( const WCHAR* name, ULONG length, RTL_ATOM* atom )
 {
     NTSTATUS    status;
+    int         pinned = 0;
+    LONG        generation = pinned_atom_generation;
 
     status = is_integral_atom( name, length / sizeof(WCHAR), atom );
     if (status == STATUS_MORE_ENTRIES)
     {
-        SERVER_START_REQ( add_atom )
+        /* the reference count of pinned atoms doesn't matter */
+        if (find_pinned_atom( name, length / sizeof(WCHAR), atom )) status = STATUS_SUCCESS;
+        else
         {
-            wine_server_add_data( req, name, length );
-            req->table = 0;
-            status = wine_server_call( req );
-            *atom = reply->atom;
+            SERVER_START_REQ( add_atom )
+            {
+                wine_server_add_data( req, name, length );
+                req->table = 0;
+                status = wine_server_call( req );
+                *atom = reply->atom;
+                pinned = reply->pinned;
+            }
+            SERVER_END_REQ;
+            if (!status && pinned) add_pinned_atom( name, length / sizeof(WCHAR), *atom, generation );
         }
-        SERVER_END_REQ;
     }
     TRACE( "%s -> %x\n",
            debugstr_wn(name, length/sizeof(WCHAR)), status == STATUS_SUCCESS ? *atom : 0 );
@@ -355,18 +433,26 @@ NTSTATUS WINAPI NtDeleteAtom(RTL_ATOM atom)
 NTSTATUS WINAPI NtFindAtom( const WCHAR* name, ULONG length, RTL_ATOM* atom )
 {
     NTSTATUS    status;
+    int         pinned = 0;
+    LONG        generation = pinned_atom_generation;
 
     status = is_integral_atom( name, length / sizeof(WCHAR), atom );
     if (status == STATUS_MORE_ENTRIES)
     {
-        SERVER_START_REQ( find_atom )
+        if (find_pinned_atom( name, length / sizeof(WCHAR), atom )) status = STATUS_SUCCESS;
+        else
         {
-            wine_server_add_data( req, name, length );
-            req->table = 0;
-            status = wine_server_call( req );
-            *atom = reply->atom;
+            SERVER_START_REQ( find_atom )
+            {
+                wine_server_add_data( req, name, length );
+                req->table = 0;
+                status = wine_server_call( req );
+                *atom = reply->atom;
+                pinned = reply->pinned;
+            }
+            SERVER_END_REQ;
+            if (!status && pinned) add_pinned_atom( name, length / sizeof(WCHAR), *atom, generation );
         }
-        SERVER_END_REQ;
     }
     TRACE( "%s -> %x\n",
            debugstr_wn(name, length/sizeof(WCHAR)), status == STATUS_SUCCESS ? *atom : 0 );
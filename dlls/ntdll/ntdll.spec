@@ -1474,7 +1474,9 @@
 
 # Server interface
 @ cdecl -norelay wine_server_call(ptr)
+@ cdecl wine_server_fd_cache_generation()
 @ cdecl wine_server_fd_to_handle(long long long ptr)
+@ cdecl wine_server_get_unix_fd(long long ptr ptr)
 @ cdecl wine_server_handle_to_fd(long long ptr ptr)
 @ cdecl wine_server_release_fd(long long)
 @ cdecl wine_server_send_fd(long)
@@ -1491,6 +1493,9 @@
 # signal handling
 @ cdecl __wine_set_signal_handler(long ptr)
 
+# Atoms
+@ cdecl __wine_flush_atom_cache()
+
 # Filesystem
 @ cdecl wine_nt_to_unix_file_name(ptr ptr long long)
 @ cdecl wine_unix_to_nt_file_name(ptr ptr)
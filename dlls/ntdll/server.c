@@ -818,6 +818,7 @@ C_ASSERT( sizeof(union fd_cache_entry) == sizeof(LONG64) );
 
 static union fd_cache_entry *fd_cache[FD_CACHE_ENTRIES];
 static union fd_cache_entry fd_cache_initial_block[FD_CACHE_BLOCK_SIZE];
+static int fd_cache_generation;  /* incremented every time a cached fd is removed */
 
 static inline unsigned int handle_to_index( HANDLE handle, unsigned int *entry )
 {
@@ -905,6 +906,7 @@ int server_remove_fd_from_cache( HANDLE handle )
         union fd_cache_entry cache;
         cache.data = interlocked_xchg64( &fd_cache[entry][idx].data, 0 );
         if (cache.s.type != FD_TYPE_INVALID) fd = cache.s.fd - 1;
+        if (fd != -1) interlocked_xchg_add( &fd_cache_generation, 1 );
     }
 
     return fd;
@@ -1032,6 +1034,43 @@ int CDECL wine_server_handle_to_fd( HANDLE handle, unsigned int access, int *uni
 }
 
 
+/***********************************************************************
+ *           wine_server_get_unix_fd   (NTDLL.@)
+ *
+ * Retrieve the file descriptor corresponding to a file handle, without
+ * duplicating it if it is cached.
+ *
+ * PARAMS
+ *     handle      [I] Wine file handle.
+ *     access      [I] Win32 file access rights requested.
+ *     unix_fd     [O] Address where Unix file descriptor will be stored.
+ *     needs_close [O] Address where the need to release the descriptor will be stored.
+ *
+ * RETURNS
+ *     NTSTATUS code
+ *
+ * NOTES
+ *     A cached descriptor is closed as soon as the handle is closed, so it
+ *     must not be used once that may have happened. The value returned by
+ *     wine_server_fd_cache_generation changes when it does.
+ */
+int CDECL wine_server_get_unix_fd( HANDLE handle, unsigned int access, int *unix_fd, int *needs_close )
+{
+    return server_get_unix_fd( handle, access, unix_fd, needs_close, NULL, NULL );
+}
+
+
+/***********************************************************************
+ *           wine_server_fd_cache_generation   (NTDLL.@)
+ *
+ * Retrieve a value that changes every time a cached file descriptor is closed.
+ */
+unsigned int CDECL wine_server_fd_cache_generation(void)
+{
+    return interlocked_cmpxchg( &fd_cache_generation, 0, 0 );
+}
+
+
 /***********************************************************************
  *           wine_server_release_fd   (NTDLL.@)
  *
@@ -2811,6 +2811,142 @@ static ULONG EmbeddedComplexMemorySize(PMIDL_STUB_MESSAGE pStubMsg,
 }
 
 
+/* Member lists of complex structs are compiled once into a list of runs of
+ * simple members, whose memory and wire layouts are identical, so that each
+ * run can be copied or sized in one step instead of member by member.
+ * Plans are never freed once published, so lookups don't need a lock. */
+
+struct member_run
+{
+  PFORMAT_STRING start; /* first member of the run */
+  PFORMAT_STRING end;   /* member following the run */
+  ULONG size;           /* size of the run, both in memory and on the wire */
+};
+
+struct member_plan
+{
+  struct member_plan *next;
+  PFORMAT_STRING format;
+  unsigned char *format_copy; /* to detect format strings unloaded and replaced */
+  ULONG format_len;
+  unsigned int run_count;
+  struct member_run runs[1];
+};
+
+#define MEMBER_PLAN_HASH_SIZE 256
+
+static struct member_plan *member_plans[MEMBER_PLAN_HASH_SIZE];
+
+static ULONG simple_member_size(unsigned char fc)
+{
+  switch (fc) {
+  case RPC_FC_BYTE:
+  case RPC_FC_CHAR:
+  case RPC_FC_SMALL:
+  case RPC_FC_USMALL:
+    return 1;
+  case RPC_FC_WCHAR:
+  case RPC_FC_SHORT:
+  case RPC_FC_USHORT:
+    return 2;
+  case RPC_FC_LONG:
+  case RPC_FC_ULONG:
+  case RPC_FC_ENUM32:
+  case RPC_FC_FLOAT:
+    return 4;
+  case RPC_FC_HYPER:
+  case RPC_FC_DOUBLE:
+    return 8;
+  default:
+    return 0;
+  }
+}
+
+/* walks the member list the same way the Complex* functions do, returning
+ * the number of runs found and filling them in if runs is not NULL */
+static unsigned int find_member_runs(PFORMAT_STRING pFormat, struct member_run *runs, ULONG *len)
+{
+  PFORMAT_STRING start = pFormat, run_start = NULL;
+  unsigned int count = 0, members = 0;
+  ULONG run_size = 0, size;
+
+  for (;;) {
+    if ((size = simple_member_size(*pFormat)))
+    {
+      if (!members++) run_start = pFormat;
+      run_size += size;
+      pFormat++;
+      continue;
+    }
+    if (members > 1)
+    {
+      if (runs)
+      {
+        runs[count].start = run_start;
+        runs[count].end = pFormat;
+        runs[count].size = run_size;
+      }
+      count++;
+    }
+    members = 0;
+    run_size = 0;
+
+    switch (*pFormat) {
+    case RPC_FC_END:
+      *len = pFormat - start + 1;
+      return count;
+    case RPC_FC_RP:
+    case RPC_FC_UP:
+    case RPC_FC_OP:
+    case RPC_FC_FP:
+      pFormat += 4;
+      break;
+    case RPC_FC_EMBEDDED_COMPLEX:
+      pFormat += 3;
+      break;
+    }
+    pFormat++;
+  }
+}
+
+static const struct member_run *get_member_runs(PFORMAT_STRING pFormat, const struct member_run **end)
+{
+  unsigned int hash = ((ULONG_PTR)pFormat >> 1) % MEMBER_PLAN_HASH_SIZE;
+  struct member_plan *plan, *head;
+  unsigned int count;
+  ULONG len;
+
+  for (plan = member_plans[hash]; plan; plan = plan->next)
+  {
+    if (plan->format == pFormat && !memcmp(plan->format_copy, pFormat, plan->format_len))
+      goto done;
+  }
+
+  count = find_member_runs(pFormat, NULL, &len);
+  plan = HeapAlloc(GetProcessHeap(), 0, FIELD_OFFSET(struct member_plan, runs[count]) + len);
+  if (!plan)
+  {
+    *end = NULL;
+    return NULL;
+  }
+  plan->format = pFormat;
+  plan->format_copy = (unsigned char *)&plan->runs[count];
+  plan->format_len = len;
+  plan->run_count = find_member_runs(pFormat, plan->runs, &len);
+  memcpy(plan->format_copy, pFormat, len);
+  TRACE("compiled %u runs for %p\n", count, pFormat);
+
+  do
+  {
+    head = member_plans[hash];
+    plan->next = head;
+  } while (InterlockedCompareExchangePointer((void **)&member_plans[hash], plan, head) != head);
+
+done:
+  *end = plan->runs + plan->run_count;
+  return plan->runs;
+}
+
 static unsigned char * ComplexMarshall(PMIDL_STUB_MESSAGE pStubMsg,
                                        unsigned char *pMemory,
                                        PFORMAT_STRING pFormat,
@@ -2819,8 +2955,19 @@ static unsigned char * ComplexMarshall(PMIDL_STUB_MESSAGE pStubMsg,
   PFORMAT_STRING desc;
   NDR_MARSHALL m;
   ULONG size;
+  const struct member_run *run, *run_end;
+
+  run = get_member_runs(pFormat, &run_end);
 
   while (*pFormat != RPC_FC_END) {
+    if (run < run_end && pFormat == run->start)
+    {
+      TRACE("%u bytes <= %p\n", run->size, pMemory);
+      safe_copy_to_buffer(pStubMsg, pMemory, run->size);
+      pMemory += run->size;
+      pFormat = run++->end;
+      continue;
+    }
     switch (*pFormat) {
     case RPC_FC_BYTE:
     case RPC_FC_CHAR:
@@ -2978,8 +3125,19 @@ static unsigned char * ComplexUnmarshall(PMIDL_STUB_MESSAGE pStubMsg,
   PFORMAT_STRING desc;
   NDR_UNMARSHALL m;
   ULONG size;
+  const struct member_run *run, *run_end;
+
+  run = get_member_runs(pFormat, &run_end);
 
   while (*pFormat != RPC_FC_END) {
+    if (run < run_end && pFormat == run->start)
+    {
+      safe_copy_from_buffer(pStubMsg, pMemory, run->size);
+      TRACE("%u bytes => %p\n", run->size, pMemory);
+      pMemory += run->size;
+      pFormat = run++->end;
+      continue;
+    }
     switch (*pFormat) {
     case RPC_FC_BYTE:
     case RPC_FC_CHAR:
@@ -3153,8 +3311,18 @@ static unsigned char * ComplexBufferSize(PMIDL_STUB_MESSAGE pStubMsg,
   PFORMAT_STRING desc;
   NDR_BUFFERSIZE m;
   ULONG size;
+  const struct member_run *run, *run_end;
+
+  run = get_member_runs(pFormat, &run_end);
 
   while (*pFormat != RPC_FC_END) {
+    if (run < run_end && pFormat == run->start)
+    {
+      safe_buffer_length_increment(pStubMsg, run->size);
+      pMemory += run->size;
+      pFormat = run++->end;
+      continue;
+    }
     switch (*pFormat) {
     case RPC_FC_BYTE:
     case RPC_FC_CHAR:
@@ -3277,8 +3445,17 @@ static unsigned char * ComplexFree(PMIDL_STUB_MESSAGE pStubMsg,
   PFORMAT_STRING desc;
   NDR_FREE m;
   ULONG size;
+  const struct member_run *run, *run_end;
+
+  run = get_member_runs(pFormat, &run_end);
 
   while (*pFormat != RPC_FC_END) {
+    if (run < run_end && pFormat == run->start)
+    {
+      pMemory += run->size;
+      pFormat = run++->end;
+      continue;
+    }
     switch (*pFormat) {
     case RPC_FC_BYTE:
     case RPC_FC_CHAR:
@@ -3375,8 +3552,18 @@ static ULONG ComplexStructMemorySize(PMIDL_STUB_MESSAGE pStubMsg,
 {
   PFORMAT_STRING desc;
   ULONG size = 0;
+  const struct member_run *run, *run_end;
+
+  run = get_member_runs(pFormat, &run_end);
 
   while (*pFormat != RPC_FC_END) {
+    if (run < run_end && pFormat == run->start)
+    {
+      size += run->size;
+      safe_buffer_increment(pStubMsg, run->size);
+      pFormat = run++->end;
+      continue;
+    }
     switch (*pFormat) {
     case RPC_FC_BYTE:
     case RPC_FC_CHAR:
@@ -3491,8 +3678,17 @@ ULONG ComplexStructSize(PMIDL_STUB_MESSAGE pStubMsg, PFORMAT_STRING pFormat)
 {
   PFORMAT_STRING desc;
   ULONG size = 0;
+  const struct member_run *run, *run_end;
+
+  run = get_member_runs(pFormat, &run_end);
 
   while (*pFormat != RPC_FC_END) {
+    if (run < run_end && pFormat == run->start)
+    {
+      size += run->size;
+      pFormat = run++->end;
+      continue;
+    }
     switch (*pFormat) {
     case RPC_FC_BYTE:
     case RPC_FC_CHAR:
@@ -893,6 +893,461 @@ static RPC_STATUS rpcrt4_ncalrpc_inquire_auth_client(
     return RPC_S_OK;
 }
 
+/**** ncalrpc shared memory support ****/
+
+/* Once an ncalrpc connection is established, the client offers the server
+ * a pair of shared memory rings, one per direction. When the server accepts
+ * them, all further traffic goes through the rings and the pipe is only kept
+ * to impersonate the client. Each side flags the connection as closed in the
+ * shared memory, and waits on the process of the other side to notice when it
+ * dies. Readers and writers spin briefly before blocking on an event, so that
+ * quick calls complete without any server round trip. */
+
+#define LRPC_SHM_MAGIC    0x4d485357 /* "WSHM", never a valid RPC packet start */
+#define LRPC_SHM_VERSION  3
+#define LRPC_RING_SIZE    0x10000
+#define LRPC_SPIN_COUNT   1000
+
+struct lrpc_ring
+{
+    LONG head;            /* total bytes written */
+    LONG tail;            /* total bytes read */
+    LONG reader_waiting;
+    LONG writer_waiting;
+    unsigned char data[LRPC_RING_SIZE];
+};
+
+struct lrpc_shm
+{
+    struct lrpc_ring ring[2]; /* client to server, server to client */
+    LONG closed[2];           /* client, server has closed the connection */
+};
+
+struct lrpc_shm_hello
+{
+    DWORD magic;
+    DWORD version;
+    DWORD pid;                /* client process id */
+    char  name[64];
+};
+
+struct lrpc_shm_reply
+{
+    DWORD status;
+    DWORD pid;                /* server process id */
+};
+
+typedef struct _RpcConnection_lrpc
+{
+    RpcConnection_np np;
+    BOOL negotiated;
+    HANDLE section;
+    struct lrpc_shm *shm;
+    struct lrpc_ring *in;
+    struct lrpc_ring *out;
+    HANDLE in_data, in_space, out_data, out_space;
+    HANDLE peer_process;
+    LONG cancelled;
+    CRITICAL_SECTION write_cs;
+    unsigned char *pending;
+    unsigned int pending_pos;
+    unsigned int pending_len;
+} RpcConnection_lrpc;
+
+static inline void small_pause(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    __asm__ __volatile__( "rep;nop" : : : "memory" );
+#else
+    __asm__ __volatile__( "" : : : "memory" );
+#endif
+}
+
+static RpcConnection *rpcrt4_conn_lrpc_alloc(void)
+{
+    RpcConnection_lrpc *lrpc = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(RpcConnection_lrpc));
+    return &lrpc->np.common;
+}
+
+static void lrpc_object_name(char *buffer, const char *name, char type, int index)
+{
+    sprintf(buffer, "%s_%c%d", name, type, index);
+}
+
+static HANDLE lrpc_create_event(const char *name, char type, int index, BOOL create)
+{
+    char event_name[80];
+    HANDLE event;
+
+    lrpc_object_name(event_name, name, type, index);
+    if (!create)
+        return OpenEventA(EVENT_MODIFY_STATE | SYNCHRONIZE, FALSE, event_name);
+
+    /* someone else already owns that name, don't share the connection with it */
+    if ((event = CreateEventA(NULL, FALSE, FALSE, event_name)) && GetLastError() == ERROR_ALREADY_EXISTS)
+    {
+        WARN("event %s already exists\n", debugstr_a(event_name));
+        CloseHandle(event);
+        event = NULL;
+    }
+    return event;
+}
+
+static void lrpc_free_shm(RpcConnection_lrpc *lrpc)
+{
+    if (lrpc->in)
+    {
+        lrpc->write_cs.DebugInfo->Spare[0] = 0;
+        DeleteCriticalSection(&lrpc->write_cs);
+    }
+    if (lrpc->shm) UnmapViewOfFile(lrpc->shm);
+    if (lrpc->section) CloseHandle(lrpc->section);
+    if (lrpc->in_data) CloseHandle(lrpc->in_data);
+    if (lrpc->in_space) CloseHandle(lrpc->in_space);
+    if (lrpc->out_data) CloseHandle(lrpc->out_data);
+    if (lrpc->out_space) CloseHandle(lrpc->out_space);
+    if (lrpc->peer_process) CloseHandle(lrpc->peer_process);
+    lrpc->shm = NULL;
+    lrpc->in = lrpc->out = NULL;
+    lrpc->section = lrpc->in_data = lrpc->in_space = lrpc->out_data = lrpc->out_space = NULL;
+    lrpc->peer_process = NULL;
+}
+
+/* maps the rings and opens or creates their events, the client writes to the first ring */
+static BOOL lrpc_map_shm(RpcConnection_lrpc *lrpc, const char *name, BOOL server)
+{
+    int in = server ? 0 : 1, out = server ? 1 : 0;
+
+    if (server)
+        lrpc->section = OpenFileMappingA(FILE_MAP_WRITE, FALSE, name);
+    else
+        lrpc->section = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+                                           0, sizeof(struct lrpc_shm), name);
+    if (!lrpc->section)
+        return FALSE;
+    if (!server && GetLastError() == ERROR_ALREADY_EXISTS)
+    {
+        WARN("section %s already exists\n", debugstr_a(name));
+        goto fail;
+    }
+    if (!(lrpc->shm = MapViewOfFile(lrpc->section, FILE_MAP_WRITE, 0, 0, sizeof(struct lrpc_shm))))
+        goto fail;
+
+    if (!(lrpc->in_data = lrpc_create_event(name, 'd', in, !server))) goto fail;
+    if (!(lrpc->in_space = lrpc_create_event(name, 's', in, !server))) goto fail;
+    if (!(lrpc->out_data = lrpc_create_event(name, 'd', out, !server))) goto fail;
+    if (!(lrpc->out_space = lrpc_create_event(name, 's', out, !server))) goto fail;
+
+    lrpc->in = &lrpc->shm->ring[in];
+    lrpc->out = &lrpc->shm->ring[out];
+    InitializeCriticalSection(&lrpc->write_cs);
+    lrpc->write_cs.DebugInfo->Spare[0] = (DWORD_PTR)(__FILE__ ": RpcConnection_lrpc.write_cs");
+    return TRUE;
+
+fail:
+    lrpc_free_shm(lrpc);
+    return FALSE;
+}
+
+/* opens the process of the other side, to notice when it goes away without closing */
+static BOOL lrpc_open_peer(RpcConnection_lrpc *lrpc, DWORD pid)
+{
+    if (!(lrpc->peer_process = OpenProcess(SYNCHRONIZE, FALSE, pid)))
+    {
+        WARN("failed to open process %04x, error %u\n", pid, GetLastError());
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* either side has closed the connection */
+static inline BOOL lrpc_closed(RpcConnection_lrpc *lrpc)
+{
+    return lrpc->shm->closed[0] || lrpc->shm->closed[1];
+}
+
+/* waits for an event of the rings, fails when the other side has gone away */
+static BOOL lrpc_wait(RpcConnection_lrpc *lrpc, HANDLE event)
+{
+    HANDLE handles[2] = { event, lrpc->peer_process };
+
+    return WaitForMultipleObjects(2, handles, FALSE, INFINITE) == WAIT_OBJECT_0;
+}
+
+static void lrpc_connect_shm(RpcConnection_lrpc *lrpc)
+{
+    struct lrpc_shm_hello hello;
+    struct lrpc_shm_reply reply;
+    UUID uuid;
+
+    /* the name has to be hard to guess, so that nobody can create the objects beforehand */
+    if (UuidCreate(&uuid) != RPC_S_OK)
+        return;
+
+    hello.magic = LRPC_SHM_MAGIC;
+    hello.version = LRPC_SHM_VERSION;
+    hello.pid = GetCurrentProcessId();
+    snprintf(hello.name, sizeof(hello.name), "wine_lrpc_%08x_%08x%04x%04x%02x%02x%02x%02x%02x%02x%02x%02x",
+             GetCurrentProcessId(), uuid.Data1, uuid.Data2, uuid.Data3,
+             uuid.Data4[0], uuid.Data4[1], uuid.Data4[2], uuid.Data4[3],
+             uuid.Data4[4], uuid.Data4[5], uuid.Data4[6], uuid.Data4[7]);
+
+    if (!lrpc_map_shm(lrpc, hello.name, FALSE))
+    {
+        WARN("failed to create shared memory, error %u\n", GetLastError());
+        return;
+    }
+    if (rpcrt4_conn_np_write(&lrpc->np.common, &hello, sizeof(hello)) != sizeof(hello) ||
+        rpcrt4_conn_np_read(&lrpc->np.common, &reply, sizeof(reply)) != sizeof(reply) ||
+        reply.status != RPC_S_OK)
+    {
+        WARN("server refused shared memory\n");
+        lrpc_free_shm(lrpc);
+        return;
+    }
+
+    /* the server uses the rings from now on, a failure here can only be reported by the next calls */
+    if (!lrpc_open_peer(lrpc, reply.pid))
+        InterlockedExchange(&lrpc->shm->closed[0], 1);
+
+    TRACE("using shared memory %s\n", hello.name);
+}
+
+static void lrpc_accept_shm(RpcConnection_lrpc *lrpc)
+{
+    struct lrpc_shm_hello hello;
+    struct lrpc_shm_reply reply;
+    int len;
+
+    lrpc->negotiated = TRUE;
+
+    len = rpcrt4_conn_np_read(&lrpc->np.common, &hello, sizeof(hello));
+    if (len <= 0)
+        return;
+    if (len != sizeof(hello) || hello.magic != LRPC_SHM_MAGIC)
+    {
+        /* client doesn't know about shared memory, keep what was read for the next reads */
+        if ((lrpc->pending = HeapAlloc(GetProcessHeap(), 0, len)))
+        {
+            memcpy(lrpc->pending, &hello, len);
+            lrpc->pending_len = len;
+        }
+        return;
+    }
+
+    hello.name[sizeof(hello.name) - 1] = 0;
+    reply.status = RPC_S_OUT_OF_RESOURCES;
+    reply.pid = GetCurrentProcessId();
+    if (hello.version == LRPC_SHM_VERSION && lrpc_map_shm(lrpc, hello.name, TRUE))
+    {
+        if (lrpc_open_peer(lrpc, hello.pid))
+            reply.status = RPC_S_OK;
+        else
+            lrpc_free_shm(lrpc);
+    }
+    else
+        WARN("failed to open shared memory %s\n", debugstr_a(hello.name));
+
+    if (rpcrt4_conn_np_write(&lrpc->np.common, &reply, sizeof(reply)) != sizeof(reply))
+        lrpc_free_shm(lrpc);
+    else if (lrpc->shm)
+        TRACE("using shared memory %s\n", hello.name);
+}
+
+static int lrpc_ring_read(RpcConnection_lrpc *lrpc, unsigned char *buffer, unsigned int count)
+{
+    struct lrpc_ring *ring = lrpc->in;
+    unsigned int done = 0, spin = 0;
+
+    while (done < count)
+    {
+        ULONG tail = ring->tail;
+        ULONG avail = (ULONG)InterlockedCompareExchange(&ring->head, 0, 0) - tail;
+
+        if (avail)
+        {
+            ULONG pos = tail % LRPC_RING_SIZE;
+            ULONG len = min(min(avail, count - done), LRPC_RING_SIZE - pos);
+
+            memcpy(buffer + done, ring->data + pos, len);
+            done += len;
+            InterlockedExchangeAdd(&ring->tail, len);
+            if (InterlockedExchange(&ring->writer_waiting, 0))
+                SetEvent(lrpc->in_space);
+            spin = 0;
+            continue;
+        }
+
+        /* a cancel stays pending until it interrupts a read */
+        if (lrpc->np.read_closed || lrpc_closed(lrpc) || InterlockedExchange(&lrpc->cancelled, FALSE))
+            return -1;
+        if (spin++ < LRPC_SPIN_COUNT)
+        {
+            small_pause();
+            continue;
+        }
+
+        InterlockedExchange(&ring->reader_waiting, 1);
+        if (InterlockedCompareExchange(&ring->head, 0, 0) != ring->tail)
+            continue;
+        if (!lrpc_wait(lrpc, lrpc->in_data))
+        {
+            /* the writer may have finished just before going away */
+            if (InterlockedCompareExchange(&ring->head, 0, 0) != ring->tail)
+                continue;
+            return -1;
+        }
+    }
+
+    return count;
+}
+
+static int lrpc_ring_write(RpcConnection_lrpc *lrpc, const unsigned char *buffer, unsigned int count)
+{
+    struct lrpc_ring *ring = lrpc->out;
+    unsigned int done = 0, spin = 0;
+    int ret = count;
+
+    EnterCriticalSection(&lrpc->write_cs);
+
+    while (done < count)
+    {
+        ULONG head = ring->head;
+        ULONG space = LRPC_RING_SIZE - (head - (ULONG)InterlockedCompareExchange(&ring->tail, 0, 0));
+
+        if (space)
+        {
+            ULONG pos = head % LRPC_RING_SIZE;
+            ULONG len = min(min(space, count - done), LRPC_RING_SIZE - pos);
+
+            memcpy(ring->data + pos, buffer + done, len);
+            done += len;
+            InterlockedExchangeAdd(&ring->head, len);
+            if (InterlockedExchange(&ring->reader_waiting, 0))
+                SetEvent(lrpc->out_data);
+            spin = 0;
+            continue;
+        }
+
+        if (lrpc_closed(lrpc))
+        {
+            ret = -1;
+            break;
+        }
+        if (spin++ < LRPC_SPIN_COUNT)
+        {
+            small_pause();
+            continue;
+        }
+
+        InterlockedExchange(&ring->writer_waiting, 1);
+        if ((ULONG)InterlockedCompareExchange(&ring->tail, 0, 0) != head - LRPC_RING_SIZE)
+            continue;
+        if (!lrpc_wait(lrpc, lrpc->out_space))
+        {
+            ret = -1;
+            break;
+        }
+    }
+
+    LeaveCriticalSection(&lrpc->write_cs);
+    return ret;
+}
+
+static RPC_STATUS rpcrt4_ncalrpc_lrpc_open(RpcConnection *conn)
+{
+    RpcConnection_lrpc *lrpc = (RpcConnection_lrpc *)conn;
+    RPC_STATUS status;
+
+    /* already connected? */
+    if (lrpc->np.pipe)
+        return RPC_S_OK;
+
+    status = rpcrt4_ncalrpc_open(conn);
+    if (status == RPC_S_OK)
+        lrpc_connect_shm(lrpc);
+    return status;
+}
+
+static int rpcrt4_conn_lrpc_read(RpcConnection *conn, void *buffer, unsigned int count)
+{
+    RpcConnection_lrpc *lrpc = (RpcConnection_lrpc *)conn;
+
+    if (conn->server && !lrpc->negotiated)
+        lrpc_accept_shm(lrpc);
+
+    if (lrpc->pending)
+    {
+        unsigned int len = min(count, lrpc->pending_len - lrpc->pending_pos);
+        int ret;
+
+        memcpy(buffer, lrpc->pending + lrpc->pending_pos, len);
+        lrpc->pending_pos += len;
+        if (lrpc->pending_pos == lrpc->pending_len)
+        {
+            HeapFree(GetProcessHeap(), 0, lrpc->pending);
+            lrpc->pending = NULL;
+        }
+        if (len == count)
+            return len;
+        ret = rpcrt4_conn_np_read(conn, (char *)buffer + len, count - len);
+        return ret < 0 ? ret : ret + len;
+    }
+
+    if (lrpc->shm)
+        return lrpc_ring_read(lrpc, buffer, count);
+    return rpcrt4_conn_np_read(conn, buffer, count);
+}
+
+static int rpcrt4_conn_lrpc_write(RpcConnection *conn, const void *buffer, unsigned int count)
+{
+    RpcConnection_lrpc *lrpc = (RpcConnection_lrpc *)conn;
+
+    if (lrpc->shm)
+        return lrpc_ring_write(lrpc, buffer, count);
+    return rpcrt4_conn_np_write(conn, buffer, count);
+}
+
+static int rpcrt4_conn_lrpc_close(RpcConnection *conn)
+{
+    RpcConnection_lrpc *lrpc = (RpcConnection_lrpc *)conn;
+
+    if (lrpc->shm)
+    {
+        /* wake up the other side, it fails its reads and writes from now on */
+        InterlockedExchange(&lrpc->shm->closed[conn->server ? 1 : 0], 1);
+        SetEvent(lrpc->out_data);
+        SetEvent(lrpc->in_space);
+    }
+    lrpc_free_shm(lrpc);
+    HeapFree(GetProcessHeap(), 0, lrpc->pending);
+    lrpc->pending = NULL;
+    lrpc->negotiated = FALSE;
+    return rpcrt4_conn_np_close(conn);
+}
+
+static void rpcrt4_conn_lrpc_close_read(RpcConnection *conn)
+{
+    RpcConnection_lrpc *lrpc = (RpcConnection_lrpc *)conn;
+
+    rpcrt4_conn_np_close_read(conn);
+    if (lrpc->in_data)
+        SetEvent(lrpc->in_data);
+}
+
+static void rpcrt4_conn_lrpc_cancel_call(RpcConnection *conn)
+{
+    RpcConnection_lrpc *lrpc = (RpcConnection_lrpc *)conn;
+
+    if (!lrpc->shm)
+    {
+        rpcrt4_conn_np_cancel_call(conn);
+        return;
+    }
+    InterlockedExchange(&lrpc->cancelled, TRUE);
+    SetEvent(lrpc->in_data);
+}
+
 /**** ncacn_ip_tcp support ****/
 
 static size_t rpcrt4_ip_tcp_get_top_of_tower(unsigned char *tower_data,
@@ -3155,14 +3610,14 @@ static const struct connection_ops conn_protseq_list[] = {
   },
   { "ncalrpc",
     { EPM_PROTOCOL_NCALRPC, EPM_PROTOCOL_PIPE },
-    rpcrt4_conn_np_alloc,
-    rpcrt4_ncalrpc_open,
+    rpcrt4_conn_lrpc_alloc,
+    rpcrt4_ncalrpc_lrpc_open,
     rpcrt4_ncalrpc_handoff,
-    rpcrt4_conn_np_read,
-    rpcrt4_conn_np_write,
-    rpcrt4_conn_np_close,
-    rpcrt4_conn_np_close_read,
-    rpcrt4_conn_np_cancel_call,
+    rpcrt4_conn_lrpc_read,
+    rpcrt4_conn_lrpc_write,
+    rpcrt4_conn_lrpc_close,
+    rpcrt4_conn_lrpc_close_read,
+    rpcrt4_conn_lrpc_cancel_call,
     rpcrt4_ncalrpc_np_is_server_listening,
     rpcrt4_conn_np_wait_for_incoming_data,
     rpcrt4_ncalrpc_get_top_of_tower,
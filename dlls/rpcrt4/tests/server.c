@@ -1610,6 +1610,30 @@ static void _test_is_server_listening2(unsigned line, RPC_BINDING_HANDLE binding
                        status, expected_status, expected_status2);
 }
 
+static DWORD WINAPI int_return_thread(void *arg)
+{
+  ok(int_return() == INT_CODE, "RPC int_return\n");
+  return 0;
+}
+
+/* the connection is opened by a thread that exits before the next call */
+static void test_exited_thread_connection(unsigned char *binding)
+{
+  HANDLE thread;
+  DWORD ret;
+
+  ok(RPC_S_OK == RpcBindingFromStringBindingA(binding, &IServer_IfHandle), "RpcBindingFromStringBinding\n");
+
+  thread = CreateThread(NULL, 0, int_return_thread, NULL, 0, NULL);
+  ok(thread != NULL, "CreateThread failed\n");
+  ret = WaitForSingleObject(thread, 10000);
+  ok(ret == WAIT_OBJECT_0, "WaitForSingleObject returned %u\n", ret);
+  CloseHandle(thread);
+
+  ok(int_return() == INT_CODE, "RPC int_return\n");
+  ok(RPC_S_OK == RpcBindingFree(&IServer_IfHandle), "RpcBindingFree\n");
+}
+
 static void
 client(const char *test)
 {
@@ -1657,8 +1681,9 @@ client(const char *test)
     authinfo_test(RPC_PROTSEQ_LRPC, 0);
     test_is_server_listening(IServer_IfHandle, RPC_S_OK);
 
-    ok(RPC_S_OK == RpcStringFreeA(&binding), "RpcStringFree\n");
     ok(RPC_S_OK == RpcBindingFree(&IServer_IfHandle), "RpcBindingFree\n");
+    test_exited_thread_connection(binding);
+    ok(RPC_S_OK == RpcStringFreeA(&binding), "RpcStringFree\n");
   }
   else if (strcmp(test, "ncalrpc_secure") == 0)
   {
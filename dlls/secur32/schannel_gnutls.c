@@ -35,6 +35,7 @@
 #include "secur32_priv.h"
 #include "wine/debug.h"
 #include "wine/library.h"
+#include "wine/list.h"
 
 #if defined(SONAME_LIBGNUTLS) && !defined(HAVE_SECURITY_SECURITY_H)
 
@@ -71,6 +72,11 @@ MAKE_FUNCPTR(gnutls_record_get_max_size);
 MAKE_FUNCPTR(gnutls_record_recv);
 MAKE_FUNCPTR(gnutls_record_send);
 MAKE_FUNCPTR(gnutls_server_name_set);
+MAKE_FUNCPTR(gnutls_session_get_data);
+MAKE_FUNCPTR(gnutls_session_get_ptr);
+MAKE_FUNCPTR(gnutls_session_is_resumed);
+MAKE_FUNCPTR(gnutls_session_set_data);
+MAKE_FUNCPTR(gnutls_session_set_ptr);
 MAKE_FUNCPTR(gnutls_transport_get_ptr);
 MAKE_FUNCPTR(gnutls_transport_set_errno);
 MAKE_FUNCPTR(gnutls_transport_set_ptr);
@@ -146,6 +152,153 @@ static ssize_t schan_push_adapter(gnutls_transport_ptr_t transport,
     return buff_len;
 }
 
+/* Client side session cache, so that new connections to the same server
+ * using the same credentials can resume the previous TLS session instead
+ * of doing a full handshake. */
+
+#define SESSION_CACHE_MAX_ENTRIES 64
+#define SESSION_CACHE_TIMEOUT     (10 * 60 * 60 * 1000) /* 10 hours, like ClientCacheTime */
+
+struct session_cache_entry
+{
+    struct list entry;
+    void       *credentials;
+    char       *target;
+    ULONGLONG   expires;
+    size_t      size;
+    BYTE        data[1];
+};
+
+static struct list session_cache = LIST_INIT( session_cache );
+static unsigned int session_cache_count;
+
+static CRITICAL_SECTION session_cache_cs;
+static CRITICAL_SECTION_DEBUG session_cache_cs_debug =
+{
+    0, 0, &session_cache_cs,
+    { &session_cache_cs_debug.ProcessLocksList, &session_cache_cs_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": session_cache_cs") }
+};
+static CRITICAL_SECTION session_cache_cs = { &session_cache_cs_debug, -1, 0, 0, 0, 0 };
+
+/* per session data, attached to client sessions */
+struct session_info
+{
+    void *credentials;
+    char *target;
+};
+
+static void free_session_cache_entry(struct session_cache_entry *cache)
+{
+    list_remove(&cache->entry);
+    session_cache_count--;
+    HeapFree(GetProcessHeap(), 0, cache->target);
+    HeapFree(GetProcessHeap(), 0, cache);
+}
+
+/* must be called with session_cache_cs held */
+static struct session_cache_entry *find_session_cache_entry(void *credentials, const char *target)
+{
+    struct session_cache_entry *cache, *next;
+    ULONGLONG now = GetTickCount64();
+
+    LIST_FOR_EACH_ENTRY_SAFE(cache, next, &session_cache, struct session_cache_entry, entry)
+    {
+        if (cache->expires < now)
+        {
+            free_session_cache_entry(cache);
+            continue;
+        }
+        if (cache->credentials == credentials && !strcmp(cache->target, target))
+            return cache;
+    }
+    return NULL;
+}
+
+static void resume_cached_session(gnutls_session_t s, struct session_info *info)
+{
+    struct session_cache_entry *cache;
+    int err;
+
+    EnterCriticalSection(&session_cache_cs);
+    if ((cache = find_session_cache_entry(info->credentials, info->target)))
+    {
+        TRACE("trying to resume session for %s\n", debugstr_a(info->target));
+        err = pgnutls_session_set_data(s, cache->data, cache->size);
+        if (err != GNUTLS_E_SUCCESS)
+        {
+            pgnutls_perror(err);
+            free_session_cache_entry(cache);
+        }
+        else
+        {
+            list_remove(&cache->entry);
+            list_add_head(&session_cache, &cache->entry);
+        }
+    }
+    LeaveCriticalSection(&session_cache_cs);
+}
+
+static void cache_session(gnutls_session_t s, struct session_info *info)
+{
+    struct session_cache_entry *cache;
+    size_t size = 0;
+    int err;
+
+    if (pgnutls_session_get_data(s, NULL, &size) != GNUTLS_E_SUCCESS || !size) return;
+    if (!(cache = HeapAlloc(GetProcessHeap(), 0, FIELD_OFFSET(struct session_cache_entry, data[size]))))
+        return;
+    if ((err = pgnutls_session_get_data(s, cache->data, &size)) != GNUTLS_E_SUCCESS ||
+        !(cache->target = HeapAlloc(GetProcessHeap(), 0, strlen(info->target) + 1)))
+    {
+        if (err != GNUTLS_E_SUCCESS) pgnutls_perror(err);
+        HeapFree(GetProcessHeap(), 0, cache);
+        return;
+    }
+    strcpy(cache->target, info->target);
+    cache->credentials = info->credentials;
+    cache->expires = GetTickCount64() + SESSION_CACHE_TIMEOUT;
+    cache->size = size;
+
+    TRACE("caching session for %s\n", debugstr_a(info->target));
+
+    EnterCriticalSection(&session_cache_cs);
+    {
+        struct session_cache_entry *old;
+
+        if ((old = find_session_cache_entry(info->credentials, info->target)))
+            free_session_cache_entry(old);
+        if (session_cache_count >= SESSION_CACHE_MAX_ENTRIES)
+            free_session_cache_entry(LIST_ENTRY(list_tail(&session_cache), struct session_cache_entry, entry));
+        list_add_head(&session_cache, &cache->entry);
+        session_cache_count++;
+    }
+    LeaveCriticalSection(&session_cache_cs);
+}
+
+static void remove_cached_session(struct session_info *info)
+{
+    struct session_cache_entry *cache;
+
+    EnterCriticalSection(&session_cache_cs);
+    if ((cache = find_session_cache_entry(info->credentials, info->target)))
+        free_session_cache_entry(cache);
+    LeaveCriticalSection(&session_cache_cs);
+}
+
+static void flush_session_cache(void *credentials)
+{
+    struct session_cache_entry *cache, *next;
+
+    EnterCriticalSection(&session_cache_cs);
+    LIST_FOR_EACH_ENTRY_SAFE(cache, next, &session_cache, struct session_cache_entry, entry)
+    {
+        if (!credentials || cache->credentials == credentials)
+            free_session_cache_entry(cache);
+    }
+    LeaveCriticalSection(&session_cache_cs);
+}
+
 static const struct {
     DWORD enable_flag;
     const char *gnutls_flag;
@@ -202,6 +355,19 @@ BOOL schan_imp_create_session(schan_imp_session *session, schan_credentials *cre
         return FALSE;
     }
 
+    if (cred->credential_use != SECPKG_CRED_INBOUND)
+    {
+        struct session_info *info;
+
+        if (!(info = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*info))))
+        {
+            pgnutls_deinit(*s);
+            return FALSE;
+        }
+        info->credentials = cred->credentials;
+        pgnutls_session_set_ptr(*s, info);
+    }
+
     pgnutls_transport_set_pull_function(*s, schan_pull_adapter);
     pgnutls_transport_set_push_function(*s, schan_push_adapter);
 
@@ -211,6 +377,13 @@ BOOL schan_imp_create_session(schan_imp_session *session, schan_credentials *cre
 void schan_imp_dispose_session(schan_imp_session session)
 {
     gnutls_session_t s = (gnutls_session_t)session;
+    struct session_info *info = pgnutls_session_get_ptr(s);
+
+    if (info)
+    {
+        HeapFree(GetProcessHeap(), 0, info->target);
+        HeapFree(GetProcessHeap(), 0, info);
+    }
     pgnutls_deinit(s);
 }
 
@@ -224,13 +397,21 @@ void schan_imp_set_session_transport(schan_imp_session session,
 void schan_imp_set_session_target(schan_imp_session session, const char *target)
 {
     gnutls_session_t s = (gnutls_session_t)session;
+    struct session_info *info = pgnutls_session_get_ptr(s);
 
     pgnutls_server_name_set( s, GNUTLS_NAME_DNS, target, strlen(target) );
+
+    if (info && !info->target && (info->target = HeapAlloc(GetProcessHeap(), 0, strlen(target) + 1)))
+    {
+        strcpy(info->target, target);
+        resume_cached_session(s, info);
+    }
 }
 
 SECURITY_STATUS schan_imp_handshake(schan_imp_session session)
 {
     gnutls_session_t s = (gnutls_session_t)session;
+    struct session_info *info = pgnutls_session_get_ptr(s);
     int err;
 
     while(1) {
@@ -238,6 +419,11 @@ SECURITY_STATUS schan_imp_handshake(schan_imp_session session)
         switch(err) {
         case GNUTLS_E_SUCCESS:
             TRACE("Handshake completed\n");
+            if (info && info->target)
+            {
+                if (pgnutls_session_is_resumed(s)) TRACE("Resumed session\n");
+                else cache_session(s, info);
+            }
             return SEC_E_OK;
 
         case GNUTLS_E_AGAIN:
@@ -263,11 +449,13 @@ SECURITY_STATUS schan_imp_handshake(schan_imp_session session)
         {
             gnutls_alert_description_t alert = pgnutls_alert_get(s);
             WARN("FATAL ALERT: %d %s\n", alert, pgnutls_alert_get_name(alert));
+            if (info && info->target) remove_cached_session(info);
             return SEC_E_INTERNAL_ERROR;
         }
 
         default:
             pgnutls_perror(err);
+            if (info && info->target) remove_cached_session(info);
             return SEC_E_INTERNAL_ERROR;
         }
     }
@@ -515,6 +703,7 @@ BOOL schan_imp_allocate_certificate_credentials(schan_credentials *c)
 
 void schan_imp_free_certificate_credentials(schan_credentials *c)
 {
+    flush_session_cache(c->credentials);
     pgnutls_certificate_free_credentials(c->credentials);
 }
 
@@ -566,6 +755,11 @@ BOOL schan_imp_init(void)
     LOAD_FUNCPTR(gnutls_record_recv);
     LOAD_FUNCPTR(gnutls_record_send);
     LOAD_FUNCPTR(gnutls_server_name_set)
+    LOAD_FUNCPTR(gnutls_session_get_data)
+    LOAD_FUNCPTR(gnutls_session_get_ptr)
+    LOAD_FUNCPTR(gnutls_session_is_resumed)
+    LOAD_FUNCPTR(gnutls_session_set_data)
+    LOAD_FUNCPTR(gnutls_session_set_ptr)
     LOAD_FUNCPTR(gnutls_transport_get_ptr)
     LOAD_FUNCPTR(gnutls_transport_set_errno)
     LOAD_FUNCPTR(gnutls_transport_set_ptr)
@@ -602,6 +796,7 @@ fail:
 
 void schan_imp_deinit(void)
 {
+    flush_session_cache(NULL);
     pgnutls_global_deinit();
     wine_dlclose(libgnutls_handle, NULL, 0);
     libgnutls_handle = NULL;
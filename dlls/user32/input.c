@@ -171,28 +171,25 @@ static void update_mouse_coords( INPUT *input )
  */
 UINT WINAPI SendInput( UINT count, LPINPUT inputs, int size )
 {
-    UINT i;
-    NTSTATUS status;
+    INPUT buffer[64];
+    UINT i, chunk, sent, total = 0;
+    NTSTATUS status = STATUS_SUCCESS;
 
-    for (i = 0; i < count; i++)
+    while (!status && total < count)
     {
-        if (inputs[i].type == INPUT_MOUSE)
+        chunk = min( count - total, sizeof(buffer) / sizeof(buffer[0]) );
+        for (i = 0; i < chunk; i++)
         {
+            buffer[i] = inputs[total + i];
             /* we need to update the coordinates to what the server expects */
-            INPUT input = inputs[i];
-            update_mouse_coords( &input );
-            status = send_hardware_message( 0, &input, SEND_HWMSG_INJECTED );
-        }
-        else status = send_hardware_message( 0, &inputs[i], SEND_HWMSG_INJECTED );
-
-        if (status)
-        {
-            SetLastError( RtlNtStatusToDosError(status) );
-            break;
+            if (buffer[i].type == INPUT_MOUSE) update_mouse_coords( &buffer[i] );
         }
+        status = send_hardware_messages( buffer, chunk, SEND_HWMSG_INJECTED, &sent );
+        total += sent;
     }
 
-    return i;
+    if (status) SetLastError( RtlNtStatusToDosError(status) );
+    return total;
 }
 
 
@@ -458,7 +455,7 @@ DWORD WINAPI GetQueueStatus( UINT flags )
         ret = MAKELONG( reply->changed_bits & flags, reply->wake_bits & flags );
     }
     SERVER_END_REQ;
-    return ret;
+    return ret | get_local_queue_status( flags );
 }
 
 
@@ -41,6 +41,7 @@
 #include "ddk/imm.h"
 #include "wine/unicode.h"
 #include "wine/server.h"
+#include "wine/list.h"
 #include "user_private.h"
 #include "win.h"
 #include "controls.h"
@@ -262,6 +263,7 @@ struct received_message_info
     enum message_type type;
     MSG               msg;
     UINT              flags;  /* InSendMessageEx return flags */
+    struct shared_message_view *shared;  /* channel holding the message data, if any */
 };
 
 /* structure to group all parameters for sent messages of the various kinds */
@@ -1812,6 +1814,463 @@ static void unpack_reply( HWND hwnd, UINT message, WPARAM wparam, LPARAM lparam,
 }
 
 
+/* messages with at least this much data go through a shared memory channel */
+#define SHARED_MESSAGE_MIN_SIZE  4096
+#define SHARED_MESSAGE_MAX_SIZE  0x10000000
+#define MAX_SHARED_VIEWS         4
+#define MAX_RETIRED_SECTIONS     16
+
+/* header at the start of the section of a message channel */
+struct shared_message_header
+{
+    LONG  busy;          /* set by the sender, cleared once the receiver is done with the data */
+    DWORD data_size;     /* size of the packed message data */
+    DWORD reply_offset;  /* offset of the reply area in the section */
+    DWORD reply_max;     /* size of the reply area */
+    DWORD reply_size;    /* size of the reply data, set by the receiver */
+    DWORD stamp;         /* creation stamp of the section, see map_shared_message */
+};
+
+#define SHARED_MESSAGE_DATA_OFFSET ((sizeof(struct shared_message_header) + 15) & ~15)
+
+/* data passed through the server for a message using a shared memory channel */
+struct shared_message_desc
+{
+    DWORD pid;           /* sender process */
+    DWORD tid;           /* sender thread */
+    DWORD serial;        /* serial number of the sender section */
+    DWORD size;          /* size of the sender section */
+    DWORD stamp;         /* creation stamp of the sender section */
+};
+
+/* mapping of the section of another thread */
+struct shared_message_view
+{
+    struct list                   entry;
+    DWORD                         pid;
+    DWORD                         tid;
+    DWORD                         serial;
+    DWORD                         size;
+    int                           refs;    /* number of messages being processed */
+    struct shared_message_header *header;
+};
+
+/* section of the current thread replaced while a receiver may still need it */
+struct retired_section
+{
+    struct list                   entry;
+    HANDLE                        mapping;
+    struct shared_message_header *header;
+};
+
+/* per-thread state of the shared memory message channels */
+struct message_channel
+{
+    HANDLE                        mapping;      /* section for the messages sent by this thread */
+    struct shared_message_header *header;
+    DWORD                         size;
+    DWORD                         serial;
+    DWORD                         reply_offset; /* reply area of the message being sent */
+    DWORD                         reply_max;
+    BOOL                          in_use;       /* a message is waiting for its reply */
+    struct list                   views;        /* sections of other threads, most recent first */
+    unsigned int                  view_count;
+    struct list                   retired;      /* replaced sections still busy, most recent first */
+    unsigned int                  retired_count;
+};
+
+static struct message_channel *get_message_channel(void)
+{
+    struct user_thread_info *thread_info = get_user_thread_info();
+    struct message_channel *channel = thread_info->msg_channel;
+
+    if (!channel && (channel = HeapAlloc( GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*channel) )))
+    {
+        list_init( &channel->views );
+        list_init( &channel->retired );
+        thread_info->msg_channel = channel;
+    }
+    return channel;
+}
+
+static void get_channel_section_name( WCHAR *name, DWORD pid, DWORD tid, DWORD serial )
+{
+    static const WCHAR formatW[] = {'_','_','w','i','n','e','_','m','s','g','_',
+                                    '%','0','8','x','_','%','0','8','x','_','%','0','8','x',0};
+    sprintfW( name, formatW, pid, tid, serial );
+}
+
+/* free the retired sections that are no longer busy, or all of them */
+static void free_retired_sections( struct message_channel *channel, BOOL all )
+{
+    struct retired_section *section, *next;
+
+    LIST_FOR_EACH_ENTRY_SAFE_REV( section, next, &channel->retired, struct retired_section, entry )
+    {
+        /* drop the oldest ones anyway when there are too many, their messages are most likely lost */
+        if (!all && section->header->busy && channel->retired_count <= MAX_RETIRED_SECTIONS) continue;
+        list_remove( &section->entry );
+        UnmapViewOfFile( section->header );
+        CloseHandle( section->mapping );
+        HeapFree( GetProcessHeap(), 0, section );
+        channel->retired_count--;
+    }
+}
+
+/* release the section of the current thread; receivers keep their own view of it, but
+ * a receiver that didn't open it yet needs it to stay around until it is done with it */
+static void close_channel_section( struct message_channel *channel )
+{
+    struct retired_section *section;
+
+    if (!channel->header) return;
+    if (channel->header->busy && (section = HeapAlloc( GetProcessHeap(), 0, sizeof(*section) )))
+    {
+        section->mapping = channel->mapping;
+        section->header  = channel->header;
+        list_add_head( &channel->retired, &section->entry );
+        channel->retired_count++;
+    }
+    else
+    {
+        UnmapViewOfFile( channel->header );
+        CloseHandle( channel->mapping );
+    }
+    channel->header = NULL;
+    channel->mapping = 0;
+    channel->size = 0;
+}
+
+/* build a security descriptor that only gives the current user access to a section */
+static BOOL init_channel_security( SECURITY_DESCRIPTOR *sd, ACL *acl, DWORD acl_size )
+{
+    char buffer[sizeof(TOKEN_USER) + SECURITY_MAX_SID_SIZE];
+    TOKEN_USER *user = (TOKEN_USER *)buffer;
+    HANDLE token;
+    DWORD size;
+    BOOL ret;
+
+    if (!OpenProcessToken( GetCurrentProcess(), TOKEN_QUERY, &token )) return FALSE;
+    ret = GetTokenInformation( token, TokenUser, buffer, sizeof(buffer), &size );
+    CloseHandle( token );
+    return ret && InitializeAcl( acl, acl_size, ACL_REVISION ) &&
+           AddAccessAllowedAce( acl, ACL_REVISION, SECTION_QUERY | SECTION_MAP_READ | SECTION_MAP_WRITE,
+                                user->User.Sid ) &&
+           InitializeSecurityDescriptor( sd, SECURITY_DESCRIPTOR_REVISION ) &&
+           SetSecurityDescriptorDacl( sd, TRUE, acl, FALSE );
+}
+
+/* get a section of at least the given size for sending a message */
+static struct shared_message_header *get_channel_section( struct message_channel *channel, DWORD size )
+{
+    char acl_buffer[sizeof(ACL) + sizeof(ACCESS_ALLOWED_ACE) + SECURITY_MAX_SID_SIZE];
+    SECURITY_ATTRIBUTES sa;
+    SECURITY_DESCRIPTOR sd;
+    LARGE_INTEGER counter;
+    WCHAR name[64];
+
+    free_retired_sections( channel, FALSE );
+
+    /* the receiver of the previous message may still be using the data */
+    if (channel->header && (channel->header->busy || channel->size < size))
+        close_channel_section( channel );
+    if (channel->header) return channel->header;
+
+    if (!init_channel_security( &sd, (ACL *)acl_buffer, sizeof(acl_buffer) )) return NULL;
+    sa.nLength = sizeof(sa);
+    sa.lpSecurityDescriptor = &sd;
+    sa.bInheritHandle = FALSE;
+
+    size = (size + 0xffff) & ~0xffff;
+    get_channel_section_name( name, GetCurrentProcessId(), GetCurrentThreadId(), ++channel->serial );
+    if (!(channel->mapping = CreateFileMappingW( INVALID_HANDLE_VALUE, &sa, PAGE_READWRITE, 0, size, name )))
+        return NULL;
+    if (GetLastError() == ERROR_ALREADY_EXISTS ||
+        !(channel->header = MapViewOfFile( channel->mapping, FILE_MAP_WRITE, 0, 0, size )))
+    {
+        CloseHandle( channel->mapping );
+        channel->mapping = 0;
+        return NULL;
+    }
+    /* a section of a thread that has exited may still be mapped with the same name by a receiver */
+    NtQueryPerformanceCounter( &counter, NULL );
+    channel->header->stamp = counter.u.LowPart ^ counter.u.HighPart ^ GetTickCount();
+    channel->size = size;
+    return channel->header;
+}
+
+/***********************************************************************
+ *		pack_shared_message
+ *
+ * Move the packed data of a large message to the shared memory channel of the current
+ * thread, leaving only a description of the channel to be sent through the server.
+ */
+static struct message_channel *pack_shared_message( UINT message, struct packed_message *data,
+                                                    size_t reply_size, struct shared_message_desc *desc )
+{
+    struct message_channel *channel;
+    struct shared_message_header *header;
+    size_t size = 0, reply_offset;
+    DWORD err;
+    char *ptr;
+    int i;
+
+    switch (message)
+    {
+    case WM_COPYDATA:
+    case WM_SETTEXT:
+    case WM_GETTEXT:
+        break;
+    default:
+        return NULL;
+    }
+
+    for (i = 0; i < data->count; i++) size += data->size[i];
+    if (size < SHARED_MESSAGE_MIN_SIZE && reply_size < SHARED_MESSAGE_MIN_SIZE) return NULL;
+    if (size > SHARED_MESSAGE_MAX_SIZE || reply_size > SHARED_MESSAGE_MAX_SIZE) return NULL;
+
+    /* nested sends go through the server */
+    if (!(channel = get_message_channel()) || channel->in_use) return NULL;
+
+    /* sending a message doesn't change the last error */
+    reply_offset = (SHARED_MESSAGE_DATA_OFFSET + size + 15) & ~15;
+    err = GetLastError();
+    header = get_channel_section( channel, reply_offset + reply_size );
+    SetLastError( err );
+    if (!header) return NULL;
+
+    ptr = (char *)header + SHARED_MESSAGE_DATA_OFFSET;
+    for (i = 0; i < data->count; i++)
+    {
+        memcpy( ptr, data->data[i], data->size[i] );
+        ptr += data->size[i];
+    }
+    header->busy         = 1;
+    header->data_size    = size;
+    header->reply_offset = reply_offset;
+    header->reply_max    = reply_size;
+    header->reply_size   = 0;
+    channel->reply_offset = reply_offset;
+    channel->reply_max    = reply_size;
+    channel->in_use       = TRUE;
+
+    desc->pid    = GetCurrentProcessId();
+    desc->tid    = GetCurrentThreadId();
+    desc->serial = channel->serial;
+    desc->size   = channel->size;
+    desc->stamp  = header->stamp;
+    data->data[0] = desc;
+    data->size[0] = sizeof(*desc);
+    data->count   = 1;
+    return channel;
+}
+
+/* retrieve the reply of a message sent through the channel of the current thread */
+static void unpack_shared_reply( struct message_channel *channel, const struct send_message_info *info,
+                                 BOOL replied )
+{
+    struct shared_message_header *header = channel->header;
+
+    if (replied && header->reply_size)
+        unpack_reply( info->hwnd, info->msg, info->wparam, info->lparam,
+                      (char *)header + channel->reply_offset, min( header->reply_size, channel->reply_max ));
+    channel->in_use = FALSE;
+}
+
+/* cancel a message that couldn't be sent through the channel */
+static void cancel_shared_message( struct message_channel *channel )
+{
+    channel->header->busy = 0;
+    channel->in_use = FALSE;
+}
+
+static void unmap_shared_view( struct message_channel *channel, struct shared_message_view *view )
+{
+    list_remove( &view->entry );
+    UnmapViewOfFile( view->header );
+    HeapFree( GetProcessHeap(), 0, view );
+    channel->view_count--;
+}
+
+/* map the section of the sending thread, reusing a recent view when possible */
+static struct shared_message_view *map_shared_message( const struct shared_message_desc *desc )
+{
+    struct message_channel *channel = get_message_channel();
+    struct shared_message_view *view, *old, *next;
+    WCHAR name[64];
+    HANDLE mapping;
+    DWORD err;
+
+    if (!channel) return NULL;
+
+    LIST_FOR_EACH_ENTRY( view, &channel->views, struct shared_message_view, entry )
+    {
+        if (view->pid != desc->pid || view->tid != desc->tid || view->serial != desc->serial) continue;
+        if (view->header->stamp != desc->stamp)
+        {
+            /* the name has been reused by a new thread, the view is stale */
+            if (!view->refs) unmap_shared_view( channel, view );
+            break;
+        }
+        list_remove( &view->entry );
+        goto found;
+    }
+
+    if (!(view = HeapAlloc( GetProcessHeap(), 0, sizeof(*view) ))) return NULL;
+    get_channel_section_name( name, desc->pid, desc->tid, desc->serial );
+    err = GetLastError();
+    if (!(mapping = OpenFileMappingW( FILE_MAP_WRITE, FALSE, name )))
+    {
+        WARN( "failed to open section %s, error %u\n", debugstr_w(name), GetLastError() );
+        SetLastError( err );
+        HeapFree( GetProcessHeap(), 0, view );
+        return NULL;
+    }
+    view->header = MapViewOfFile( mapping, FILE_MAP_WRITE, 0, 0, desc->size );
+    CloseHandle( mapping );
+    SetLastError( err );
+    if (!view->header || view->header->stamp != desc->stamp)
+    {
+        if (view->header) UnmapViewOfFile( view->header );
+        HeapFree( GetProcessHeap(), 0, view );
+        return NULL;
+    }
+    view->pid    = desc->pid;
+    view->tid    = desc->tid;
+    view->serial = desc->serial;
+    view->size   = desc->size;
+    view->refs   = 0;
+    channel->view_count++;
+
+found:
+    list_add_head( &channel->views, &view->entry );
+    view->refs++;
+
+    /* drop the least recently used views that are not in use */
+    LIST_FOR_EACH_ENTRY_SAFE_REV( old, next, &channel->views, struct shared_message_view, entry )
+    {
+        if (channel->view_count <= MAX_SHARED_VIEWS) break;
+        if (!old->refs) unmap_shared_view( channel, old );
+    }
+    return view;
+}
+
+/***********************************************************************
+ *		unpack_shared_message
+ *
+ * Unpack a message whose data is in the shared memory channel of the sender.
+ * The message parameters point directly to the shared data.
+ */
+static BOOL unpack_shared_message( struct received_message_info *info, const void *buffer, size_t size )
+{
+    struct shared_message_view *view;
+    struct shared_message_header *header;
+    char *data;
+    DWORD data_size;
+
+    if (size < sizeof(struct shared_message_desc)) return FALSE;
+    if (((const struct shared_message_desc *)buffer)->size < SHARED_MESSAGE_DATA_OFFSET) return FALSE;
+    if (!(view = map_shared_message( buffer ))) return FALSE;
+
+    header = view->header;
+    data = (char *)header + SHARED_MESSAGE_DATA_OFFSET;
+    data_size = header->data_size;
+    if (data_size > view->size - SHARED_MESSAGE_DATA_OFFSET ||
+        header->reply_offset > view->size || header->reply_max > view->size - header->reply_offset)
+        goto failed;
+
+    switch (info->msg.message)
+    {
+    case WM_COPYDATA:
+    {
+        struct packed_COPYDATASTRUCT *ps = (struct packed_COPYDATASTRUCT *)data;
+        COPYDATASTRUCT cds;
+
+        if (data_size < sizeof(*ps)) goto failed;
+        cds.dwData = (ULONG_PTR)unpack_ptr( ps->dwData );
+        if (ps->lpData)
+        {
+            if (ps->cbData > data_size - sizeof(*ps)) goto failed;
+            cds.cbData = ps->cbData;
+            cds.lpData = ps + 1;
+        }
+        else
+        {
+            cds.cbData = 0;
+            cds.lpData = 0;
+        }
+        memcpy( ps, &cds, sizeof(cds) );
+        info->msg.lParam = (LPARAM)ps;
+        break;
+    }
+    case WM_SETTEXT:
+        if (!check_string( (WCHAR *)data, data_size )) goto failed;
+        info->msg.lParam = (LPARAM)data;
+        break;
+    case WM_GETTEXT:
+        if (info->msg.wParam > header->reply_max / sizeof(WCHAR)) goto failed;
+        info->msg.lParam = (LPARAM)((char *)header + header->reply_offset);
+        break;
+    default:
+        goto failed;
+    }
+    info->shared = view;
+    return TRUE;
+
+failed:
+    header->busy = 0;
+    view->refs--;
+    return FALSE;
+}
+
+/* store the reply to a message in the shared memory channel of the sender */
+static void pack_shared_reply( struct shared_message_view *view, const struct packed_message *data )
+{
+    struct shared_message_header *header = view->header;
+    char *ptr = (char *)header + header->reply_offset;
+    size_t size, reply_max = header->reply_max;
+    int i;
+
+    if (header->reply_offset > view->size || reply_max > view->size - header->reply_offset) return;
+
+    /* the reply data may already be in place, e.g. for WM_GETTEXT */
+    for (i = 0, size = 0; i < data->count && size < reply_max; i++)
+    {
+        size_t len = min( data->size[i], reply_max - size );
+        memmove( ptr + size, data->data[i], len );
+        size += len;
+    }
+    header->reply_size = size;
+}
+
+/* the window procedure is done with a message sent through a shared memory channel */
+static void release_shared_message( struct shared_message_view *view )
+{
+    InterlockedExchange( &view->header->busy, 0 );
+    view->refs--;
+}
+
+/***********************************************************************
+ *		destroy_message_channel
+ *
+ * Free the shared memory channels of the current thread.
+ */
+void destroy_message_channel(void)
+{
+    struct user_thread_info *thread_info = get_user_thread_info();
+    struct message_channel *channel = thread_info->msg_channel;
+    struct shared_message_view *view, *next;
+
+    if (!channel) return;
+    close_channel_section( channel );
+    free_retired_sections( channel, TRUE );
+    LIST_FOR_EACH_ENTRY_SAFE( view, next, &channel->views, struct shared_message_view, entry )
+        unmap_shared_view( channel, view );
+    HeapFree( GetProcessHeap(), 0, channel );
+    thread_info->msg_channel = NULL;
+}
+
+
 /***********************************************************************
  *           reply_message
  *
@@ -1832,6 +2291,16 @@ static void reply_message( struct received_message_info *info, LRESULT result, B
     {
         pack_reply( info->msg.hwnd, info->msg.message, info->msg.wParam,
                     info->msg.lParam, result, &data );
+        if (info->shared)
+        {
+            pack_shared_reply( info->shared, &data );
+            data.count = 0;
+        }
+    }
+    if (remove && info->shared)
+    {
+        release_shared_message( info->shared );
+        info->shared = NULL;
     }
 
     SERVER_START_REQ( reply_message )
@@ -2720,6 +3189,357 @@ static inline void call_sendmsg_callback( SENDASYNCPROC callback, HWND hwnd, UIN
 }
 
 
+/* posted messages between threads of the same process are kept on the client side */
+struct local_message
+{
+    struct list entry;
+    HWND        hwnd;
+    UINT        msg;
+    WPARAM      wparam;
+    LPARAM      lparam;
+    DWORD       time;
+    unsigned int serial;       /* serial of the last message posted through the server before it */
+};
+
+struct local_queue
+{
+    struct list entry;         /* entry in the list of local queues */
+    DWORD       tid;           /* id of the owner thread */
+    struct list messages;      /* pending posted messages */
+    UINT        changed_bits;  /* bits changed since the last check, like the server changed bits */
+    BOOL        waiting;       /* the owner is blocked waiting on its server queue */
+};
+
+static struct list local_queues = LIST_INIT( local_queues );
+
+static CRITICAL_SECTION local_queue_section;
+static CRITICAL_SECTION_DEBUG local_queue_critsect_debug =
+{
+    0, 0, &local_queue_section,
+    { &local_queue_critsect_debug.ProcessLocksList, &local_queue_critsect_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": local_queue_section") }
+};
+static CRITICAL_SECTION local_queue_section = { &local_queue_critsect_debug, -1, 0, 0, 0, 0 };
+
+static const volatile unsigned int *post_serial;
+
+/* map the serial of the last message posted through the server on first use */
+static const volatile unsigned int *get_post_serial(void)
+{
+    static BOOL failed;
+    HANDLE mapping = 0;
+    void *ptr = NULL;
+
+    if (post_serial || failed) return post_serial;
+
+    SERVER_START_REQ( get_post_serial )
+    {
+        if (!wine_server_call( req )) mapping = wine_server_ptr_handle( reply->handle );
+    }
+    SERVER_END_REQ;
+
+    if (mapping)
+    {
+        ptr = MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 );
+        CloseHandle( mapping );
+    }
+    if (!ptr)
+    {
+        WARN( "failed to map the posted message serial\n" );
+        failed = TRUE;
+    }
+    else if (interlocked_cmpxchg_ptr( (void **)&post_serial, ptr, NULL )) UnmapViewOfFile( ptr );
+    return post_serial;
+}
+
+/* find the local queue of a thread; local_queue_section must be held */
+static struct local_queue *find_local_queue( DWORD tid )
+{
+    struct local_queue *queue;
+
+    LIST_FOR_EACH_ENTRY( queue, &local_queues, struct local_queue, entry )
+    {
+        if (queue->tid == tid)
+        {
+            /* keep the most active queues at the front */
+            list_remove( &queue->entry );
+            list_add_head( &local_queues, &queue->entry );
+            return queue;
+        }
+    }
+    return NULL;
+}
+
+/* get the local queue of the current thread, creating it if needed; local_queue_section must be held */
+static struct local_queue *get_local_queue(void)
+{
+    DWORD tid = GetCurrentThreadId();
+    struct local_queue *queue;
+
+    if ((queue = find_local_queue( tid ))) return queue;
+    if (!(queue = HeapAlloc( GetProcessHeap(), 0, sizeof(*queue) ))) return NULL;
+    queue->tid = tid;
+    queue->changed_bits = 0;
+    queue->waiting = FALSE;
+    list_init( &queue->messages );
+    list_add_head( &local_queues, &queue->entry );
+    return queue;
+}
+
+/* move a local message to the server queue and free it; local_queue_section must be held */
+static void move_local_message( struct local_queue *queue, struct local_message *msg )
+{
+    SERVER_START_REQ( send_message )
+    {
+        req->id      = queue->tid;
+        req->type    = MSG_POSTED;
+        req->flags   = 0;
+        req->win     = wine_server_user_handle( msg->hwnd );
+        req->msg     = msg->msg;
+        req->wparam  = msg->wparam;
+        req->lparam  = msg->lparam;
+        req->timeout = TIMEOUT_INFINITE;
+        req->serial  = msg->serial;
+        if (wine_server_call( req ))
+            WARN( "failed to move message %x to the queue of thread %04x\n", msg->msg, queue->tid );
+    }
+    SERVER_END_REQ;
+    list_remove( &msg->entry );
+    HeapFree( GetProcessHeap(), 0, msg );
+}
+
+/* move the pending messages of a local queue to the server queue; local_queue_section must be held */
+static void flush_local_queue( struct local_queue *queue )
+{
+    struct local_message *msg, *next;
+
+    LIST_FOR_EACH_ENTRY_SAFE( msg, next, &queue->messages, struct local_message, entry )
+        move_local_message( queue, msg );
+}
+
+/* check if a local message matches a peek_message window filter; filters on a specific window are left to the server */
+static inline BOOL match_local_window( HWND hwnd, HWND msg_hwnd )
+{
+    if (!hwnd) return TRUE;
+    if (hwnd == HWND_TOPMOST || hwnd == HWND_BOTTOM) return !msg_hwnd;
+    return FALSE;
+}
+
+/***********************************************************************
+ *           post_local_message
+ *
+ * Post a message to another thread of the current process without going through the server.
+ * Return FALSE if the destination thread has no local queue.
+ */
+static BOOL post_local_message( const struct send_message_info *info )
+{
+    const volatile unsigned int *serial;
+    struct local_queue *queue;
+    struct local_message *msg;
+    BOOL wake = FALSE;
+
+    if (!(serial = get_post_serial())) return FALSE;
+    if (!(msg = HeapAlloc( GetProcessHeap(), 0, sizeof(*msg) ))) return FALSE;
+    msg->hwnd   = info->hwnd ? WIN_GetFullHandle( info->hwnd ) : 0;
+    msg->msg    = info->msg;
+    msg->wparam = info->wparam;
+    msg->lparam = info->lparam;
+    msg->time   = GetTickCount();
+
+    EnterCriticalSection( &local_queue_section );
+    if ((queue = find_local_queue( info->dest_tid )))
+    {
+        /* read under the lock, so that the serials of a local queue never decrease */
+        msg->serial = *serial;
+        list_add_tail( &queue->messages, &msg->entry );
+        queue->changed_bits |= QS_POSTMESSAGE | QS_ALLPOSTMESSAGE;
+        wake = queue->waiting;
+        queue->waiting = FALSE;
+    }
+    LeaveCriticalSection( &local_queue_section );
+
+    if (!queue)
+    {
+        HeapFree( GetProcessHeap(), 0, msg );
+        return FALSE;
+    }
+
+    /* the server only needs to know about it if the receiver is blocked */
+    if (wake)
+    {
+        SERVER_START_REQ( wake_posted_queue )
+        {
+            req->id = info->dest_tid;
+            wine_server_call( req );
+        }
+        SERVER_END_REQ;
+    }
+    return TRUE;
+}
+
+/***********************************************************************
+ *           flush_local_messages
+ *
+ * Move the local messages pending for a thread to its server queue, so that a
+ * message posted through the server doesn't overtake them.
+ */
+static void flush_local_messages( DWORD tid )
+{
+    struct local_queue *queue;
+
+    EnterCriticalSection( &local_queue_section );
+    if ((queue = find_local_queue( tid ))) flush_local_queue( queue );
+    LeaveCriticalSection( &local_queue_section );
+}
+
+/***********************************************************************
+ *           purge_local_messages
+ *
+ * Remove the local messages posted to a window of the current thread that is
+ * being destroyed. WM_QUIT is moved to the server, which turns it into a quit
+ * message when it destroys the window.
+ */
+void purge_local_messages( HWND hwnd )
+{
+    struct local_queue *queue;
+    struct local_message *msg, *next;
+
+    EnterCriticalSection( &local_queue_section );
+    if ((queue = find_local_queue( GetCurrentThreadId() )))
+    {
+        LIST_FOR_EACH_ENTRY_SAFE( msg, next, &queue->messages, struct local_message, entry )
+        {
+            if (msg->hwnd != hwnd) continue;
+            if (msg->msg == WM_QUIT) move_local_message( queue, msg );
+            else
+            {
+                list_remove( &msg->entry );
+                HeapFree( GetProcessHeap(), 0, msg );
+            }
+        }
+    }
+    LeaveCriticalSection( &local_queue_section );
+}
+
+/***********************************************************************
+ *           check_local_messages
+ *
+ * Check whether the current thread has a local posted message matching the filter,
+ * and return its serial. The server only returns the posted messages that were
+ * posted before it, and nothing else.
+ */
+static BOOL check_local_messages( HWND hwnd, UINT first, UINT last, UINT flags, unsigned int *serial )
+{
+    struct local_queue *queue;
+    struct local_message *msg;
+    UINT filter = HIWORD( flags );
+    BOOL ret = FALSE;
+
+    if (filter && !(filter & QS_POSTMESSAGE)) return FALSE;
+
+    EnterCriticalSection( &local_queue_section );
+    if ((queue = get_local_queue()))
+    {
+        /* same as the server does when looking for posted messages */
+        queue->changed_bits &= ~QS_POSTMESSAGE;
+        if (!first && last == ~0U) queue->changed_bits &= ~QS_ALLPOSTMESSAGE;
+
+        if (!list_empty( &queue->messages ))
+        {
+            /* child windows can only be matched by the server */
+            if (hwnd && hwnd != HWND_TOPMOST && hwnd != HWND_BOTTOM) flush_local_queue( queue );
+            else LIST_FOR_EACH_ENTRY( msg, &queue->messages, struct local_message, entry )
+            {
+                if (!match_local_window( hwnd, msg->hwnd )) continue;
+                if (msg->msg < first || msg->msg > last) continue;
+                *serial = msg->serial;
+                ret = TRUE;
+                break;
+            }
+        }
+    }
+    LeaveCriticalSection( &local_queue_section );
+    return ret;
+}
+
+/***********************************************************************
+ *           get_local_message
+ *
+ * Retrieve the first local posted message matching the filter.
+ */
+static BOOL get_local_message( MSG *ret, HWND hwnd, UINT first, UINT last, UINT flags )
+{
+    struct local_queue *queue;
+    struct local_message *msg;
+    BOOL found = FALSE;
+
+    EnterCriticalSection( &local_queue_section );
+    if ((queue = find_local_queue( GetCurrentThreadId() )))
+    {
+        LIST_FOR_EACH_ENTRY( msg, &queue->messages, struct local_message, entry )
+        {
+            if (!match_local_window( hwnd, msg->hwnd )) continue;
+            if (msg->msg < first || msg->msg > last) continue;
+            ret->hwnd    = msg->hwnd;
+            ret->message = msg->msg;
+            ret->wParam  = msg->wparam;
+            ret->lParam  = msg->lparam;
+            ret->time    = msg->time;
+            if (flags & PM_REMOVE)
+            {
+                list_remove( &msg->entry );
+                HeapFree( GetProcessHeap(), 0, msg );
+            }
+            found = TRUE;
+            break;
+        }
+    }
+    LeaveCriticalSection( &local_queue_section );
+    return found;
+}
+
+/***********************************************************************
+ *           get_local_queue_status
+ *
+ * Return the local posted message state in GetQueueStatus format, clearing the changed bits.
+ */
+DWORD get_local_queue_status( UINT flags )
+{
+    struct local_queue *queue;
+    UINT changed = 0, wake = 0;
+
+    EnterCriticalSection( &local_queue_section );
+    if ((queue = find_local_queue( GetCurrentThreadId() )))
+    {
+        changed = queue->changed_bits & flags;
+        queue->changed_bits &= ~flags;
+        if (!list_empty( &queue->messages )) wake = (QS_POSTMESSAGE | QS_ALLPOSTMESSAGE) & flags;
+    }
+    LeaveCriticalSection( &local_queue_section );
+    return MAKELONG( changed, wake );
+}
+
+/***********************************************************************
+ *           destroy_local_queue
+ *
+ * Free the local queue of the current thread; pending messages are lost like the server ones.
+ */
+void destroy_local_queue(void)
+{
+    struct local_queue *queue;
+    struct local_message *msg, *next;
+
+    EnterCriticalSection( &local_queue_section );
+    if ((queue = find_local_queue( GetCurrentThreadId() ))) list_remove( &queue->entry );
+    LeaveCriticalSection( &local_queue_section );
+
+    if (!queue) return;
+    LIST_FOR_EACH_ENTRY_SAFE( msg, next, &queue->messages, struct local_message, entry )
+        HeapFree( GetProcessHeap(), 0, msg );
+    HeapFree( GetProcessHeap(), 0, queue );
+}
+
+
 /***********************************************************************
  *           peek_message
  *
@@ -2745,6 +3565,10 @@ static BOOL peek_message( MSG *msg, HWND hwnd, UINT first, UINT last, UINT flags
         NTSTATUS res;
         size_t size = 0;
         const message_data_t *msg_data = buffer;
+        unsigned int local_serial = 0;
+        BOOL local_posted = check_local_messages( hwnd, first, last, flags, &local_serial );
+
+        info.shared = NULL;
 
         SERVER_START_REQ( get_message )
         {
@@ -2755,6 +3579,8 @@ static BOOL peek_message( MSG *msg, HWND hwnd, UINT first, UINT last, UINT flags
             req->hw_id     = hw_id;
             req->wake_mask = changed_mask & (QS_SENDMESSAGE | QS_SMRESULT);
             req->changed_mask = changed_mask;
+            req->local_posted = local_posted;
+            req->local_serial = local_serial;
             wine_server_set_reply( req, buffer, buffer_size );
             if (!(res = wine_server_call( req )))
             {
@@ -2770,10 +3596,24 @@ static BOOL peek_message( MSG *msg, HWND hwnd, UINT first, UINT last, UINT flags
                 hw_id            = 0;
                 thread_info->active_hooks = reply->active_hooks;
             }
+            else if (res == STATUS_PENDING && local_posted)
+            {
+                info.msg.pt.x    = reply->x;
+                info.msg.pt.y    = reply->y;
+                thread_info->active_hooks = reply->active_hooks;
+            }
             else buffer_size = reply->total;
         }
         SERVER_END_REQ;
 
+        if (res == STATUS_PENDING && local_posted)
+        {
+            /* nothing queued on the server comes before the local message */
+            if (!get_local_message( &info.msg, hwnd, first, last, flags )) continue;
+            info.type = MSG_POSTED;
+            res = 0;
+        }
+
         if (res)
         {
             HeapFree( GetProcessHeap(), 0, buffer );
@@ -2892,6 +3732,16 @@ static BOOL peek_message( MSG *msg, HWND hwnd, UINT first, UINT last, UINT flags
                 continue;
             }
             break;
+        case MSG_OTHER_PROCESS_SHARED:
+            info.flags = ISMEX_SEND;
+            if (!unpack_shared_message( &info, buffer, size ))
+            {
+                /* ignore it */
+                reply_message( &info, 0, TRUE );
+                continue;
+            }
+            info.type = MSG_OTHER_PROCESS;
+            break;
         case MSG_HARDWARE:
             if (size >= sizeof(msg_data->hardware))
             {
@@ -3045,12 +3895,27 @@ static DWORD wait_objects( DWORD count, const HANDLE *handles, DWORD timeout,
                            DWORD wake_mask, DWORD changed_mask, DWORD flags )
 {
     struct user_thread_info *thread_info = get_user_thread_info();
+    struct local_queue *queue;
     DWORD ret;
 
     assert( count );  /* we must have at least the server queue */
 
     flush_window_surfaces( TRUE );
 
+    /* local posted messages don't signal the server queue until we are blocked on it */
+    EnterCriticalSection( &local_queue_section );
+    if ((queue = find_local_queue( GetCurrentThreadId() )))
+    {
+        if ((queue->changed_bits & changed_mask) ||
+            (!list_empty( &queue->messages ) && (wake_mask & (QS_POSTMESSAGE | QS_ALLPOSTMESSAGE))))
+        {
+            LeaveCriticalSection( &local_queue_section );
+            return WAIT_OBJECT_0 + count - 1;
+        }
+        queue->waiting = TRUE;
+    }
+    LeaveCriticalSection( &local_queue_section );
+
     if (thread_info->wake_mask != wake_mask || thread_info->changed_mask != changed_mask)
     {
         SERVER_START_REQ( set_queue_mask )
@@ -3067,6 +3932,13 @@ static DWORD wait_objects( DWORD count, const HANDLE *handles, DWORD timeout,
 
     ret = wow_handlers.wait_message( count, handles, timeout, changed_mask, flags );
 
+    if (queue)
+    {
+        EnterCriticalSection( &local_queue_section );
+        queue->waiting = FALSE;
+        LeaveCriticalSection( &local_queue_section );
+    }
+
     if (ret != WAIT_TIMEOUT) thread_info->wake_mask = thread_info->changed_mask = 0;
     return ret;
 }
@@ -3078,9 +3950,11 @@ static DWORD wait_objects( DWORD count, const HANDLE *handles, DWORD timeout,
  * Put a sent message into the destination queue.
  * For inter-process message, reply_size is set to expected size of reply data.
  */
-static BOOL put_message_in_queue( const struct send_message_info *info, size_t *reply_size )
+static BOOL put_message_in_queue( const struct send_message_info *info, size_t *reply_size,
+                                  struct message_channel **channel )
 {
     struct packed_message data;
+    struct shared_message_desc desc;
     message_data_t msg_data;
     unsigned int res;
     int i;
@@ -3108,6 +3982,7 @@ static BOOL put_message_in_queue( const struct send_message_info *info, size_t *
             WARN( "cannot pack message %x\n", info->msg );
             return FALSE;
         }
+        *channel = pack_shared_message( info->msg, &data, *reply_size, &desc );
     }
     else if (info->type == MSG_CALLBACK)
     {
@@ -3120,13 +3995,19 @@ static BOOL put_message_in_queue( const struct send_message_info *info, size_t *
     }
     else if (info->type == MSG_POSTED && info->msg >= WM_DDE_FIRST && info->msg <= WM_DDE_LAST)
     {
+        flush_local_messages( info->dest_tid );
         return post_dde_message( &data, info );
     }
+    else if (info->type == MSG_POSTED && info->dest_tid != GetCurrentThreadId())
+    {
+        if (!(info->msg & 0x80000000) && post_local_message( info )) return TRUE;
+        flush_local_messages( info->dest_tid );
+    }
 
     SERVER_START_REQ( send_message )
     {
         req->id      = info->dest_tid;
-        req->type    = info->type;
+        req->type    = (channel && *channel) ? MSG_OTHER_PROCESS_SHARED : info->type;
         req->flags   = 0;
         req->win     = wine_server_user_handle( info->hwnd );
         req->msg     = info->msg;
@@ -3146,6 +4027,12 @@ static BOOL put_message_in_queue( const struct send_message_info *info, size_t *
         }
     }
     SERVER_END_REQ;
+
+    if (res && channel && *channel)
+    {
+        cancel_shared_message( *channel );
+        *channel = NULL;
+    }
     return !res;
 }
 
@@ -3155,12 +4042,15 @@ static BOOL put_message_in_queue( const struct send_message_info *info, size_t *
  *
  * Retrieve a message reply from the server.
  */
-static LRESULT retrieve_reply( const struct send_message_info *info,
-                               size_t reply_size, LRESULT *result )
+static LRESULT retrieve_reply( const struct send_message_info *info, size_t reply_size,
+                               struct message_channel *channel, LRESULT *result )
 {
     NTSTATUS status;
     void *reply_data = NULL;
 
+    /* the reply data of shared messages is stored in the channel */
+    if (channel) reply_size = 0;
+
     if (reply_size)
     {
         if (!(reply_data = HeapAlloc( GetProcessHeap(), 0, reply_size )))
@@ -3179,6 +4069,7 @@ static LRESULT retrieve_reply( const struct send_message_info *info,
     SERVER_END_REQ;
     if (!status && reply_size)
         unpack_reply( info->hwnd, info->msg, info->wparam, info->lparam, reply_data, reply_size );
+    if (channel) unpack_shared_reply( channel, info, !status );
 
     HeapFree( GetProcessHeap(), 0, reply_data );
 
@@ -3197,6 +4088,7 @@ static LRESULT retrieve_reply( const struct send_message_info *info,
  */
 static LRESULT send_inter_thread_message( const struct send_message_info *info, LRESULT *res_ptr )
 {
+    struct message_channel *channel = NULL;
     size_t reply_size = 0;
 
     TRACE( "hwnd %p msg %x (%s) wp %lx lp %lx\n",
@@ -3204,13 +4096,13 @@ static LRESULT send_inter_thread_message( const struct send_message_info *info,
 
     USER_CheckNotLock();
 
-    if (!put_message_in_queue( info, &reply_size )) return 0;
+    if (!put_message_in_queue( info, &reply_size, &channel )) return 0;
 
     /* there's no reply to wait for on notify/callback messages */
     if (info->type == MSG_NOTIFY || info->type == MSG_CALLBACK) return 1;
 
     wait_message_reply( info->flags );
-    return retrieve_reply( info, reply_size, res_ptr );
+    return retrieve_reply( info, reply_size, channel, res_ptr );
 }
 
 
@@ -3286,6 +4178,39 @@ static BOOL send_message( struct send_message_info *info, DWORD_PTR *res_ptr, BO
 }
 
 
+/***********************************************************************
+ *		init_hw_input
+ *
+ * Convert an INPUT structure to the server format.
+ */
+static void init_hw_input( hw_input_t *hw, const INPUT *input )
+{
+    hw->type = input->type;
+    switch (input->type)
+    {
+    case INPUT_MOUSE:
+        hw->mouse.x     = input->u.mi.dx;
+        hw->mouse.y     = input->u.mi.dy;
+        hw->mouse.data  = input->u.mi.mouseData;
+        hw->mouse.flags = input->u.mi.dwFlags;
+        hw->mouse.time  = input->u.mi.time;
+        hw->mouse.info  = input->u.mi.dwExtraInfo;
+        break;
+    case INPUT_KEYBOARD:
+        hw->kbd.vkey  = input->u.ki.wVk;
+        hw->kbd.scan  = input->u.ki.wScan;
+        hw->kbd.flags = input->u.ki.dwFlags;
+        hw->kbd.time  = input->u.ki.time;
+        hw->kbd.info  = input->u.ki.dwExtraInfo;
+        break;
+    case INPUT_HARDWARE:
+        hw->hw.msg    = input->u.hi.uMsg;
+        hw->hw.lparam = MAKELONG( input->u.hi.wParamL, input->u.hi.wParamH );
+        break;
+    }
+}
+
+
 /***********************************************************************
  *		send_hardware_message
  */
@@ -3308,29 +4233,7 @@ NTSTATUS send_hardware_message( HWND hwnd, const INPUT *input, UINT flags )
     {
         req->win        = wine_server_user_handle( hwnd );
         req->flags      = flags;
-        req->input.type = input->type;
-        switch (input->type)
-        {
-        case INPUT_MOUSE:
-            req->input.mouse.x     = input->u.mi.dx;
-            req->input.mouse.y     = input->u.mi.dy;
-            req->input.mouse.data  = input->u.mi.mouseData;
-            req->input.mouse.flags = input->u.mi.dwFlags;
-            req->input.mouse.time  = input->u.mi.time;
-            req->input.mouse.info  = input->u.mi.dwExtraInfo;
-            break;
-        case INPUT_KEYBOARD:
-            req->input.kbd.vkey  = input->u.ki.wVk;
-            req->input.kbd.scan  = input->u.ki.wScan;
-            req->input.kbd.flags = input->u.ki.dwFlags;
-            req->input.kbd.time  = input->u.ki.time;
-            req->input.kbd.info  = input->u.ki.dwExtraInfo;
-            break;
-        case INPUT_HARDWARE:
-            req->input.hw.msg    = input->u.hi.uMsg;
-            req->input.hw.lparam = MAKELONG( input->u.hi.wParamL, input->u.hi.wParamH );
-            break;
-        }
+        init_hw_input( &req->input, input );
         if (key_state_info) wine_server_set_reply( req, key_state_info->state,
                                                    sizeof(key_state_info->state) );
         ret = wine_server_call( req );
@@ -3357,7 +4260,74 @@ NTSTATUS send_hardware_message( HWND hwnd, const INPUT *input, UINT flags )
     {
         LRESULT ignored;
         wait_message_reply( 0 );
-        retrieve_reply( &info, 0, &ignored );
+        retrieve_reply( &info, 0, NULL, &ignored );
+    }
+    return ret;
+}
+
+
+/***********************************************************************
+ *		send_hardware_messages
+ *
+ * Send a list of inputs with a single server call per chunk; the server only
+ * stops early when a low-level hook has to process one of them first.
+ */
+NTSTATUS send_hardware_messages( const INPUT *inputs, UINT count, UINT flags, UINT *sent )
+{
+    struct user_key_state_info *key_state_info = get_user_thread_info()->key_state;
+    struct send_message_info info;
+    hw_input_t hw_inputs[64];
+    int prev_x, prev_y, new_x, new_y;
+    NTSTATUS ret = STATUS_SUCCESS;
+    UINT i, chunk, done;
+    INT counter;
+    BOOL wait;
+
+    info.type     = MSG_HARDWARE;
+    info.dest_tid = 0;
+    info.hwnd     = 0;
+    info.flags    = 0;
+    info.timeout  = 0;
+
+    *sent = 0;
+    while (!ret && *sent < count)
+    {
+        chunk = min( count - *sent, sizeof(hw_inputs) / sizeof(hw_inputs[0]) );
+        for (i = 0; i < chunk; i++) init_hw_input( &hw_inputs[i], &inputs[*sent + i] );
+        counter = global_key_state_counter;
+
+        SERVER_START_REQ( send_hardware_messages )
+        {
+            req->flags = flags;
+            wine_server_add_data( req, hw_inputs, chunk * sizeof(hw_inputs[0]) );
+            if (key_state_info) wine_server_set_reply( req, key_state_info->state,
+                                                       sizeof(key_state_info->state) );
+            ret = wine_server_call( req );
+            done   = reply->count;
+            wait   = reply->wait;
+            prev_x = reply->prev_x;
+            prev_y = reply->prev_y;
+            new_x  = reply->new_x;
+            new_y  = reply->new_y;
+        }
+        SERVER_END_REQ;
+
+        *sent += done;
+        if (!ret && key_state_info)
+        {
+            key_state_info->time    = GetTickCount();
+            key_state_info->counter = counter;
+        }
+        /* the cursor may have moved even if a later input failed */
+        if ((flags & SEND_HWMSG_INJECTED) && (prev_x != new_x || prev_y != new_y))
+            USER_Driver->pSetCursorPos( new_x, new_y );
+
+        if (wait)
+        {
+            LRESULT ignored;
+            wait_message_reply( 0 );
+            retrieve_reply( &info, 0, NULL, &ignored );
+        }
     }
     return ret;
 }
@@ -3671,7 +4641,7 @@ BOOL WINAPI PostMessageW( HWND hwnd, UINT msg, WPARAM wparam, LPARAM lparam )
 
     if (USER_IsExitingThread( info.dest_tid )) return TRUE;
 
-    return put_message_in_queue( &info, NULL );
+    return put_message_in_queue( &info, NULL, NULL );
 }
 
 
@@ -3706,7 +4676,7 @@ BOOL WINAPI PostThreadMessageW( DWORD thread, UINT msg, WPARAM wparam, LPARAM lp
     info.wparam   = wparam;
     info.lparam   = lparam;
     info.flags    = 0;
-    return put_message_in_queue( &info, NULL );
+    return put_message_in_queue( &info, NULL, NULL );
 }
 
 
@@ -4220,13 +5190,72 @@ DWORD WINAPI WaitForInputIdle( HANDLE hProcess, DWORD dwTimeOut )
 }
 
 
+/* registered atoms that are known to be pinned already */
+static LONG pinned_atoms[(0x10000 - MAXINTATOM) / 32];
+
+/***********************************************************************
+ *		register_atom
+ *
+ * Add the global atom of a registered message or clipboard format. These atoms
+ * are pinned, which lets ntdll resolve further lookups from its cache.
+ */
+ATOM register_atom( LPCWSTR name )
+{
+    ATOM atom = GlobalAddAtomW( name );
+    unsigned int index = atom - MAXINTATOM;
+
+    if (atom < MAXINTATOM) return atom;
+    if (pinned_atoms[index / 32] & (1u << (index % 32))) return atom;
+
+    SERVER_START_REQ( set_atom_information )
+    {
+        req->table  = 0;
+        req->atom   = atom;
+        req->pinned = TRUE;
+        wine_server_call( req );
+    }
+    SERVER_END_REQ;
+    pinned_atoms[index / 32] |= 1u << (index % 32);
+    return atom;
+}
+
+
+/***********************************************************************
+ *		flush_registered_atoms
+ *
+ * Forget which atoms are pinned, the global atom table may be a different
+ * one after switching to another window station.
+ */
+void flush_registered_atoms(void)
+{
+    extern void CDECL __wine_flush_atom_cache(void);
+
+    memset( pinned_atoms, 0, sizeof(pinned_atoms) );
+    __wine_flush_atom_cache();
+}
+
+
+/***********************************************************************
+ *		register_atomA
+ */
+ATOM register_atomA( LPCSTR name )
+{
+    WCHAR buffer[256];
+
+    /* let GlobalAddAtomA deal with integral atoms and invalid names */
+    if (IS_INTRESOURCE(name) || !MultiByteToWideChar( CP_ACP, 0, name, -1, buffer, 256 ))
+        return GlobalAddAtomA( name );
+    return register_atom( buffer );
+}
+
+
 /***********************************************************************
  *		RegisterWindowMessageA (USER32.@)
  *		RegisterWindowMessage (USER.118)
  */
 UINT WINAPI RegisterWindowMessageA( LPCSTR str )
 {
-    UINT ret = GlobalAddAtomA(str);
+    UINT ret = register_atomA(str);
     TRACE("%s, ret=%x\n", str, ret);
     return ret;
 }
@@ -4237,7 +5266,7 @@ UINT WINAPI RegisterWindowMessageA( LPCSTR str )
  */
 UINT WINAPI RegisterWindowMessageW( LPCWSTR str )
 {
-    UINT ret = GlobalAddAtomW(str);
+    UINT ret = register_atom(str);
     TRACE("%s ret=%x\n", debugstr_w(str), ret);
     return ret;
 }
@@ -1353,6 +1353,64 @@ done:
     SetCursorPos(pt_org.x, pt_org.y);
 }
 
+static int batch_hook_count;
+
+static LRESULT CALLBACK batch_hook_proc(int code, WPARAM wparam, LPARAM lparam)
+{
+    if (code == HC_ACTION && wparam == WM_MOUSEMOVE) batch_hook_count++;
+    return CallNextHookEx(0, code, wparam, lparam);
+}
+
+static void test_SendInput_batch(void)
+{
+    INPUT inputs[150];
+    POINT pt_org, pt;
+    HHOOK hook;
+    UINT i, ret;
+
+    GetCursorPos(&pt_org);
+    SetCursorPos(100, 100);
+
+    memset(inputs, 0, sizeof(inputs));
+    for (i = 0; i < 100; i++)
+    {
+        inputs[i].type = INPUT_MOUSE;
+        inputs[i].mi.dx = 1;
+        inputs[i].mi.dwFlags = MOUSEEVENTF_MOVE;
+    }
+    for (; i < 150; i++)
+    {
+        inputs[i].type = INPUT_MOUSE;
+        inputs[i].mi.dx = (i * 2 * 65536) / GetSystemMetrics(SM_CXSCREEN);
+        inputs[i].mi.dy = (120 * 65536) / GetSystemMetrics(SM_CYSCREEN);
+        inputs[i].mi.dwFlags = MOUSEEVENTF_MOVE | MOUSEEVENTF_ABSOLUTE;
+    }
+
+    ret = pSendInput(100, inputs, sizeof(INPUT));
+    ok(ret == 100, "SendInput returned %u\n", ret);
+    GetCursorPos(&pt);
+    ok(pt.x == 200 && pt.y == 100, "wrong position (%d,%d)\n", pt.x, pt.y);
+
+    ret = pSendInput(50, inputs + 100, sizeof(INPUT));
+    ok(ret == 50, "SendInput returned %u\n", ret);
+    GetCursorPos(&pt);
+    ok(abs(pt.x - 298) <= 1 && abs(pt.y - 120) <= 1, "wrong position (%d,%d)\n", pt.x, pt.y);
+
+    /* every move is seen by low-level hooks */
+    if ((hook = SetWindowsHookExA(WH_MOUSE_LL, batch_hook_proc, GetModuleHandleA(0), 0)))
+    {
+        SetCursorPos(100, 100);
+        batch_hook_count = 0;
+        ret = pSendInput(150, inputs, sizeof(INPUT));
+        ok(ret == 150, "SendInput returned %u\n", ret);
+        ok(batch_hook_count == 150, "hook called %d times\n", batch_hook_count);
+        UnhookWindowsHookEx(hook);
+    }
+    else win_skip("cannot set MOUSE_LL hook\n");
+
+    SetCursorPos(pt_org.x, pt_org.y);
+}
+
 static void test_GetMouseMovePointsEx(void)
 {
 #define BUFLIM  64
@@ -2542,6 +2600,7 @@ START_TEST(input)
         test_Input_whitebox();
         test_Input_unicode();
         test_Input_mouse();
+        test_SendInput_batch();
     }
     else win_skip("SendInput is not available\n");
 
@@ -14744,6 +14744,203 @@ static void test_PostMessage(void)
     flush_events();
 }
 
+struct post_thread_params
+{
+    DWORD tid;
+    HWND  hwnd;
+    DWORD delay;
+};
+
+static DWORD WINAPI post_message_thread(void *arg)
+{
+    const struct post_thread_params *params = arg;
+    int i;
+
+    Sleep(params->delay);
+    for (i = 0; i < 100; i++)
+        PostThreadMessageA(params->tid, WM_USER + i, i, 0);
+    PostMessageA(params->hwnd, WM_USER + 100, 100, 0);
+    PostThreadMessageA(params->tid, WM_USER + 101, 101, 0);
+    return 0;
+}
+
+static DWORD WINAPI post_quit_thread(void *arg)
+{
+    const struct post_thread_params *params = arg;
+
+    PostMessageA(params->hwnd, WM_USER, 0, 0);
+    PostMessageA(params->hwnd, WM_QUIT, 0x1234, 0x5678);
+    PostMessageA(params->hwnd, WM_QUIT, 0x4321, 0x8765);
+    return 0;
+}
+
+static DWORD WINAPI post_one_message_thread(void *arg)
+{
+    const MSG *msg = arg;
+
+    PostMessageA(msg->hwnd, msg->message, msg->wParam, 0);
+    return 0;
+}
+
+/* alternate messages posted by other threads of the process and by the current thread */
+static void post_mixed_messages(HWND hwnd, int count)
+{
+    HANDLE thread;
+    DWORD ret;
+    MSG msg;
+    int i;
+
+    for (i = 0; i < count; i++)
+    {
+        msg.hwnd = hwnd;
+        msg.message = WM_USER + i;
+        msg.wParam = i;
+        if (i % 2)
+        {
+            PostMessageA(hwnd, WM_USER + i, i, 0);
+            continue;
+        }
+        thread = CreateThread(NULL, 0, post_one_message_thread, &msg, 0, NULL);
+        ok(thread != NULL, "CreateThread failed, error %u\n", GetLastError());
+        ret = WaitForSingleObject(thread, 5000);
+        ok(ret == WAIT_OBJECT_0, "WaitForSingleObject returned %x\n", ret);
+        CloseHandle(thread);
+    }
+}
+
+static void test_PostMessage_other_thread(void)
+{
+    static const WCHAR staticW[] = {'s','t','a','t','i','c',0};
+    struct post_thread_params params;
+    HANDLE thread;
+    DWORD ret, tid, status;
+    MSG msg;
+    int i;
+
+    params.tid = GetCurrentThreadId();
+    params.hwnd = CreateWindowExW(0, staticW, NULL, WS_POPUP, 0,0,0,0,0,0,0, NULL);
+    ok(params.hwnd != NULL, "CreateWindowEx failed\n");
+    params.delay = 0;
+    flush_events();
+    GetQueueStatus(QS_ALLINPUT);
+
+    thread = CreateThread(NULL, 0, post_message_thread, &params, 0, &tid);
+    ok(thread != NULL, "CreateThread failed, error %u\n", GetLastError());
+    ret = WaitForSingleObject(thread, 5000);
+    ok(ret == WAIT_OBJECT_0, "WaitForSingleObject returned %x\n", ret);
+    CloseHandle(thread);
+
+    status = GetQueueStatus(QS_POSTMESSAGE);
+    ok(status == MAKELONG(QS_POSTMESSAGE, QS_POSTMESSAGE), "wrong status %08x\n", status);
+    status = GetQueueStatus(QS_POSTMESSAGE);
+    ok(status == MAKELONG(0, QS_POSTMESSAGE), "wrong status %08x\n", status);
+
+    /* window filters see the messages in the order they were posted */
+    ret = PeekMessageA(&msg, params.hwnd, 0, 0, PM_REMOVE);
+    ok(ret && msg.hwnd == params.hwnd && msg.message == WM_USER + 100,
+       "got ret %d hwnd %p msg %04x\n", ret, msg.hwnd, msg.message);
+    for (i = 0; i < 100; i++)
+    {
+        ret = PeekMessageA(&msg, 0, 0, 0, PM_REMOVE);
+        ok(ret && !msg.hwnd && msg.message == WM_USER + i && msg.wParam == i,
+           "%d: got ret %d msg %04x wParam %lx\n", i, ret, msg.message, msg.wParam);
+    }
+    ret = PeekMessageA(&msg, 0, 0, 0, PM_REMOVE);
+    ok(ret && msg.message == WM_USER + 101, "got ret %d msg %04x\n", ret, msg.message);
+    ret = PeekMessageA(&msg, 0, 0, 0, PM_REMOVE);
+    ok(!ret, "got unexpected msg %04x\n", msg.message);
+
+    /* a blocked receiver must be woken up */
+    params.delay = 100;
+    thread = CreateThread(NULL, 0, post_message_thread, &params, 0, &tid);
+    ok(thread != NULL, "CreateThread failed, error %u\n", GetLastError());
+    ret = MsgWaitForMultipleObjects(0, NULL, FALSE, 5000, QS_POSTMESSAGE);
+    ok(ret == WAIT_OBJECT_0, "MsgWaitForMultipleObjects returned %x\n", ret);
+    ret = GetMessageA(&msg, 0, 0, 0);
+    ok(ret && msg.message == WM_USER, "got ret %d msg %04x\n", ret, msg.message);
+    WaitForSingleObject(thread, 5000);
+    CloseHandle(thread);
+    flush_events();
+
+    /* a message posted through the server comes after the ones posted before it */
+    params.delay = 0;
+    thread = CreateThread(NULL, 0, post_message_thread, &params, 0, &tid);
+    ok(thread != NULL, "CreateThread failed, error %u\n", GetLastError());
+    ret = WaitForSingleObject(thread, 5000);
+    ok(ret == WAIT_OBJECT_0, "WaitForSingleObject returned %x\n", ret);
+    CloseHandle(thread);
+    PostThreadMessageA(GetCurrentThreadId(), WM_USER + 102, 102, 0);
+    for (i = 0; i <= 102; i++)
+    {
+        ret = PeekMessageA(&msg, 0, 0, 0, PM_REMOVE);
+        ok(ret && msg.message == WM_USER + i && msg.wParam == i,
+           "%d: got ret %d msg %04x wParam %lx\n", i, ret, msg.message, msg.wParam);
+    }
+    ret = PeekMessageA(&msg, 0, 0, 0, PM_REMOVE);
+    ok(!ret, "got unexpected msg %04x\n", msg.message);
+
+    /* messages posted to a window are dropped when it is destroyed */
+    thread = CreateThread(NULL, 0, post_message_thread, &params, 0, &tid);
+    ok(thread != NULL, "CreateThread failed, error %u\n", GetLastError());
+    ret = WaitForSingleObject(thread, 5000);
+    ok(ret == WAIT_OBJECT_0, "WaitForSingleObject returned %x\n", ret);
+    CloseHandle(thread);
+    DestroyWindow(params.hwnd);
+    for (i = 0; i < 100; i++)
+    {
+        ret = PeekMessageA(&msg, 0, 0, 0, PM_REMOVE);
+        ok(ret && msg.message == WM_USER + i, "%d: got ret %d msg %04x\n", i, ret, msg.message);
+    }
+    ret = PeekMessageA(&msg, 0, 0, 0, PM_REMOVE);
+    ok(ret && msg.message == WM_USER + 101, "got ret %d msg %04x\n", ret, msg.message);
+    ret = PeekMessageA(&msg, 0, 0, 0, PM_REMOVE);
+    ok(!ret, "got unexpected msg %04x\n", msg.message);
+
+    /* except for the first WM_QUIT, which becomes a quit message */
+    params.hwnd = CreateWindowExW(0, staticW, NULL, WS_POPUP, 0,0,0,0,0,0,0, NULL);
+    ok(params.hwnd != NULL, "CreateWindowEx failed\n");
+    flush_events();
+    thread = CreateThread(NULL, 0, post_quit_thread, &params, 0, &tid);
+    ok(thread != NULL, "CreateThread failed, error %u\n", GetLastError());
+    ret = WaitForSingleObject(thread, 5000);
+    ok(ret == WAIT_OBJECT_0, "WaitForSingleObject returned %x\n", ret);
+    CloseHandle(thread);
+    DestroyWindow(params.hwnd);
+    ret = PeekMessageA(&msg, 0, 0, 0, PM_REMOVE);
+    ok(ret && msg.message == WM_QUIT && !msg.hwnd && msg.wParam == 0x1234,
+       "got ret %d hwnd %p msg %04x wParam %lx\n", ret, msg.hwnd, msg.message, msg.wParam);
+    ret = PeekMessageA(&msg, 0, 0, 0, PM_REMOVE);
+    ok(!ret, "got unexpected msg %04x\n", msg.message);
+
+    /* messages posted by other threads and by the current thread come out in the order they were posted */
+    params.hwnd = CreateWindowExW(0, staticW, NULL, WS_POPUP, 0,0,0,0,0,0,0, NULL);
+    ok(params.hwnd != NULL, "CreateWindowEx failed\n");
+    flush_events();
+    post_mixed_messages(params.hwnd, 20);
+    for (i = 0; i < 20; i++)
+    {
+        ret = PeekMessageA(&msg, 0, 0, 0, PM_REMOVE);
+        ok(ret && msg.message == WM_USER + i && msg.wParam == i,
+           "%d: got ret %d msg %04x wParam %lx\n", i, ret, msg.message, msg.wParam);
+    }
+    ret = PeekMessageA(&msg, 0, 0, 0, PM_REMOVE);
+    ok(!ret, "got unexpected msg %04x\n", msg.message);
+
+    /* also after a window filter has moved the messages of the other threads to the server */
+    post_mixed_messages(params.hwnd, 20);
+    ret = PeekMessageA(&msg, params.hwnd, WM_USER + 100, WM_USER + 100, PM_NOREMOVE);
+    ok(!ret, "got unexpected msg %04x\n", msg.message);
+    for (i = 0; i < 20; i++)
+    {
+        ret = PeekMessageA(&msg, 0, 0, 0, PM_REMOVE);
+        ok(ret && msg.message == WM_USER + i && msg.wParam == i,
+           "%d: got ret %d msg %04x wParam %lx\n", i, ret, msg.message, msg.wParam);
+    }
+    ret = PeekMessageA(&msg, 0, 0, 0, PM_REMOVE);
+    ok(!ret, "got unexpected msg %04x\n", msg.message);
+    DestroyWindow(params.hwnd);
+}
+
 static LPARAM g_broadcast_lparam;
 static LRESULT WINAPI broadcast_test_proc(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam)
 {
@@ -14900,6 +15097,98 @@ static DWORD CALLBACK do_wait_idle_child_thread( void *arg )
     return 0;
 }
 
+static LRESULT CALLBACK copydata_wnd_proc( HWND hwnd, UINT msg, WPARAM wp, LPARAM lp )
+{
+    switch (msg)
+    {
+    case WM_COPYDATA:
+    {
+        const COPYDATASTRUCT *cds = (const COPYDATASTRUCT *)lp;
+        const BYTE *data = cds->lpData;
+        DWORD i;
+
+        if (cds->dwData != 0x1234) return 0;
+        for (i = 0; i < cds->cbData; i++) if (data[i] != (BYTE)i) return 0;
+        return cds->cbData;
+    }
+    case WM_GETTEXT:
+        if (!wp) return 0;
+        memset( (char *)lp, 'a', wp - 1 );
+        ((char *)lp)[wp - 1] = 0;
+        return wp - 1;
+    }
+    return DefWindowProcA( hwnd, msg, wp, lp );
+}
+
+static void do_copydata_child( HWND hwnd )
+{
+    COPYDATASTRUCT cds;
+    WCHAR *text;
+    BYTE *data;
+    LRESULT res;
+    DWORD i, size;
+
+    data = HeapAlloc( GetProcessHeap(), 0, 0x20000 );
+    text = HeapAlloc( GetProcessHeap(), 0, 0x2000 * sizeof(WCHAR) );
+    for (i = 0; i < 0x20000; i++) data[i] = i;
+
+    /* small messages go through the server, large ones through shared memory */
+    for (size = 0x10; size <= 0x20000; size *= 0x10)
+    {
+        cds.dwData = 0x1234;
+        cds.cbData = size;
+        cds.lpData = data;
+        res = SendMessageA( hwnd, WM_COPYDATA, 0, (LPARAM)&cds );
+        ok( res == size, "WM_COPYDATA of %x bytes returned %lx\n", size, res );
+    }
+
+    for (i = 0; i < 2; i++)
+    {
+        memset( text, 0, 0x2000 * sizeof(WCHAR) );
+        res = SendMessageW( hwnd, WM_GETTEXT, 0x2000, (LPARAM)text );
+        ok( res == 0x1fff, "WM_GETTEXT returned %lx\n", res );
+        ok( text[0] == 'a' && text[0x1ffe] == 'a' && !text[0x1fff], "wrong text\n" );
+    }
+
+    HeapFree( GetProcessHeap(), 0, data );
+    HeapFree( GetProcessHeap(), 0, text );
+}
+
+static void test_copydata_other_process( char *argv0 )
+{
+    char path[MAX_PATH];
+    PROCESS_INFORMATION pi;
+    STARTUPINFOA startup;
+    WNDCLASSA cls;
+    HWND hwnd;
+    MSG msg;
+    BOOL ret;
+
+    memset( &cls, 0, sizeof(cls) );
+    cls.lpfnWndProc = copydata_wnd_proc;
+    cls.hInstance = GetModuleHandleA( 0 );
+    cls.lpszClassName = "CopyDataClass";
+    RegisterClassA( &cls );
+    hwnd = CreateWindowA( "CopyDataClass", "test", WS_POPUP, 0, 0, 10, 10, 0, 0, 0, NULL );
+    ok( hwnd != 0, "CreateWindow failed err %u\n", GetLastError() );
+
+    memset( &startup, 0, sizeof(startup) );
+    startup.cb = sizeof(startup);
+    sprintf( path, "%s msg copydata %p", argv0, hwnd );
+    ret = CreateProcessA( NULL, path, NULL, NULL, FALSE, 0, NULL, NULL, &startup, &pi );
+    ok( ret, "CreateProcess '%s' failed err %u.\n", path, GetLastError() );
+    if (ret)
+    {
+        while (MsgWaitForMultipleObjects( 1, &pi.hProcess, FALSE, 5000, QS_ALLINPUT ) == WAIT_OBJECT_0 + 1)
+            while (PeekMessageA( &msg, 0, 0, 0, PM_REMOVE )) DispatchMessageA( &msg );
+        winetest_wait_child_process( pi.hProcess );
+        CloseHandle( pi.hProcess );
+        CloseHandle( pi.hThread );
+    }
+    DestroyWindow( hwnd );
+    UnregisterClassA( "CopyDataClass", GetModuleHandleA( 0 ) );
+}
+
 static void do_wait_idle_child( int arg )
 {
     WNDCLASSA cls;
@@ -16559,6 +16848,13 @@ START_TEST(msg)
     init_funcs();
 
     argc = winetest_get_mainargs( &test_argv );
+    if (argc >= 4 && !strcmp( test_argv[2], "copydata" ))
+    {
+        HWND hwnd;
+        sscanf( test_argv[3], "%p", &hwnd );
+        do_copydata_child( hwnd );
+        return;
+    }
     if (argc >= 3)
     {
         unsigned int arg;
@@ -16618,12 +16914,14 @@ START_TEST(msg)
     test_SetFocus();
     test_SetParent();
     test_PostMessage();
+    test_PostMessage_other_thread();
     test_broadcast();
     test_ShowWindow();
     test_PeekMessage();
     test_PeekMessage2();
     test_PeekMessage3();
     test_WaitForInputIdle( test_argv[0] );
+    test_copydata_other_process( test_argv[0] );
     test_scrollwindowex();
     test_messages();
     test_setwindowpos();
@@ -3032,6 +3032,119 @@ static void test_vis_rgn( HWND hwnd )
     ReleaseDC( hwnd, hdc );
 }
 
+static BOOL is_point_visible_ex( HWND hwnd, int x, int y, DWORD flags )
+{
+    HRGN hrgn = CreateRectRgn( 0, 0, 0, 0 );
+    POINT pt;
+    BOOL ret;
+    HDC hdc;
+
+    pt.x = x;
+    pt.y = y;
+    MapWindowPoints( hwnd, 0, &pt, 1 );
+    hdc = GetDCEx( hwnd, 0, flags );
+    ok( GetRandomRgn( hdc, hrgn, SYSRGN ) != 0, "GetRandomRgn failed\n" );
+    ret = PtInRegion( hrgn, pt.x, pt.y );
+    ReleaseDC( hwnd, hdc );
+    DeleteObject( hrgn );
+    return ret;
+}
+
+static BOOL is_point_visible( HWND hwnd, int x, int y )
+{
+    return is_point_visible_ex( hwnd, x, y, DCX_CACHE | DCX_USESTYLE );
+}
+
+static void test_vis_rgn_children(void)
+{
+    HWND parent, cover, other, children[500];
+    DWORD style;
+    int i;
+
+    parent = CreateWindowExA( 0, "MainWindowClass", NULL, WS_POPUP | WS_VISIBLE | WS_CLIPCHILDREN,
+                              0, 0, 500, 500, 0, 0, GetModuleHandleA(NULL), NULL );
+    ok( parent != 0, "CreateWindowEx failed\n" );
+    for (i = 0; i < COUNTOF(children); i++)
+    {
+        children[i] = CreateWindowExA( 0, "static", NULL, WS_CHILD | WS_VISIBLE | WS_CLIPSIBLINGS,
+                                       (i % 25) * 20, (i / 25) * 20, 20, 20, parent, 0, 0, NULL );
+        ok( children[i] != 0, "CreateWindowEx failed for child %d\n", i );
+    }
+    cover = CreateWindowExA( 0, "static", NULL, WS_CHILD | WS_CLIPSIBLINGS,
+                             10, 10, 20, 20, parent, 0, 0, NULL );
+    ok( cover != 0, "CreateWindowEx failed\n" );
+
+    other = CreateWindowExA( 0, "MainWindowClass", NULL, WS_POPUP,
+                             0, 0, 100, 100, 0, 0, GetModuleHandleA(NULL), NULL );
+    ok( other != 0, "CreateWindowEx failed\n" );
+
+    ok( is_point_visible( children[0], 15, 15 ), "point should be visible\n" );
+
+    /* the region depends on the flags it is requested with */
+    ok( !is_point_visible_ex( parent, 15, 15, DCX_CACHE | DCX_CLIPCHILDREN ), "point should be clipped\n" );
+    ok( is_point_visible_ex( parent, 15, 15, DCX_CACHE ), "point should be visible\n" );
+    ok( !is_point_visible_ex( parent, 15, 15, DCX_CACHE | DCX_CLIPCHILDREN ), "point should be clipped\n" );
+
+    /* and on the window style */
+    ok( !is_point_visible( parent, 15, 15 ), "point should be clipped\n" );
+    style = GetWindowLongA( parent, GWL_STYLE );
+    SetWindowLongA( parent, GWL_STYLE, style & ~WS_CLIPCHILDREN );
+    ok( is_point_visible( parent, 15, 15 ), "point should be visible\n" );
+    SetWindowLongA( parent, GWL_STYLE, style );
+    ok( !is_point_visible( parent, 15, 15 ), "point should be clipped\n" );
+
+    /* on the children of the window */
+    ok( !is_point_visible( parent, 25, 5 ), "point should be clipped\n" );
+    SetParent( children[1], other );
+    ok( is_point_visible( parent, 25, 5 ), "point should be visible\n" );
+    SetParent( children[1], parent );
+    ok( !is_point_visible( parent, 25, 5 ), "point should be clipped\n" );
+
+    /* and on the size of the parent */
+    ok( is_point_visible( children[COUNTOF(children) - 1], 15, 15 ), "point should be visible\n" );
+    SetWindowPos( parent, 0, 0, 0, 490, 490, SWP_NOMOVE | SWP_NOZORDER | SWP_NOACTIVATE );
+    ok( !is_point_visible( children[COUNTOF(children) - 1], 15, 15 ), "point should be clipped\n" );
+    SetWindowPos( parent, 0, 0, 0, 500, 500, SWP_NOMOVE | SWP_NOZORDER | SWP_NOACTIVATE );
+    ok( is_point_visible( children[COUNTOF(children) - 1], 15, 15 ), "point should be visible\n" );
+
+    /* showing, moving and shaping an overlapping sibling changes the visible region */
+    SetWindowPos( cover, HWND_TOP, 0, 0, 0, 0, SWP_NOMOVE | SWP_NOSIZE | SWP_SHOWWINDOW );
+    ok( !is_point_visible( children[0], 15, 15 ), "point should be covered\n" );
+    ok( is_point_visible( children[0], 5, 5 ), "point should be visible\n" );
+
+    SetWindowPos( cover, 0, 300, 450, 0, 0, SWP_NOSIZE | SWP_NOZORDER );
+    ok( is_point_visible( children[0], 15, 15 ), "point should be visible\n" );
+
+    SetWindowPos( cover, 0, 10, 10, 0, 0, SWP_NOSIZE | SWP_NOZORDER );
+    ok( !is_point_visible( children[0], 15, 15 ), "point should be covered\n" );
+
+    SetWindowRgn( cover, CreateRectRgn( 10, 10, 20, 20 ), TRUE );
+    ok( is_point_visible( children[0], 15, 15 ), "point should be visible\n" );
+    SetWindowRgn( cover, 0, TRUE );
+    ok( !is_point_visible( children[0], 15, 15 ), "point should be covered\n" );
+
+    /* moving the sibling below the window uncovers it */
+    SetWindowPos( cover, HWND_BOTTOM, 0, 0, 0, 0, SWP_NOMOVE | SWP_NOSIZE );
+    ok( is_point_visible( children[0], 15, 15 ), "point should be visible\n" );
+    SetWindowPos( cover, HWND_TOP, 0, 0, 0, 0, SWP_NOMOVE | SWP_NOSIZE );
+    ok( !is_point_visible( children[0], 15, 15 ), "point should be covered\n" );
+
+    /* so does hiding or destroying it */
+    ShowWindow( cover, SW_HIDE );
+    ok( is_point_visible( children[0], 15, 15 ), "point should be visible\n" );
+    ShowWindow( cover, SW_SHOWNA );
+    ok( !is_point_visible( children[0], 15, 15 ), "point should be covered\n" );
+    DestroyWindow( cover );
+    ok( is_point_visible( children[0], 15, 15 ), "point should be visible\n" );
+
+    /* moving the parent moves the region along */
+    SetWindowPos( parent, 0, 50, 50, 0, 0, SWP_NOSIZE | SWP_NOZORDER | SWP_NOACTIVATE );
+    ok( is_point_visible( children[0], 15, 15 ), "point should be visible\n" );
+
+    DestroyWindow( other );
+    DestroyWindow( parent );
+}
+
 static LRESULT WINAPI set_focus_on_activate_proc(HWND hwnd, UINT msg, WPARAM wp, LPARAM lp)
 {
     if (msg == WM_ACTIVATE && LOWORD(wp) == WA_ACTIVE)
@@ -9709,6 +9822,127 @@ static void test_winproc_limit(void)
     ok(i == 1, "winproc should be called once (%d)\n", i);
 }
 
+static DWORD WINAPI shared_window_desktop_thread(void *arg)
+{
+    HANDLE *events = arg;
+    HWND hwnd;
+
+    ok(SetThreadDesktop(events[0]), "SetThreadDesktop failed, error %u\n", GetLastError());
+    hwnd = CreateWindowExA(0, "static", "test", WS_POPUP, 30, 40, 60, 70, 0, 0, 0, 0);
+    ok(hwnd != 0, "CreateWindowEx failed\n");
+    events[1] = hwnd;
+    SetEvent(events[2]);
+    wait_for_event(events[3], 5000);
+    DestroyWindow(hwnd);
+    return 0;
+}
+
+static void test_shared_window_lookup(const char *argv0)
+{
+    HANDLE ready_event, next_event, thread, events[4];
+    PROCESS_INFORMATION info;
+    STARTUPINFOA startup;
+    HWND hwnd, child;
+    char cmd[MAX_PATH];
+    HDESK desktop;
+
+    hwnd = CreateWindowExA(0, "static", "test", WS_POPUP | WS_VISIBLE, 10, 20, 100, 50, 0, 0, 0, 0);
+    ok(hwnd != 0, "CreateWindowEx failed\n");
+    child = CreateWindowExA(0, "static", "test", WS_CHILD | WS_VISIBLE, 5, 5, 20, 20, hwnd, 0, 0, 0);
+    ok(child != 0, "CreateWindowEx failed\n");
+
+    desktop = CreateDesktopA("shared_window_test", NULL, NULL, 0, GENERIC_ALL, NULL);
+    ok(desktop != 0, "CreateDesktop failed, error %u\n", GetLastError());
+    events[0] = desktop;
+    events[1] = 0;
+    events[2] = CreateEventA(NULL, FALSE, FALSE, NULL);
+    events[3] = CreateEventA(NULL, FALSE, FALSE, NULL);
+    thread = CreateThread(NULL, 0, shared_window_desktop_thread, events, 0, NULL);
+    ok(wait_for_event(events[2], 5000), "didn't get thread event\n");
+
+    ready_event = CreateEventA(NULL, FALSE, FALSE, "test_shared_window_ready");
+    ok(ready_event != 0, "CreateEvent failed\n");
+    next_event = CreateEventA(NULL, FALSE, FALSE, "test_shared_window_next");
+    ok(next_event != 0, "CreateEvent failed\n");
+
+    sprintf(cmd, "%s win shared_window %p %p %p", argv0, hwnd, child, events[1]);
+    memset(&startup, 0, sizeof(startup));
+    startup.cb = sizeof(startup);
+    ok(CreateProcessA(NULL, cmd, NULL, NULL, FALSE, 0, NULL, NULL,
+                &startup, &info), "CreateProcess failed.\n");
+    ok(wait_for_event(ready_event, 5000), "didn't get ready_event\n");
+
+    /* the child process has to see the changes through the shared table */
+    SetWindowPos(hwnd, 0, 15, 25, 0, 0, SWP_NOSIZE | SWP_NOZORDER | SWP_NOACTIVATE);
+    ShowWindow(child, SW_HIDE);
+    SetEvent(events[3]);
+    WaitForSingleObject(thread, 5000);
+    SetEvent(next_event);
+
+    winetest_wait_child_process(info.hProcess);
+    CloseHandle(info.hProcess);
+    CloseHandle(info.hThread);
+    CloseHandle(ready_event);
+    CloseHandle(next_event);
+    CloseHandle(thread);
+    CloseHandle(events[2]);
+    CloseHandle(events[3]);
+    CloseDesktop(desktop);
+    DestroyWindow(hwnd);
+}
+
+static void shared_window_lookup_proc(HWND hwnd, HWND child, HWND other)
+{
+    HANDLE ready_event, next_event;
+    DWORD tid, pid;
+    RECT rect;
+
+    ready_event = OpenEventA(EVENT_MODIFY_STATE, FALSE, "test_shared_window_ready");
+    ok(ready_event != 0, "OpenEvent failed\n");
+    next_event = OpenEventA(SYNCHRONIZE, FALSE, "test_shared_window_next");
+    ok(next_event != 0, "OpenEvent failed\n");
+
+    ok(IsWindow(hwnd), "%p is not a window\n", hwnd);
+    ok(IsWindowVisible(child), "%p is not visible\n", child);
+    ok(GetParent(child) == hwnd, "got parent %p, expected %p\n", GetParent(child), hwnd);
+    if (pGetAncestor)
+        ok(pGetAncestor(child, GA_ROOT) == hwnd, "got root %p, expected %p\n",
+           pGetAncestor(child, GA_ROOT), hwnd);
+    tid = GetWindowThreadProcessId(hwnd, &pid);
+    ok(tid && tid != GetCurrentThreadId(), "got thread %04x\n", tid);
+    ok(pid && pid != GetCurrentProcessId(), "got process %04x\n", pid);
+    ok(GetWindowThreadProcessId(child, NULL) == tid, "got thread %04x, expected %04x\n",
+       GetWindowThreadProcessId(child, NULL), tid);
+    GetWindowRect(hwnd, &rect);
+    ok(rect.left == 10 && rect.top == 20 && rect.right == 110 && rect.bottom == 70,
+       "got window rect %s\n", wine_dbgstr_rect(&rect));
+    GetWindowRect(child, &rect);
+    ok(rect.left == 15 && rect.top == 25 && rect.right == 35 && rect.bottom == 45,
+       "got child rect %s\n", wine_dbgstr_rect(&rect));
+
+    /* window of another desktop */
+    ok(IsWindow(other), "%p is not a window\n", other);
+    GetWindowRect(other, &rect);
+    ok(rect.left == 30 && rect.top == 40 && rect.right == 90 && rect.bottom == 110,
+       "got other rect %s\n", wine_dbgstr_rect(&rect));
+    ok(GetWindowThreadProcessId(other, NULL) != tid, "got the same thread\n");
+
+    SetEvent(ready_event);
+    ok(wait_for_event(next_event, 5000), "didn't get next_event\n");
+
+    GetWindowRect(hwnd, &rect);
+    ok(rect.left == 15 && rect.top == 25 && rect.right == 115 && rect.bottom == 75,
+       "got window rect %s\n", wine_dbgstr_rect(&rect));
+    GetWindowRect(child, &rect);
+    ok(rect.left == 20 && rect.top == 30 && rect.right == 40 && rect.bottom == 50,
+       "got child rect %s\n", wine_dbgstr_rect(&rect));
+    ok(!IsWindowVisible(child), "%p is visible\n", child);
+    ok(!IsWindow(other), "%p is still a window\n", other);
+
+    CloseHandle(ready_event);
+    CloseHandle(next_event);
+}
+
 static void test_deferwindowpos(void)
 {
     HDWP hdwp, hdwp2;
@@ -9754,6 +9988,144 @@ todo_wine
     ok(ret, "got %d\n", ret);
 }
 
+static void test_deferwindowpos_children(void)
+{
+    HWND parent, children[50];
+    HDWP hdwp;
+    HRGN rgn;
+    RECT rect;
+    POINT pt;
+    BOOL ret;
+    int i;
+
+    parent = CreateWindowExA(0, "static", NULL, WS_POPUP | WS_VISIBLE, 100, 100, 400, 400, 0, 0, 0, NULL);
+    ok(parent != NULL, "CreateWindowEx failed\n");
+    for (i = 0; i < sizeof(children) / sizeof(children[0]); i++)
+    {
+        children[i] = CreateWindowExA(0, "static", NULL, WS_CHILD | WS_VISIBLE,
+                                      (i % 10) * 15, (i / 10) * 15, 10, 10, parent, 0, 0, NULL);
+        ok(children[i] != NULL, "CreateWindowEx failed\n");
+    }
+    flush_events( TRUE );
+    ValidateRect(parent, NULL);
+
+    hdwp = BeginDeferWindowPos(0);
+    ok(hdwp != NULL, "got %p\n", hdwp);
+    for (i = 0; i < sizeof(children) / sizeof(children[0]); i++)
+    {
+        hdwp = DeferWindowPos(hdwp, children[i], NULL, 200 + (i % 10) * 15, 200 + (i / 10) * 15, 12, 12,
+                              SWP_NOZORDER | SWP_NOACTIVATE | SWP_DEFERERASE);
+        ok(hdwp != NULL, "%d: DeferWindowPos failed, error %u\n", i, GetLastError());
+    }
+    ret = EndDeferWindowPos(hdwp);
+    ok(ret, "EndDeferWindowPos failed\n");
+
+    rgn = CreateRectRgn(0, 0, 0, 0);
+    GetUpdateRgn(parent, rgn, FALSE);
+    for (i = 0; i < sizeof(children) / sizeof(children[0]); i++)
+    {
+        GetWindowRect(children[i], &rect);
+        MapWindowPoints(0, parent, (POINT *)&rect, 2);
+        ok(rect.left == 200 + (i % 10) * 15 && rect.top == 200 + (i / 10) * 15 &&
+           rect.right == rect.left + 12 && rect.bottom == rect.top + 12,
+           "%d: wrong rect %s\n", i, wine_dbgstr_rect(&rect));
+
+        /* the old position must have been exposed in the parent */
+        pt.x = (i % 10) * 15 + 5;
+        pt.y = (i / 10) * 15 + 5;
+        ok(PtInRegion(rgn, pt.x, pt.y), "%d: old position %d,%d not exposed\n", i, pt.x, pt.y);
+    }
+    DeleteObject(rgn);
+    DestroyWindow(parent);
+}
+
+static WNDPROC defer_static_proc;
+static HWND defer_changing_other;
+static RECT defer_changing_rect;
+
+static LRESULT WINAPI defer_changing_proc(HWND hwnd, UINT msg, WPARAM wparam, LPARAM lparam)
+{
+    if (msg == WM_WINDOWPOSCHANGING && defer_changing_other)
+    {
+        GetWindowRect(defer_changing_other, &defer_changing_rect);
+        MapWindowPoints(0, GetParent(hwnd), (POINT *)&defer_changing_rect, 2);
+    }
+    return CallWindowProcA(defer_static_proc, hwnd, msg, wparam, lparam);
+}
+
+static void check_child_zorder(HWND parent, const HWND *expect, int count, int line)
+{
+    HWND hwnd = GetWindow(parent, GW_CHILD);
+    int i;
+
+    for (i = 0; i < count; i++)
+    {
+        ok_(__FILE__, line)(hwnd == expect[i], "%d: got %p, expected %p\n", i, hwnd, expect[i]);
+        hwnd = GetWindow(hwnd, GW_HWNDNEXT);
+    }
+    ok_(__FILE__, line)(!hwnd, "got unexpected window %p\n", hwnd);
+}
+
+static void test_deferwindowpos_siblings(void)
+{
+    static const UINT flags = SWP_NOMOVE | SWP_NOSIZE | SWP_NOACTIVATE;
+    HWND parent, a, b, c, expect[3];
+    HDWP hdwp;
+    BOOL ret;
+
+    parent = CreateWindowExA(0, "static", NULL, WS_POPUP | WS_VISIBLE, 100, 100, 200, 200, 0, 0, 0, NULL);
+    ok(parent != NULL, "CreateWindowEx failed\n");
+    a = CreateWindowExA(0, "static", NULL, WS_CHILD | WS_VISIBLE, 0, 0, 10, 10, parent, 0, 0, NULL);
+    ok(a != NULL, "CreateWindowEx failed\n");
+    b = CreateWindowExA(0, "static", NULL, WS_CHILD | WS_VISIBLE, 20, 0, 10, 10, parent, 0, 0, NULL);
+    ok(b != NULL, "CreateWindowEx failed\n");
+    c = CreateWindowExA(0, "static", NULL, WS_CHILD | WS_VISIBLE, 40, 0, 10, 10, parent, 0, 0, NULL);
+    ok(c != NULL, "CreateWindowEx failed\n");
+
+    /* each change sees the Z order left by the previous ones */
+    SetWindowPos(c, HWND_BOTTOM, 0, 0, 0, 0, flags);
+    SetWindowPos(b, HWND_TOP, 0, 0, 0, 0, flags);
+    SetWindowPos(a, HWND_TOP, 0, 0, 0, 0, flags);
+    expect[0] = a;
+    expect[1] = b;
+    expect[2] = c;
+    check_child_zorder(parent, expect, 3, __LINE__);
+
+    hdwp = BeginDeferWindowPos(2);
+    hdwp = DeferWindowPos(hdwp, b, HWND_TOP, 0, 0, 0, 0, flags);
+    hdwp = DeferWindowPos(hdwp, a, HWND_TOP, 0, 0, 0, 0, flags);
+    ok(hdwp != NULL, "DeferWindowPos failed, error %u\n", GetLastError());
+    ret = EndDeferWindowPos(hdwp);
+    ok(ret, "EndDeferWindowPos failed\n");
+    check_child_zorder(parent, expect, 3, __LINE__);
+
+    hdwp = BeginDeferWindowPos(2);
+    hdwp = DeferWindowPos(hdwp, c, a, 0, 0, 0, 0, flags);
+    hdwp = DeferWindowPos(hdwp, b, a, 0, 0, 0, 0, flags);
+    ok(hdwp != NULL, "DeferWindowPos failed, error %u\n", GetLastError());
+    ret = EndDeferWindowPos(hdwp);
+    ok(ret, "EndDeferWindowPos failed\n");
+    check_child_zorder(parent, expect, 3, __LINE__);
+
+    /* WM_WINDOWPOSCHANGING sees the windows moved before it at their new position */
+    defer_static_proc = (WNDPROC)SetWindowLongPtrA(b, GWLP_WNDPROC, (LONG_PTR)defer_changing_proc);
+    defer_changing_other = a;
+    SetRectEmpty(&defer_changing_rect);
+    hdwp = BeginDeferWindowPos(2);
+    hdwp = DeferWindowPos(hdwp, a, NULL, 50, 50, 10, 10, SWP_NOZORDER | SWP_NOACTIVATE);
+    hdwp = DeferWindowPos(hdwp, b, NULL, 60, 60, 10, 10, SWP_NOZORDER | SWP_NOACTIVATE);
+    ok(hdwp != NULL, "DeferWindowPos failed, error %u\n", GetLastError());
+    ret = EndDeferWindowPos(hdwp);
+    ok(ret, "EndDeferWindowPos failed\n");
+    ok(defer_changing_rect.left == 50 && defer_changing_rect.top == 50 &&
+       defer_changing_rect.right == 60 && defer_changing_rect.bottom == 60,
+       "got rect %s\n", wine_dbgstr_rect(&defer_changing_rect));
+    defer_changing_other = NULL;
+    check_child_zorder(parent, expect, 3, __LINE__);
+
+    DestroyWindow(parent);
+}
+
 static void test_LockWindowUpdate(HWND parent)
 {
     typedef struct
@@ -9897,6 +10269,17 @@ START_TEST(win)
         return;
     }
 
+    if (argc==6 && !strcmp(argv[2], "shared_window"))
+    {
+        HWND hwnd, child, other;
+
+        sscanf(argv[3], "%p", &hwnd);
+        sscanf(argv[4], "%p", &child);
+        sscanf(argv[5], "%p", &other);
+        shared_window_lookup_proc(hwnd, child, other);
+        return;
+    }
+
     if (argc==3 && !strcmp(argv[2], "winproc_limit"))
     {
         test_winproc_limit();
@@ -9982,6 +10365,7 @@ START_TEST(win)
     test_scroll();
     test_IsWindowUnicode();
     test_vis_rgn(hwndMain);
+    test_vis_rgn_children();
 
     test_AdjustWindowRect();
     test_window_styles();
@@ -10009,7 +10393,10 @@ START_TEST(win)
     test_GetMessagePos();
     test_activateapp(hwndMain);
     test_winproc_handles(argv[0]);
+    test_shared_window_lookup(argv[0]);
     test_deferwindowpos();
+    test_deferwindowpos_children();
+    test_deferwindowpos_siblings();
     test_LockWindowUpdate(hwndMain);
     test_desktop();
 
@@ -997,6 +997,49 @@ static void test_foregroundwindow(void)
     ok(timeout == timeout_old, "unexpected timeout %d\n", timeout);
 }
 
+static void test_registered_atoms(void)
+{
+    static const char name[] = "winetest_registered_atom";
+    HWINSTA w1, w2;
+    UINT atom1, atom2, len;
+    char buffer[64];
+    DWORD le;
+
+    w1 = GetProcessWindowStation();
+    ok( w1 != 0, "GetProcessWindowStation failed\n" );
+
+    atom1 = RegisterWindowMessageA( name );
+    ok( atom1 >= 0xc000, "RegisterWindowMessage returned %x\n", atom1 );
+    ok( RegisterWindowMessageA( name ) == atom1, "RegisterWindowMessage returned a different atom\n" );
+    ok( GlobalFindAtomA( name ) == atom1, "GlobalFindAtom returned a different atom\n" );
+
+    w2 = CreateWindowStationA( "winetest_atoms", 0, WINSTA_ALL_ACCESS, NULL );
+    le = GetLastError();
+    ok( w2 != 0 || le == ERROR_ACCESS_DENIED, "CreateWindowStation failed (%u)\n", le );
+    if (!w2)
+    {
+        win_skip( "Not enough privileges for CreateWindowStation\n" );
+        return;
+    }
+    ok( SetProcessWindowStation( w2 ), "SetProcessWindowStation failed\n" );
+
+    /* registered atoms remembered from the previous window station must still be valid */
+    atom2 = RegisterWindowMessageA( name );
+    ok( atom2 >= 0xc000, "RegisterWindowMessage returned %x\n", atom2 );
+    memset( buffer, 0, sizeof(buffer) );
+    len = GlobalGetAtomNameA( atom2, buffer, sizeof(buffer) );
+    ok( len == strlen(name), "GlobalGetAtomName returned %u\n", len );
+    ok( !lstrcmpiA( buffer, name ), "wrong atom name %s\n", buffer );
+    ok( GlobalFindAtomA( name ) == atom2, "GlobalFindAtom returned a different atom\n" );
+    ok( RegisterClipboardFormatA( name ) == atom2, "RegisterClipboardFormat returned a different atom\n" );
+
+    ok( SetProcessWindowStation( w1 ), "SetProcessWindowStation failed\n" );
+    ok( RegisterWindowMessageA( name ) == atom1, "RegisterWindowMessage returned a different atom\n" );
+    ok( GlobalFindAtomA( name ) == atom1, "GlobalFindAtom returned a different atom\n" );
+
+    ok( CloseWindowStation( w2 ), "CloseWindowStation failed\n" );
+}
+
 START_TEST(winstation)
 {
     HMODULE hntdll = GetModuleHandleA("ntdll.dll");
@@ -1019,4 +1062,5 @@ START_TEST(winstation)
     test_handles();
     test_getuserobjectinformation();
     test_foregroundwindow();
+    test_registered_atoms();
 }
@@ -181,10 +181,12 @@ struct user_thread_info
     DWORD                         GetMessagePosVal;       /* Value for GetMessagePos */
     ULONG_PTR                     GetMessageExtraInfoVal; /* Value for GetMessageExtraInfo */
     UINT                          active_hooks;           /* Bitmap of active hooks */
+    unsigned int                  shared_window_table;    /* Id of the desktop shared window table, ~0 if none */
     struct user_key_state_info   *key_state;              /* Cache of global key state */
     HWND                          top_window;             /* Desktop window */
     HWND                          msg_window;             /* HWND_MESSAGE parent window */
     RAWINPUT                     *rawinput;
+    struct message_channel       *msg_channel;            /* Shared memory message channels */
 };
 
 C_ASSERT( sizeof(struct user_thread_info) <= sizeof(((TEB *)0)->Win32ClientInfo) );
@@ -240,6 +242,14 @@ extern LRESULT call_current_hook( HHOOK hhook, INT code, WPARAM wparam, LPARAM l
 extern DWORD get_input_codepage( void ) DECLSPEC_HIDDEN;
 extern BOOL map_wparam_AtoW( UINT message, WPARAM *wparam, enum wm_char_mapping mapping ) DECLSPEC_HIDDEN;
 extern NTSTATUS send_hardware_message( HWND hwnd, const INPUT *input, UINT flags ) DECLSPEC_HIDDEN;
+extern void destroy_message_channel(void) DECLSPEC_HIDDEN;
+extern ATOM register_atom( LPCWSTR name ) DECLSPEC_HIDDEN;
+extern ATOM register_atomA( LPCSTR name ) DECLSPEC_HIDDEN;
+extern void flush_registered_atoms(void) DECLSPEC_HIDDEN;
+extern NTSTATUS send_hardware_messages( const INPUT *inputs, UINT count, UINT flags, UINT *sent ) DECLSPEC_HIDDEN;
+extern DWORD get_local_queue_status( UINT flags ) DECLSPEC_HIDDEN;
+extern void destroy_local_queue(void) DECLSPEC_HIDDEN;
+extern void purge_local_messages( HWND hwnd ) DECLSPEC_HIDDEN;
 extern LRESULT MSG_SendInternalMessageTimeout( DWORD dest_pid, DWORD dest_tid,
                                                UINT msg, WPARAM wparam, LPARAM lparam,
                                                UINT flags, UINT timeout, PDWORD_PTR res_ptr ) DECLSPEC_HIDDEN;
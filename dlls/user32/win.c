@@ -103,6 +103,16 @@ static inline void set_win_data( void *ptr, LONG_PTR val, UINT size )
 
 static void *user_handles[NB_USER_HANDLES];
 
+/* shared window tables mapped in this process, one per desktop */
+struct shared_window_table
+{
+    struct list                 entry;
+    unsigned int                id;
+    const struct shared_window *windows;
+};
+
+static struct list shared_window_tables = LIST_INIT( shared_window_tables );
+
 /***********************************************************************
  *           alloc_user_handle
  */
@@ -187,6 +197,190 @@ void *free_user_handle( HANDLE handle, enum user_obj_type type )
 }
 
 
+static inline void shared_memory_barrier(void)
+{
+#ifdef __GNUC__
+    __sync_synchronize();
+#endif
+}
+
+
+/***********************************************************************
+ *           find_shared_window_table
+ *
+ * Find a shared window table mapped by this process.
+ */
+static const struct shared_window *find_shared_window_table( unsigned int id )
+{
+    static struct shared_window_table *last_table;
+    struct shared_window_table *table = last_table;
+    const struct shared_window *ret = NULL;
+
+    if (table && table->id == id) return table->windows;
+
+    USER_Lock();
+    LIST_FOR_EACH_ENTRY( table, &shared_window_tables, struct shared_window_table, entry )
+    {
+        if (table->id != id) continue;
+        last_table = table;
+        ret = table->windows;
+        break;
+    }
+    USER_Unlock();
+    return ret;
+}
+
+
+/***********************************************************************
+ *           get_shared_window_table
+ *
+ * Map the server's shared window table of the thread desktop on first use.
+ * The table only contains the windows of that desktop.
+ */
+static const struct shared_window *get_shared_window_table(void)
+{
+    struct user_thread_info *thread_info = get_user_thread_info();
+    struct shared_window_table *table;
+    const struct shared_window *ptr;
+    HANDLE mapping = 0;
+    unsigned int id = 0;
+
+    if (thread_info->shared_window_table == ~0u) return NULL;
+    if (thread_info->shared_window_table) return find_shared_window_table( thread_info->shared_window_table );
+
+    SERVER_START_REQ( get_shared_window_table )
+    {
+        if (!wine_server_call( req ))
+        {
+            mapping = wine_server_ptr_handle( reply->handle );
+            id = reply->id;
+        }
+    }
+    SERVER_END_REQ;
+
+    if (!mapping)
+    {
+        WARN( "failed to get the shared window table\n" );
+        thread_info->shared_window_table = ~0u;
+        return NULL;
+    }
+
+    USER_Lock();
+    if (!(ptr = find_shared_window_table( id )) && (ptr = MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 )))
+    {
+        if ((table = HeapAlloc( GetProcessHeap(), 0, sizeof(*table) )))
+        {
+            table->id = id;
+            table->windows = ptr;
+            list_add_tail( &shared_window_tables, &table->entry );
+        }
+        else
+        {
+            UnmapViewOfFile( (void *)ptr );
+            ptr = NULL;
+        }
+    }
+    USER_Unlock();
+    CloseHandle( mapping );
+
+    thread_info->shared_window_table = ptr ? id : ~0u;
+    if (!ptr) WARN( "failed to map the shared window table\n" );
+    return ptr;
+}
+
+
+/***********************************************************************
+ *           get_shared_window
+ *
+ * Get a consistent copy of the shared table entry of a window.
+ * Return FALSE if the server has to be asked instead.
+ */
+static BOOL get_shared_window( HWND hwnd, struct shared_window *info )
+{
+    const volatile struct shared_window *entry;
+    const struct shared_window *table;
+    WORD index = USER_HANDLE_TO_INDEX( hwnd );
+    unsigned int seq;
+
+    if (index >= NB_USER_HANDLES || !(table = get_shared_window_table())) return FALSE;
+
+    entry = &table[index];
+    for (;;)
+    {
+        /* the server is updating the entry while the sequence number is odd */
+        if ((seq = entry->seq) & 1) continue;
+        shared_memory_barrier();
+        *info = *(const struct shared_window *)entry;
+        shared_memory_barrier();
+        if (entry->seq == seq) break;
+    }
+
+    if (!info->handle) return FALSE;
+    return info->handle == (UINT)(UINT_PTR)hwnd || !HIWORD(hwnd) || HIWORD(hwnd) == 0xffff;
+}
+
+
+/***********************************************************************
+ *           get_shared_window_rectangles
+ *
+ * Compute the window rectangles from the shared window table,
+ * see get_window_rectangles in the server.
+ */
+static BOOL get_shared_window_rectangles( HWND hwnd, enum coords_relative relative,
+                                          RECT *rectWindow, RECT *rectClient )
+{
+    struct shared_window info, parent;
+    RECT window_rect, client_rect, rect;
+    user_handle_t handle;
+
+    if (!get_shared_window( hwnd, &info )) return FALSE;
+
+    SetRect( &window_rect, info.window.left, info.window.top, info.window.right, info.window.bottom );
+    SetRect( &client_rect, info.client.left, info.client.top, info.client.right, info.client.bottom );
+
+    switch (relative)
+    {
+    case COORDS_CLIENT:
+        rect = client_rect;
+        OffsetRect( &window_rect, -rect.left, -rect.top );
+        OffsetRect( &client_rect, -rect.left, -rect.top );
+        if (info.ex_style & WS_EX_LAYOUTRTL) mirror_rect( &rect, &window_rect );
+        break;
+    case COORDS_WINDOW:
+        rect = window_rect;
+        OffsetRect( &window_rect, -rect.left, -rect.top );
+        OffsetRect( &client_rect, -rect.left, -rect.top );
+        if (info.ex_style & WS_EX_LAYOUTRTL) mirror_rect( &rect, &client_rect );
+        break;
+    case COORDS_PARENT:
+        if (!info.parent) break;
+        if (!get_shared_window( wine_server_ptr_handle( info.parent ), &parent )) return FALSE;
+        if (parent.ex_style & WS_EX_LAYOUTRTL)
+        {
+            SetRect( &rect, parent.client.left, parent.client.top, parent.client.right, parent.client.bottom );
+            mirror_rect( &rect, &window_rect );
+            mirror_rect( &rect, &client_rect );
+        }
+        break;
+    case COORDS_SCREEN:
+        for (handle = info.parent; handle; handle = parent.parent)
+        {
+            if (!get_shared_window( wine_server_ptr_handle( handle ), &parent )) return FALSE;
+            if (!parent.parent) break;  /* desktop window */
+            OffsetRect( &window_rect, parent.client.left, parent.client.top );
+            OffsetRect( &client_rect, parent.client.left, parent.client.top );
+        }
+        break;
+    default:
+        return FALSE;
+    }
+
+    if (rectWindow) *rectWindow = window_rect;
+    if (rectClient) *rectClient = client_rect;
+    return TRUE;
+}
+
+
 /***********************************************************************
  *           create_window_handle
  *
@@ -363,15 +557,24 @@ static HWND *list_window_parents( HWND hwnd )
     for (;;)
     {
         if (!(win = WIN_GetPtr( current ))) goto empty;
-        if (win == WND_OTHER_PROCESS) break;  /* need to do it the hard way */
         if (win == WND_DESKTOP)
         {
             if (!pos) goto empty;
             list[pos] = 0;
             return list;
         }
-        list[pos] = current = win->parent;
-        WIN_ReleasePtr( win );
+        if (win == WND_OTHER_PROCESS)
+        {
+            struct shared_window info;
+
+            if (!get_shared_window( current, &info )) break;  /* need to do it the hard way */
+            list[pos] = current = wine_server_ptr_handle( info.parent );
+        }
+        else
+        {
+            list[pos] = current = win->parent;
+            WIN_ReleasePtr( win );
+        }
         if (!current) return list;
         if (++pos == size - 1)
         {
@@ -593,7 +796,7 @@ void register_window_surface( struct window_surface *old, struct window_surface
  */
 void flush_window_surfaces( BOOL idle )
 {
-    static DWORD last_idle;
+    static DWORD last_idle, last_flush;
     DWORD now;
     struct window_surface *surface;
 
@@ -602,7 +805,10 @@ void flush_window_surfaces( BOOL idle )
     if (idle) last_idle = now;
     /* if not idle, we only flush if there's evidence that the app never goes idle */
     else if ((int)(now - last_idle) < 50) goto done;
+    /* and then not more often than the screen can show it */
+    else if ((int)(now - last_flush) < 16) goto done;
 
+    last_flush = now;
     LIST_FOR_EACH_ENTRY( surface, &window_surfaces, struct window_surface, entry )
         surface->funcs->flush( surface );
 done:
@@ -710,6 +916,10 @@ HWND WIN_GetFullHandle( HWND hwnd )
     }
     else  /* may belong to another process */
     {
+        struct shared_window info;
+
+        if (get_shared_window( hwnd, &info )) return wine_server_ptr_handle( info.handle );
+
         SERVER_START_REQ( get_window_info )
         {
             req->handle = wine_server_user_handle( hwnd );
@@ -915,6 +1125,8 @@ BOOL WIN_GetRectangles( HWND hwnd, enum coords_relative relative, RECT *rectWind
     }
 
 other_process:
+    if (get_shared_window_rectangles( hwnd, relative, rectWindow, rectClient )) return TRUE;
+
     SERVER_START_REQ( get_window_rectangles )
     {
         req->handle = wine_server_user_handle( hwnd );
@@ -1021,6 +1233,7 @@ LRESULT WIN_DestroyWindow( HWND hwnd )
 
     USER_Driver->pDestroyWindow( hwnd );
 
+    purge_local_messages( hwnd );
     free_window_handle( hwnd );
     return 0;
 }
@@ -2253,11 +2466,23 @@ static LONG_PTR WIN_GetWindowLong( HWND hwnd, INT offset, UINT size, BOOL unicod
 
     if (wndPtr == WND_OTHER_PROCESS)
     {
+        struct shared_window info;
+
         if (offset == GWLP_WNDPROC)
         {
             SetLastError( ERROR_ACCESS_DENIED );
             return 0;
         }
+        if ((offset == GWL_STYLE || offset == GWL_EXSTYLE || offset == GWLP_ID) &&
+            get_shared_window( hwnd, &info ))
+        {
+            switch(offset)
+            {
+            case GWL_STYLE:   return info.style;
+            case GWL_EXSTYLE: return info.ex_style;
+            default:          return info.id;
+            }
+        }
         SERVER_START_REQ( set_window_info )
         {
             req->handle = wine_server_user_handle( hwnd );
@@ -2844,6 +3069,7 @@ INT WINAPI GetWindowTextLengthW( HWND hwnd )
  */
 BOOL WINAPI IsWindow( HWND hwnd )
 {
+    struct shared_window info;
     WND *ptr;
     BOOL ret;
 
@@ -2857,6 +3083,8 @@ BOOL WINAPI IsWindow( HWND hwnd )
     }
 
     /* check other processes */
+    if (get_shared_window( hwnd, &info )) return TRUE;
+
     SERVER_START_REQ( get_window_info )
     {
         req->handle = wine_server_user_handle( hwnd );
@@ -2872,6 +3100,7 @@ BOOL WINAPI IsWindow( HWND hwnd )
  */
 DWORD WINAPI GetWindowThreadProcessId( HWND hwnd, LPDWORD process )
 {
+    struct shared_window info;
     WND *ptr;
     DWORD tid = 0;
 
@@ -2891,6 +3120,12 @@ DWORD WINAPI GetWindowThreadProcessId( HWND hwnd, LPDWORD process )
     }
 
     /* check other processes */
+    if (ptr == WND_OTHER_PROCESS && get_shared_window( hwnd, &info ))
+    {
+        if (process) *process = info.pid;
+        return info.tid;
+    }
+
     SERVER_START_REQ( get_window_info )
     {
         req->handle = wine_server_user_handle( hwnd );
@@ -2921,7 +3156,17 @@ HWND WINAPI GetParent( HWND hwnd )
     if (wndPtr == WND_DESKTOP) return 0;
     if (wndPtr == WND_OTHER_PROCESS)
     {
-        LONG style = GetWindowLongW( hwnd, GWL_STYLE );
+        struct shared_window info;
+        LONG style;
+
+        if (get_shared_window( hwnd, &info ))
+        {
+            if (info.style & WS_POPUP) retvalue = wine_server_ptr_handle( info.owner );
+            else if (info.style & WS_CHILD) retvalue = wine_server_ptr_handle( info.parent );
+            return retvalue;
+        }
+
+        style = GetWindowLongW( hwnd, GWL_STYLE );
         if (style & (WS_POPUP | WS_CHILD))
         {
             SERVER_START_REQ( get_window_tree )
@@ -2054,46 +2054,185 @@ done:
 }
 
 
+/* window position change being applied by set_window_pos or set_window_pos_list */
+struct window_pos_change
+{
+    HWND                   hwnd;
+    HWND                   insert_after;
+    UINT                   swp_flags;
+    RECT                   window_rect;
+    RECT                   client_rect;
+    RECT                   visible_rect;
+    const RECT            *valid_rects;
+    RECT                   old_window_rect;
+    RECT                   old_visible_rect;
+    RECT                   old_client_rect;
+    struct window_surface *old_surface;
+    struct window_surface *new_surface;
+};
+
 /***********************************************************************
- *		set_window_pos
+ *		begin_window_pos_change
  *
- * Backend implementation of SetWindowPos.
+ * Let the driver prepare the change and save the current state of the window.
+ * Return the locked window pointer, or NULL on failure.
  */
-BOOL set_window_pos( HWND hwnd, HWND insert_after, UINT swp_flags,
-                     const RECT *window_rect, const RECT *client_rect, const RECT *valid_rects )
+static WND *begin_window_pos_change( struct window_pos_change *change )
 {
+    HWND parent = GetAncestor( change->hwnd, GA_PARENT );
     WND *win;
-    HWND surface_win = 0, parent = GetAncestor( hwnd, GA_PARENT );
-    BOOL ret, needs_update = FALSE;
-    RECT visible_rect, old_visible_rect, old_window_rect, old_client_rect;
-    struct window_surface *old_surface, *new_surface = NULL;
 
+    change->new_surface = NULL;
     if (!parent || parent == GetDesktopWindow())
     {
-        new_surface = &dummy_surface;  /* provide a default surface for top-level windows */
-        window_surface_add_ref( new_surface );
+        change->new_surface = &dummy_surface;  /* provide a default surface for top-level windows */
+        window_surface_add_ref( change->new_surface );
     }
-    visible_rect = *window_rect;
-    USER_Driver->pWindowPosChanging( hwnd, insert_after, swp_flags,
-                                     window_rect, client_rect, &visible_rect, &new_surface );
+    change->visible_rect = change->window_rect;
+    USER_Driver->pWindowPosChanging( change->hwnd, change->insert_after, change->swp_flags,
+                                     &change->window_rect, &change->client_rect,
+                                     &change->visible_rect, &change->new_surface );
 
-    WIN_GetRectangles( hwnd, COORDS_SCREEN, &old_window_rect, NULL );
+    WIN_GetRectangles( change->hwnd, COORDS_SCREEN, &change->old_window_rect, NULL );
 
-    if (!(win = WIN_GetPtr( hwnd )) || win == WND_DESKTOP || win == WND_OTHER_PROCESS)
+    if (!(win = WIN_GetPtr( change->hwnd )) || win == WND_DESKTOP || win == WND_OTHER_PROCESS)
     {
-        if (new_surface) window_surface_release( new_surface );
-        return FALSE;
+        if (change->new_surface) window_surface_release( change->new_surface );
+        return NULL;
+    }
+    change->old_visible_rect = win->visible_rect;
+    change->old_client_rect = win->rectClient;
+    change->old_surface = win->surface;
+    /* force refreshing non-client area */
+    if (change->old_surface != change->new_surface) change->swp_flags |= SWP_FRAMECHANGED;
+    return win;
+}
+
+/***********************************************************************
+ *		apply_window_pos_change
+ *
+ * Store the new window state once the server accepted it. The window must be locked.
+ */
+static void apply_window_pos_change( WND *win, const struct window_pos_change *change,
+                                     UINT new_style, UINT new_ex_style )
+{
+    win->dwStyle    = new_style;
+    win->dwExStyle  = new_ex_style;
+    win->rectWindow = change->window_rect;
+    win->rectClient = change->client_rect;
+    win->visible_rect = change->visible_rect;
+    win->surface      = change->new_surface;
+    if (GetWindowLongW( win->parent, GWL_EXSTYLE ) & WS_EX_LAYOUTRTL)
+    {
+        RECT client;
+        GetClientRect( win->parent, &client );
+        mirror_rect( &client, &win->rectWindow );
+        mirror_rect( &client, &win->rectClient );
+        mirror_rect( &client, &win->visible_rect );
+    }
+    /* if an RTL window is resized the children have moved */
+    if (win->dwExStyle & WS_EX_LAYOUTRTL &&
+        change->client_rect.right - change->client_rect.left !=
+        change->old_client_rect.right - change->old_client_rect.left)
+        win->flags |= WIN_CHILDREN_MOVED;
+}
+
+/***********************************************************************
+ *		end_window_pos_change
+ *
+ * Finish a change accepted by the server: update the surfaces and notify the driver.
+ * The window must be locked, the lock is released.
+ */
+static void end_window_pos_change( WND *win, struct window_pos_change *change,
+                                   HWND surface_win, BOOL needs_update )
+{
+    const RECT *valid_rects = change->valid_rects;
+    UINT swp_flags = change->swp_flags;
+
+    if (needs_update) update_surface_region( surface_win );
+    if (((swp_flags & SWP_AGG_NOPOSCHANGE) != SWP_AGG_NOPOSCHANGE) ||
+        (swp_flags & (SWP_HIDEWINDOW | SWP_SHOWWINDOW | SWP_STATECHANGED | SWP_FRAMECHANGED)))
+        invalidate_dce( win, &change->old_window_rect );
+
+    WIN_ReleasePtr( win );
+
+    TRACE( "win %p surface %p -> %p\n", change->hwnd, change->old_surface, change->new_surface );
+    register_window_surface( change->old_surface, change->new_surface );
+    if (change->old_surface)
+    {
+        if (!IsRectEmpty( valid_rects ))
+        {
+            move_window_bits( change->hwnd, change->old_surface, change->new_surface,
+                              &change->visible_rect, &change->old_visible_rect,
+                              &change->window_rect, valid_rects );
+            valid_rects = NULL;  /* prevent the driver from trying to also move the bits */
+        }
+        window_surface_release( change->old_surface );
+    }
+    else if (surface_win && surface_win != change->hwnd)
+    {
+        if (!IsRectEmpty( valid_rects ))
+        {
+            const RECT *client_rect = &change->client_rect;
+            const RECT *visible_rect = &change->visible_rect;
+            const RECT *old_visible_rect = &change->old_visible_rect;
+            const RECT *old_client_rect = &change->old_client_rect;
+            RECT rects[2];
+            int x_offset = old_visible_rect->left - visible_rect->left;
+            int y_offset = old_visible_rect->top - visible_rect->top;
+
+            /* if all that happened is that the whole window moved, copy everything */
+            if (!(swp_flags & SWP_FRAMECHANGED) &&
+                old_visible_rect->right  - visible_rect->right  == x_offset &&
+                old_visible_rect->bottom - visible_rect->bottom == y_offset &&
+                old_client_rect->left    - client_rect->left    == x_offset &&
+                old_client_rect->right   - client_rect->right   == x_offset &&
+                old_client_rect->top     - client_rect->top     == y_offset &&
+                old_client_rect->bottom  - client_rect->bottom  == y_offset &&
+                EqualRect( &valid_rects[0], client_rect ))
+            {
+                rects[0] = *visible_rect;
+                rects[1] = *old_visible_rect;
+                valid_rects = rects;
+            }
+            move_window_bits_parent( change->hwnd, surface_win, &change->window_rect, valid_rects );
+            valid_rects = NULL;  /* prevent the driver from trying to also move the bits */
+        }
     }
-    old_visible_rect = win->visible_rect;
-    old_client_rect = win->rectClient;
-    old_surface = win->surface;
-    if (old_surface != new_surface) swp_flags |= SWP_FRAMECHANGED;  /* force refreshing non-client area */
+
+    USER_Driver->pWindowPosChanged( change->hwnd, change->insert_after, swp_flags,
+                                    &change->window_rect, &change->client_rect,
+                                    &change->visible_rect, valid_rects, change->new_surface );
+}
+
+
+/***********************************************************************
+ *		set_window_pos
+ *
+ * Backend implementation of SetWindowPos.
+ */
+BOOL set_window_pos( HWND hwnd, HWND insert_after, UINT swp_flags,
+                     const RECT *window_rect, const RECT *client_rect, const RECT *valid_rects )
+{
+    struct window_pos_change change;
+    WND *win;
+    HWND surface_win = 0;
+    BOOL ret, needs_update = FALSE;
+
+    change.hwnd         = hwnd;
+    change.insert_after = insert_after;
+    change.swp_flags    = swp_flags;
+    change.window_rect  = *window_rect;
+    change.client_rect  = *client_rect;
+    change.valid_rects  = valid_rects;
+
+    if (!(win = begin_window_pos_change( &change ))) return FALSE;
 
     SERVER_START_REQ( set_window_pos )
     {
         req->handle        = wine_server_user_handle( hwnd );
         req->previous      = wine_server_user_handle( insert_after );
-        req->swp_flags     = swp_flags;
+        req->swp_flags     = change.swp_flags;
         req->window.left   = window_rect->left;
         req->window.top    = window_rect->top;
         req->window.right  = window_rect->right;
@@ -2102,112 +2241,131 @@ BOOL set_window_pos( HWND hwnd, HWND insert_after, UINT swp_flags,
         req->client.top    = client_rect->top;
         req->client.right  = client_rect->right;
         req->client.bottom = client_rect->bottom;
-        if (!EqualRect( window_rect, &visible_rect ) || !IsRectEmpty( &valid_rects[0] ))
+        if (!EqualRect( window_rect, &change.visible_rect ) || !IsRectEmpty( &valid_rects[0] ))
         {
-            wine_server_add_data( req, &visible_rect, sizeof(visible_rect) );
+            wine_server_add_data( req, &change.visible_rect, sizeof(change.visible_rect) );
             if (!IsRectEmpty( &valid_rects[0] ))
                 wine_server_add_data( req, valid_rects, 2 * sizeof(*valid_rects) );
         }
-        if (new_surface) req->paint_flags |= SET_WINPOS_PAINT_SURFACE;
+        if (change.new_surface) req->paint_flags |= SET_WINPOS_PAINT_SURFACE;
         if (win->pixel_format) req->paint_flags |= SET_WINPOS_PIXEL_FORMAT;
 
         if ((ret = !wine_server_call( req )))
         {
-            win->dwStyle    = reply->new_style;
-            win->dwExStyle  = reply->new_ex_style;
-            win->rectWindow = *window_rect;
-            win->rectClient = *client_rect;
-            win->visible_rect = visible_rect;
-            win->surface      = new_surface;
-            surface_win       = wine_server_ptr_handle( reply->surface_win );
-            needs_update      = reply->needs_update;
-            if (GetWindowLongW( win->parent, GWL_EXSTYLE ) & WS_EX_LAYOUTRTL)
-            {
-                RECT client;
-                GetClientRect( win->parent, &client );
-                mirror_rect( &client, &win->rectWindow );
-                mirror_rect( &client, &win->rectClient );
-                mirror_rect( &client, &win->visible_rect );
-            }
-            /* if an RTL window is resized the children have moved */
-            if (win->dwExStyle & WS_EX_LAYOUTRTL &&
-                client_rect->right - client_rect->left != old_client_rect.right - old_client_rect.left)
-                win->flags |= WIN_CHILDREN_MOVED;
+            apply_window_pos_change( win, &change, reply->new_style, reply->new_ex_style );
+            surface_win  = wine_server_ptr_handle( reply->surface_win );
+            needs_update = reply->needs_update;
         }
     }
     SERVER_END_REQ;
 
-    if (ret)
+    if (ret) end_window_pos_change( win, &change, surface_win, needs_update );
+    else
     {
-        if (needs_update) update_surface_region( surface_win );
-        if (((swp_flags & SWP_AGG_NOPOSCHANGE) != SWP_AGG_NOPOSCHANGE) ||
-            (swp_flags & (SWP_HIDEWINDOW | SWP_SHOWWINDOW | SWP_STATECHANGED | SWP_FRAMECHANGED)))
-            invalidate_dce( win, &old_window_rect );
+        WIN_ReleasePtr( win );
+        if (change.new_surface) window_surface_release( change.new_surface );
     }
+    return ret;
+}
 
-    WIN_ReleasePtr( win );
 
-    if (ret)
+/***********************************************************************
+ *		set_window_pos_list
+ *
+ * Apply the position changes of several windows of the current thread with a single
+ * server request, so that the exposed areas of their parents are only redrawn once.
+ * The results are stored in the ret array.
+ */
+static void set_window_pos_list( struct window_pos_change *changes, UINT count, BOOL *ret )
+{
+    struct window_pos_info *info;
+    struct window_pos_result *results;
+    WND *win;
+    UINT i;
+
+    if (!(info = HeapAlloc( GetProcessHeap(), HEAP_ZERO_MEMORY,
+                            count * (sizeof(*info) + sizeof(*results) ))))
     {
-        TRACE( "win %p surface %p -> %p\n", hwnd, old_surface, new_surface );
-        register_window_surface( old_surface, new_surface );
-        if (old_surface)
-        {
-            if (!IsRectEmpty( valid_rects ))
-            {
-                move_window_bits( hwnd, old_surface, new_surface, &visible_rect,
-                                  &old_visible_rect, window_rect, valid_rects );
-                valid_rects = NULL;  /* prevent the driver from trying to also move the bits */
-            }
-            window_surface_release( old_surface );
-        }
-        else if (surface_win && surface_win != hwnd)
+        for (i = 0; i < count; i++)
+            ret[i] = set_window_pos( changes[i].hwnd, changes[i].insert_after, changes[i].swp_flags,
+                                     &changes[i].window_rect, &changes[i].client_rect,
+                                     changes[i].valid_rects );
+        return;
+    }
+    results = (struct window_pos_result *)(info + count);
+
+    for (i = 0; i < count; i++)
+    {
+        struct window_pos_change *change = &changes[i];
+
+        if (!(win = begin_window_pos_change( change )))
         {
-            if (!IsRectEmpty( valid_rects ))
-            {
-                RECT rects[2];
-                int x_offset = old_visible_rect.left - visible_rect.left;
-                int y_offset = old_visible_rect.top - visible_rect.top;
-
-                /* if all that happened is that the whole window moved, copy everything */
-                if (!(swp_flags & SWP_FRAMECHANGED) &&
-                    old_visible_rect.right  - visible_rect.right  == x_offset &&
-                    old_visible_rect.bottom - visible_rect.bottom == y_offset &&
-                    old_client_rect.left    - client_rect->left   == x_offset &&
-                    old_client_rect.right   - client_rect->right  == x_offset &&
-                    old_client_rect.top     - client_rect->top    == y_offset &&
-                    old_client_rect.bottom  - client_rect->bottom == y_offset &&
-                    EqualRect( &valid_rects[0], client_rect ))
-                {
-                    rects[0] = visible_rect;
-                    rects[1] = old_visible_rect;
-                    valid_rects = rects;
-                }
-                move_window_bits_parent( hwnd, surface_win, window_rect, valid_rects );
-                valid_rects = NULL;  /* prevent the driver from trying to also move the bits */
-            }
+            ret[i] = FALSE;
+            continue;
         }
+        ret[i] = TRUE;
+        info[i].handle         = wine_server_user_handle( change->hwnd );
+        info[i].previous       = wine_server_user_handle( change->insert_after );
+        info[i].swp_flags      = change->swp_flags;
+        info[i].window.left    = change->window_rect.left;
+        info[i].window.top     = change->window_rect.top;
+        info[i].window.right   = change->window_rect.right;
+        info[i].window.bottom  = change->window_rect.bottom;
+        info[i].client.left    = change->client_rect.left;
+        info[i].client.top     = change->client_rect.top;
+        info[i].client.right   = change->client_rect.right;
+        info[i].client.bottom  = change->client_rect.bottom;
+        info[i].visible.left   = change->visible_rect.left;
+        info[i].visible.top    = change->visible_rect.top;
+        info[i].visible.right  = change->visible_rect.right;
+        info[i].visible.bottom = change->visible_rect.bottom;
+        if (!IsRectEmpty( change->valid_rects ))
+            memcpy( info[i].valid, change->valid_rects, sizeof(info[i].valid) );
+        if (change->new_surface) info[i].paint_flags |= SET_WINPOS_PAINT_SURFACE;
+        if (win->pixel_format) info[i].paint_flags |= SET_WINPOS_PIXEL_FORMAT;
+        WIN_ReleasePtr( win );
+    }
 
-        USER_Driver->pWindowPosChanged( hwnd, insert_after, swp_flags, window_rect,
-                                        client_rect, &visible_rect, valid_rects, new_surface );
+    SERVER_START_REQ( set_window_positions )
+    {
+        /* windows that failed to prepare have a null handle and fail on the server side too */
+        wine_server_add_data( req, info, count * sizeof(*info) );
+        wine_server_set_reply( req, results, count * sizeof(*results) );
+        if (wine_server_call( req )) memset( results, 0xff, count * sizeof(*results) );
     }
-    else if (new_surface) window_surface_release( new_surface );
+    SERVER_END_REQ;
 
-    return ret;
+    for (i = 0; i < count; i++)
+    {
+        struct window_pos_change *change = &changes[i];
+
+        if (!ret[i]) continue;
+        if (!(ret[i] = !results[i].status) ||
+            !(win = WIN_GetPtr( change->hwnd )) || win == WND_DESKTOP || win == WND_OTHER_PROCESS)
+        {
+            ret[i] = FALSE;
+            if (change->new_surface) window_surface_release( change->new_surface );
+            continue;
+        }
+        apply_window_pos_change( win, change, results[i].new_style, results[i].new_ex_style );
+        end_window_pos_change( win, change, wine_server_ptr_handle( results[i].surface_win ),
+                               results[i].needs_update );
+    }
+    HeapFree( GetProcessHeap(), 0, info );
 }
 
 
 /***********************************************************************
- *		USER_SetWindowPos
+ *		begin_set_window_pos
  *
- *     User32 internal function
+ * Validate the parameters of a position change and send the WM_WINDOWPOSCHANGING and
+ * WM_NCCALCSIZE messages. Return FALSE if the change must not be applied, with the
+ * function result in *ret.
  */
-BOOL USER_SetWindowPos( WINDOWPOS * winpos )
+static BOOL begin_set_window_pos( WINDOWPOS *winpos, RECT *window_rect, RECT *client_rect,
+                                  RECT *valid_rects, BOOL *ret )
 {
-    RECT newWindowRect, newClientRect, valid_rects[2];
-    UINT orig_flags;
-    
-    orig_flags = winpos->flags;
+    *ret = FALSE;
 
     /* First, check z-order arguments.  */
     if (!(winpos->flags & SWP_NOZORDER))
@@ -2226,7 +2384,11 @@ BOOL USER_SetWindowPos( WINDOWPOS * winpos )
 
             /* hwndInsertAfter must be a sibling of the window */
             if (!insertafter_parent) return FALSE;
-            if (insertafter_parent != parent) return TRUE;
+            if (insertafter_parent != parent)
+            {
+                *ret = TRUE;
+                return FALSE;
+            }
         }
     }
 
@@ -2246,7 +2408,7 @@ BOOL USER_SetWindowPos( WINDOWPOS * winpos )
         else if (winpos->cy > 32767) winpos->cy = 32767;
     }
 
-    if (!SWP_DoWinPosChanging( winpos, &newWindowRect, &newClientRect )) return FALSE;
+    if (!SWP_DoWinPosChanging( winpos, window_rect, client_rect )) return FALSE;
 
     /* Fix redundant flags */
     if (!fixup_flags( winpos )) return FALSE;
@@ -2259,13 +2421,43 @@ BOOL USER_SetWindowPos( WINDOWPOS * winpos )
 
     /* Common operations */
 
-    SWP_DoNCCalcSize( winpos, &newWindowRect, &newClientRect, valid_rects );
+    SWP_DoNCCalcSize( winpos, window_rect, client_rect, valid_rects );
+    return TRUE;
+}
 
-    if (!set_window_pos( winpos->hwnd, winpos->hwndInsertAfter, winpos->flags,
-                         &newWindowRect, &newClientRect, valid_rects ))
-        return FALSE;
 
+/***********************************************************************
+ *		get_erase_parent
+ *
+ * Return the window that needs to be erased once a position change is applied, if any.
+ */
+static HWND get_erase_parent( const WINDOWPOS *winpos, UINT orig_flags )
+{
+    HWND parent;
+
+    if (orig_flags & SWP_DEFERERASE) return 0;
 
+    /* erase parent when hiding or resizing child */
+    if (!(orig_flags & SWP_HIDEWINDOW) &&
+        ((orig_flags & SWP_SHOWWINDOW) ||
+         (winpos->flags & SWP_AGG_STATUSFLAGS) == SWP_AGG_NOGEOMETRYCHANGE))
+        return 0;
+
+    parent = GetAncestor( winpos->hwnd, GA_PARENT );
+    if (!parent || parent == GetDesktopWindow()) parent = winpos->hwnd;
+    return parent;
+}
+
+
+/***********************************************************************
+ *		end_set_window_pos
+ *
+ * Send the notifications once the new position has been set.
+ */
+static void end_set_window_pos( WINDOWPOS *winpos, UINT orig_flags, const RECT *window_rect,
+                                BOOL erase_parent )
+{
+    HWND parent;
 
     if( winpos->flags & SWP_HIDEWINDOW )
         HideCaret(winpos->hwnd);
@@ -2283,15 +2475,7 @@ BOOL USER_SetWindowPos( WINDOWPOS * winpos )
 
     if(!(orig_flags & SWP_DEFERERASE))
     {
-        /* erase parent when hiding or resizing child */
-        if ((orig_flags & SWP_HIDEWINDOW) ||
-         (!(orig_flags & SWP_SHOWWINDOW) &&
-          (winpos->flags & SWP_AGG_STATUSFLAGS) != SWP_AGG_NOGEOMETRYCHANGE))
-        {
-            HWND parent = GetAncestor( winpos->hwnd, GA_PARENT );
-            if (!parent || parent == GetDesktopWindow()) parent = winpos->hwnd;
-            erase_now( parent, 0 );
-        }
+        if (erase_parent && (parent = get_erase_parent( winpos, orig_flags ))) erase_now( parent, 0 );
 
         /* Give newly shown windows a chance to redraw */
         if(((winpos->flags & SWP_AGG_STATUSFLAGS) != SWP_AGG_NOPOSCHANGE)
@@ -2311,15 +2495,191 @@ BOOL USER_SetWindowPos( WINDOWPOS * winpos )
         /* WM_WINDOWPOSCHANGED is sent even if SWP_NOSENDCHANGING is set
            and always contains final window position.
          */
-        winpos->x = newWindowRect.left;
-        winpos->y = newWindowRect.top;
-        winpos->cx = newWindowRect.right - newWindowRect.left;
-        winpos->cy = newWindowRect.bottom - newWindowRect.top;
+        winpos->x = window_rect->left;
+        winpos->y = window_rect->top;
+        winpos->cx = window_rect->right - window_rect->left;
+        winpos->cy = window_rect->bottom - window_rect->top;
         SendMessageW( winpos->hwnd, WM_WINDOWPOSCHANGED, 0, (LPARAM)winpos );
     }
+}
+
+
+/***********************************************************************
+ *		USER_SetWindowPos
+ *
+ *     User32 internal function
+ */
+BOOL USER_SetWindowPos( WINDOWPOS * winpos )
+{
+    RECT newWindowRect, newClientRect, valid_rects[2];
+    UINT orig_flags;
+    BOOL ret;
+
+    orig_flags = winpos->flags;
+
+    if (!begin_set_window_pos( winpos, &newWindowRect, &newClientRect, valid_rects, &ret ))
+        return ret;
+
+    if (!set_window_pos( winpos->hwnd, winpos->hwndInsertAfter, winpos->flags,
+                         &newWindowRect, &newClientRect, valid_rects ))
+        return FALSE;
+
+    end_set_window_pos( winpos, orig_flags, &newWindowRect, TRUE );
     return TRUE;
 }
 
+
+/* per-window data for set_window_pos_batch */
+struct window_pos_batch_entry
+{
+    WINDOWPOS *winpos;
+    UINT       orig_flags;
+    RECT       valid_rects[2];
+    RECT       old_window_rect;  /* rectangles stored in the window before the batch */
+    RECT       old_client_rect;
+    HWND       erase_parent;
+};
+
+/***********************************************************************
+ *		can_batch_window_pos
+ *
+ * Check whether a position change can be applied together with others, i.e. it changes
+ * neither the Z order nor the visibility, so that the changes don't depend on each other.
+ */
+static BOOL can_batch_window_pos( const WINDOWPOS *winpos )
+{
+    if (!(winpos->flags & SWP_NOZORDER)) return FALSE;
+    if (winpos->flags & (SWP_SHOWWINDOW | SWP_HIDEWINDOW)) return FALSE;
+    /* activating a top-level window brings it to the top */
+    return (winpos->flags & SWP_NOACTIVATE) ||
+           (GetWindowLongW( winpos->hwnd, GWL_STYLE ) & (WS_POPUP | WS_CHILD)) == WS_CHILD;
+}
+
+/***********************************************************************
+ *		store_batch_window_rects
+ *
+ * Store rectangles in a window of the current thread without telling the server. When
+ * old_window_rect is not NULL the new rectangles are in parent coordinates like the ones
+ * given to the server, and the previous ones are returned as stored, for restoring them.
+ */
+static void store_batch_window_rects( HWND hwnd, const RECT *window_rect, const RECT *client_rect,
+                                      RECT *old_window_rect, RECT *old_client_rect )
+{
+    WND *win = WIN_GetPtr( hwnd );
+    RECT client;
+
+    if (!win || win == WND_DESKTOP || win == WND_OTHER_PROCESS) return;
+    if (old_window_rect) *old_window_rect = win->rectWindow;
+    if (old_client_rect) *old_client_rect = win->rectClient;
+    win->rectWindow = *window_rect;
+    win->rectClient = *client_rect;
+    if (old_window_rect && GetWindowLongW( win->parent, GWL_EXSTYLE ) & WS_EX_LAYOUTRTL)
+    {
+        GetClientRect( win->parent, &client );
+        mirror_rect( &client, &win->rectWindow );
+        mirror_rect( &client, &win->rectClient );
+    }
+    WIN_ReleasePtr( win );
+}
+
+/***********************************************************************
+ *		flush_window_pos_batch
+ *
+ * Apply the pending changes of set_window_pos_batch and send the notifications.
+ */
+static void flush_window_pos_batch( struct window_pos_change *changes,
+                                    struct window_pos_batch_entry *entries, BOOL *ret, UINT count )
+{
+    UINT i, j;
+
+    if (!count) return;
+
+    /* the changes are computed against the previous state of the windows */
+    for (i = 0; i < count; i++)
+        store_batch_window_rects( changes[i].hwnd, &entries[i].old_window_rect,
+                                  &entries[i].old_client_rect, NULL, NULL );
+
+    set_window_pos_list( changes, count, ret );
+
+    /* erase each parent only once */
+    for (i = 0; i < count; i++)
+    {
+        entries[i].erase_parent = ret[i] ? get_erase_parent( entries[i].winpos, entries[i].orig_flags ) : 0;
+        if (!entries[i].erase_parent) continue;
+        for (j = 0; j < i; j++) if (entries[j].erase_parent == entries[i].erase_parent) break;
+        if (j == i) erase_now( entries[i].erase_parent, 0 );
+    }
+
+    for (i = 0; i < count; i++)
+        if (ret[i]) end_set_window_pos( entries[i].winpos, entries[i].orig_flags,
+                                        &changes[i].window_rect, FALSE );
+}
+
+/***********************************************************************
+ *		set_window_pos_batch
+ *
+ * Apply a list of position changes for windows of the current thread. The positions
+ * are set with a single server request, and each parent is erased once before the
+ * WM_WINDOWPOSCHANGED messages are sent. Until then the new rectangles are stored on
+ * the client side, so that the WM_WINDOWPOSCHANGING message of a window sees the
+ * windows that come before it at their new position. Changes that depend on each
+ * other through the Z order or the visibility are applied one at a time.
+ */
+static void set_window_pos_batch( WINDOWPOS *winpos, UINT count )
+{
+    struct window_pos_change *changes;
+    struct window_pos_batch_entry *entries;
+    UINT i, done = 0;
+    BOOL *ret;
+
+    for (i = 0; i < count; i++) if (!can_batch_window_pos( &winpos[i] )) break;
+
+    if (i < count || count == 1 ||
+        !(changes = HeapAlloc( GetProcessHeap(), 0,
+                               count * (sizeof(*changes) + sizeof(*entries) + sizeof(*ret) ))))
+    {
+        for (i = 0; i < count; i++) USER_SetWindowPos( &winpos[i] );
+        return;
+    }
+    entries = (struct window_pos_batch_entry *)(changes + count);
+    ret = (BOOL *)(entries + count);
+
+    for (i = 0; i < count; i++)
+    {
+        struct window_pos_change *change = &changes[done];
+        struct window_pos_batch_entry *entry = &entries[done];
+
+        entry->winpos = &winpos[i];
+        entry->orig_flags = winpos[i].flags;
+        if (!begin_set_window_pos( entry->winpos, &change->window_rect, &change->client_rect,
+                                   entry->valid_rects, &ret[done] ))
+            continue;
+
+        if (!can_batch_window_pos( entry->winpos ))
+        {
+            /* the WM_WINDOWPOSCHANGING handler asked for a Z order or visibility change */
+            flush_window_pos_batch( changes, entries, ret, done );
+            done = 0;
+            if (set_window_pos( winpos[i].hwnd, winpos[i].hwndInsertAfter, winpos[i].flags,
+                                &change->window_rect, &change->client_rect, entry->valid_rects ))
+                end_set_window_pos( entry->winpos, entry->orig_flags, &change->window_rect, TRUE );
+            continue;
+        }
+
+        change->hwnd         = winpos[i].hwnd;
+        change->insert_after = winpos[i].hwndInsertAfter;
+        change->swp_flags    = winpos[i].flags;
+        change->valid_rects  = entry->valid_rects;
+        store_batch_window_rects( change->hwnd, &change->window_rect, &change->client_rect,
+                                  &entry->old_window_rect, &entry->old_client_rect );
+        done++;
+    }
+
+    flush_window_pos_batch( changes, entries, ret, done );
+    HeapFree( GetProcessHeap(), 0, changes );
+}
+
+
 /***********************************************************************
  *		SetWindowPos (USER32.@)
  */
@@ -2478,7 +2838,7 @@ BOOL WINAPI EndDeferWindowPos( HDWP hdwp )
 {
     DWP *pDWP;
     WINDOWPOS *winpos;
-    int i;
+    int i, count;
 
     TRACE("%p\n", hdwp);
 
@@ -2496,7 +2856,14 @@ BOOL WINAPI EndDeferWindowPos( HDWP hdwp )
                winpos->cx, winpos->cy, winpos->flags);
 
         if (WIN_IsCurrentThread( winpos->hwnd ))
-            USER_SetWindowPos( winpos );
+        {
+            /* apply consecutive windows of the current thread together */
+            for (count = 1; i + count < pDWP->actualCount; count++)
+                if (!WIN_IsCurrentThread( winpos[count].hwnd )) break;
+            set_window_pos_batch( winpos, count );
+            i += count - 1;
+            winpos += count - 1;
+        }
         else
             SendMessageW( winpos->hwnd, WM_WINE_SETWINDOWPOS, 0, (LPARAM)winpos );
     }
@@ -218,6 +218,7 @@ BOOL WINAPI SetProcessWindowStation( HWINSTA handle )
         ret = !wine_server_call_err( req );
     }
     SERVER_END_REQ;
+    if (ret) flush_registered_atoms();
     return ret;
 }
 
@@ -428,6 +429,7 @@ BOOL WINAPI SetThreadDesktop( HDESK handle )
         struct user_key_state_info *key_state_info = thread_info->key_state;
         thread_info->top_window = 0;
         thread_info->msg_window = 0;
+        thread_info->shared_window_table = 0;
         if (key_state_info) key_state_info->time = 0;
     }
     return ret;
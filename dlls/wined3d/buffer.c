@@ -34,6 +34,7 @@ WINE_DEFAULT_DEBUG_CHANNEL(d3d);
 #define WINED3D_BUFFER_PIN_SYSMEM   0x04    /* Keep a system memory copy for this buffer. */
 #define WINED3D_BUFFER_DISCARD      0x08    /* A DISCARD lock has occurred since the last preload. */
 #define WINED3D_BUFFER_APPLESYNC    0x10    /* Using sync as in GL_APPLE_flush_buffer_range. */
+#define WINED3D_BUFFER_HEAP         0x20    /* Using a slice of the device's buffer heap. */
 
 #define VB_MAXDECLCHANGES     100     /* After that number of decl changes we stop converting */
 #define VB_RESETDECLCHANGE    1000    /* Reset the decl changecount after that number of draws */
@@ -138,6 +139,263 @@ static void buffer_bind(struct wined3d_buffer *buffer, struct wined3d_context *c
     context_bind_bo(context, buffer->buffer_type_hint, buffer->buffer_object);
 }
 
+void wined3d_buffer_heap_init(struct wined3d_buffer_heap *heap)
+{
+    InitializeCriticalSection(&heap->cs);
+    heap->cs.DebugInfo->Spare[0] = (DWORD_PTR)(__FILE__ ": wined3d_buffer_heap.cs");
+    list_init(&heap->free_ranges);
+    list_init(&heap->retired_ranges);
+    list_init(&heap->batches);
+}
+
+void wined3d_buffer_heap_cleanup(struct wined3d_buffer_heap *heap)
+{
+    heap->cs.DebugInfo->Spare[0] = 0;
+    DeleteCriticalSection(&heap->cs);
+}
+
+static unsigned int wined3d_buffer_heap_slice_size(unsigned int size)
+{
+    return (size + RESOURCE_ALIGNMENT - 1) & ~(RESOURCE_ALIGNMENT - 1);
+}
+
+static void wined3d_buffer_heap_free_ranges(struct list *ranges)
+{
+    struct wined3d_buffer_heap_range *range, *next;
+
+    LIST_FOR_EACH_ENTRY_SAFE(range, next, ranges, struct wined3d_buffer_heap_range, entry)
+    {
+        HeapFree(GetProcessHeap(), 0, range);
+    }
+    list_init(ranges);
+}
+
+/* Context activation is done by the caller. */
+void wined3d_buffer_heap_create_storage(struct wined3d_buffer_heap *heap, struct wined3d_context *context)
+{
+    static const GLbitfield map_flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    const struct wined3d_gl_info *gl_info = context->gl_info;
+    struct wined3d_buffer_heap_range *range;
+    GLuint buffer_object;
+    BYTE *map_ptr;
+
+    if (!gl_info->supported[ARB_BUFFER_STORAGE] || !gl_info->supported[ARB_MAP_BUFFER_RANGE])
+        return;
+
+    if (!(range = HeapAlloc(GetProcessHeap(), 0, sizeof(*range))))
+        return;
+
+    GL_EXTCALL(glGenBuffers(1, &buffer_object));
+    context_bind_bo(context, GL_ARRAY_BUFFER, buffer_object);
+    GL_EXTCALL(glBufferStorage(GL_ARRAY_BUFFER, WINED3D_BUFFER_HEAP_SIZE, NULL,
+            map_flags | GL_DYNAMIC_STORAGE_BIT));
+    map_ptr = GL_EXTCALL(glMapBufferRange(GL_ARRAY_BUFFER, 0, WINED3D_BUFFER_HEAP_SIZE, map_flags));
+    checkGLcall("create buffer heap");
+
+    if (!map_ptr || ((DWORD_PTR)map_ptr & (RESOURCE_ALIGNMENT - 1)))
+    {
+        WARN("Unusable buffer heap mapping %p.\n", map_ptr);
+        if (map_ptr)
+            GL_EXTCALL(glUnmapBuffer(GL_ARRAY_BUFFER));
+        GL_EXTCALL(glDeleteBuffers(1, &buffer_object));
+        checkGLcall("destroy buffer heap");
+        HeapFree(GetProcessHeap(), 0, range);
+        return;
+    }
+
+    TRACE("Created buffer heap %u, mapped at %p.\n", buffer_object, map_ptr);
+
+    range->offset = 0;
+    range->size = WINED3D_BUFFER_HEAP_SIZE;
+
+    EnterCriticalSection(&heap->cs);
+    heap->buffer_object = buffer_object;
+    heap->map_ptr = map_ptr;
+    list_add_head(&heap->free_ranges, &range->entry);
+    LeaveCriticalSection(&heap->cs);
+}
+
+/* Context activation is done by the caller. Buffers are expected to have
+ * left the heap already. */
+void wined3d_buffer_heap_destroy_storage(struct wined3d_buffer_heap *heap, struct wined3d_context *context)
+{
+    const struct wined3d_gl_info *gl_info = context->gl_info;
+    struct wined3d_buffer_heap_batch *batch, *next;
+    GLuint buffer_object;
+
+    if (!(buffer_object = heap->buffer_object))
+        return;
+
+    LIST_FOR_EACH_ENTRY_SAFE(batch, next, &heap->batches, struct wined3d_buffer_heap_batch, entry)
+    {
+        wined3d_buffer_heap_free_ranges(&batch->ranges);
+        wined3d_fence_destroy(batch->fence);
+        HeapFree(GetProcessHeap(), 0, batch);
+    }
+    list_init(&heap->batches);
+    wined3d_buffer_heap_free_ranges(&heap->retired_ranges);
+    heap->retired_size = 0;
+
+    EnterCriticalSection(&heap->cs);
+    wined3d_buffer_heap_free_ranges(&heap->free_ranges);
+    heap->buffer_object = 0;
+    heap->map_ptr = NULL;
+    LeaveCriticalSection(&heap->cs);
+
+    context_bind_bo(context, GL_ARRAY_BUFFER, buffer_object);
+    GL_EXTCALL(glUnmapBuffer(GL_ARRAY_BUFFER));
+    GL_EXTCALL(glDeleteBuffers(1, &buffer_object));
+    checkGLcall("destroy buffer heap");
+}
+
+/* Returns the mapping of a newly allocated heap slice, or NULL if the heap
+ * is full. This never waits for the GPU. */
+static BYTE *wined3d_buffer_heap_alloc(struct wined3d_buffer_heap *heap, unsigned int size, unsigned int *offset)
+{
+    struct wined3d_buffer_heap_range *range;
+    BYTE *map_ptr = NULL;
+
+    size = wined3d_buffer_heap_slice_size(size);
+
+    EnterCriticalSection(&heap->cs);
+    LIST_FOR_EACH_ENTRY(range, &heap->free_ranges, struct wined3d_buffer_heap_range, entry)
+    {
+        if (range->size < size)
+            continue;
+
+        *offset = range->offset;
+        map_ptr = heap->map_ptr + range->offset;
+        range->offset += size;
+        if (!(range->size -= size))
+        {
+            list_remove(&range->entry);
+            HeapFree(GetProcessHeap(), 0, range);
+        }
+        break;
+    }
+    LeaveCriticalSection(&heap->cs);
+
+    return map_ptr;
+}
+
+static void wined3d_buffer_heap_free(struct wined3d_buffer_heap *heap, struct wined3d_buffer_heap_range *range)
+{
+    struct wined3d_buffer_heap_range *neighbour;
+    struct list *entry = &heap->free_ranges;
+
+    EnterCriticalSection(&heap->cs);
+
+    /* Keep the free list sorted, and merge adjacent ranges. */
+    LIST_FOR_EACH_ENTRY(neighbour, &heap->free_ranges, struct wined3d_buffer_heap_range, entry)
+    {
+        if (neighbour->offset > range->offset)
+            break;
+        entry = &neighbour->entry;
+    }
+    list_add_after(entry, &range->entry);
+
+    if ((entry = list_next(&heap->free_ranges, &range->entry)))
+    {
+        neighbour = LIST_ENTRY(entry, struct wined3d_buffer_heap_range, entry);
+        if (range->offset + range->size == neighbour->offset)
+        {
+            range->size += neighbour->size;
+            list_remove(&neighbour->entry);
+            HeapFree(GetProcessHeap(), 0, neighbour);
+        }
+    }
+    if ((entry = list_prev(&heap->free_ranges, &range->entry)))
+    {
+        neighbour = LIST_ENTRY(entry, struct wined3d_buffer_heap_range, entry);
+        if (neighbour->offset + neighbour->size == range->offset)
+        {
+            neighbour->size += range->size;
+            list_remove(&range->entry);
+            HeapFree(GetProcessHeap(), 0, range);
+        }
+    }
+
+    LeaveCriticalSection(&heap->cs);
+}
+
+static void wined3d_buffer_heap_poll(struct wined3d_buffer_heap *heap, const struct wined3d_device *device)
+{
+    struct wined3d_buffer_heap_range *range, *next_range;
+    struct wined3d_buffer_heap_batch *batch, *next;
+
+    LIST_FOR_EACH_ENTRY_SAFE(batch, next, &heap->batches, struct wined3d_buffer_heap_batch, entry)
+    {
+        /* Batches complete in order. */
+        if (wined3d_fence_test(batch->fence, device, 0) != WINED3D_FENCE_OK)
+            break;
+
+        LIST_FOR_EACH_ENTRY_SAFE(range, next_range, &batch->ranges, struct wined3d_buffer_heap_range, entry)
+        {
+            list_remove(&range->entry);
+            wined3d_buffer_heap_free(heap, range);
+        }
+        list_remove(&batch->entry);
+        wined3d_fence_destroy(batch->fence);
+        HeapFree(GetProcessHeap(), 0, batch);
+    }
+}
+
+/* Context activation is done by the caller. */
+static void wined3d_buffer_heap_retire(struct wined3d_buffer_heap *heap, struct wined3d_context *context,
+        unsigned int offset, unsigned int size)
+{
+    const struct wined3d_gl_info *gl_info = context->gl_info;
+    struct wined3d_device *device = context->device;
+    struct wined3d_buffer_heap_range *range, *next;
+    struct wined3d_buffer_heap_batch *batch;
+    HRESULT hr;
+
+    if (!(range = HeapAlloc(GetProcessHeap(), 0, sizeof(*range))))
+    {
+        ERR("Failed to allocate range, leaking heap slice at %#x.\n", offset);
+        return;
+    }
+    range->offset = offset;
+    range->size = wined3d_buffer_heap_slice_size(size);
+    list_add_tail(&heap->retired_ranges, &range->entry);
+    heap->retired_size += range->size;
+
+    if (heap->retired_size >= WINED3D_BUFFER_HEAP_BATCH_SIZE)
+    {
+        /* Everything that used these slices was submitted before they were
+         * retired, so a single fence issued now covers all of them. */
+        if (!(batch = HeapAlloc(GetProcessHeap(), 0, sizeof(*batch))))
+        {
+            ERR("Failed to allocate batch.\n");
+        }
+        else if (FAILED(hr = wined3d_fence_create(device, &batch->fence)))
+        {
+            WARN("Failed to create fence, hr %#x.\n", hr);
+            HeapFree(GetProcessHeap(), 0, batch);
+
+            gl_info->gl_ops.gl.p_glFinish();
+            LIST_FOR_EACH_ENTRY_SAFE(range, next, &heap->retired_ranges, struct wined3d_buffer_heap_range, entry)
+            {
+                list_remove(&range->entry);
+                wined3d_buffer_heap_free(heap, range);
+            }
+            heap->retired_size = 0;
+        }
+        else
+        {
+            wined3d_fence_issue(batch->fence, device);
+            gl_info->gl_ops.gl.p_glFlush();
+
+            list_init(&batch->ranges);
+            list_move_tail(&batch->ranges, &heap->retired_ranges);
+            list_add_tail(&heap->batches, &batch->entry);
+            heap->retired_size = 0;
+        }
+    }
+
+    wined3d_buffer_heap_poll(heap, device);
+}
+
 /* Context activation is done by the caller. */
 static void buffer_destroy_buffer_object(struct wined3d_buffer *buffer, struct wined3d_context *context)
 {
@@ -181,8 +439,18 @@ static void buffer_destroy_buffer_object(struct wined3d_buffer *buffer, struct w
         }
     }
 
-    GL_EXTCALL(glDeleteBuffers(1, &buffer->buffer_object));
-    checkGLcall("glDeleteBuffers");
+    if (buffer->flags & WINED3D_BUFFER_HEAP)
+    {
+        wined3d_buffer_heap_retire(&resource->device->buffer_heap, context,
+                buffer->bo_offset, buffer->resource.size);
+        buffer->flags &= ~WINED3D_BUFFER_HEAP;
+        buffer->bo_offset = 0;
+    }
+    else
+    {
+        GL_EXTCALL(glDeleteBuffers(1, &buffer->buffer_object));
+        checkGLcall("glDeleteBuffers");
+    }
     buffer->buffer_object = 0;
 
     if (buffer->fence)
@@ -542,8 +810,8 @@ static void wined3d_buffer_upload_ranges(struct wined3d_buffer *buffer, struct w
     while (range_count--)
     {
         range = &ranges[range_count];
-        GL_EXTCALL(glBufferSubData(buffer->buffer_type_hint,
-                range->offset, range->size, (BYTE *)data + range->offset - data_offset));
+        GL_EXTCALL(glBufferSubData(buffer->buffer_type_hint, buffer->bo_offset + range->offset,
+                range->size, (BYTE *)data + range->offset - data_offset));
     }
     checkGLcall("glBufferSubData");
 }
@@ -675,8 +943,8 @@ BOOL wined3d_buffer_load_location(struct wined3d_buffer *buffer,
     {
         case WINED3D_LOCATION_SYSMEM:
             buffer_bind(buffer, context);
-            GL_EXTCALL(glGetBufferSubData(buffer->buffer_type_hint, 0, buffer->resource.size,
-                    buffer->resource.heap_memory));
+            GL_EXTCALL(glGetBufferSubData(buffer->buffer_type_hint, buffer->bo_offset,
+                    buffer->resource.size, buffer->resource.heap_memory));
             checkGLcall("buffer download");
             break;
 
@@ -704,7 +972,14 @@ BOOL wined3d_buffer_load_location(struct wined3d_buffer *buffer,
 /* Context activation is done by the caller. */
 BYTE *wined3d_buffer_load_sysmem(struct wined3d_buffer *buffer, struct wined3d_context *context)
 {
-    if (wined3d_buffer_load_location(buffer, context, WINED3D_LOCATION_SYSMEM))
+    if (!wined3d_buffer_load_location(buffer, context, WINED3D_LOCATION_SYSMEM))
+        return buffer->resource.heap_memory;
+
+    /* The application writes to heap slices directly, so the copy is only
+     * good for the caller. */
+    if (buffer->flags & WINED3D_BUFFER_HEAP)
+        wined3d_buffer_invalidate_location(buffer, WINED3D_LOCATION_SYSMEM);
+    else
         buffer->flags |= WINED3D_BUFFER_PIN_SYSMEM;
     return buffer->resource.heap_memory;
 }
@@ -718,7 +993,7 @@ DWORD wined3d_buffer_get_memory(struct wined3d_buffer *buffer,
     if (locations & WINED3D_LOCATION_BUFFER)
     {
         data->buffer_object = buffer->buffer_object;
-        data->addr = NULL;
+        data->addr = (BYTE *)(ULONG_PTR)buffer->bo_offset;
         return WINED3D_LOCATION_BUFFER;
     }
     if (locations & WINED3D_LOCATION_SYSMEM)
@@ -998,6 +1273,98 @@ struct wined3d_resource * CDECL wined3d_buffer_get_resource(struct wined3d_buffe
     return &buffer->resource;
 }
 
+/* Context activation is done by the caller. */
+void wined3d_buffer_rename(struct wined3d_buffer *buffer, struct wined3d_context *context, unsigned int offset)
+{
+    struct wined3d_device *device = buffer->resource.device;
+
+    TRACE("buffer %p, context %p, offset %#x.\n", buffer, context, offset);
+
+    /* The previous storage is only retired here, in command stream order, so
+     * commands that still use it were queued before the rename. */
+    buffer_destroy_buffer_object(buffer, context);
+
+    buffer->buffer_object = device->buffer_heap.buffer_object;
+    buffer->bo_offset = offset;
+    buffer->flags |= WINED3D_BUFFER_HEAP;
+
+    if (buffer->resource.bind_count)
+    {
+        if (buffer->bind_flags & WINED3D_BIND_VERTEX_BUFFER)
+            device_invalidate_state(device, STATE_STREAMSRC);
+        if (buffer->bind_flags & WINED3D_BIND_INDEX_BUFFER)
+            device_invalidate_state(device, STATE_INDEXBUFFER);
+    }
+
+    wined3d_buffer_validate_location(buffer, WINED3D_LOCATION_BUFFER);
+    wined3d_buffer_invalidate_location(buffer, ~WINED3D_LOCATION_BUFFER);
+    if (buffer->resource.heap_memory)
+        wined3d_buffer_evict_sysmem(buffer);
+}
+
+/* DISCARD and NOOVERWRITE maps of dynamic vertex and index buffers are
+ * served from the device's buffer heap, on the application side of the
+ * command stream. A DISCARD map allocates a new slice and queues the rename,
+ * so it waits for neither the command stream nor the GPU. Any map served by
+ * the command stream moves the buffer out of the heap. Maps served by the
+ * command stream are counted in cs_map_count rather than read from
+ * resource.map_count, so this only uses state owned by the application side. */
+BOOL wined3d_buffer_map_direct(struct wined3d_buffer *buffer, struct wined3d_map_desc *map_desc,
+        const struct wined3d_box *box, DWORD flags)
+{
+    struct wined3d_device *device = buffer->resource.device;
+    unsigned int offset;
+    BYTE *map_ptr;
+
+    if (!buffer->use_heap)
+        return FALSE;
+
+    if (!(flags & (WINED3D_MAP_DISCARD | WINED3D_MAP_NOOVERWRITE)) || flags & WINED3D_MAP_READONLY
+            || buffer->cs_map_count)
+        goto fail;
+
+    if (flags & WINED3D_MAP_DISCARD)
+    {
+        if (!(map_ptr = wined3d_buffer_heap_alloc(&device->buffer_heap, buffer->resource.size, &offset)))
+        {
+            TRACE("Buffer heap is full.\n");
+            goto fail;
+        }
+        wined3d_cs_emit_rename_buffer(device->cs, buffer, offset);
+        buffer->heap_map_ptr = map_ptr;
+    }
+    else if (!buffer->heap_map_ptr)
+    {
+        return FALSE;
+    }
+
+    ++buffer->direct_map_count;
+    map_desc->row_pitch = map_desc->slice_pitch = buffer->desc.byte_width;
+    map_desc->data = buffer->heap_map_ptr + (box ? box->left : 0);
+
+    TRACE("Returning memory at %p for buffer %p.\n", map_desc->data, buffer);
+
+    return TRUE;
+
+fail:
+    buffer->heap_map_ptr = NULL;
+    return FALSE;
+}
+
+BOOL wined3d_buffer_unmap_direct(struct wined3d_buffer *buffer)
+{
+    if (!buffer->direct_map_count)
+        return FALSE;
+
+    --buffer->direct_map_count;
+    return TRUE;
+}
+
+void wined3d_buffer_unload_direct(struct wined3d_buffer *buffer)
+{
+    buffer->heap_map_ptr = NULL;
+}
+
 static HRESULT wined3d_buffer_map(struct wined3d_buffer *buffer, UINT offset, UINT size, BYTE **data, DWORD flags)
 {
     struct wined3d_device *device = buffer->resource.device;
@@ -1009,6 +1376,20 @@ static HRESULT wined3d_buffer_map(struct wined3d_buffer *buffer, UINT offset, UI
 
     count = ++buffer->resource.map_count;
 
+    if (buffer->flags & WINED3D_BUFFER_HEAP)
+    {
+        /* The application stopped mapping the heap slice directly when it
+         * issued this map. Move the buffer to system memory, it gets a buffer
+         * object of its own when it is loaded again. */
+        context = context_acquire(device, NULL, 0);
+        if (flags & WINED3D_MAP_DISCARD)
+            wined3d_buffer_validate_location(buffer, WINED3D_LOCATION_DISCARDED);
+        wined3d_buffer_load_location(buffer, context, WINED3D_LOCATION_SYSMEM);
+        wined3d_buffer_invalidate_location(buffer, WINED3D_LOCATION_BUFFER);
+        buffer_destroy_buffer_object(buffer, context);
+        context_release(context);
+    }
+
     if (buffer->buffer_object)
     {
         unsigned int dirty_offset = offset, dirty_size = size;
@@ -1323,6 +1704,36 @@ static GLenum buffer_type_hint_from_bind_flags(const struct wined3d_gl_info *gl_
     return GL_ARRAY_BUFFER;
 }
 
+static BOOL buffer_use_heap(const struct wined3d_buffer *buffer)
+{
+    const struct wined3d_adapter *adapter = buffer->resource.device->adapter;
+    const struct wined3d_gl_info *gl_info = &adapter->gl_info;
+    const struct wined3d_d3d_info *d3d_info = &adapter->d3d_info;
+
+    if (!gl_info->supported[ARB_BUFFER_STORAGE] || !gl_info->supported[ARB_MAP_BUFFER_RANGE])
+        return FALSE;
+
+    if (!(buffer->resource.usage & WINED3DUSAGE_DYNAMIC) || !(buffer->flags & WINED3D_BUFFER_USE_BO)
+            || buffer->flags & WINED3D_BUFFER_PIN_SYSMEM)
+        return FALSE;
+
+    if (buffer->resource.size > WINED3D_BUFFER_HEAP_BATCH_SIZE)
+        return FALSE;
+
+    /* Renaming only refreshes vertex and index buffer bindings. */
+    if (buffer->bind_flags & ~(WINED3D_BIND_VERTEX_BUFFER | WINED3D_BIND_INDEX_BUFFER))
+        return FALSE;
+
+    /* The application writes straight into the heap, so the contents must
+     * never need conversion. */
+    if (!gl_info->supported[ARB_VERTEX_ARRAY_BGRA] && !d3d_info->ffp_generic_attributes)
+        return FALSE;
+    if (!d3d_info->xyzrhw)
+        return FALSE;
+
+    return TRUE;
+}
+
 static HRESULT buffer_init(struct wined3d_buffer *buffer, struct wined3d_device *device,
         UINT size, DWORD usage, enum wined3d_format_id format_id, enum wined3d_pool pool, unsigned int bind_flags,
         const struct wined3d_sub_resource_data *data, void *parent, const struct wined3d_parent_ops *parent_ops)
@@ -1396,6 +1807,9 @@ static HRESULT buffer_init(struct wined3d_buffer *buffer, struct wined3d_device
         buffer->flags |= WINED3D_BUFFER_USE_BO;
     }
 
+    if ((buffer->use_heap = buffer_use_heap(buffer)))
+        TRACE("Using the buffer heap for DISCARD and NOOVERWRITE maps.\n");
+
     if (!(buffer->maps = HeapAlloc(GetProcessHeap(), 0, sizeof(*buffer->maps))))
     {
         ERR("Out of memory.\n");
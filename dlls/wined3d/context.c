@@ -3906,12 +3906,21 @@ BOOL context_apply_draw_state(struct wined3d_context *context,
         state_table[rep].apply(context, state, rep);
     }
 
-    if (context->shader_update_mask & ~(1u << WINED3D_SHADER_TYPE_COMPUTE))
+    if (context->shader_update_mask & ~(1u << WINED3D_SHADER_TYPE_COMPUTE) || context->shader_pending)
     {
         device->shader_backend->shader_select(device->shader_priv, context, state);
         context->shader_update_mask &= 1u << WINED3D_SHADER_TYPE_COMPUTE;
     }
 
+    /* The shader backend is still linking the program for this draw in the
+     * background. Skip the draw rather than stalling on it; shader_select()
+     * gets called again for the next draw. */
+    if (context->shader_pending)
+    {
+        context->numDirtyEntries = 0;
+        return FALSE;
+    }
+
     if (context->constant_update_mask)
     {
         device->shader_backend->shader_load_constants(device->shader_priv, context, state);
@@ -21,6 +21,7 @@
 #include "wined3d_private.h"
 
 WINE_DEFAULT_DEBUG_CHANNEL(d3d);
+WINE_DECLARE_DEBUG_CHANNEL(d3d_perf);
 
 #define WINED3D_INITIAL_CS_SIZE 4096
 
@@ -71,6 +72,7 @@ enum wined3d_cs_op
     WINED3D_CS_OP_ADD_DIRTY_TEXTURE_REGION,
     WINED3D_CS_OP_CLEAR_UNORDERED_ACCESS_VIEW,
     WINED3D_CS_OP_COPY_UAV_COUNTER,
+    WINED3D_CS_OP_RENAME_BUFFER,
     WINED3D_CS_OP_STOP,
 };
 
@@ -362,6 +364,13 @@ struct wined3d_cs_unload_resource
     struct wined3d_resource *resource;
 };
 
+struct wined3d_cs_rename_buffer
+{
+    enum wined3d_cs_op opcode;
+    struct wined3d_buffer *buffer;
+    unsigned int offset;
+};
+
 struct wined3d_cs_map
 {
     enum wined3d_cs_op opcode;
@@ -1902,6 +1911,11 @@ void wined3d_cs_emit_unload_resource(struct wined3d_cs *cs, struct wined3d_resou
 {
     struct wined3d_cs_unload_resource *op;
 
+    /* Unloading takes buffers out of the buffer heap, which ends direct maps
+     * of their current slice. */
+    if (resource->type == WINED3D_RTYPE_BUFFER)
+        wined3d_buffer_unload_direct(buffer_from_resource(resource));
+
     op = cs->ops->require_space(cs, sizeof(*op), WINED3D_CS_QUEUE_DEFAULT);
     op->opcode = WINED3D_CS_OP_UNLOAD_RESOURCE;
     op->resource = resource;
@@ -1911,6 +1925,33 @@ void wined3d_cs_emit_unload_resource(struct wined3d_cs *cs, struct wined3d_resou
     cs->ops->submit(cs, WINED3D_CS_QUEUE_DEFAULT);
 }
 
+static void wined3d_cs_exec_rename_buffer(struct wined3d_cs *cs, const void *data)
+{
+    const struct wined3d_cs_rename_buffer *op = data;
+    struct wined3d_buffer *buffer = op->buffer;
+    struct wined3d_context *context;
+
+    context = context_acquire(cs->device, NULL, 0);
+    wined3d_buffer_rename(buffer, context, op->offset);
+    context_release(context);
+
+    wined3d_resource_release(&buffer->resource);
+}
+
+void wined3d_cs_emit_rename_buffer(struct wined3d_cs *cs, struct wined3d_buffer *buffer, unsigned int offset)
+{
+    struct wined3d_cs_rename_buffer *op;
+
+    op = cs->ops->require_space(cs, sizeof(*op), WINED3D_CS_QUEUE_DEFAULT);
+    op->opcode = WINED3D_CS_OP_RENAME_BUFFER;
+    op->buffer = buffer;
+    op->offset = offset;
+
+    wined3d_resource_acquire(&buffer->resource);
+
+    cs->ops->submit(cs, WINED3D_CS_QUEUE_DEFAULT);
+}
+
 static void wined3d_cs_exec_map(struct wined3d_cs *cs, const void *data)
 {
     const struct wined3d_cs_map *op = data;
@@ -2354,8 +2395,233 @@ static void (* const wined3d_cs_op_handlers[])(struct wined3d_cs *cs, const void
     /* WINED3D_CS_OP_ADD_DIRTY_TEXTURE_REGION    */ wined3d_cs_exec_add_dirty_texture_region,
     /* WINED3D_CS_OP_CLEAR_UNORDERED_ACCESS_VIEW */ wined3d_cs_exec_clear_unordered_access_view,
     /* WINED3D_CS_OP_COPY_UAV_COUNTER            */ wined3d_cs_exec_copy_uav_counter,
+    /* WINED3D_CS_OP_RENAME_BUFFER               */ wined3d_cs_exec_rename_buffer,
+};
+
+/* Command stream statistics traces.
+ *
+ * When the "CSTrace" setting names a file, the opcode, size and execution
+ * time of every packet executed by the command stream are appended to it.
+ * A trace consists of a wined3d_cs_trace_header, followed by one
+ * wined3d_cs_trace_record per packet. Per-opcode totals are appended as
+ * "op_count" wined3d_cs_trace_stats structures when the command stream is
+ * destroyed. Traces don't contain packet contents or resource data, and
+ * can't be replayed. */
+#define WINED3D_CS_TRACE_MAGIC          0x53433357 /* "W3CS" */
+#define WINED3D_CS_TRACE_VERSION        2
+#define WINED3D_CS_TRACE_BUFFER_SIZE    0x10000
+
+struct wined3d_cs_trace_header
+{
+    DWORD magic;
+    DWORD version;
+    DWORD op_count;
+    DWORD pointer_size;
+    LARGE_INTEGER frequency;
+};
+
+struct wined3d_cs_trace_record
+{
+    DWORD opcode;
+    DWORD packet_size;
+    ULONGLONG ticks;
+};
+
+struct wined3d_cs_trace_stats
+{
+    ULONGLONG count;
+    ULONGLONG ticks;
+    ULONGLONG max_ticks;
+    ULONGLONG bytes;
+};
+
+struct wined3d_cs_trace
+{
+    HANDLE file;
+    size_t buffer_size;
+    BYTE buffer[WINED3D_CS_TRACE_BUFFER_SIZE];
+    LARGE_INTEGER frequency;
+    struct wined3d_cs_trace_stats stats[WINED3D_CS_OP_STOP];
 };
 
+static const char *debug_cs_op(enum wined3d_cs_op op)
+{
+    switch (op)
+    {
+#define WINED3D_TO_STR(x) case x: return #x
+        WINED3D_TO_STR(WINED3D_CS_OP_NOP);
+        WINED3D_TO_STR(WINED3D_CS_OP_PRESENT);
+        WINED3D_TO_STR(WINED3D_CS_OP_CLEAR);
+        WINED3D_TO_STR(WINED3D_CS_OP_DISPATCH);
+        WINED3D_TO_STR(WINED3D_CS_OP_DRAW);
+        WINED3D_TO_STR(WINED3D_CS_OP_FLUSH);
+        WINED3D_TO_STR(WINED3D_CS_OP_SET_PREDICATION);
+        WINED3D_TO_STR(WINED3D_CS_OP_SET_VIEWPORT);
+        WINED3D_TO_STR(WINED3D_CS_OP_SET_SCISSOR_RECT);
+        WINED3D_TO_STR(WINED3D_CS_OP_SET_RENDERTARGET_VIEW);
+        WINED3D_TO_STR(WINED3D_CS_OP_SET_DEPTH_STENCIL_VIEW);
+        WINED3D_TO_STR(WINED3D_CS_OP_SET_VERTEX_DECLARATION);
+        WINED3D_TO_STR(WINED3D_CS_OP_SET_STREAM_SOURCE);
+        WINED3D_TO_STR(WINED3D_CS_OP_SET_STREAM_SOURCE_FREQ);
+        WINED3D_TO_STR(WINED3D_CS_OP_SET_STREAM_OUTPUT);
+        WINED3D_TO_STR(WINED3D_CS_OP_SET_INDEX_BUFFER);
+        WINED3D_TO_STR(WINED3D_CS_OP_SET_CONSTANT_BUFFER);
+        WINED3D_TO_STR(WINED3D_CS_OP_SET_TEXTURE);
+        WINED3D_TO_STR(WINED3D_CS_OP_SET_SHADER_RESOURCE_VIEW);
+        WINED3D_TO_STR(WINED3D_CS_OP_SET_UNORDERED_ACCESS_VIEW);
+        WINED3D_TO_STR(WINED3D_CS_OP_SET_SAMPLER);
+        WINED3D_TO_STR(WINED3D_CS_OP_SET_SHADER);
+        WINED3D_TO_STR(WINED3D_CS_OP_SET_RASTERIZER_STATE);
+        WINED3D_TO_STR(WINED3D_CS_OP_SET_RENDER_STATE);
+        WINED3D_TO_STR(WINED3D_CS_OP_SET_TEXTURE_STATE);
+        WINED3D_TO_STR(WINED3D_CS_OP_SET_SAMPLER_STATE);
+        WINED3D_TO_STR(WINED3D_CS_OP_SET_TRANSFORM);
+        WINED3D_TO_STR(WINED3D_CS_OP_SET_CLIP_PLANE);
+        WINED3D_TO_STR(WINED3D_CS_OP_SET_COLOR_KEY);
+        WINED3D_TO_STR(WINED3D_CS_OP_SET_MATERIAL);
+        WINED3D_TO_STR(WINED3D_CS_OP_SET_LIGHT);
+        WINED3D_TO_STR(WINED3D_CS_OP_SET_LIGHT_ENABLE);
+        WINED3D_TO_STR(WINED3D_CS_OP_PUSH_CONSTANTS);
+        WINED3D_TO_STR(WINED3D_CS_OP_RESET_STATE);
+        WINED3D_TO_STR(WINED3D_CS_OP_CALLBACK);
+        WINED3D_TO_STR(WINED3D_CS_OP_QUERY_ISSUE);
+        WINED3D_TO_STR(WINED3D_CS_OP_PRELOAD_RESOURCE);
+        WINED3D_TO_STR(WINED3D_CS_OP_UNLOAD_RESOURCE);
+        WINED3D_TO_STR(WINED3D_CS_OP_MAP);
+        WINED3D_TO_STR(WINED3D_CS_OP_UNMAP);
+        WINED3D_TO_STR(WINED3D_CS_OP_BLT_SUB_RESOURCE);
+        WINED3D_TO_STR(WINED3D_CS_OP_UPDATE_SUB_RESOURCE);
+        WINED3D_TO_STR(WINED3D_CS_OP_ADD_DIRTY_TEXTURE_REGION);
+        WINED3D_TO_STR(WINED3D_CS_OP_CLEAR_UNORDERED_ACCESS_VIEW);
+        WINED3D_TO_STR(WINED3D_CS_OP_COPY_UAV_COUNTER);
+        WINED3D_TO_STR(WINED3D_CS_OP_RENAME_BUFFER);
+        WINED3D_TO_STR(WINED3D_CS_OP_STOP);
+#undef WINED3D_TO_STR
+    }
+    return wine_dbg_sprintf("UNKNOWN_OP(%#x)", op);
+}
+
+static void wined3d_cs_trace_flush(struct wined3d_cs_trace *trace)
+{
+    DWORD written;
+
+    if (!trace->buffer_size)
+        return;
+    if (!WriteFile(trace->file, trace->buffer, trace->buffer_size, &written, NULL)
+            || written != trace->buffer_size)
+        ERR("Failed to write command stream trace, error %u.\n", GetLastError());
+    trace->buffer_size = 0;
+}
+
+static void wined3d_cs_trace_write(struct wined3d_cs_trace *trace, const void *data, size_t size)
+{
+    DWORD written;
+
+    if (trace->buffer_size + size > sizeof(trace->buffer))
+    {
+        wined3d_cs_trace_flush(trace);
+        if (size > sizeof(trace->buffer))
+        {
+            if (!WriteFile(trace->file, data, size, &written, NULL) || written != size)
+                ERR("Failed to write command stream trace, error %u.\n", GetLastError());
+            return;
+        }
+    }
+    memcpy(&trace->buffer[trace->buffer_size], data, size);
+    trace->buffer_size += size;
+}
+
+static struct wined3d_cs_trace *wined3d_cs_trace_create(const char *filename)
+{
+    struct wined3d_cs_trace_header header;
+    struct wined3d_cs_trace *trace;
+
+    if (!(trace = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*trace))))
+        return NULL;
+
+    if ((trace->file = CreateFileA(filename, GENERIC_WRITE, FILE_SHARE_READ,
+            NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL)) == INVALID_HANDLE_VALUE)
+    {
+        WARN("Failed to create command stream trace %s, error %u.\n", debugstr_a(filename), GetLastError());
+        HeapFree(GetProcessHeap(), 0, trace);
+        return NULL;
+    }
+    QueryPerformanceFrequency(&trace->frequency);
+
+    header.magic = WINED3D_CS_TRACE_MAGIC;
+    header.version = WINED3D_CS_TRACE_VERSION;
+    header.op_count = WINED3D_CS_OP_STOP;
+    header.pointer_size = sizeof(void *);
+    header.frequency = trace->frequency;
+    wined3d_cs_trace_write(trace, &header, sizeof(header));
+
+    TRACE("Writing command stream trace to %s.\n", debugstr_a(filename));
+
+    return trace;
+}
+
+static void wined3d_cs_trace_destroy(struct wined3d_cs_trace *trace)
+{
+    const struct wined3d_cs_trace_stats *stats;
+    unsigned int i;
+
+    wined3d_cs_trace_write(trace, trace->stats, sizeof(trace->stats));
+    wined3d_cs_trace_flush(trace);
+    CloseHandle(trace->file);
+
+    if (TRACE_ON(d3d_perf))
+    {
+        for (i = 0; i < WINED3D_CS_OP_STOP; ++i)
+        {
+            stats = &trace->stats[i];
+            if (!stats->count)
+                continue;
+            TRACE_(d3d_perf)("%s: %s ops, %s bytes, %s us total, %s us max.\n", debug_cs_op(i),
+                    wine_dbgstr_longlong(stats->count), wine_dbgstr_longlong(stats->bytes),
+                    wine_dbgstr_longlong(stats->ticks * 1000000 / trace->frequency.QuadPart),
+                    wine_dbgstr_longlong(stats->max_ticks * 1000000 / trace->frequency.QuadPart));
+        }
+    }
+
+    HeapFree(GetProcessHeap(), 0, trace);
+}
+
+static void wined3d_cs_trace_packet(struct wined3d_cs_trace *trace,
+        const void *data, size_t size, ULONGLONG ticks)
+{
+    enum wined3d_cs_op opcode = *(const enum wined3d_cs_op *)data;
+    struct wined3d_cs_trace_stats *stats;
+    struct wined3d_cs_trace_record record;
+
+    record.opcode = opcode;
+    record.packet_size = size;
+    record.ticks = ticks;
+    wined3d_cs_trace_write(trace, &record, sizeof(record));
+
+    stats = &trace->stats[opcode];
+    ++stats->count;
+    stats->ticks += ticks;
+    stats->max_ticks = max(stats->max_ticks, ticks);
+    stats->bytes += size;
+}
+
+static void wined3d_cs_exec_packet(struct wined3d_cs *cs, const void *data, size_t size)
+{
+    enum wined3d_cs_op opcode = *(const enum wined3d_cs_op *)data;
+    LARGE_INTEGER start, end;
+
+    if (!cs->trace)
+    {
+        wined3d_cs_op_handlers[opcode](cs, data);
+        return;
+    }
+
+    QueryPerformanceCounter(&start);
+    wined3d_cs_op_handlers[opcode](cs, data);
+    QueryPerformanceCounter(&end);
+    wined3d_cs_trace_packet(cs->trace, data, size, end.QuadPart - start.QuadPart);
+}
+
 static void *wined3d_cs_st_require_space(struct wined3d_cs *cs, size_t size, enum wined3d_cs_queue_id queue_id)
 {
     if (size > (cs->data_size - cs->end))
@@ -2395,7 +2661,7 @@ static void wined3d_cs_st_submit(struct wined3d_cs *cs, enum wined3d_cs_queue_id
     if (opcode >= WINED3D_CS_OP_STOP)
         ERR("Invalid opcode %#x.\n", opcode);
     else
-        wined3d_cs_op_handlers[opcode](cs, &data[start]);
+        wined3d_cs_exec_packet(cs, &data[start], cs->end - start);
 
     if (cs->data == data)
         cs->start = cs->end = start;
@@ -2615,7 +2881,7 @@ static DWORD WINAPI wined3d_cs_run(void *ctx)
                 break;
             }
 
-            wined3d_cs_op_handlers[opcode](cs, packet->data);
+            wined3d_cs_exec_packet(cs, packet->data, packet->size);
         }
 
         tail += FIELD_OFFSET(struct wined3d_cs_packet, data[packet->size]);
@@ -2653,6 +2919,9 @@ struct wined3d_cs *wined3d_cs_create(struct wined3d_device *device)
     if (!(cs->data = HeapAlloc(GetProcessHeap(), 0, cs->data_size)))
         goto fail;
 
+    if (wined3d_settings.cs_trace)
+        cs->trace = wined3d_cs_trace_create(wined3d_settings.cs_trace);
+
     if (wined3d_settings.cs_multithreaded
             && !RtlIsCriticalSectionLockedByThread(NtCurrentTeb()->Peb->LoaderLock))
     {
@@ -2661,7 +2930,6 @@ struct wined3d_cs *wined3d_cs_create(struct wined3d_device *device)
         if (!(cs->event = CreateEventW(NULL, FALSE, FALSE, NULL)))
         {
             ERR("Failed to create command stream event.\n");
-            HeapFree(GetProcessHeap(), 0, cs->data);
             goto fail;
         }
 
@@ -2670,7 +2938,6 @@ struct wined3d_cs *wined3d_cs_create(struct wined3d_device *device)
         {
             ERR("Failed to get wined3d module handle.\n");
             CloseHandle(cs->event);
-            HeapFree(GetProcessHeap(), 0, cs->data);
             goto fail;
         }
 
@@ -2679,7 +2946,6 @@ struct wined3d_cs *wined3d_cs_create(struct wined3d_device *device)
             ERR("Failed to create wined3d command stream thread.\n");
             FreeLibrary(cs->wined3d_module);
             CloseHandle(cs->event);
-            HeapFree(GetProcessHeap(), 0, cs->data);
             goto fail;
         }
     }
@@ -2687,6 +2953,9 @@ struct wined3d_cs *wined3d_cs_create(struct wined3d_device *device)
     return cs;
 
 fail:
+    if (cs->trace)
+        wined3d_cs_trace_destroy(cs->trace);
+    HeapFree(GetProcessHeap(), 0, cs->data);
     state_cleanup(&cs->state);
     HeapFree(GetProcessHeap(), 0, cs->fb.render_targets);
     HeapFree(GetProcessHeap(), 0, cs);
@@ -2703,6 +2972,8 @@ void wined3d_cs_destroy(struct wined3d_cs *cs)
             ERR("Closing event failed.\n");
     }
 
+    if (cs->trace)
+        wined3d_cs_trace_destroy(cs->trace);
     state_cleanup(&cs->state);
     HeapFree(GetProcessHeap(), 0, cs->fb.render_targets);
     HeapFree(GetProcessHeap(), 0, cs->data);
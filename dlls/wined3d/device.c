@@ -481,6 +481,7 @@ ULONG CDECL wined3d_device_decref(struct wined3d_device *device)
         UINT i;
 
         wined3d_cs_destroy(device->cs);
+        wined3d_buffer_heap_cleanup(&device->buffer_heap);
 
         if (device->recording && wined3d_stateblock_decref(device->recording))
             ERR("Something's still holding the recording stateblock.\n");
@@ -985,6 +986,7 @@ static void wined3d_device_delete_opengl_contexts_cs(void *object)
     }
 
     context = context_acquire(device, NULL, 0);
+    wined3d_buffer_heap_destroy_storage(&device->buffer_heap, context);
     device->blitter->ops->blitter_destroy(device->blitter, context);
     device->shader_backend->shader_free_private(device);
     destroy_dummy_textures(device, context);
@@ -1036,6 +1038,7 @@ static void wined3d_device_create_primary_opengl_context_cs(void *object)
     context = context_acquire(device, target, 0);
     create_dummy_textures(device, context);
     create_default_samplers(device, context);
+    wined3d_buffer_heap_create_storage(&device->buffer_heap, context);
     context_release(context);
 }
 
@@ -5103,6 +5106,8 @@ HRESULT device_init(struct wined3d_device *device, struct wined3d *wined3d,
         goto err;
     }
 
+    wined3d_buffer_heap_init(&device->buffer_heap);
+
     return WINED3D_OK;
 
 err:
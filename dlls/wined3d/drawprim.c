@@ -557,7 +557,7 @@ void draw_primitive(struct wined3d_device *device, const struct wined3d_state *s
         else
         {
             ib_fence = index_buffer->fence;
-            idx_data = NULL;
+            idx_data = (const void *)(ULONG_PTR)index_buffer->bo_offset;
         }
         idx_data = (const BYTE *)idx_data + state->index_offset;
 
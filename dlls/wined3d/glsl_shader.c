@@ -42,6 +42,7 @@
 
 WINE_DEFAULT_DEBUG_CHANNEL(d3d_shader);
 WINE_DECLARE_DEBUG_CHANNEL(d3d);
+WINE_DECLARE_DEBUG_CHANNEL(d3d_perf);
 WINE_DECLARE_DEBUG_CHANNEL(winediag);
 
 #define WINED3D_GLSL_SAMPLE_PROJECTED   0x01
@@ -131,6 +132,15 @@ struct shader_glsl_priv
     struct wine_rb_tree ffp_fragment_shaders;
     BOOL ffp_proj_control;
     BOOL legacy_lighting;
+
+    struct wined3d_shader_cache *program_cache;
+    struct wined3d_shader_cache_key program_cache_seed;
+    BOOL program_cache_seeded;
+
+    BOOL async_link;
+    unsigned int programs_pending;
+    unsigned int programs_ready;
+    unsigned int draws_skipped;
 };
 
 struct glsl_vs_program
@@ -242,6 +252,10 @@ struct glsl_shader_prog_link
     GLuint id;
     DWORD constant_update_mask;
     UINT constant_version;
+    struct wined3d_shader_cache_key stage_keys[WINED3D_SHADER_TYPE_GRAPHICS_COUNT];
+    struct wined3d_shader_cache_key cache_key;
+    BOOL cacheable;
+    BOOL pending;
 };
 
 struct glsl_program_key
@@ -258,7 +272,7 @@ struct shader_glsl_ctx_priv {
     const struct vs_compile_args    *cur_vs_args;
     const struct ds_compile_args    *cur_ds_args;
     const struct ps_compile_args    *cur_ps_args;
-    struct ps_np2fixup_info         *cur_np2fixup_info;
+    const struct ps_np2fixup_info   *cur_np2fixup_info;
     struct wined3d_string_buffer_list *string_buffers;
 };
 
@@ -268,34 +282,47 @@ struct glsl_context_data
     GLenum vertex_color_clamp;
 };
 
+/* With a program cache, GL shader objects are created empty, and GLSL is only
+ * generated and compiled for them when a program using them isn't found in
+ * the cache. */
 struct glsl_ps_compiled_shader
 {
     struct ps_compile_args          args;
     struct ps_np2fixup_info         np2fixup;
     GLuint                          id;
+    BOOL                            compiled;
+    struct wined3d_shader_cache_key cache_key;
 };
 
 struct glsl_vs_compiled_shader
 {
     struct vs_compile_args          args;
     GLuint                          id;
+    BOOL                            compiled;
+    struct wined3d_shader_cache_key cache_key;
 };
 
 struct glsl_hs_compiled_shader
 {
     GLuint id;
+    BOOL compiled;
+    struct wined3d_shader_cache_key cache_key;
 };
 
 struct glsl_ds_compiled_shader
 {
     struct ds_compile_args args;
     GLuint id;
+    BOOL compiled;
+    struct wined3d_shader_cache_key cache_key;
 };
 
 struct glsl_gs_compiled_shader
 {
     struct gs_compile_args args;
     GLuint id;
+    BOOL compiled;
+    struct wined3d_shader_cache_key cache_key;
 };
 
 struct glsl_cs_compiled_shader
@@ -321,6 +348,7 @@ struct glsl_ffp_vertex_shader
 {
     struct wined3d_ffp_vs_desc desc;
     GLuint id;
+    struct wined3d_shader_cache_key cache_key;
     struct list linked_programs;
 };
 
@@ -328,6 +356,7 @@ struct glsl_ffp_fragment_shader
 {
     struct ffp_frag_desc entry;
     GLuint id;
+    struct wined3d_shader_cache_key cache_key;
     struct list linked_programs;
 };
 
@@ -585,6 +614,182 @@ void shader_glsl_validate_link(const struct wined3d_gl_info *gl_info, GLuint pro
     print_glsl_info_log(gl_info, program, TRUE);
 }
 
+static void shader_glsl_cache_key_add_signature(struct wined3d_shader_cache_key *key,
+        const struct wined3d_shader_signature *signature)
+{
+    const struct wined3d_shader_signature_element *e;
+    unsigned int i;
+
+    wined3d_shader_cache_key_update(key, &signature->element_count, sizeof(signature->element_count));
+    for (i = 0; i < signature->element_count; ++i)
+    {
+        e = &signature->elements[i];
+        if (e->semantic_name)
+            wined3d_shader_cache_key_update(key, e->semantic_name, strlen(e->semantic_name) + 1);
+        wined3d_shader_cache_key_update(key, &e->semantic_idx, sizeof(e->semantic_idx));
+        wined3d_shader_cache_key_update(key, &e->stream_idx, sizeof(e->stream_idx));
+        wined3d_shader_cache_key_update(key, &e->sysval_semantic, sizeof(e->sysval_semantic));
+        wined3d_shader_cache_key_update(key, &e->component_type, sizeof(e->component_type));
+        wined3d_shader_cache_key_update(key, &e->register_idx, sizeof(e->register_idx));
+        wined3d_shader_cache_key_update(key, &e->mask, sizeof(e->mask));
+    }
+}
+
+/* The cache key of a GL shader covers everything its GLSL is generated from:
+ * the shader byte code, its signatures and limits, and the compile args. */
+static void shader_glsl_get_shader_cache_key(const struct wined3d_shader *shader,
+        const void *args, SIZE_T args_size, struct wined3d_shader_cache_key *key)
+{
+    wined3d_shader_cache_key_init(key);
+    wined3d_shader_cache_key_update(key, shader->function, shader->functionLength);
+    shader_glsl_cache_key_add_signature(key, &shader->input_signature);
+    shader_glsl_cache_key_add_signature(key, &shader->output_signature);
+    shader_glsl_cache_key_add_signature(key, &shader->patch_constant_signature);
+    wined3d_shader_cache_key_update(key, shader->limits, sizeof(*shader->limits));
+    if (args_size)
+        wined3d_shader_cache_key_update(key, args, args_size);
+}
+
+static void shader_glsl_get_ffp_cache_key(const char *name, const void *settings, SIZE_T settings_size,
+        struct wined3d_shader_cache_key *key)
+{
+    wined3d_shader_cache_key_init(key);
+    wined3d_shader_cache_key_update(key, name, strlen(name) + 1);
+    wined3d_shader_cache_key_update(key, settings, settings_size);
+}
+
+/* Context activation is done by the caller. */
+static void shader_glsl_get_program_cache_key(struct shader_glsl_priv *priv, const struct wined3d_context *context,
+        const struct wined3d_shader_cache_key *stage_keys, unsigned int stage_count, DWORD flags,
+        struct wined3d_shader_cache_key *key)
+{
+    static const GLenum driver_strings[] = {GL_VENDOR, GL_RENDERER, GL_VERSION};
+    const struct wined3d_gl_info *gl_info = context->gl_info;
+    unsigned int i;
+    const char *str;
+
+    /* Program binaries are only valid for the driver that produced them, and
+     * the generated GLSL also depends on a few device wide settings. */
+    if (!priv->program_cache_seeded)
+    {
+        DWORD creation_flags = context->d3d_info->wined3d_creation_flags;
+
+        wined3d_shader_cache_key_init(&priv->program_cache_seed);
+        for (i = 0; i < ARRAY_SIZE(driver_strings); ++i)
+        {
+            if ((str = (const char *)gl_info->gl_ops.gl.p_glGetString(driver_strings[i])))
+                wined3d_shader_cache_key_update(&priv->program_cache_seed, str, strlen(str) + 1);
+        }
+        wined3d_shader_cache_key_update(&priv->program_cache_seed, &creation_flags, sizeof(creation_flags));
+        wined3d_shader_cache_key_update(&priv->program_cache_seed, &wined3d_settings.check_float_constants,
+                sizeof(wined3d_settings.check_float_constants));
+        wined3d_shader_cache_key_update(&priv->program_cache_seed, &priv->legacy_lighting,
+                sizeof(priv->legacy_lighting));
+        wined3d_shader_cache_key_update(&priv->program_cache_seed, &priv->ffp_proj_control,
+                sizeof(priv->ffp_proj_control));
+        priv->program_cache_seeded = TRUE;
+    }
+    *key = priv->program_cache_seed;
+
+    for (i = 0; i < stage_count; ++i)
+    {
+        wined3d_shader_cache_key_update(key, &stage_keys[i].hash, sizeof(stage_keys[i].hash));
+        wined3d_shader_cache_key_update(key, &stage_keys[i].check, sizeof(stage_keys[i].check));
+    }
+    wined3d_shader_cache_key_update(key, &flags, sizeof(flags));
+}
+
+/* Context activation is done by the caller. */
+static void shader_glsl_store_program_binary(struct shader_glsl_priv *priv,
+        const struct wined3d_gl_info *gl_info, GLuint program, const struct wined3d_shader_cache_key *key)
+{
+    GLint size = 0;
+    GLenum format;
+    void *data;
+
+    GL_EXTCALL(glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size));
+    if (size <= 0 || !(data = HeapAlloc(GetProcessHeap(), 0, size)))
+        return;
+
+    GL_EXTCALL(glGetProgramBinary(program, size, &size, &format, data));
+    checkGLcall("glGetProgramBinary");
+    wined3d_shader_cache_put(priv->program_cache, key, format, data, size);
+
+    HeapFree(GetProcessHeap(), 0, data);
+}
+
+/* Context activation is done by the caller. */
+static void shader_glsl_finish_link(struct shader_glsl_priv *priv, const struct wined3d_gl_info *gl_info,
+        GLuint program, const struct wined3d_shader_cache_key *key)
+{
+    GLint status;
+
+    shader_glsl_validate_link(gl_info, program);
+
+    if (!key)
+        return;
+
+    GL_EXTCALL(glGetProgramiv(program, GL_LINK_STATUS, &status));
+    if (status)
+        shader_glsl_store_program_binary(priv, gl_info, program, key);
+}
+
+/* Loads a program from the shader cache. This happens before any GLSL is
+ * generated for the program's shaders. */
+/* Context activation is done by the caller. */
+static BOOL shader_glsl_load_program_binary(struct shader_glsl_priv *priv,
+        const struct wined3d_gl_info *gl_info, GLuint program, const struct wined3d_shader_cache_key *key)
+{
+    struct wined3d_shader_cache_entry *entry;
+    GLint status;
+
+    if (!(entry = wined3d_shader_cache_get(priv->program_cache, key)))
+        return FALSE;
+
+    GL_EXTCALL(glProgramBinary(program, entry->format, entry->data, entry->size));
+    HeapFree(GetProcessHeap(), 0, entry);
+    GL_EXTCALL(glGetProgramiv(program, GL_LINK_STATUS, &status));
+    checkGLcall("glProgramBinary");
+    if (!status)
+    {
+        WARN("Failed to load program binary for program %u, relinking.\n", program);
+        return FALSE;
+    }
+
+    TRACE("Loaded GLSL shader program %u from the shader cache.\n", program);
+    return TRUE;
+}
+
+/* Links the program. With "key" set, the program binary is stored in the
+ * shader cache under that key. Programs with transform feedback varyings
+ * aren't cached, since those aren't part of the key.
+ *
+ * With "async" set the link may continue in the background, in which case
+ * FALSE is returned and shader_glsl_finish_link() has to be called once
+ * GL_COMPLETION_STATUS_ARB reports the program as complete. */
+/* Context activation is done by the caller. */
+static BOOL shader_glsl_link_program(struct shader_glsl_priv *priv, const struct wined3d_gl_info *gl_info,
+        GLuint program, const struct wined3d_shader_cache_key *key, BOOL async)
+{
+    GLint status;
+
+    if (key)
+        GL_EXTCALL(glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE));
+
+    TRACE("Linking GLSL shader program %u.\n", program);
+    GL_EXTCALL(glLinkProgram(program));
+
+    if (async)
+    {
+        GL_EXTCALL(glGetProgramiv(program, GL_COMPLETION_STATUS_ARB, &status));
+        if (!status)
+            return FALSE;
+    }
+
+    shader_glsl_finish_link(priv, gl_info, program, key);
+    return TRUE;
+}
+
 static BOOL shader_glsl_use_layout_qualifier(const struct wined3d_gl_info *gl_info)
 {
     /* Layout qualifiers were introduced in GLSL 1.40. The Nvidia Legacy GPU
@@ -6648,6 +6853,8 @@ static void delete_glsl_program_entry(struct shader_glsl_priv *priv, const struc
 {
     wine_rb_remove(&priv->program_lookup, &entry->program_lookup_entry);
 
+    if (entry->pending)
+        --priv->programs_pending;
     GL_EXTCALL(glDeleteProgram(entry->id));
     if (entry->vs.id)
         list_remove(&entry->vs.shader_entry);
@@ -7221,10 +7428,42 @@ static void shader_glsl_generate_ps_epilogue(const struct wined3d_gl_info *gl_in
 }
 
 /* Context activation is done by the caller. */
+/* NP2/RECT textures in OpenGL use texcoords in the range [0,width]x[0,height]
+ * while D3D has them in the (normalized) [0,1]x[0,1] range.
+ * samplerNP2Fixup stores texture dimensions and is updated through
+ * shader_glsl_load_np2fixup_constants when the sampler changes. */
+static void shader_glsl_init_ps_np2fixup(const struct wined3d_shader *shader,
+        const struct ps_compile_args *args, struct ps_np2fixup_info *fixup)
+{
+    const struct wined3d_shader_reg_maps *reg_maps = &shader->reg_maps;
+    unsigned int i, cur = 0;
+
+    memset(fixup, 0, sizeof(*fixup));
+    if (!args->np2_fixup)
+        return;
+
+    for (i = 0; i < shader->limits->sampler; ++i)
+    {
+        if (!reg_maps->resource_info[i].type || !(args->np2_fixup & (1u << i)))
+            continue;
+
+        if (reg_maps->resource_info[i].type != WINED3D_SHADER_RESOURCE_TEXTURE_2D)
+        {
+            FIXME("Non-2D texture is flagged for NP2 texcoord fixup.\n");
+            continue;
+        }
+
+        fixup->idx[i] = cur++;
+    }
+
+    fixup->num_consts = (cur + 1) >> 1;
+    fixup->active = args->np2_fixup;
+}
+
 static GLuint shader_glsl_generate_pshader(const struct wined3d_context *context,
         struct wined3d_string_buffer *buffer, struct wined3d_string_buffer_list *string_buffers,
-        const struct wined3d_shader *shader,
-        const struct ps_compile_args *args, struct ps_np2fixup_info *np2fixup_info)
+        const struct wined3d_shader *shader, const struct ps_compile_args *args,
+        const struct ps_np2fixup_info *np2fixup_info, GLuint shader_id)
 {
     const struct wined3d_shader_reg_maps *reg_maps = &shader->reg_maps;
     const struct wined3d_shader_version *version = &reg_maps->shader_version;
@@ -7233,7 +7472,6 @@ static GLuint shader_glsl_generate_pshader(const struct wined3d_context *context
     const BOOL legacy_syntax = needs_legacy_glsl_syntax(gl_info);
     unsigned int i, extra_constants_needed = 0;
     struct shader_glsl_ctx_priv priv_ctx;
-    GLuint shader_id;
     DWORD map;
 
     memset(&priv_ctx, 0, sizeof(priv_ctx));
@@ -7278,33 +7516,7 @@ static GLuint shader_glsl_generate_pshader(const struct wined3d_context *context
      * series and when forcing the ARB_npot extension off. Modern cards just
      * skip the code anyway, so put it inside a separate loop. */
     if (args->np2_fixup)
-    {
-        struct ps_np2fixup_info *fixup = priv_ctx.cur_np2fixup_info;
-        unsigned int cur = 0;
-
-        /* NP2/RECT textures in OpenGL use texcoords in the range [0,width]x[0,height]
-         * while D3D has them in the (normalized) [0,1]x[0,1] range.
-         * samplerNP2Fixup stores texture dimensions and is updated through
-         * shader_glsl_load_np2fixup_constants when the sampler changes. */
-
-        for (i = 0; i < shader->limits->sampler; ++i)
-        {
-            if (!reg_maps->resource_info[i].type || !(args->np2_fixup & (1u << i)))
-                continue;
-
-            if (reg_maps->resource_info[i].type != WINED3D_SHADER_RESOURCE_TEXTURE_2D)
-            {
-                FIXME("Non-2D texture is flagged for NP2 texcoord fixup.\n");
-                continue;
-            }
-
-            fixup->idx[i] = cur++;
-        }
-
-        fixup->num_consts = (cur + 1) >> 1;
-        fixup->active = args->np2_fixup;
-        shader_addline(buffer, "uniform vec4 %s_samplerNP2Fixup[%u];\n", prefix, fixup->num_consts);
-    }
+        shader_addline(buffer, "uniform vec4 %s_samplerNP2Fixup[%u];\n", prefix, np2fixup_info->num_consts);
 
     if (version->major < 3 || args->vp_mode != vertexshader)
     {
@@ -7484,7 +7696,6 @@ static GLuint shader_glsl_generate_pshader(const struct wined3d_context *context
 
     shader_addline(buffer, "}\n");
 
-    shader_id = GL_EXTCALL(glCreateShader(GL_FRAGMENT_SHADER));
     TRACE("Compiling shader object %u.\n", shader_id);
     shader_glsl_compile(gl_info, shader_id, buffer->buffer);
 
@@ -7535,8 +7746,8 @@ static void shader_glsl_generate_vs_epilogue(const struct wined3d_gl_info *gl_in
 }
 
 /* Context activation is done by the caller. */
-static GLuint shader_glsl_generate_vshader(const struct wined3d_context *context,
-        struct shader_glsl_priv *priv, const struct wined3d_shader *shader, const struct vs_compile_args *args)
+static GLuint shader_glsl_generate_vshader(const struct wined3d_context *context, struct shader_glsl_priv *priv,
+        const struct wined3d_shader *shader, const struct vs_compile_args *args, GLuint shader_id)
 {
     struct wined3d_string_buffer_list *string_buffers = &priv->string_buffers;
     const struct wined3d_shader_reg_maps *reg_maps = &shader->reg_maps;
@@ -7544,7 +7755,6 @@ static GLuint shader_glsl_generate_vshader(const struct wined3d_context *context
     struct wined3d_string_buffer *buffer = &priv->shader_buffer;
     const struct wined3d_gl_info *gl_info = context->gl_info;
     struct shader_glsl_ctx_priv priv_ctx;
-    GLuint shader_id;
     unsigned int i;
 
     memset(&priv_ctx, 0, sizeof(priv_ctx));
@@ -7610,7 +7820,6 @@ static GLuint shader_glsl_generate_vshader(const struct wined3d_context *context
 
     shader_addline(buffer, "}\n");
 
-    shader_id = GL_EXTCALL(glCreateShader(GL_VERTEX_SHADER));
     TRACE("Compiling shader object %u.\n", shader_id);
     shader_glsl_compile(gl_info, shader_id, buffer->buffer);
 
@@ -7667,7 +7876,7 @@ static void shader_glsl_generate_shader_phase_invocation(struct wined3d_string_b
 }
 
 static GLuint shader_glsl_generate_hull_shader(const struct wined3d_context *context,
-        struct shader_glsl_priv *priv, const struct wined3d_shader *shader)
+        struct shader_glsl_priv *priv, const struct wined3d_shader *shader, GLuint shader_id)
 {
     struct wined3d_string_buffer_list *string_buffers = &priv->string_buffers;
     const struct wined3d_shader_reg_maps *reg_maps = &shader->reg_maps;
@@ -7676,7 +7885,6 @@ static GLuint shader_glsl_generate_hull_shader(const struct wined3d_context *con
     const struct wined3d_hull_shader *hs = &shader->u.hs;
     const struct wined3d_shader_phase *phase;
     struct shader_glsl_ctx_priv priv_ctx;
-    GLuint shader_id;
     unsigned int i;
 
     memset(&priv_ctx, 0, sizeof(priv_ctx));
@@ -7745,7 +7953,6 @@ static GLuint shader_glsl_generate_hull_shader(const struct wined3d_context *con
     shader_addline(buffer, "setup_patch_constant_output();\n");
     shader_addline(buffer, "}\n");
 
-    shader_id = GL_EXTCALL(glCreateShader(GL_TESS_CONTROL_SHADER));
     TRACE("Compiling shader object %u.\n", shader_id);
     shader_glsl_compile(gl_info, shader_id, buffer->buffer);
 
@@ -7762,15 +7969,14 @@ static void shader_glsl_generate_ds_epilogue(const struct wined3d_gl_info *gl_in
         shader_glsl_fixup_position(buffer);
 }
 
-static GLuint shader_glsl_generate_domain_shader(const struct wined3d_context *context,
-        struct shader_glsl_priv *priv, const struct wined3d_shader *shader, const struct ds_compile_args *args)
+static GLuint shader_glsl_generate_domain_shader(const struct wined3d_context *context, struct shader_glsl_priv *priv,
+        const struct wined3d_shader *shader, const struct ds_compile_args *args, GLuint shader_id)
 {
     struct wined3d_string_buffer_list *string_buffers = &priv->string_buffers;
     const struct wined3d_shader_reg_maps *reg_maps = &shader->reg_maps;
     struct wined3d_string_buffer *buffer = &priv->shader_buffer;
     const struct wined3d_gl_info *gl_info = context->gl_info;
     struct shader_glsl_ctx_priv priv_ctx;
-    GLuint shader_id;
 
     memset(&priv_ctx, 0, sizeof(priv_ctx));
     priv_ctx.cur_ds_args = args;
@@ -7848,7 +8054,6 @@ static GLuint shader_glsl_generate_domain_shader(const struct wined3d_context *c
 
     shader_addline(buffer, "}\n");
 
-    shader_id = GL_EXTCALL(glCreateShader(GL_TESS_EVALUATION_SHADER));
     TRACE("Compiling shader object %u.\n", shader_id);
     shader_glsl_compile(gl_info, shader_id, buffer->buffer);
 
@@ -7856,15 +8061,14 @@ static GLuint shader_glsl_generate_domain_shader(const struct wined3d_context *c
 }
 
 /* Context activation is done by the caller. */
-static GLuint shader_glsl_generate_geometry_shader(const struct wined3d_context *context,
-        struct shader_glsl_priv *priv, const struct wined3d_shader *shader, const struct gs_compile_args *args)
+static GLuint shader_glsl_generate_geometry_shader(const struct wined3d_context *context, struct shader_glsl_priv *priv,
+        const struct wined3d_shader *shader, const struct gs_compile_args *args, GLuint shader_id)
 {
     struct wined3d_string_buffer_list *string_buffers = &priv->string_buffers;
     const struct wined3d_shader_reg_maps *reg_maps = &shader->reg_maps;
     struct wined3d_string_buffer *buffer = &priv->shader_buffer;
     const struct wined3d_gl_info *gl_info = context->gl_info;
     struct shader_glsl_ctx_priv priv_ctx;
-    GLuint shader_id;
 
     memset(&priv_ctx, 0, sizeof(priv_ctx));
     priv_ctx.string_buffers = string_buffers;
@@ -7892,7 +8096,6 @@ static GLuint shader_glsl_generate_geometry_shader(const struct wined3d_context
         return 0;
     shader_addline(buffer, "}\n");
 
-    shader_id = GL_EXTCALL(glCreateShader(GL_GEOMETRY_SHADER));
     TRACE("Compiling shader object %u.\n", shader_id);
     shader_glsl_compile(gl_info, shader_id, buffer->buffer);
 
@@ -7929,13 +8132,12 @@ static void shader_glsl_generate_shader_epilogue(const struct wined3d_shader_con
 /* Context activation is done by the caller. */
 static GLuint shader_glsl_generate_compute_shader(const struct wined3d_context *context,
         struct wined3d_string_buffer *buffer, struct wined3d_string_buffer_list *string_buffers,
-        const struct wined3d_shader *shader)
+        const struct wined3d_shader *shader, GLuint shader_id)
 {
     const struct wined3d_shader_thread_group_size *thread_group_size = &shader->u.cs.thread_group_size;
     const struct wined3d_shader_reg_maps *reg_maps = &shader->reg_maps;
     const struct wined3d_gl_info *gl_info = context->gl_info;
     struct shader_glsl_ctx_priv priv_ctx;
-    GLuint shader_id;
     unsigned int i;
 
     memset(&priv_ctx, 0, sizeof(priv_ctx));
@@ -7961,24 +8163,122 @@ static GLuint shader_glsl_generate_compute_shader(const struct wined3d_context *
     shader_generate_code(shader, buffer, reg_maps, &priv_ctx, NULL, NULL);
     shader_addline(buffer, "}\n");
 
-    shader_id = GL_EXTCALL(glCreateShader(GL_COMPUTE_SHADER));
     TRACE("Compiling shader object %u.\n", shader_id);
     shader_glsl_compile(gl_info, shader_id, buffer->buffer);
 
     return shader_id;
 }
 
-static GLuint find_glsl_pshader(const struct wined3d_context *context,
-        struct wined3d_string_buffer *buffer, struct wined3d_string_buffer_list *string_buffers,
-        struct wined3d_shader *shader,
-        const struct ps_compile_args *args, const struct ps_np2fixup_info **np2fixup_info)
+/* Returns the cache key of the GL shader "id" of "shader". With "compile"
+ * set, the GLSL for the GL shader is generated and compiled as well, unless
+ * that was done before. */
+/* Context activation is done by the caller. */
+static const struct wined3d_shader_cache_key *shader_glsl_prepare_gl_shader(const struct wined3d_context *context,
+        struct shader_glsl_priv *priv, struct wined3d_shader *shader, GLuint id, BOOL compile)
+{
+    struct glsl_shader_private *shader_data = shader->backend_data;
+    unsigned int i;
+
+    for (i = 0; i < shader_data->num_gl_shaders; ++i)
+    {
+        switch (shader->reg_maps.shader_version.type)
+        {
+            case WINED3D_SHADER_TYPE_VERTEX:
+            {
+                struct glsl_vs_compiled_shader *gl_shader = &shader_data->gl_shaders.vs[i];
+
+                if (gl_shader->id != id)
+                    continue;
+                if (compile && !gl_shader->compiled)
+                {
+                    string_buffer_clear(&priv->shader_buffer);
+                    shader_glsl_generate_vshader(context, priv, shader, &gl_shader->args, id);
+                    gl_shader->compiled = TRUE;
+                }
+                return &gl_shader->cache_key;
+            }
+
+            case WINED3D_SHADER_TYPE_HULL:
+            {
+                struct glsl_hs_compiled_shader *gl_shader = &shader_data->gl_shaders.hs[i];
+
+                if (gl_shader->id != id)
+                    continue;
+                if (compile && !gl_shader->compiled)
+                {
+                    string_buffer_clear(&priv->shader_buffer);
+                    shader_glsl_generate_hull_shader(context, priv, shader, id);
+                    gl_shader->compiled = TRUE;
+                }
+                return &gl_shader->cache_key;
+            }
+
+            case WINED3D_SHADER_TYPE_DOMAIN:
+            {
+                struct glsl_ds_compiled_shader *gl_shader = &shader_data->gl_shaders.ds[i];
+
+                if (gl_shader->id != id)
+                    continue;
+                if (compile && !gl_shader->compiled)
+                {
+                    string_buffer_clear(&priv->shader_buffer);
+                    shader_glsl_generate_domain_shader(context, priv, shader, &gl_shader->args, id);
+                    gl_shader->compiled = TRUE;
+                }
+                return &gl_shader->cache_key;
+            }
+
+            case WINED3D_SHADER_TYPE_GEOMETRY:
+            {
+                struct glsl_gs_compiled_shader *gl_shader = &shader_data->gl_shaders.gs[i];
+
+                if (gl_shader->id != id)
+                    continue;
+                if (compile && !gl_shader->compiled)
+                {
+                    string_buffer_clear(&priv->shader_buffer);
+                    shader_glsl_generate_geometry_shader(context, priv, shader, &gl_shader->args, id);
+                    gl_shader->compiled = TRUE;
+                }
+                return &gl_shader->cache_key;
+            }
+
+            case WINED3D_SHADER_TYPE_PIXEL:
+            {
+                struct glsl_ps_compiled_shader *gl_shader = &shader_data->gl_shaders.ps[i];
+
+                if (gl_shader->id != id)
+                    continue;
+                if (compile && !gl_shader->compiled)
+                {
+                    pixelshader_update_resource_types(shader, gl_shader->args.tex_types);
+                    string_buffer_clear(&priv->shader_buffer);
+                    shader_glsl_generate_pshader(context, &priv->shader_buffer, &priv->string_buffers,
+                            shader, &gl_shader->args, &gl_shader->np2fixup, id);
+                    gl_shader->compiled = TRUE;
+                }
+                return &gl_shader->cache_key;
+            }
+
+            default:
+                FIXME("Unhandled shader type %#x.\n", shader->reg_maps.shader_version.type);
+                return NULL;
+        }
+    }
+
+    ERR("Failed to find GL shader %u for shader %p.\n", id, shader);
+    return NULL;
+}
+
+static GLuint find_glsl_pshader(const struct wined3d_context *context, struct shader_glsl_priv *priv,
+        struct wined3d_shader *shader, const struct ps_compile_args *args,
+        const struct ps_np2fixup_info **np2fixup_info)
 {
-    struct glsl_ps_compiled_shader *gl_shaders, *new_array;
+    struct glsl_ps_compiled_shader *gl_shaders, *new_array, *gl_shader;
     struct glsl_shader_private *shader_data;
-    struct ps_np2fixup_info *np2fixup;
+    const struct wined3d_gl_info *gl_info = context->gl_info;
     UINT i;
     DWORD new_size;
-    GLuint ret;
 
     if (!shader->backend_data)
     {
@@ -8029,19 +8329,20 @@ static GLuint find_glsl_pshader(const struct wined3d_context *context,
         gl_shaders = new_array;
     }
 
-    gl_shaders[shader_data->num_gl_shaders].args = *args;
-
-    np2fixup = &gl_shaders[shader_data->num_gl_shaders].np2fixup;
-    memset(np2fixup, 0, sizeof(*np2fixup));
-    *np2fixup_info = args->np2_fixup ? np2fixup : NULL;
+    gl_shader = &gl_shaders[shader_data->num_gl_shaders++];
+    gl_shader->args = *args;
 
     pixelshader_update_resource_types(shader, args->tex_types);
+    shader_glsl_init_ps_np2fixup(shader, args, &gl_shader->np2fixup);
+    *np2fixup_info = args->np2_fixup ? &gl_shader->np2fixup : NULL;
 
-    string_buffer_clear(buffer);
-    ret = shader_glsl_generate_pshader(context, buffer, string_buffers, shader, args, np2fixup);
-    gl_shaders[shader_data->num_gl_shaders++].id = ret;
+    gl_shader->id = GL_EXTCALL(glCreateShader(GL_FRAGMENT_SHADER));
+    gl_shader->compiled = FALSE;
+    shader_glsl_get_shader_cache_key(shader, args, sizeof(*args), &gl_shader->cache_key);
+    if (!priv->program_cache)
+        shader_glsl_prepare_gl_shader(context, priv, shader, gl_shader->id, TRUE);
 
-    return ret;
+    return gl_shader->id;
 }
 
 static inline BOOL vs_args_equal(const struct vs_compile_args *stored, const struct vs_compile_args *new,
@@ -8068,9 +8369,10 @@ static GLuint find_glsl_vshader(const struct wined3d_context *context, struct sh
     UINT i;
     DWORD new_size;
     DWORD use_map = context->stream_info.use_map;
-    struct glsl_vs_compiled_shader *gl_shaders, *new_array;
+    struct glsl_vs_compiled_shader *gl_shaders, *new_array, *gl_shader;
     struct glsl_shader_private *shader_data;
-    GLuint ret;
+    const struct wined3d_gl_info *gl_info = context->gl_info;
+    struct vs_compile_args key_args;
 
     if (!shader->backend_data)
     {
@@ -8118,22 +8420,27 @@ static GLuint find_glsl_vshader(const struct wined3d_context *context, struct sh
         gl_shaders = new_array;
     }
 
-    gl_shaders[shader_data->num_gl_shaders].args = *args;
+    gl_shader = &gl_shaders[shader_data->num_gl_shaders++];
+    gl_shader->args = *args;
 
-    string_buffer_clear(&priv->shader_buffer);
-    ret = shader_glsl_generate_vshader(context, priv, shader, args);
-    gl_shaders[shader_data->num_gl_shaders++].id = ret;
+    gl_shader->id = GL_EXTCALL(glCreateShader(GL_VERTEX_SHADER));
+    gl_shader->compiled = FALSE;
+    key_args = *args;
+    key_args.padding = 0;
+    shader_glsl_get_shader_cache_key(shader, &key_args, sizeof(key_args), &gl_shader->cache_key);
+    if (!priv->program_cache)
+        shader_glsl_prepare_gl_shader(context, priv, shader, gl_shader->id, TRUE);
 
-    return ret;
+    return gl_shader->id;
 }
 
 static GLuint find_glsl_hull_shader(const struct wined3d_context *context,
         struct shader_glsl_priv *priv, struct wined3d_shader *shader)
 {
-    struct glsl_hs_compiled_shader *gl_shaders, *new_array;
+    struct glsl_hs_compiled_shader *gl_shaders, *new_array, *gl_shader;
     struct glsl_shader_private *shader_data;
+    const struct wined3d_gl_info *gl_info = context->gl_info;
     unsigned int new_size;
-    GLuint ret;
 
     if (!shader->backend_data)
     {
@@ -8166,20 +8473,23 @@ static GLuint find_glsl_hull_shader(const struct wined3d_context *context,
     shader_data->shader_array_size = new_size;
     gl_shaders = new_array;
 
-    string_buffer_clear(&priv->shader_buffer);
-    ret = shader_glsl_generate_hull_shader(context, priv, shader);
-    gl_shaders[shader_data->num_gl_shaders++].id = ret;
+    gl_shader = &gl_shaders[shader_data->num_gl_shaders++];
+    gl_shader->id = GL_EXTCALL(glCreateShader(GL_TESS_CONTROL_SHADER));
+    gl_shader->compiled = FALSE;
+    shader_glsl_get_shader_cache_key(shader, NULL, 0, &gl_shader->cache_key);
+    if (!priv->program_cache)
+        shader_glsl_prepare_gl_shader(context, priv, shader, gl_shader->id, TRUE);
 
-    return ret;
+    return gl_shader->id;
 }
 
 static GLuint find_glsl_domain_shader(const struct wined3d_context *context,
         struct shader_glsl_priv *priv, struct wined3d_shader *shader, const struct ds_compile_args *args)
 {
-    struct glsl_ds_compiled_shader *gl_shaders, *new_array;
+    struct glsl_ds_compiled_shader *gl_shaders, *new_array, *gl_shader;
     struct glsl_shader_private *shader_data;
+    const struct wined3d_gl_info *gl_info = context->gl_info;
     unsigned int i, new_size;
-    GLuint ret;
 
     if (!shader->backend_data)
     {
@@ -8221,21 +8531,25 @@ static GLuint find_glsl_domain_shader(const struct wined3d_context *context,
     shader_data->shader_array_size = new_size;
     gl_shaders = new_array;
 
-    string_buffer_clear(&priv->shader_buffer);
-    ret = shader_glsl_generate_domain_shader(context, priv, shader, args);
-    gl_shaders[shader_data->num_gl_shaders].args = *args;
-    gl_shaders[shader_data->num_gl_shaders++].id = ret;
+    gl_shader = &gl_shaders[shader_data->num_gl_shaders++];
+    gl_shader->args = *args;
 
-    return ret;
+    gl_shader->id = GL_EXTCALL(glCreateShader(GL_TESS_EVALUATION_SHADER));
+    gl_shader->compiled = FALSE;
+    shader_glsl_get_shader_cache_key(shader, args, sizeof(*args), &gl_shader->cache_key);
+    if (!priv->program_cache)
+        shader_glsl_prepare_gl_shader(context, priv, shader, gl_shader->id, TRUE);
+
+    return gl_shader->id;
 }
 
 static GLuint find_glsl_geometry_shader(const struct wined3d_context *context,
         struct shader_glsl_priv *priv, struct wined3d_shader *shader, const struct gs_compile_args *args)
 {
-    struct glsl_gs_compiled_shader *gl_shaders, *new_array;
+    struct glsl_gs_compiled_shader *gl_shaders, *new_array, *gl_shader;
     struct glsl_shader_private *shader_data;
+    const struct wined3d_gl_info *gl_info = context->gl_info;
     unsigned int i, new_size;
-    GLuint ret;
 
     if (!shader->backend_data)
     {
@@ -8277,12 +8591,16 @@ static GLuint find_glsl_geometry_shader(const struct wined3d_context *context,
     shader_data->shader_array_size = new_size;
     gl_shaders = new_array;
 
-    string_buffer_clear(&priv->shader_buffer);
-    ret = shader_glsl_generate_geometry_shader(context, priv, shader, args);
-    gl_shaders[shader_data->num_gl_shaders].args = *args;
-    gl_shaders[shader_data->num_gl_shaders++].id = ret;
+    gl_shader = &gl_shaders[shader_data->num_gl_shaders++];
+    gl_shader->args = *args;
 
-    return ret;
+    gl_shader->id = GL_EXTCALL(glCreateShader(GL_GEOMETRY_SHADER));
+    gl_shader->compiled = FALSE;
+    shader_glsl_get_shader_cache_key(shader, args, sizeof(*args), &gl_shader->cache_key);
+    if (!priv->program_cache)
+        shader_glsl_prepare_gl_shader(context, priv, shader, gl_shader->id, TRUE);
+
+    return gl_shader->id;
 }
 
 static const char *shader_glsl_ffp_mcs(enum wined3d_material_color_source mcs, const char *material)
@@ -9415,6 +9733,7 @@ static struct glsl_ffp_vertex_shader *shader_glsl_find_ffp_vertex_shader(struct
 
     shader->desc.settings = *settings;
     shader->id = shader_glsl_generate_ffp_vertex_shader(priv, settings, gl_info);
+    shader_glsl_get_ffp_cache_key("ffp_vs", settings, sizeof(*settings), &shader->cache_key);
     list_init(&shader->linked_programs);
     if (wine_rb_put(&priv->ffp_vertex_shaders, &shader->desc.settings, &shader->desc.entry) == -1)
         ERR("Failed to insert ffp vertex shader.\n");
@@ -9436,6 +9755,7 @@ static struct glsl_ffp_fragment_shader *shader_glsl_find_ffp_fragment_shader(str
 
     glsl_desc->entry.settings = *args;
     glsl_desc->id = shader_glsl_generate_ffp_fragment_shader(priv, args, context);
+    shader_glsl_get_ffp_cache_key("ffp_ps", args, sizeof(*args), &glsl_desc->cache_key);
     list_init(&glsl_desc->linked_programs);
     add_ffp_frag_shader(&priv->ffp_fragment_shaders, &glsl_desc->entry);
 
@@ -9600,6 +9920,7 @@ static HRESULT shader_glsl_compile_compute_shader(struct shader_glsl_priv *priv,
     const struct wined3d_gl_info *gl_info = context->gl_info;
     struct glsl_cs_compiled_shader *gl_shaders;
     struct glsl_shader_private *shader_data;
+    struct wined3d_shader_cache_key cs_key;
     struct glsl_shader_prog_link *entry;
     GLuint shader_id, program_id;
 
@@ -9629,10 +9950,7 @@ static HRESULT shader_glsl_compile_compute_shader(struct shader_glsl_priv *priv,
     shader_data->shader_array_size = 1;
     gl_shaders = shader_data->gl_shaders.cs;
 
-    TRACE("Compiling compute shader %p.\n", shader);
-
-    string_buffer_clear(buffer);
-    shader_id = shader_glsl_generate_compute_shader(context, buffer, &priv->string_buffers, shader);
+    shader_id = GL_EXTCALL(glCreateShader(GL_COMPUTE_SHADER));
     gl_shaders[shader_data->num_gl_shaders++].id = shader_id;
 
     program_id = GL_EXTCALL(glCreateProgram());
@@ -9647,17 +9965,31 @@ static HRESULT shader_glsl_compile_compute_shader(struct shader_glsl_priv *priv,
     entry->cs.id = shader_id;
     entry->constant_version = 0;
     entry->ps.np2_fixup_info = NULL;
+    entry->cacheable = !!priv->program_cache;
+    entry->pending = FALSE;
     add_glsl_program_entry(priv, entry);
 
-    TRACE("Attaching GLSL shader object %u to program %u.\n", shader_id, program_id);
-    GL_EXTCALL(glAttachShader(program_id, shader_id));
-    checkGLcall("glAttachShader");
-
     list_add_head(&shader->linked_programs, &entry->cs.shader_entry);
 
-    TRACE("Linking GLSL shader program %u.\n", program_id);
-    GL_EXTCALL(glLinkProgram(program_id));
-    shader_glsl_validate_link(gl_info, program_id);
+    if (entry->cacheable)
+    {
+        shader_glsl_get_shader_cache_key(shader, NULL, 0, &cs_key);
+        shader_glsl_get_program_cache_key(priv, context, &cs_key, 1, 0, &entry->cache_key);
+    }
+
+    if (!entry->cacheable || !shader_glsl_load_program_binary(priv, gl_info, program_id, &entry->cache_key))
+    {
+        TRACE("Compiling compute shader %p.\n", shader);
+
+        string_buffer_clear(buffer);
+        shader_glsl_generate_compute_shader(context, buffer, &priv->string_buffers, shader, shader_id);
+
+        TRACE("Attaching GLSL shader object %u to program %u.\n", shader_id, program_id);
+        GL_EXTCALL(glAttachShader(program_id, shader_id));
+        checkGLcall("glAttachShader");
+
+        shader_glsl_link_program(priv, gl_info, program_id, entry->cacheable ? &entry->cache_key : NULL, FALSE);
+    }
 
     GL_EXTCALL(glUseProgram(program_id));
     checkGLcall("glUseProgram");
@@ -9666,7 +9998,8 @@ static HRESULT shader_glsl_compile_compute_shader(struct shader_glsl_priv *priv,
 
     entry->constant_update_mask = 0;
 
-    GL_EXTCALL(glUseProgram(ctx_data->glsl_program ? ctx_data->glsl_program->id : 0));
+    GL_EXTCALL(glUseProgram(ctx_data->glsl_program && !ctx_data->glsl_program->pending
+            ? ctx_data->glsl_program->id : 0));
     checkGLcall("glUseProgram");
     return WINED3D_OK;
 }
@@ -9717,56 +10050,261 @@ static void set_glsl_compute_shader_program(const struct wined3d_context *contex
 }
 
 /* Context activation is done by the caller. */
-static void set_glsl_shader_program(const struct wined3d_context *context, const struct wined3d_state *state,
-        struct shader_glsl_priv *priv, struct glsl_context_data *ctx_data)
+static void shader_glsl_init_program(const struct wined3d_context *context, struct shader_glsl_priv *priv,
+        struct glsl_shader_prog_link *entry, const struct wined3d_shader *vshader,
+        const struct wined3d_shader *hshader, const struct wined3d_shader *dshader,
+        const struct wined3d_shader *gshader, const struct wined3d_shader *pshader)
 {
     const struct wined3d_gl_info *gl_info = context->gl_info;
-    const struct wined3d_d3d_info *d3d_info = context->d3d_info;
-    const struct ps_np2fixup_info *np2fixup_info = NULL;
-    struct glsl_shader_prog_link *entry = NULL;
-    struct wined3d_shader *hshader, *dshader, *gshader;
-    struct wined3d_shader *vshader = NULL;
-    struct wined3d_shader *pshader = NULL;
-    GLuint reorder_shader_id = 0;
-    struct glsl_program_key key;
-    GLuint program_id;
     unsigned int i;
-    GLuint vs_id = 0;
-    GLuint hs_id = 0;
-    GLuint ds_id = 0;
-    GLuint gs_id = 0;
-    GLuint ps_id = 0;
-    struct list *ps_list, *vs_list;
-    WORD attribs_map;
-    struct wined3d_string_buffer *tmp_name;
 
-    if (!(context->shader_update_mask & (1u << WINED3D_SHADER_TYPE_VERTEX)) && ctx_data->glsl_program)
-    {
-        vs_id = ctx_data->glsl_program->vs.id;
-        vs_list = &ctx_data->glsl_program->vs.shader_entry;
+    shader_glsl_init_vs_uniform_locations(gl_info, priv, entry->id, &entry->vs,
+            vshader ? vshader->limits->constant_float : 0);
+    shader_glsl_init_ds_uniform_locations(gl_info, priv, entry->id, &entry->ds);
+    shader_glsl_init_gs_uniform_locations(gl_info, priv, entry->id, &entry->gs);
+    shader_glsl_init_ps_uniform_locations(gl_info, priv, entry->id, &entry->ps,
+            pshader ? pshader->limits->constant_float : 0);
+    checkGLcall("Find glsl program uniform locations");
 
-        if (use_vs(state))
-            vshader = state->shader[WINED3D_SHADER_TYPE_VERTEX];
+    if (needs_legacy_glsl_syntax(gl_info))
+    {
+        if (pshader && pshader->reg_maps.shader_version.major >= 3
+                && pshader->u.ps.declared_in_count > vec4_varyings(3, gl_info))
+        {
+            TRACE("Shader %d needs vertex color clamping disabled.\n", entry->id);
+            entry->vs.vertex_color_clamp = GL_FALSE;
+        }
+        else
+        {
+            entry->vs.vertex_color_clamp = GL_FIXED_ONLY_ARB;
+        }
     }
-    else if (use_vs(state))
+    else
     {
-        struct vs_compile_args vs_compile_args;
+        /* With core profile we never change vertex_color_clamp from
+         * GL_FIXED_ONLY_MODE (which is also the initial value) so we never call
+         * glClampColorARB(). */
+        entry->vs.vertex_color_clamp = GL_FIXED_ONLY_ARB;
+    }
 
-        vshader = state->shader[WINED3D_SHADER_TYPE_VERTEX];
+    /* Set the shader to allow uniform loading on it */
+    GL_EXTCALL(glUseProgram(entry->id));
+    checkGLcall("glUseProgram");
 
-        find_vs_compile_args(state, vshader, context->stream_info.swizzle_map, &vs_compile_args, d3d_info);
-        vs_id = find_glsl_vshader(context, priv, vshader, &vs_compile_args);
-        vs_list = &vshader->linked_programs;
-    }
-    else if (priv->vertex_pipe == &glsl_vertex_pipe)
+    entry->constant_update_mask = 0;
+    if (vshader)
     {
-        struct glsl_ffp_vertex_shader *ffp_shader;
+        entry->constant_update_mask |= WINED3D_SHADER_CONST_VS_F;
+        if (vshader->reg_maps.integer_constants)
+            entry->constant_update_mask |= WINED3D_SHADER_CONST_VS_I;
+        if (vshader->reg_maps.boolean_constants)
+            entry->constant_update_mask |= WINED3D_SHADER_CONST_VS_B;
+        if (entry->vs.pos_fixup_location != -1)
+            entry->constant_update_mask |= WINED3D_SHADER_CONST_POS_FIXUP;
+
+        shader_glsl_load_program_resources(context, priv, entry->id, vshader);
+    }
+    else
+    {
+        entry->constant_update_mask |= WINED3D_SHADER_CONST_FFP_MODELVIEW
+                | WINED3D_SHADER_CONST_FFP_PROJ;
+
+        for (i = 1; i < MAX_VERTEX_BLENDS; ++i)
+        {
+            if (entry->vs.modelview_matrix_location[i] != -1)
+            {
+                entry->constant_update_mask |= WINED3D_SHADER_CONST_FFP_VERTEXBLEND;
+                break;
+            }
+        }
+
+        for (i = 0; i < MAX_TEXTURES; ++i)
+        {
+            if (entry->vs.texture_matrix_location[i] != -1)
+            {
+                entry->constant_update_mask |= WINED3D_SHADER_CONST_FFP_TEXMATRIX;
+                break;
+            }
+        }
+        if (entry->vs.material_ambient_location != -1 || entry->vs.material_diffuse_location != -1
+                || entry->vs.material_specular_location != -1
+                || entry->vs.material_emissive_location != -1
+                || entry->vs.material_shininess_location != -1)
+            entry->constant_update_mask |= WINED3D_SHADER_CONST_FFP_MATERIAL;
+        if (entry->vs.light_ambient_location != -1)
+            entry->constant_update_mask |= WINED3D_SHADER_CONST_FFP_LIGHTS;
+    }
+    if (entry->vs.clip_planes_location != -1)
+        entry->constant_update_mask |= WINED3D_SHADER_CONST_VS_CLIP_PLANES;
+    if (entry->vs.pointsize_min_location != -1)
+        entry->constant_update_mask |= WINED3D_SHADER_CONST_VS_POINTSIZE;
+
+    if (hshader)
+        shader_glsl_load_program_resources(context, priv, entry->id, hshader);
+
+    if (dshader)
+    {
+        if (entry->ds.pos_fixup_location != -1)
+            entry->constant_update_mask |= WINED3D_SHADER_CONST_POS_FIXUP;
+
+        shader_glsl_load_program_resources(context, priv, entry->id, dshader);
+    }
+
+    if (gshader)
+    {
+        if (entry->gs.pos_fixup_location != -1)
+            entry->constant_update_mask |= WINED3D_SHADER_CONST_POS_FIXUP;
+
+        shader_glsl_load_program_resources(context, priv, entry->id, gshader);
+    }
+
+    if (entry->ps.id)
+    {
+        if (pshader)
+        {
+            entry->constant_update_mask |= WINED3D_SHADER_CONST_PS_F;
+            if (pshader->reg_maps.integer_constants)
+                entry->constant_update_mask |= WINED3D_SHADER_CONST_PS_I;
+            if (pshader->reg_maps.boolean_constants)
+                entry->constant_update_mask |= WINED3D_SHADER_CONST_PS_B;
+            if (entry->ps.ycorrection_location != -1)
+                entry->constant_update_mask |= WINED3D_SHADER_CONST_PS_Y_CORR;
+
+            shader_glsl_load_program_resources(context, priv, entry->id, pshader);
+            shader_glsl_load_images(gl_info, priv, entry->id, &pshader->reg_maps);
+        }
+        else
+        {
+            entry->constant_update_mask |= WINED3D_SHADER_CONST_FFP_PS;
+
+            shader_glsl_load_samplers(context, priv, entry->id, NULL);
+        }
+
+        for (i = 0; i < MAX_TEXTURES; ++i)
+        {
+            if (entry->ps.bumpenv_mat_location[i] != -1)
+            {
+                entry->constant_update_mask |= WINED3D_SHADER_CONST_PS_BUMP_ENV;
+                break;
+            }
+        }
+
+        if (entry->ps.fog_color_location != -1)
+            entry->constant_update_mask |= WINED3D_SHADER_CONST_PS_FOG;
+        if (entry->ps.alpha_test_ref_location != -1)
+            entry->constant_update_mask |= WINED3D_SHADER_CONST_PS_ALPHA_TEST;
+        if (entry->ps.np2_fixup_location != -1)
+            entry->constant_update_mask |= WINED3D_SHADER_CONST_PS_NP2_FIXUP;
+        if (entry->ps.color_key_location != -1)
+            entry->constant_update_mask |= WINED3D_SHADER_CONST_FFP_COLOR_KEY;
+    }
+}
+
+/* Gets the cache key of a program stage. "ffp_key" is used for fixed
+ * function stages. Returns FALSE if the key can't be determined. */
+/* Context activation is done by the caller. */
+static BOOL shader_glsl_get_stage_cache_key(const struct wined3d_context *context, struct shader_glsl_priv *priv,
+        struct wined3d_shader *shader, GLuint id, const struct wined3d_shader_cache_key *ffp_key,
+        struct wined3d_shader_cache_key *key)
+{
+    const struct wined3d_shader_cache_key *stage_key = NULL;
+
+    memset(key, 0, sizeof(*key));
+    if (!id)
+        return TRUE;
+
+    if (shader)
+        stage_key = shader_glsl_prepare_gl_shader(context, priv, shader, id, FALSE);
+    else
+        stage_key = ffp_key;
+    if (!stage_key)
+        return FALSE;
+
+    *key = *stage_key;
+    return TRUE;
+}
+
+/* Finishes the setup of a program that was being linked in the background,
+ * if the driver is done with it. */
+/* Context activation is done by the caller. */
+static void shader_glsl_poll_program(const struct wined3d_context *context, struct shader_glsl_priv *priv,
+        struct glsl_shader_prog_link *entry, const struct wined3d_shader *vshader,
+        const struct wined3d_shader *hshader, const struct wined3d_shader *dshader,
+        const struct wined3d_shader *gshader, const struct wined3d_shader *pshader)
+{
+    const struct wined3d_gl_info *gl_info = context->gl_info;
+    GLint status;
+
+    GL_EXTCALL(glGetProgramiv(entry->id, GL_COMPLETION_STATUS_ARB, &status));
+    checkGLcall("glGetProgramiv");
+    if (!status)
+        return;
+
+    TRACE("Background link of program %u completed.\n", entry->id);
+    shader_glsl_finish_link(priv, gl_info, entry->id, entry->cacheable ? &entry->cache_key : NULL);
+    shader_glsl_init_program(context, priv, entry, vshader, hshader, dshader, gshader, pshader);
+    entry->pending = FALSE;
+    --priv->programs_pending;
+    ++priv->programs_ready;
+}
+
+/* Context activation is done by the caller. */
+static void set_glsl_shader_program(const struct wined3d_context *context, const struct wined3d_state *state,
+        struct shader_glsl_priv *priv, struct glsl_context_data *ctx_data)
+{
+    const struct wined3d_gl_info *gl_info = context->gl_info;
+    const struct wined3d_d3d_info *d3d_info = context->d3d_info;
+    const struct ps_np2fixup_info *np2fixup_info = NULL;
+    const struct wined3d_shader_cache_key *vs_ffp_key = NULL, *ps_ffp_key = NULL;
+    struct glsl_shader_prog_link *entry = NULL;
+    struct wined3d_shader *hshader, *dshader, *gshader;
+    struct wined3d_shader *vshader = NULL;
+    struct wined3d_shader *pshader = NULL;
+    BOOL rasterizer_point_size = FALSE;
+    BOOL rasterizer_flatshading = FALSE;
+    GLuint reorder_shader_id = 0;
+    struct glsl_program_key key;
+    GLuint program_id;
+    unsigned int i;
+    GLuint vs_id = 0;
+    GLuint hs_id = 0;
+    GLuint ds_id = 0;
+    GLuint gs_id = 0;
+    GLuint ps_id = 0;
+    struct list *ps_list, *vs_list;
+    WORD attribs_map;
+    struct wined3d_string_buffer *tmp_name;
+
+    if (!(context->shader_update_mask & (1u << WINED3D_SHADER_TYPE_VERTEX)) && ctx_data->glsl_program)
+    {
+        vs_id = ctx_data->glsl_program->vs.id;
+        vs_list = &ctx_data->glsl_program->vs.shader_entry;
+
+        if (use_vs(state))
+            vshader = state->shader[WINED3D_SHADER_TYPE_VERTEX];
+        else
+            vs_ffp_key = &ctx_data->glsl_program->stage_keys[WINED3D_SHADER_TYPE_VERTEX];
+    }
+    else if (use_vs(state))
+    {
+        struct vs_compile_args vs_compile_args;
+
+        vshader = state->shader[WINED3D_SHADER_TYPE_VERTEX];
+
+        find_vs_compile_args(state, vshader, context->stream_info.swizzle_map, &vs_compile_args, d3d_info);
+        vs_id = find_glsl_vshader(context, priv, vshader, &vs_compile_args);
+        vs_list = &vshader->linked_programs;
+    }
+    else if (priv->vertex_pipe == &glsl_vertex_pipe)
+    {
+        struct glsl_ffp_vertex_shader *ffp_shader;
         struct wined3d_ffp_vs_settings settings;
 
         wined3d_ffp_get_vs_settings(context, state, &settings);
         ffp_shader = shader_glsl_find_ffp_vertex_shader(priv, gl_info, &settings);
         vs_id = ffp_shader->id;
         vs_list = &ffp_shader->linked_programs;
+        vs_ffp_key = &ffp_shader->cache_key;
     }
 
     hshader = state->shader[WINED3D_SHADER_TYPE_HULL];
@@ -9808,14 +10346,15 @@ static void set_glsl_shader_program(const struct wined3d_context *context, const
 
         if (use_ps(state))
             pshader = state->shader[WINED3D_SHADER_TYPE_PIXEL];
+        else
+            ps_ffp_key = &ctx_data->glsl_program->stage_keys[WINED3D_SHADER_TYPE_PIXEL];
     }
     else if (use_ps(state))
     {
         struct ps_compile_args ps_compile_args;
         pshader = state->shader[WINED3D_SHADER_TYPE_PIXEL];
         find_ps_compile_args(state, pshader, context->stream_info.position_transformed, &ps_compile_args, context);
-        ps_id = find_glsl_pshader(context, &priv->shader_buffer, &priv->string_buffers,
-                pshader, &ps_compile_args, &np2fixup_info);
+        ps_id = find_glsl_pshader(context, priv, pshader, &ps_compile_args, &np2fixup_info);
         ps_list = &pshader->linked_programs;
     }
     else if (priv->fragment_pipe == &glsl_fragment_pipe
@@ -9828,6 +10367,7 @@ static void set_glsl_shader_program(const struct wined3d_context *context, const
         ffp_shader = shader_glsl_find_ffp_fragment_shader(priv, &settings, context);
         ps_id = ffp_shader->id;
         ps_list = &ffp_shader->linked_programs;
+        ps_ffp_key = &ffp_shader->cache_key;
     }
 
     key.vs_id = vs_id;
@@ -9838,6 +10378,8 @@ static void set_glsl_shader_program(const struct wined3d_context *context, const
     key.cs_id = 0;
     if ((!vs_id && !hs_id && !ds_id && !gs_id && !ps_id) || (entry = get_glsl_program_entry(priv, &key)))
     {
+        if (entry && entry->pending)
+            shader_glsl_poll_program(context, priv, entry, vshader, hshader, dshader, gshader, pshader);
         ctx_data->glsl_program = entry;
         return;
     }
@@ -9857,20 +10399,66 @@ static void set_glsl_shader_program(const struct wined3d_context *context, const
     entry->cs.id = 0;
     entry->constant_version = 0;
     entry->ps.np2_fixup_info = np2fixup_info;
+    entry->pending = FALSE;
+
+    if (vshader && vshader->reg_maps.shader_version.major < 4)
+    {
+        rasterizer_point_size = state->gl_primitive_type == GL_POINTS && vshader->reg_maps.point_size;
+        rasterizer_flatshading = d3d_info->emulated_flatshading
+                && state->render_states[WINED3D_RS_SHADEMODE] == WINED3D_SHADE_FLAT;
+    }
+
+    /* The cache key is built before any GLSL is generated for the program. */
+    entry->cacheable = priv->program_cache && (!gshader || !gshader->u.gs.so_desc.element_count);
+    if (priv->program_cache)
+    {
+        entry->cacheable &= shader_glsl_get_stage_cache_key(context, priv, vshader, vs_id, vs_ffp_key,
+                &entry->stage_keys[WINED3D_SHADER_TYPE_VERTEX]);
+        entry->cacheable &= shader_glsl_get_stage_cache_key(context, priv, hshader, hs_id, NULL,
+                &entry->stage_keys[WINED3D_SHADER_TYPE_HULL]);
+        entry->cacheable &= shader_glsl_get_stage_cache_key(context, priv, dshader, ds_id, NULL,
+                &entry->stage_keys[WINED3D_SHADER_TYPE_DOMAIN]);
+        entry->cacheable &= shader_glsl_get_stage_cache_key(context, priv, gshader, gs_id, NULL,
+                &entry->stage_keys[WINED3D_SHADER_TYPE_GEOMETRY]);
+        entry->cacheable &= shader_glsl_get_stage_cache_key(context, priv, pshader, ps_id, ps_ffp_key,
+                &entry->stage_keys[WINED3D_SHADER_TYPE_PIXEL]);
+    }
+    if (entry->cacheable)
+        shader_glsl_get_program_cache_key(priv, context, entry->stage_keys, ARRAY_SIZE(entry->stage_keys),
+                (rasterizer_point_size ? 0x1 : 0) | (rasterizer_flatshading ? 0x2 : 0), &entry->cache_key);
+
     /* Add the hash table entry */
     add_glsl_program_entry(priv, entry);
 
     /* Set the current program */
     ctx_data->glsl_program = entry;
 
+    if (vs_id)
+        list_add_head(vs_list, &entry->vs.shader_entry);
+    if (hshader)
+        list_add_head(&hshader->linked_programs, &entry->hs.shader_entry);
+    if (dshader)
+        list_add_head(&dshader->linked_programs, &entry->ds.shader_entry);
+    if (gshader)
+        list_add_head(&gshader->linked_programs, &entry->gs.shader_entry);
+    if (ps_id)
+        list_add_head(ps_list, &entry->ps.shader_entry);
+
+    if (entry->cacheable && shader_glsl_load_program_binary(priv, gl_info, program_id, &entry->cache_key))
+    {
+        shader_glsl_init_program(context, priv, entry, vshader, hshader, dshader, gshader, pshader);
+        return;
+    }
+
     /* Attach GLSL vshader */
     if (vs_id)
     {
+        if (vshader)
+            shader_glsl_prepare_gl_shader(context, priv, vshader, vs_id, TRUE);
+
         TRACE("Attaching GLSL shader object %u to program %u.\n", vs_id, program_id);
         GL_EXTCALL(glAttachShader(program_id, vs_id));
         checkGLcall("glAttachShader");
-
-        list_add_head(vs_list, &entry->vs.shader_entry);
     }
 
     if (vshader)
@@ -9879,9 +10467,7 @@ static void set_glsl_shader_program(const struct wined3d_context *context, const
         if (vshader->reg_maps.shader_version.major < 4)
         {
             reorder_shader_id = shader_glsl_generate_vs3_rasterizer_input_setup(priv, vshader, pshader,
-                    state->gl_primitive_type == GL_POINTS && vshader->reg_maps.point_size,
-                    d3d_info->emulated_flatshading
-                    && state->render_states[WINED3D_RS_SHADEMODE] == WINED3D_SHADE_FLAT, gl_info);
+                    rasterizer_point_size, rasterizer_flatshading, gl_info);
             TRACE("Attaching GLSL shader object %u to program %u.\n", reorder_shader_id, program_id);
             GL_EXTCALL(glAttachShader(program_id, reorder_shader_id));
             checkGLcall("glAttachShader");
@@ -9934,188 +10520,55 @@ static void set_glsl_shader_program(const struct wined3d_context *context, const
 
     if (hshader)
     {
+        shader_glsl_prepare_gl_shader(context, priv, hshader, hs_id, TRUE);
+
         TRACE("Attaching GLSL tessellation control shader object %u to program %u.\n", hs_id, program_id);
         GL_EXTCALL(glAttachShader(program_id, hs_id));
         checkGLcall("glAttachShader");
-
-        list_add_head(&hshader->linked_programs, &entry->hs.shader_entry);
     }
 
     if (dshader)
     {
+        shader_glsl_prepare_gl_shader(context, priv, dshader, ds_id, TRUE);
+
         TRACE("Attaching GLSL tessellation evaluation shader object %u to program %u.\n", ds_id, program_id);
         GL_EXTCALL(glAttachShader(program_id, ds_id));
         checkGLcall("glAttachShader");
-
-        list_add_head(&dshader->linked_programs, &entry->ds.shader_entry);
     }
 
     if (gshader)
     {
+        shader_glsl_prepare_gl_shader(context, priv, gshader, gs_id, TRUE);
+
         TRACE("Attaching GLSL geometry shader object %u to program %u.\n", gs_id, program_id);
         GL_EXTCALL(glAttachShader(program_id, gs_id));
         checkGLcall("glAttachShader");
 
         shader_glsl_init_transform_feedback(context, priv, program_id, gshader);
-
-        list_add_head(&gshader->linked_programs, &entry->gs.shader_entry);
     }
 
     /* Attach GLSL pshader */
     if (ps_id)
     {
+        if (pshader)
+            shader_glsl_prepare_gl_shader(context, priv, pshader, ps_id, TRUE);
+
         TRACE("Attaching GLSL shader object %u to program %u.\n", ps_id, program_id);
         GL_EXTCALL(glAttachShader(program_id, ps_id));
         checkGLcall("glAttachShader");
-
-        list_add_head(ps_list, &entry->ps.shader_entry);
     }
 
     /* Link the program */
-    TRACE("Linking GLSL shader program %u.\n", program_id);
-    GL_EXTCALL(glLinkProgram(program_id));
-    shader_glsl_validate_link(gl_info, program_id);
-
-    shader_glsl_init_vs_uniform_locations(gl_info, priv, program_id, &entry->vs,
-            vshader ? vshader->limits->constant_float : 0);
-    shader_glsl_init_ds_uniform_locations(gl_info, priv, program_id, &entry->ds);
-    shader_glsl_init_gs_uniform_locations(gl_info, priv, program_id, &entry->gs);
-    shader_glsl_init_ps_uniform_locations(gl_info, priv, program_id, &entry->ps,
-            pshader ? pshader->limits->constant_float : 0);
-    checkGLcall("Find glsl program uniform locations");
-
-    if (needs_legacy_glsl_syntax(gl_info))
+    if (!shader_glsl_link_program(priv, gl_info, program_id,
+            entry->cacheable ? &entry->cache_key : NULL, priv->async_link))
     {
-        if (pshader && pshader->reg_maps.shader_version.major >= 3
-                && pshader->u.ps.declared_in_count > vec4_varyings(3, gl_info))
-        {
-            TRACE("Shader %d needs vertex color clamping disabled.\n", program_id);
-            entry->vs.vertex_color_clamp = GL_FALSE;
-        }
-        else
-        {
-            entry->vs.vertex_color_clamp = GL_FIXED_ONLY_ARB;
-        }
-    }
-    else
-    {
-        /* With core profile we never change vertex_color_clamp from
-         * GL_FIXED_ONLY_MODE (which is also the initial value) so we never call
-         * glClampColorARB(). */
-        entry->vs.vertex_color_clamp = GL_FIXED_ONLY_ARB;
-    }
-
-    /* Set the shader to allow uniform loading on it */
-    GL_EXTCALL(glUseProgram(program_id));
-    checkGLcall("glUseProgram");
-
-    entry->constant_update_mask = 0;
-    if (vshader)
-    {
-        entry->constant_update_mask |= WINED3D_SHADER_CONST_VS_F;
-        if (vshader->reg_maps.integer_constants)
-            entry->constant_update_mask |= WINED3D_SHADER_CONST_VS_I;
-        if (vshader->reg_maps.boolean_constants)
-            entry->constant_update_mask |= WINED3D_SHADER_CONST_VS_B;
-        if (entry->vs.pos_fixup_location != -1)
-            entry->constant_update_mask |= WINED3D_SHADER_CONST_POS_FIXUP;
-
-        shader_glsl_load_program_resources(context, priv, program_id, vshader);
-    }
-    else
-    {
-        entry->constant_update_mask |= WINED3D_SHADER_CONST_FFP_MODELVIEW
-                | WINED3D_SHADER_CONST_FFP_PROJ;
-
-        for (i = 1; i < MAX_VERTEX_BLENDS; ++i)
-        {
-            if (entry->vs.modelview_matrix_location[i] != -1)
-            {
-                entry->constant_update_mask |= WINED3D_SHADER_CONST_FFP_VERTEXBLEND;
-                break;
-            }
-        }
-
-        for (i = 0; i < MAX_TEXTURES; ++i)
-        {
-            if (entry->vs.texture_matrix_location[i] != -1)
-            {
-                entry->constant_update_mask |= WINED3D_SHADER_CONST_FFP_TEXMATRIX;
-                break;
-            }
-        }
-        if (entry->vs.material_ambient_location != -1 || entry->vs.material_diffuse_location != -1
-                || entry->vs.material_specular_location != -1
-                || entry->vs.material_emissive_location != -1
-                || entry->vs.material_shininess_location != -1)
-            entry->constant_update_mask |= WINED3D_SHADER_CONST_FFP_MATERIAL;
-        if (entry->vs.light_ambient_location != -1)
-            entry->constant_update_mask |= WINED3D_SHADER_CONST_FFP_LIGHTS;
-    }
-    if (entry->vs.clip_planes_location != -1)
-        entry->constant_update_mask |= WINED3D_SHADER_CONST_VS_CLIP_PLANES;
-    if (entry->vs.pointsize_min_location != -1)
-        entry->constant_update_mask |= WINED3D_SHADER_CONST_VS_POINTSIZE;
-
-    if (hshader)
-        shader_glsl_load_program_resources(context, priv, program_id, hshader);
-
-    if (dshader)
-    {
-        if (entry->ds.pos_fixup_location != -1)
-            entry->constant_update_mask |= WINED3D_SHADER_CONST_POS_FIXUP;
-
-        shader_glsl_load_program_resources(context, priv, program_id, dshader);
-    }
-
-    if (gshader)
-    {
-        if (entry->gs.pos_fixup_location != -1)
-            entry->constant_update_mask |= WINED3D_SHADER_CONST_POS_FIXUP;
-
-        shader_glsl_load_program_resources(context, priv, program_id, gshader);
+        TRACE("Program %u is being linked in the background.\n", program_id);
+        entry->pending = TRUE;
+        ++priv->programs_pending;
+        return;
     }
 
-    if (ps_id)
-    {
-        if (pshader)
-        {
-            entry->constant_update_mask |= WINED3D_SHADER_CONST_PS_F;
-            if (pshader->reg_maps.integer_constants)
-                entry->constant_update_mask |= WINED3D_SHADER_CONST_PS_I;
-            if (pshader->reg_maps.boolean_constants)
-                entry->constant_update_mask |= WINED3D_SHADER_CONST_PS_B;
-            if (entry->ps.ycorrection_location != -1)
-                entry->constant_update_mask |= WINED3D_SHADER_CONST_PS_Y_CORR;
-
-            shader_glsl_load_program_resources(context, priv, program_id, pshader);
-            shader_glsl_load_images(gl_info, priv, program_id, &pshader->reg_maps);
-        }
-        else
-        {
-            entry->constant_update_mask |= WINED3D_SHADER_CONST_FFP_PS;
-
-            shader_glsl_load_samplers(context, priv, program_id, NULL);
-        }
-
-        for (i = 0; i < MAX_TEXTURES; ++i)
-        {
-            if (entry->ps.bumpenv_mat_location[i] != -1)
-            {
-                entry->constant_update_mask |= WINED3D_SHADER_CONST_PS_BUMP_ENV;
-                break;
-            }
-        }
-
-        if (entry->ps.fog_color_location != -1)
-            entry->constant_update_mask |= WINED3D_SHADER_CONST_PS_FOG;
-        if (entry->ps.alpha_test_ref_location != -1)
-            entry->constant_update_mask |= WINED3D_SHADER_CONST_PS_ALPHA_TEST;
-        if (entry->ps.np2_fixup_location != -1)
-            entry->constant_update_mask |= WINED3D_SHADER_CONST_PS_NP2_FIXUP;
-        if (entry->ps.color_key_location != -1)
-            entry->constant_update_mask |= WINED3D_SHADER_CONST_FFP_COLOR_KEY;
-    }
+    shader_glsl_init_program(context, priv, entry, vshader, hshader, dshader, gshader, pshader);
 }
 
 static void shader_glsl_precompile(void *shader_priv, struct wined3d_shader *shader)
@@ -10144,10 +10597,19 @@ static void shader_glsl_select(void *shader_priv, struct wined3d_context *contex
     priv->vertex_pipe->vp_enable(gl_info, !use_vs(state));
     priv->fragment_pipe->enable_extension(gl_info, !use_ps(state));
 
-    prev_id = ctx_data->glsl_program ? ctx_data->glsl_program->id : 0;
+    /* A pending program was never made current. */
+    prev_id = ctx_data->glsl_program && !ctx_data->glsl_program->pending ? ctx_data->glsl_program->id : 0;
 
     set_glsl_shader_program(context, state, priv, ctx_data);
 
+    if ((context->shader_pending = ctx_data->glsl_program && ctx_data->glsl_program->pending))
+    {
+        TRACE("GLSL program %u is not linked yet.\n", ctx_data->glsl_program->id);
+        ++priv->draws_skipped;
+        context->shader_update_mask |= (1u << WINED3D_SHADER_TYPE_COMPUTE);
+        return;
+    }
+
     if (ctx_data->glsl_program)
     {
         program_id = ctx_data->glsl_program->id;
@@ -10554,6 +11016,18 @@ static HRESULT shader_glsl_alloc(struct wined3d_device *device, const struct win
     priv->ffp_proj_control = fragment_caps.wined3d_caps & WINED3D_FRAGMENT_CAP_PROJ_CONTROL;
     priv->legacy_lighting = device->wined3d->flags & WINED3D_LEGACY_FFP_LIGHTING;
 
+    if (wined3d_settings.shader_cache && gl_info->supported[ARB_GET_PROGRAM_BINARY]
+            && !(priv->program_cache = wined3d_shader_cache_create(wined3d_settings.shader_cache)))
+        WARN("Failed to create shader cache, continuing without.\n");
+
+    if (wined3d_settings.async_shader_compile)
+    {
+        if (gl_info->supported[ARB_PARALLEL_SHADER_COMPILE])
+            priv->async_link = TRUE;
+        else
+            WARN("Asynchronous shader compilation requested, but ARB_parallel_shader_compile is not supported.\n");
+    }
+
     device->vertex_priv = vertex_priv;
     device->fragment_priv = fragment_priv;
     device->shader_priv = priv;
@@ -10576,6 +11050,11 @@ static void shader_glsl_free(struct wined3d_device *device)
 {
     struct shader_glsl_priv *priv = device->shader_priv;
 
+    if (priv->async_link)
+        TRACE_(d3d_perf)("%u programs linked in the background, %u still pending, %u draws skipped.\n",
+                priv->programs_ready, priv->programs_pending, priv->draws_skipped);
+    if (priv->program_cache)
+        wined3d_shader_cache_destroy(priv->program_cache);
     wine_rb_destroy(&priv->program_lookup, NULL, NULL);
     constant_heap_free(&priv->pconst_heap);
     constant_heap_free(&priv->vconst_heap);
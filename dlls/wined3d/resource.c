@@ -354,19 +354,38 @@ static DWORD wined3d_resource_sanitise_map_flags(const struct wined3d_resource *
 HRESULT CDECL wined3d_resource_map(struct wined3d_resource *resource, unsigned int sub_resource_idx,
         struct wined3d_map_desc *map_desc, const struct wined3d_box *box, DWORD flags)
 {
+    HRESULT hr;
+
     TRACE("resource %p, sub_resource_idx %u, map_desc %p, box %s, flags %#x.\n",
             resource, sub_resource_idx, map_desc, debug_box(box), flags);
 
     flags = wined3d_resource_sanitise_map_flags(resource, flags);
+    if (resource->type == WINED3D_RTYPE_BUFFER && !sub_resource_idx
+            && wined3d_buffer_map_direct(buffer_from_resource(resource), map_desc, box, flags))
+        return WINED3D_OK;
     wined3d_resource_wait_idle(resource);
 
-    return wined3d_cs_map(resource->device->cs, resource, sub_resource_idx, map_desc, box, flags);
+    hr = wined3d_cs_map(resource->device->cs, resource, sub_resource_idx, map_desc, box, flags);
+    if (SUCCEEDED(hr) && resource->type == WINED3D_RTYPE_BUFFER)
+        ++buffer_from_resource(resource)->cs_map_count;
+
+    return hr;
 }
 
 HRESULT CDECL wined3d_resource_unmap(struct wined3d_resource *resource, unsigned int sub_resource_idx)
 {
     TRACE("resource %p, sub_resource_idx %u.\n", resource, sub_resource_idx);
 
+    if (resource->type == WINED3D_RTYPE_BUFFER && !sub_resource_idx)
+    {
+        struct wined3d_buffer *buffer = buffer_from_resource(resource);
+
+        if (wined3d_buffer_unmap_direct(buffer))
+            return WINED3D_OK;
+        if (buffer->cs_map_count)
+            --buffer->cs_map_count;
+    }
+
     return wined3d_cs_unmap(resource->device->cs, resource, sub_resource_idx);
 }
 
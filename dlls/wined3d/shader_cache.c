@@ -0,0 +1,360 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include "config.h"
+#include "wine/port.h"
+
+#include <stdio.h>
+
+#include "wined3d_private.h"
+
+WINE_DEFAULT_DEBUG_CHANNEL(d3d_shader);
+
+/* The cache is a directory with one file per linked program, named after the
+ * hash of its key. Keys are built from the shader byte code and compile args
+ * of the program's stages, so a program can be looked up before any GLSL is
+ * generated for it. Files are read into memory by a background thread when
+ * the cache is created, and written when a program is linked for the first
+ * time. */
+
+#define WINED3D_SHADER_CACHE_MAGIC          0x43503357  /* "W3PC" */
+#define WINED3D_SHADER_CACHE_VERSION        2
+#define WINED3D_SHADER_CACHE_MAX_ENTRY_SIZE (16u * 1024 * 1024)
+#define WINED3D_SHADER_CACHE_PREWARM_LIMIT  (64u * 1024 * 1024)
+
+struct wined3d_shader_cache_header
+{
+    DWORD magic;
+    DWORD version;
+    ULONG64 hash;
+    DWORD check;
+    DWORD format;
+    DWORD size;
+};
+
+struct wined3d_shader_cache
+{
+    char *path;
+    CRITICAL_SECTION cs;
+    struct wine_rb_tree entries;
+    SIZE_T prewarm_size;
+    HANDLE thread;
+    LONG shutdown;
+};
+
+static int wined3d_shader_cache_entry_compare(const void *key, const struct wine_rb_entry *entry)
+{
+    const struct wined3d_shader_cache_key *k = key;
+    const struct wined3d_shader_cache_entry *e = WINE_RB_ENTRY_VALUE(entry, struct wined3d_shader_cache_entry, entry);
+
+    if (k->hash != e->key.hash)
+        return k->hash < e->key.hash ? -1 : 1;
+    if (k->check != e->key.check)
+        return k->check < e->key.check ? -1 : 1;
+    return 0;
+}
+
+static void wined3d_shader_cache_entry_free(struct wine_rb_entry *entry, void *context)
+{
+    HeapFree(GetProcessHeap(), 0, WINE_RB_ENTRY_VALUE(entry, struct wined3d_shader_cache_entry, entry));
+}
+
+void wined3d_shader_cache_key_init(struct wined3d_shader_cache_key *key)
+{
+    key->hash = 0xcbf29ce484222325ull;
+    key->check = 0;
+}
+
+/* FNV-1a for the hash, and Jenkins' one-at-a-time hash as an independent
+ * check against collisions. */
+void wined3d_shader_cache_key_update(struct wined3d_shader_cache_key *key, const void *data, SIZE_T size)
+{
+    const BYTE *p = data;
+    ULONG64 hash = key->hash;
+    DWORD check = key->check;
+    SIZE_T i;
+
+    for (i = 0; i < size; ++i)
+    {
+        hash = (hash ^ p[i]) * 0x100000001b3ull;
+        check += p[i];
+        check += check << 10;
+        check ^= check >> 6;
+    }
+
+    key->hash = hash;
+    key->check = check;
+}
+
+/* The returned path should be freed with HeapFree(). */
+static char *wined3d_shader_cache_get_path(const struct wined3d_shader_cache *cache,
+        const char *file_name, const char *suffix)
+{
+    char *path;
+
+    if (!(path = HeapAlloc(GetProcessHeap(), 0, strlen(cache->path) + strlen(file_name) + strlen(suffix) + 2)))
+        return NULL;
+    sprintf(path, "%s\\%s%s", cache->path, file_name, suffix);
+    return path;
+}
+
+static void wined3d_shader_cache_get_file_name(const struct wined3d_shader_cache_key *key, char *name)
+{
+    sprintf(name, "%08x%08x.bin", (DWORD)(key->hash >> 32), (DWORD)key->hash);
+}
+
+static struct wined3d_shader_cache_entry *wined3d_shader_cache_read_file(const char *name,
+        const struct wined3d_shader_cache_key *key)
+{
+    struct wined3d_shader_cache_header header;
+    struct wined3d_shader_cache_entry *entry;
+    DWORD read;
+    HANDLE file;
+
+    if ((file = CreateFileA(name, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+            NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL)) == INVALID_HANDLE_VALUE)
+        return NULL;
+
+    if (!ReadFile(file, &header, sizeof(header), &read, NULL) || read != sizeof(header)
+            || header.magic != WINED3D_SHADER_CACHE_MAGIC || header.version != WINED3D_SHADER_CACHE_VERSION
+            || !header.size || header.size > WINED3D_SHADER_CACHE_MAX_ENTRY_SIZE
+            || (key && (header.hash != key->hash || header.check != key->check)))
+    {
+        WARN("Ignoring invalid shader cache file %s.\n", debugstr_a(name));
+        CloseHandle(file);
+        return NULL;
+    }
+
+    if (!(entry = HeapAlloc(GetProcessHeap(), 0, FIELD_OFFSET(struct wined3d_shader_cache_entry, data[header.size]))))
+    {
+        CloseHandle(file);
+        return NULL;
+    }
+    entry->key.hash = header.hash;
+    entry->key.check = header.check;
+    entry->format = header.format;
+    entry->size = header.size;
+
+    if (!ReadFile(file, entry->data, header.size, &read, NULL) || read != header.size)
+    {
+        WARN("Short read from shader cache file %s.\n", debugstr_a(name));
+        HeapFree(GetProcessHeap(), 0, entry);
+        entry = NULL;
+    }
+
+    CloseHandle(file);
+    return entry;
+}
+
+static DWORD WINAPI wined3d_shader_cache_prewarm(void *ctx)
+{
+    struct wined3d_shader_cache *cache = ctx;
+    struct wined3d_shader_cache_entry *entry;
+    WIN32_FIND_DATAA data;
+    unsigned int count = 0;
+    HANDLE find;
+    char *name;
+
+    TRACE("Prewarming shader cache %s.\n", debugstr_a(cache->path));
+
+    if (!(name = wined3d_shader_cache_get_path(cache, "*.bin", "")))
+        return 0;
+    find = FindFirstFileA(name, &data);
+    HeapFree(GetProcessHeap(), 0, name);
+    if (find == INVALID_HANDLE_VALUE)
+        return 0;
+
+    do
+    {
+        if (*(volatile LONG *)&cache->shutdown)
+            break;
+        if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            continue;
+        if (cache->prewarm_size + data.nFileSizeLow > WINED3D_SHADER_CACHE_PREWARM_LIMIT)
+        {
+            TRACE("Reached the prewarm limit, leaving the remaining entries on disk.\n");
+            break;
+        }
+
+        if (!(name = wined3d_shader_cache_get_path(cache, data.cFileName, "")))
+            continue;
+        entry = wined3d_shader_cache_read_file(name, NULL);
+        HeapFree(GetProcessHeap(), 0, name);
+        if (!entry)
+            continue;
+
+        EnterCriticalSection(&cache->cs);
+        if (wine_rb_put(&cache->entries, &entry->key, &entry->entry) == -1)
+            HeapFree(GetProcessHeap(), 0, entry);
+        else
+            cache->prewarm_size += entry->size;
+        LeaveCriticalSection(&cache->cs);
+        ++count;
+    } while (FindNextFileA(find, &data));
+
+    FindClose(find);
+
+    TRACE("Read %u shader cache entries.\n", count);
+
+    return 0;
+}
+
+struct wined3d_shader_cache *wined3d_shader_cache_create(const char *path)
+{
+    struct wined3d_shader_cache *cache;
+    size_t len = strlen(path);
+
+    if (!(cache = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*cache))))
+        return NULL;
+
+    while (len && (path[len - 1] == '\\' || path[len - 1] == '/'))
+        --len;
+    if (!(cache->path = HeapAlloc(GetProcessHeap(), 0, len + 1)))
+    {
+        HeapFree(GetProcessHeap(), 0, cache);
+        return NULL;
+    }
+    memcpy(cache->path, path, len);
+    cache->path[len] = 0;
+
+    if (!CreateDirectoryA(cache->path, NULL) && GetLastError() != ERROR_ALREADY_EXISTS)
+    {
+        ERR("Failed to create shader cache directory %s, error %u.\n",
+                debugstr_a(cache->path), GetLastError());
+        HeapFree(GetProcessHeap(), 0, cache->path);
+        HeapFree(GetProcessHeap(), 0, cache);
+        return NULL;
+    }
+
+    InitializeCriticalSection(&cache->cs);
+    cache->cs.DebugInfo->Spare[0] = (DWORD_PTR)(__FILE__ ": wined3d_shader_cache.cs");
+    wine_rb_init(&cache->entries, wined3d_shader_cache_entry_compare);
+
+    if (!RtlIsCriticalSectionLockedByThread(NtCurrentTeb()->Peb->LoaderLock)
+            && !(cache->thread = CreateThread(NULL, 0, wined3d_shader_cache_prewarm, cache, 0, NULL)))
+        WARN("Failed to create shader cache prewarm thread.\n");
+
+    TRACE("Created shader cache %p for %s.\n", cache, debugstr_a(cache->path));
+
+    return cache;
+}
+
+void wined3d_shader_cache_destroy(struct wined3d_shader_cache *cache)
+{
+    if (cache->thread)
+    {
+        InterlockedExchange(&cache->shutdown, TRUE);
+        WaitForSingleObject(cache->thread, INFINITE);
+        CloseHandle(cache->thread);
+    }
+
+    wine_rb_destroy(&cache->entries, wined3d_shader_cache_entry_free, NULL);
+    cache->cs.DebugInfo->Spare[0] = 0;
+    DeleteCriticalSection(&cache->cs);
+    HeapFree(GetProcessHeap(), 0, cache->path);
+    HeapFree(GetProcessHeap(), 0, cache);
+}
+
+/* The returned entry belongs to the caller, and should be freed with
+ * HeapFree(). */
+struct wined3d_shader_cache_entry *wined3d_shader_cache_get(struct wined3d_shader_cache *cache,
+        const struct wined3d_shader_cache_key *key)
+{
+    struct wined3d_shader_cache_entry *entry = NULL;
+    struct wine_rb_entry *rb_entry;
+    char file_name[24], *name;
+
+    EnterCriticalSection(&cache->cs);
+    if ((rb_entry = wine_rb_get(&cache->entries, key)))
+    {
+        wine_rb_remove(&cache->entries, rb_entry);
+        entry = WINE_RB_ENTRY_VALUE(rb_entry, struct wined3d_shader_cache_entry, entry);
+    }
+    LeaveCriticalSection(&cache->cs);
+
+    if (!entry)
+    {
+        /* Either prewarming hasn't got to it yet, or another process wrote it
+         * since. */
+        wined3d_shader_cache_get_file_name(key, file_name);
+        if ((name = wined3d_shader_cache_get_path(cache, file_name, "")))
+        {
+            entry = wined3d_shader_cache_read_file(name, key);
+            HeapFree(GetProcessHeap(), 0, name);
+        }
+    }
+
+    TRACE("Cache %s for key %s.\n", entry ? "hit" : "miss", wine_dbgstr_longlong(key->hash));
+
+    return entry;
+}
+
+void wined3d_shader_cache_put(struct wined3d_shader_cache *cache, const struct wined3d_shader_cache_key *key,
+        GLenum format, const void *data, unsigned int size)
+{
+    struct wined3d_shader_cache_header header;
+    char file_name[24], suffix[16], *name, *tmp_name;
+    DWORD written;
+    HANDLE file;
+    BOOL ret;
+
+    if (!size || size > WINED3D_SHADER_CACHE_MAX_ENTRY_SIZE)
+        return;
+
+    header.magic = WINED3D_SHADER_CACHE_MAGIC;
+    header.version = WINED3D_SHADER_CACHE_VERSION;
+    header.hash = key->hash;
+    header.check = key->check;
+    header.format = format;
+    header.size = size;
+
+    /* Write to a temporary file first, so that other processes never see a
+     * partially written entry. */
+    wined3d_shader_cache_get_file_name(key, file_name);
+    sprintf(suffix, ".%x.tmp", GetCurrentProcessId());
+    if (!(name = wined3d_shader_cache_get_path(cache, file_name, "")))
+        return;
+    if (!(tmp_name = wined3d_shader_cache_get_path(cache, file_name, suffix)))
+    {
+        HeapFree(GetProcessHeap(), 0, name);
+        return;
+    }
+
+    if ((file = CreateFileA(tmp_name, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 0, NULL)) == INVALID_HANDLE_VALUE)
+    {
+        WARN("Failed to create shader cache file %s, error %u.\n", debugstr_a(tmp_name), GetLastError());
+        HeapFree(GetProcessHeap(), 0, tmp_name);
+        HeapFree(GetProcessHeap(), 0, name);
+        return;
+    }
+
+    ret = WriteFile(file, &header, sizeof(header), &written, NULL) && written == sizeof(header)
+            && WriteFile(file, data, size, &written, NULL) && written == size;
+    CloseHandle(file);
+
+    if (!ret || !MoveFileExA(tmp_name, name, MOVEFILE_REPLACE_EXISTING))
+    {
+        WARN("Failed to write shader cache file %s, error %u.\n", debugstr_a(name), GetLastError());
+        DeleteFileA(tmp_name);
+    }
+    else
+    {
+        TRACE("Stored %u bytes for key %s.\n", size, wine_dbgstr_longlong(key->hash));
+    }
+
+    HeapFree(GetProcessHeap(), 0, tmp_name);
+    HeapFree(GetProcessHeap(), 0, name);
+}
@@ -90,6 +90,9 @@ struct wined3d_settings wined3d_settings =
     ~0U,            /* No PS shader model limit by default. */
     ~0u,            /* No CS shader model limit by default. */
     FALSE,          /* 3D support enabled by default. */
+    NULL,           /* No command stream trace by default. */
+    NULL,           /* No shader cache by default. */
+    FALSE,          /* Link shader programs synchronously by default. */
 };
 
 struct wined3d * CDECL wined3d_create(DWORD flags)
@@ -313,6 +316,30 @@ static BOOL wined3d_dll_init(HINSTANCE hInstDLL)
             TRACE("Limiting PS shader model to %u.\n", wined3d_settings.max_sm_ps);
         if (!get_config_key_dword(hkey, appkey, "MaxShaderModelCS", &wined3d_settings.max_sm_cs))
             TRACE("Limiting CS shader model to %u.\n", wined3d_settings.max_sm_cs);
+        if (!get_config_key(hkey, appkey, "CSTrace", buffer, size))
+        {
+            size_t len = strlen(buffer) + 1;
+
+            if (!(wined3d_settings.cs_trace = HeapAlloc(GetProcessHeap(), 0, len)))
+                ERR("Failed to allocate command stream trace path memory.\n");
+            else
+                memcpy(wined3d_settings.cs_trace, buffer, len);
+        }
+        if (!get_config_key(hkey, appkey, "ShaderCache", buffer, size))
+        {
+            size_t len = strlen(buffer) + 1;
+
+            if (!(wined3d_settings.shader_cache = HeapAlloc(GetProcessHeap(), 0, len)))
+                ERR("Failed to allocate shader cache path memory.\n");
+            else
+                memcpy(wined3d_settings.shader_cache, buffer, len);
+        }
+        if (!get_config_key(hkey, appkey, "AsyncShaderCompile", buffer, size)
+                && !strcmp(buffer, "enabled"))
+        {
+            TRACE("Linking shader programs asynchronously.\n");
+            wined3d_settings.async_shader_compile = TRUE;
+        }
         if (!get_config_key(hkey, appkey, "DirectDrawRenderer", buffer, size)
                 && !strcmp(buffer, "gdi"))
         {
@@ -351,6 +378,8 @@ static BOOL wined3d_dll_destroy(HINSTANCE hInstDLL)
     HeapFree(GetProcessHeap(), 0, wndproc_table.entries);
 
     HeapFree(GetProcessHeap(), 0, wined3d_settings.logo);
+    HeapFree(GetProcessHeap(), 0, wined3d_settings.cs_trace);
+    HeapFree(GetProcessHeap(), 0, wined3d_settings.shader_cache);
     UnregisterClassA(WINED3D_OPENGL_WINDOW_CLASS_NAME, hInstDLL);
 
     DeleteCriticalSection(&wined3d_wndproc_cs);
@@ -398,6 +398,9 @@ struct wined3d_settings
     unsigned int max_sm_ps;
     unsigned int max_sm_cs;
     BOOL no_3d;
+    char *cs_trace;
+    char *shader_cache;
+    BOOL async_shader_compile;
 };
 
 extern struct wined3d_settings wined3d_settings DECLSPEC_HIDDEN;
@@ -1658,6 +1661,8 @@ struct wined3d_fence
 HRESULT wined3d_fence_create(struct wined3d_device *device, struct wined3d_fence **fence) DECLSPEC_HIDDEN;
 void wined3d_fence_destroy(struct wined3d_fence *fence) DECLSPEC_HIDDEN;
 void wined3d_fence_issue(struct wined3d_fence *fence, const struct wined3d_device *device) DECLSPEC_HIDDEN;
+enum wined3d_fence_result wined3d_fence_test(const struct wined3d_fence *fence,
+        const struct wined3d_device *device, DWORD flags) DECLSPEC_HIDDEN;
 enum wined3d_fence_result wined3d_fence_wait(const struct wined3d_fence *fence,
         const struct wined3d_device *device) DECLSPEC_HIDDEN;
 
@@ -1861,7 +1866,8 @@ struct wined3d_context
     DWORD destroy_delayed : 1;
     DWORD transform_feedback_active : 1;
     DWORD transform_feedback_paused : 1;
-    DWORD padding : 7;
+    DWORD shader_pending : 1;
+    DWORD padding : 6;
     DWORD last_swizzle_map; /* MAX_ATTRIBS, 16 */
     DWORD shader_update_mask;
     DWORD constant_update_mask;
@@ -2805,6 +2811,47 @@ struct wined3d_state
  * wined3d_device_create() ignores it. */
 #define WINED3DCREATE_MULTITHREADED 0x00000004
 
+#define WINED3D_BUFFER_HEAP_SIZE        (32 * 1024 * 1024)
+#define WINED3D_BUFFER_HEAP_BATCH_SIZE  (WINED3D_BUFFER_HEAP_SIZE / 16)
+
+struct wined3d_buffer_heap_range
+{
+    struct list entry;
+    unsigned int offset;
+    unsigned int size;
+};
+
+struct wined3d_buffer_heap_batch
+{
+    struct list entry;
+    struct list ranges;
+    struct wined3d_fence *fence;
+};
+
+/* A single persistently mapped, write-only buffer object that dynamic
+ * buffers take their storage from. Slices are allocated on the application
+ * thread and returned to the heap by the command stream, once the GPU is
+ * done with them. */
+struct wined3d_buffer_heap
+{
+    CRITICAL_SECTION cs;
+    GLuint buffer_object;
+    BYTE *map_ptr;
+    struct list free_ranges;
+
+    /* Only accessed from the command stream. */
+    struct list retired_ranges;
+    unsigned int retired_size;
+    struct list batches;
+};
+
+void wined3d_buffer_heap_cleanup(struct wined3d_buffer_heap *heap) DECLSPEC_HIDDEN;
+void wined3d_buffer_heap_create_storage(struct wined3d_buffer_heap *heap,
+        struct wined3d_context *context) DECLSPEC_HIDDEN;
+void wined3d_buffer_heap_destroy_storage(struct wined3d_buffer_heap *heap,
+        struct wined3d_context *context) DECLSPEC_HIDDEN;
+void wined3d_buffer_heap_init(struct wined3d_buffer_heap *heap) DECLSPEC_HIDDEN;
+
 struct wined3d_device
 {
     LONG ref;
@@ -2890,6 +2937,9 @@ struct wined3d_device
     /* Command stream */
     struct wined3d_cs *cs;
 
+    /* Storage for dynamic buffers */
+    struct wined3d_buffer_heap buffer_heap;
+
     /* Context management */
     struct wined3d_context **contexts;
     UINT context_count;
@@ -3434,6 +3484,8 @@ struct wined3d_cs
     HANDLE event;
     BOOL waiting_for_event;
     LONG pending_presents;
+
+    struct wined3d_cs_trace *trace;
 };
 
 struct wined3d_cs *wined3d_cs_create(struct wined3d_device *device) DECLSPEC_HIDDEN;
@@ -3466,6 +3518,8 @@ void wined3d_cs_emit_preload_resource(struct wined3d_cs *cs, struct wined3d_reso
 void wined3d_cs_emit_present(struct wined3d_cs *cs, struct wined3d_swapchain *swapchain,
         const RECT *src_rect, const RECT *dst_rect, HWND dst_window_override, DWORD flags) DECLSPEC_HIDDEN;
 void wined3d_cs_emit_query_issue(struct wined3d_cs *cs, struct wined3d_query *query, DWORD flags) DECLSPEC_HIDDEN;
+void wined3d_cs_emit_rename_buffer(struct wined3d_cs *cs, struct wined3d_buffer *buffer,
+        unsigned int offset) DECLSPEC_HIDDEN;
 void wined3d_cs_emit_reset_state(struct wined3d_cs *cs) DECLSPEC_HIDDEN;
 void wined3d_cs_emit_set_clip_plane(struct wined3d_cs *cs, UINT plane_idx,
         const struct wined3d_vec4 *plane) DECLSPEC_HIDDEN;
@@ -3574,6 +3628,13 @@ struct wined3d_buffer
     struct wined3d_map_range *maps;
     SIZE_T maps_size, modified_areas;
     struct wined3d_fence *fence;
+    unsigned int bo_offset;
+
+    /* Only accessed on the application side of the command stream. */
+    BOOL use_heap;
+    BYTE *heap_map_ptr;
+    LONG direct_map_count;
+    LONG cs_map_count;
 
     /* conversion stuff */
     UINT decl_change_count, full_conversion_count;
@@ -3596,6 +3657,12 @@ void wined3d_buffer_load(struct wined3d_buffer *buffer, struct wined3d_context *
 BOOL wined3d_buffer_load_location(struct wined3d_buffer *buffer,
         struct wined3d_context *context, DWORD location) DECLSPEC_HIDDEN;
 BYTE *wined3d_buffer_load_sysmem(struct wined3d_buffer *buffer, struct wined3d_context *context) DECLSPEC_HIDDEN;
+BOOL wined3d_buffer_map_direct(struct wined3d_buffer *buffer, struct wined3d_map_desc *map_desc,
+        const struct wined3d_box *box, DWORD flags) DECLSPEC_HIDDEN;
+void wined3d_buffer_rename(struct wined3d_buffer *buffer,
+        struct wined3d_context *context, unsigned int offset) DECLSPEC_HIDDEN;
+BOOL wined3d_buffer_unmap_direct(struct wined3d_buffer *buffer) DECLSPEC_HIDDEN;
+void wined3d_buffer_unload_direct(struct wined3d_buffer *buffer) DECLSPEC_HIDDEN;
 void wined3d_buffer_copy(struct wined3d_buffer *dst_buffer, unsigned int dst_offset,
         struct wined3d_buffer *src_buffer, unsigned int src_offset, unsigned int size) DECLSPEC_HIDDEN;
 void wined3d_buffer_upload_data(struct wined3d_buffer *buffer, struct wined3d_context *context,
@@ -4097,6 +4164,31 @@ struct ps_np2fixup_info {
 void print_glsl_info_log(const struct wined3d_gl_info *gl_info, GLuint id, BOOL program) DECLSPEC_HIDDEN;
 void shader_glsl_validate_link(const struct wined3d_gl_info *gl_info, GLuint program) DECLSPEC_HIDDEN;
 
+struct wined3d_shader_cache_key
+{
+    ULONG64 hash;
+    DWORD check;
+};
+
+struct wined3d_shader_cache_entry
+{
+    struct wine_rb_entry entry;
+    struct wined3d_shader_cache_key key;
+    GLenum format;
+    unsigned int size;
+    BYTE data[1];
+};
+
+struct wined3d_shader_cache *wined3d_shader_cache_create(const char *path) DECLSPEC_HIDDEN;
+void wined3d_shader_cache_destroy(struct wined3d_shader_cache *cache) DECLSPEC_HIDDEN;
+struct wined3d_shader_cache_entry *wined3d_shader_cache_get(struct wined3d_shader_cache *cache,
+        const struct wined3d_shader_cache_key *key) DECLSPEC_HIDDEN;
+void wined3d_shader_cache_put(struct wined3d_shader_cache *cache, const struct wined3d_shader_cache_key *key,
+        GLenum format, const void *data, unsigned int size) DECLSPEC_HIDDEN;
+void wined3d_shader_cache_key_init(struct wined3d_shader_cache_key *key) DECLSPEC_HIDDEN;
+void wined3d_shader_cache_key_update(struct wined3d_shader_cache_key *key,
+        const void *data, SIZE_T size) DECLSPEC_HIDDEN;
+
 struct wined3d_palette
 {
     LONG ref;
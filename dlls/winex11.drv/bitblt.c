@@ -1568,6 +1568,13 @@ struct x11drv_window_surface
     COLORREF              color_key;
     HRGN                  region;
     void                 *bits;
+    unsigned char        *shadow;         /* copy of the bits last sent, for damage tracking */
+    unsigned char        *tile_valid;     /* whether the shadow of each tile matches what was sent */
+    int                  *palette;        /* palette mapping used for the shadow bits, if any */
+    BOOL                  track_damage;   /* only send the tiles that changed */
+    RECT                  exposed;        /* area that must be sent even if unchanged */
+    ULONGLONG             bytes_flushed;  /* statistics */
+    ULONGLONG             bytes_skipped;
 #ifdef HAVE_LIBXXSHM
     XShmSegmentInfo       shminfo;
 #endif
@@ -1882,14 +1889,190 @@ static void x11drv_surface_set_region( struct window_surface *window_surface, HR
     window_surface->funcs->unlock( window_surface );
 }
 
+/* size of the tiles compared against the shadow bits when tracking damage */
+#define SURFACE_TILE_SIZE 64
+
+static inline int get_surface_tiles_x( const struct x11drv_window_surface *surface )
+{
+    return (surface->info.bmiHeader.biWidth + SURFACE_TILE_SIZE - 1) / SURFACE_TILE_SIZE;
+}
+
+static inline int get_surface_tiles_y( const struct x11drv_window_surface *surface )
+{
+    return (abs( surface->info.bmiHeader.biHeight ) + SURFACE_TILE_SIZE - 1) / SURFACE_TILE_SIZE;
+}
+
+/***********************************************************************
+ *           init_surface_shadow
+ *
+ * Allocate the shadow bits. No tile is valid until it has been sent entirely.
+ */
+static BOOL init_surface_shadow( struct x11drv_window_surface *surface )
+{
+    int tiles = get_surface_tiles_x( surface ) * get_surface_tiles_y( surface );
+
+    surface->shadow = HeapAlloc( GetProcessHeap(), 0, surface->info.bmiHeader.biSizeImage );
+    surface->tile_valid = HeapAlloc( GetProcessHeap(), HEAP_ZERO_MEMORY, tiles );
+    if ((surface->image->bits_per_pixel == 4 || surface->image->bits_per_pixel == 8) &&
+        X11DRV_PALETTE_PaletteToXPixel)
+    {
+        if ((surface->palette = HeapAlloc( GetProcessHeap(), 0, 256 * sizeof(int) )))
+            memcpy( surface->palette, X11DRV_PALETTE_PaletteToXPixel, 256 * sizeof(int) );
+        else surface->track_damage = FALSE;
+    }
+    if (surface->shadow && surface->tile_valid && surface->track_damage) return TRUE;
+
+    HeapFree( GetProcessHeap(), 0, surface->shadow );
+    HeapFree( GetProcessHeap(), 0, surface->tile_valid );
+    HeapFree( GetProcessHeap(), 0, surface->palette );
+    surface->shadow = surface->tile_valid = NULL;
+    surface->palette = NULL;
+    surface->track_damage = FALSE;
+    return FALSE;
+}
+
+/***********************************************************************
+ *           check_surface_palette
+ *
+ * Invalidate all the tiles when the palette mapping changed, the bits don't
+ * change but the pixels sent to the X server do.
+ */
+static void check_surface_palette( struct x11drv_window_surface *surface )
+{
+    if (!surface->palette || !X11DRV_PALETTE_PaletteToXPixel) return;
+    if (!memcmp( surface->palette, X11DRV_PALETTE_PaletteToXPixel, 256 * sizeof(int) )) return;
+
+    TRACE( "palette changed, resending %p\n", surface );
+    memcpy( surface->palette, X11DRV_PALETTE_PaletteToXPixel, 256 * sizeof(int) );
+    memset( surface->tile_valid, 0, get_surface_tiles_x( surface ) * get_surface_tiles_y( surface ));
+}
+
+/***********************************************************************
+ *           put_surface_image
+ *
+ * Send a rectangle of the surface image to the X server.
+ */
+static void put_surface_image( struct x11drv_window_surface *surface, const RECT *rect )
+{
+    int width = rect->right - rect->left, height = rect->bottom - rect->top;
+
+#ifdef HAVE_LIBXXSHM
+    if (surface->shminfo.shmid != -1)
+        XShmPutImage( gdi_display, surface->window, surface->gc, surface->image,
+                      rect->left, rect->top,
+                      surface->header.rect.left + rect->left, surface->header.rect.top + rect->top,
+                      width, height, False );
+    else
+#endif
+    XPutImage( gdi_display, surface->window, surface->gc, surface->image,
+               rect->left, rect->top,
+               surface->header.rect.left + rect->left, surface->header.rect.top + rect->top,
+               width, height );
+    surface->bytes_flushed += (ULONGLONG)height * ((width * surface->image->bits_per_pixel + 7) / 8);
+}
+
+/***********************************************************************
+ *           convert_surface_rows
+ *
+ * Convert rows of the surface bits to the image format, if needed.
+ */
+static void convert_surface_rows( struct x11drv_window_surface *surface, int top, int bottom )
+{
+    unsigned char *src = surface->bits;
+    unsigned char *dst = (unsigned char *)surface->image->data;
+    int width_bytes = surface->image->bytes_per_line;
+    const int *mapping = NULL;
+
+    if (src == dst) return;
+
+    if (surface->image->bits_per_pixel == 4 || surface->image->bits_per_pixel == 8)
+        mapping = X11DRV_PALETTE_PaletteToXPixel;
+
+    src += top * width_bytes;
+    dst += top * width_bytes;
+    copy_image_byteswap( &surface->info, src, dst, width_bytes, width_bytes,
+                         bottom - top, surface->byteswap, mapping, ~0u );
+}
+
+/***********************************************************************
+ *           flush_surface_tiles
+ *
+ * Send only the tiles of the flushed rectangle that differ from the shadow copy
+ * of the bits, merging consecutive dirty tiles of a row of tiles. Tiles whose
+ * shadow isn't valid yet are always sent.
+ */
+static void flush_surface_tiles( struct x11drv_window_surface *surface, const RECT *visrect )
+{
+    int width_bytes = surface->image->bytes_per_line;
+    int bpp = surface->image->bits_per_pixel;
+    int width = surface->info.bmiHeader.biWidth;
+    int height = abs( surface->info.bmiHeader.biHeight );
+    int tiles_x = get_surface_tiles_x( surface );
+    const unsigned char *bits = surface->bits;
+    int x, y, row, start, len;
+    unsigned char *valid;
+    RECT tile, run;
+    BOOL dirty, converted;
+
+    for (y = visrect->top & ~(SURFACE_TILE_SIZE - 1); y < visrect->bottom; y += SURFACE_TILE_SIZE)
+    {
+        tile.top = max( y, visrect->top );
+        tile.bottom = min( y + SURFACE_TILE_SIZE, visrect->bottom );
+        SetRectEmpty( &run );
+        converted = FALSE;
+
+        for (x = visrect->left & ~(SURFACE_TILE_SIZE - 1); x < visrect->right; x += SURFACE_TILE_SIZE)
+        {
+            RECT exposed;
+
+            tile.left = max( x, visrect->left );
+            tile.right = min( x + SURFACE_TILE_SIZE, visrect->right );
+            start = tile.left * bpp / 8;
+            len = (tile.right * bpp + 7) / 8 - start;
+            valid = surface->tile_valid + (y / SURFACE_TILE_SIZE) * tiles_x + x / SURFACE_TILE_SIZE;
+
+            dirty = !*valid || IntersectRect( &exposed, &tile, &surface->exposed );
+            for (row = tile.top; row < tile.bottom; row++)
+            {
+                const unsigned char *src = bits + row * width_bytes + start;
+                unsigned char *shadow = surface->shadow + row * width_bytes + start;
+
+                if (!dirty && !memcmp( src, shadow, len )) continue;
+                dirty = TRUE;
+                memcpy( shadow, src, len );
+            }
+
+            /* the whole shadow of the tile is valid once all of it has been sent */
+            if (tile.left == x && tile.top == y &&
+                tile.right == min( x + SURFACE_TILE_SIZE, width ) &&
+                tile.bottom == min( y + SURFACE_TILE_SIZE, height ))
+                *valid = 1;
+
+            if (dirty)
+            {
+                if (IsRectEmpty( &run )) run = tile;
+                else run.right = tile.right;
+                continue;
+            }
+            surface->bytes_skipped += (ULONGLONG)len * (tile.bottom - tile.top);
+            if (IsRectEmpty( &run )) continue;
+            if (!converted) convert_surface_rows( surface, tile.top, tile.bottom );
+            converted = TRUE;
+            put_surface_image( surface, &run );
+            SetRectEmpty( &run );
+        }
+        if (IsRectEmpty( &run )) continue;
+        if (!converted) convert_surface_rows( surface, tile.top, tile.bottom );
+        put_surface_image( surface, &run );
+    }
+}
+
 /***********************************************************************
  *           x11drv_surface_flush
  */
 static void x11drv_surface_flush( struct window_surface *window_surface )
 {
     struct x11drv_window_surface *surface = get_x11_surface( window_surface );
-    unsigned char *src = surface->bits;
-    unsigned char *dst = (unsigned char *)surface->image->data;
     struct bitblt_coords coords;
 
     window_surface->funcs->lock( window_surface );
@@ -1906,40 +2089,20 @@ static void x11drv_surface_flush( struct window_surface *window_surface )
 
         if (surface->is_argb || surface->color_key != CLR_INVALID) update_surface_region( surface );
 
-        if (src != dst)
+        if (surface->track_damage && (surface->shadow || init_surface_shadow( surface )))
         {
-            const int *mapping = NULL;
-            int width_bytes = surface->image->bytes_per_line;
-
-            if (surface->image->bits_per_pixel == 4 || surface->image->bits_per_pixel == 8)
-                mapping = X11DRV_PALETTE_PaletteToXPixel;
-
-            src += coords.visrect.top * width_bytes;
-            dst += coords.visrect.top * width_bytes;
-            copy_image_byteswap( &surface->info, src, dst, width_bytes, width_bytes,
-                                 coords.visrect.bottom - coords.visrect.top,
-                                 surface->byteswap, mapping, ~0u );
+            check_surface_palette( surface );
+            flush_surface_tiles( surface, &coords.visrect );
         }
-
-#ifdef HAVE_LIBXXSHM
-        if (surface->shminfo.shmid != -1)
-            XShmPutImage( gdi_display, surface->window, surface->gc, surface->image,
-                          coords.visrect.left, coords.visrect.top,
-                          surface->header.rect.left + coords.visrect.left,
-                          surface->header.rect.top + coords.visrect.top,
-                          coords.visrect.right - coords.visrect.left,
-                          coords.visrect.bottom - coords.visrect.top, False );
         else
-#endif
-        XPutImage( gdi_display, surface->window, surface->gc, surface->image,
-                   coords.visrect.left, coords.visrect.top,
-                   surface->header.rect.left + coords.visrect.left,
-                   surface->header.rect.top + coords.visrect.top,
-                   coords.visrect.right - coords.visrect.left,
-                   coords.visrect.bottom - coords.visrect.top );
+        {
+            convert_surface_rows( surface, coords.visrect.top, coords.visrect.bottom );
+            put_surface_image( surface, &coords.visrect );
+        }
         XFlush( gdi_display );
     }
     reset_bounds( &surface->bounds );
+    reset_bounds( &surface->exposed );
     window_surface->funcs->unlock( window_surface );
 }
 
@@ -1950,8 +2113,12 @@ static void x11drv_surface_destroy( struct window_surface *window_surface )
 {
     struct x11drv_window_surface *surface = get_x11_surface( window_surface );
 
-    TRACE( "freeing %p bits %p\n", surface, surface->bits );
+    TRACE( "freeing %p bits %p, flushed %s bytes, skipped %s unchanged bytes\n", surface, surface->bits,
+           wine_dbgstr_longlong( surface->bytes_flushed ), wine_dbgstr_longlong( surface->bytes_skipped ));
     if (surface->gc) XFreeGC( gdi_display, surface->gc );
+    HeapFree( GetProcessHeap(), 0, surface->shadow );
+    HeapFree( GetProcessHeap(), 0, surface->tile_valid );
+    HeapFree( GetProcessHeap(), 0, surface->palette );
     if (surface->image)
     {
         if (surface->image->data != surface->bits) HeapFree( GetProcessHeap(), 0, surface->bits );
@@ -2016,6 +2183,7 @@ struct window_surface *create_surface( Window window, const XVisualInfo *vis, co
     surface->is_argb = (use_alpha && vis->depth == 32 && surface->info.bmiHeader.biCompression == BI_RGB);
     set_color_key( surface, color_key );
     reset_bounds( &surface->bounds );
+    reset_bounds( &surface->exposed );
 
 #ifdef HAVE_LIBXXSHM
     surface->image = create_shm_image( vis, width, height, &surface->shminfo );
@@ -2042,6 +2210,12 @@ struct window_surface *create_surface( Window window, const XVisualInfo *vis, co
     }
     else surface->bits = surface->image->data;
 
+    /* without shared memory every pixel goes through the X connection, only send what changed */
+    surface->track_damage = TRUE;
+#ifdef HAVE_LIBXXSHM
+    if (surface->shminfo.shmid != -1) surface->track_damage = FALSE;
+#endif
+
     TRACE( "created %p for %lx %s bits %p-%p image %p\n", surface, window, wine_dbgstr_rect(rect),
            surface->bits, (char *)surface->bits + surface->info.bmiHeader.biSizeImage,
            surface->image->data );
@@ -2082,6 +2256,7 @@ HRGN expose_surface( struct window_surface *window_surface, const RECT *rect )
 
     window_surface->funcs->lock( window_surface );
     add_bounds_rect( &surface->bounds, rect );
+    add_bounds_rect( &surface->exposed, rect );
     if (surface->region)
     {
         region = CreateRectRgnIndirect( rect );
@@ -132,8 +132,11 @@ typedef struct
 {
     LFANDSIZE lfsz;
     gsCacheEntryFormat *format[GLYPH_NBTYPES][AA_MAXVALUE];
-    INT count;
-    INT next;
+    INT count;      /* number of DCs using the entry, -1 if the entry is free */
+    INT next;       /* next entry in the free list */
+    INT hash_next;  /* next entry in the same hash bucket */
+    DWORD last_use; /* stamp of the last lookup, for LRU eviction */
+    UINT size;      /* bytes of glyph data uploaded to the server */
 } gsCacheEntry;
 
 struct xrender_physdev
@@ -160,10 +163,29 @@ static const struct gdi_dc_funcs xrender_funcs;
 static gsCacheEntry *glyphsetCache = NULL;
 static DWORD glyphsetCacheSize = 0;
 static INT lastfree = -1;
-static INT mru = -1;
+static DWORD glyphset_use_stamp;
+static SIZE_T glyphset_cache_bytes;
 
 #define INIT_CACHE_SIZE 10
 
+#define GLYPHSET_HASH_SIZE 64
+static INT glyphset_hash[GLYPHSET_HASH_SIZE];
+
+/* glyphs uploaded during one text run are sent in a single XRenderAddGlyphs request */
+struct glyph_batch
+{
+    gsCacheEntryFormat *format;
+    Glyph              *gids;
+    XGlyphInfo         *gis;
+    unsigned int        count;
+    unsigned int        max_count;
+    char               *data;
+    unsigned int        size;
+    unsigned int        max_size;
+};
+
+#define GLYPH_BATCH_MAX_SIZE 65536
+
 static void *xrender_handle;
 
 #define MAKE_FUNCPTR(f) static typeof(f) * p##f;
@@ -371,6 +393,7 @@ const struct gdi_dc_funcs *X11DRV_XRender_Init(void)
         glyphsetCache[i].count = -1;
     }
     glyphsetCache[i-1].next = -1;
+    for (i = 0; i < GLYPHSET_HASH_SIZE; i++) glyphset_hash[i] = -1;
 
     return &xrender_funcs;
 }
@@ -588,23 +611,16 @@ static BOOL fontcmp(LFANDSIZE *p1, LFANDSIZE *p2)
 
 static int LookupEntry(LFANDSIZE *plfsz)
 {
-  int i, prev_i = -1;
+  int i;
 
-  for(i = mru; i >= 0; i = glyphsetCache[i].next) {
+  for(i = glyphset_hash[plfsz->hash % GLYPHSET_HASH_SIZE]; i >= 0; i = glyphsetCache[i].hash_next) {
     TRACE("%d\n", i);
-    if(glyphsetCache[i].count == -1) break; /* reached free list so stop */
-
     if(!fontcmp(&glyphsetCache[i].lfsz, plfsz)) {
       glyphsetCache[i].count++;
-      if(prev_i >= 0) {
-	glyphsetCache[prev_i].next = glyphsetCache[i].next;
-	glyphsetCache[i].next = mru;
-	mru = i;
-      }
+      glyphsetCache[i].last_use = ++glyphset_use_stamp;
       TRACE("found font in cache %d\n", i);
       return i;
     }
-    prev_i = i;
   }
   TRACE("font not in cache\n");
   return -1;
@@ -612,7 +628,16 @@ static int LookupEntry(LFANDSIZE *plfsz)
 
 static void FreeEntry(int entry)
 {
-    int type, format;
+    int type, format, *pos;
+
+    for (pos = &glyphset_hash[glyphsetCache[entry].lfsz.hash % GLYPHSET_HASH_SIZE];
+         *pos >= 0; pos = &glyphsetCache[*pos].hash_next)
+    {
+        if (*pos != entry) continue;
+        *pos = glyphsetCache[entry].hash_next;
+        break;
+    }
+    glyphsetCache[entry].hash_next = -1;
 
     for (type = 0; type < GLYPH_NBTYPES; type++)
     {
@@ -640,45 +665,59 @@ static void FreeEntry(int entry)
             glyphsetCache[entry].format[type][format] = NULL;
         }
     }
+
+    glyphset_cache_bytes -= glyphsetCache[entry].size;
+    glyphsetCache[entry].size = 0;
+}
+
+/* find the least recently used entry that no DC references */
+static int find_lru_entry( int exclude )
+{
+    int best = -1, i;
+
+    for (i = 0; i < glyphsetCacheSize; i++)
+    {
+        if (glyphsetCache[i].count != 0 || i == exclude) continue;
+        if (best == -1 || (int)(glyphsetCache[i].last_use - glyphsetCache[best].last_use) < 0)
+            best = i;
+    }
+    return best;
+}
+
+/* release unused glyphsets until the server side glyph memory fits in the budget */
+static void shrink_glyphset_cache( int current )
+{
+    int entry;
+
+    while (glyphset_cache_bytes > (SIZE_T)glyph_cache_size * 1024 &&
+           (entry = find_lru_entry( current )) != -1)
+    {
+        TRACE("evicting glyphset %d (%u bytes)\n", entry, glyphsetCache[entry].size);
+        FreeEntry(entry);
+        glyphsetCache[entry].count = -1;
+        glyphsetCache[entry].next = lastfree;
+        lastfree = entry;
+    }
 }
 
 static int AllocEntry(void)
 {
-  int best = -1, prev_best = -1, i, prev_i = -1;
+  int best, i;
 
   if(lastfree >= 0) {
     assert(glyphsetCache[lastfree].count == -1);
-    glyphsetCache[lastfree].count = 1;
     best = lastfree;
     lastfree = glyphsetCache[lastfree].next;
-    assert(best != mru);
-    glyphsetCache[best].next = mru;
-    mru = best;
-
-    TRACE("empty space at %d, next lastfree = %d\n", mru, lastfree);
-    return mru;
-  }
-
-  for(i = mru; i >= 0; i = glyphsetCache[i].next) {
-    if(glyphsetCache[i].count == 0) {
-      best = i;
-      prev_best = prev_i;
-    }
-    prev_i = i;
+    glyphsetCache[best].count = 1;
+    TRACE("empty space at %d, next lastfree = %d\n", best, lastfree);
+    return best;
   }
 
-  if(best >= 0) {
+  if((best = find_lru_entry( -1 )) >= 0) {
     TRACE("freeing unused glyphset at cache %d\n", best);
     FreeEntry(best);
     glyphsetCache[best].count = 1;
-    if(prev_best >= 0) {
-      glyphsetCache[prev_best].next = glyphsetCache[best].next;
-      glyphsetCache[best].next = mru;
-      mru = best;
-    } else {
-      assert(mru == best);
-    }
-    return mru;
+    return best;
   }
 
   TRACE("Growing cache\n");
@@ -703,10 +742,8 @@ static int AllocEntry(void)
 
   lastfree = glyphsetCache[best].next;
   glyphsetCache[best].count = 1;
-  glyphsetCache[best].next = mru;
-  mru = best;
-  TRACE("new free cache slot at %d\n", mru);
-  return mru;
+  TRACE("new free cache slot at %d\n", best);
+  return best;
 }
 
 static int GetCacheEntry( LFANDSIZE *plfsz )
@@ -719,6 +756,9 @@ static int GetCacheEntry( LFANDSIZE *plfsz )
     ret = AllocEntry();
     entry = glyphsetCache + ret;
     entry->lfsz = *plfsz;
+    entry->last_use = ++glyphset_use_stamp;
+    entry->hash_next = glyphset_hash[plfsz->hash % GLYPHSET_HASH_SIZE];
+    glyphset_hash[plfsz->hash % GLYPHSET_HASH_SIZE] = ret;
     return ret;
 }
 
@@ -996,12 +1036,80 @@ static void xrenderdrv_SetDeviceClipping( PHYSDEV dev, HRGN rgn )
 }
 
 
+/************************************************************************
+ *   flush_glyph_batch
+ *
+ * Send the pending glyphs to the server.  Must be called inside xrender_cs
+ */
+static void flush_glyph_batch( struct glyph_batch *batch )
+{
+    if (batch->count && batch->format->glyphset)
+        pXRenderAddGlyphs( gdi_display, batch->format->glyphset, batch->gids, batch->gis,
+                           batch->count, batch->data, batch->size );
+    batch->format = NULL;
+    batch->count = 0;
+    batch->size = 0;
+}
+
+static void free_glyph_batch( struct glyph_batch *batch )
+{
+    HeapFree( GetProcessHeap(), 0, batch->gids );
+    HeapFree( GetProcessHeap(), 0, batch->gis );
+    HeapFree( GetProcessHeap(), 0, batch->data );
+}
+
+/************************************************************************
+ *   reserve_glyph_batch
+ *
+ * Make room for one more glyph of the given size and return the buffer
+ * where its bitmap has to be stored.
+ */
+static char *reserve_glyph_batch( struct glyph_batch *batch, gsCacheEntryFormat *format,
+                                  unsigned int size )
+{
+    if (batch->count && (batch->format != format || batch->size + size > GLYPH_BATCH_MAX_SIZE))
+        flush_glyph_batch( batch );
+
+    if (batch->count == batch->max_count)
+    {
+        unsigned int new_count = max( 16, batch->max_count * 2 );
+        Glyph *gids;
+        XGlyphInfo *gis;
+
+        if (batch->gids) gids = HeapReAlloc( GetProcessHeap(), 0, batch->gids, new_count * sizeof(*gids) );
+        else gids = HeapAlloc( GetProcessHeap(), 0, new_count * sizeof(*gids) );
+        if (!gids) return NULL;
+        batch->gids = gids;
+        if (batch->gis) gis = HeapReAlloc( GetProcessHeap(), 0, batch->gis, new_count * sizeof(*gis) );
+        else gis = HeapAlloc( GetProcessHeap(), 0, new_count * sizeof(*gis) );
+        if (!gis) return NULL;
+        batch->gis = gis;
+        batch->max_count = new_count;
+    }
+
+    if (batch->size + size > batch->max_size)
+    {
+        unsigned int new_size = max( batch->max_size * 2, batch->size + size );
+        char *data;
+
+        if (batch->data) data = HeapReAlloc( GetProcessHeap(), 0, batch->data, new_size );
+        else data = HeapAlloc( GetProcessHeap(), 0, new_size );
+        if (!data) return NULL;
+        batch->data = data;
+        batch->max_size = new_size;
+    }
+
+    batch->format = format;
+    return batch->data + batch->size;
+}
+
 /************************************************************************
  *   UploadGlyph
  *
  * Helper to ExtTextOut.  Must be called inside xrender_cs
  */
-static void UploadGlyph(struct xrender_physdev *physDev, UINT glyph, enum glyph_type type)
+static void UploadGlyph(struct xrender_physdev *physDev, UINT glyph, enum glyph_type type,
+                        struct glyph_batch *batch)
 {
     unsigned int buflen;
     char *buf;
@@ -1099,11 +1207,21 @@ static void UploadGlyph(struct xrender_physdev *physDev, UINT glyph, enum glyph_
     }
 
 
-    buf = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, buflen);
+    if (!(buf = reserve_glyph_batch( batch, formatEntry, buflen ? buflen : sizeof(zero) )))
+    {
+        WARN("out of memory for glyph %u\n", glyph);
+        return;
+    }
     if (buflen)
+    {
+        memset(buf, 0, buflen);
         GetGlyphOutlineW(physDev->dev.hdc, glyph, ggo_format, &gm, buflen, buf, &identity);
+    }
     else
+    {
         gm.gmBlackBoxX = gm.gmBlackBoxY = 0;  /* empty glyph */
+        memcpy(buf, zero, sizeof(zero));
+    }
     formatEntry->realized[glyph] = TRUE;
 
     TRACE("buflen = %d. Got metrics: %dx%d adv=%d,%d origin=%d,%d\n",
@@ -1186,11 +1304,14 @@ static void UploadGlyph(struct xrender_physdev *physDev, UINT glyph, enum glyph_
         if(buflen == 0)
             gi.width = gi.height = 1;
 
-	pXRenderAddGlyphs(gdi_display, formatEntry->glyphset, &gid, &gi, 1,
-                          buflen ? buf : zero, buflen ? buflen : sizeof(zero));
+        batch->gids[batch->count] = gid;
+        batch->gis[batch->count] = gi;
+        batch->count++;
+        batch->size += buflen ? buflen : sizeof(zero);
+        entry->size += buflen ? buflen : sizeof(zero);
+        glyphset_cache_bytes += buflen ? buflen : sizeof(zero);
     }
 
-    HeapFree(GetProcessHeap(), 0, buf);
     formatEntry->gis[glyph] = gi;
 }
 
@@ -1295,6 +1416,8 @@ static BOOL xrenderdrv_ExtTextOut( PHYSDEV dev, INT x, INT y, UINT flags,
     XRenderColor col;
     RECT rect, bounds;
     enum glyph_type type = (flags & ETO_GLYPH_INDEX) ? GLYPH_INDEX : GLYPH_WCHAR;
+    struct glyph_batch batch;
+    unsigned int nelts;
 
     get_xrender_color( physdev, GetTextColor( physdev->dev.hdc ), &col );
     pict = get_xrender_picture( physdev, 0, (flags & ETO_CLIPPED) ? lprect : NULL );
@@ -1325,15 +1448,20 @@ static BOOL xrenderdrv_ExtTextOut( PHYSDEV dev, INT x, INT y, UINT flags,
     entry = glyphsetCache + physdev->cache_index;
     formatEntry = entry->format[type][aa_type_from_flags( physdev->aa_flags )];
 
+    memset( &batch, 0, sizeof(batch) );
     for(idx = 0; idx < count; idx++) {
         if( !formatEntry ) {
-	    UploadGlyph(physdev, wstr[idx], type);
+	    UploadGlyph(physdev, wstr[idx], type, &batch);
             /* re-evaluate format entry since aa_flags may have changed */
             formatEntry = entry->format[type][aa_type_from_flags( physdev->aa_flags )];
         } else if( wstr[idx] >= formatEntry->nrealized || formatEntry->realized[wstr[idx]] == FALSE) {
-	    UploadGlyph(physdev, wstr[idx], type);
+	    UploadGlyph(physdev, wstr[idx], type, &batch);
 	}
     }
+    flush_glyph_batch( &batch );
+    free_glyph_batch( &batch );
+    shrink_glyphset_cache( physdev->cache_index );
+
     if (!formatEntry)
     {
         WARN("could not upload requested glyphs\n");
@@ -1363,16 +1491,25 @@ static BOOL xrenderdrv_ExtTextOut( PHYSDEV dev, INT x, INT y, UINT flags,
         render_op = PictOpOutReverse; /* This gives us 'black' text */
 
     reset_bounds( &bounds );
-    for(idx = 0; idx < count; idx++)
+    for(idx = nelts = 0; idx < count; idx++)
     {
-        elts[idx].glyphset = formatEntry->glyphset;
-        elts[idx].chars = wstr + idx;
-        elts[idx].nchars = 1;
-        elts[idx].xOff = desired.x - current.x;
-        elts[idx].yOff = desired.y - current.y;
+        /* glyphs that need no repositioning are appended to the previous element */
+        if (nelts && desired.x == current.x && desired.y == current.y)
+            elts[nelts - 1].nchars++;
+        else
+        {
+            elts[nelts].glyphset = formatEntry->glyphset;
+            elts[nelts].chars = wstr + idx;
+            elts[nelts].nchars = 1;
+            elts[nelts].xOff = desired.x - current.x;
+            elts[nelts].yOff = desired.y - current.y;
+            current.x += elts[nelts].xOff;
+            current.y += elts[nelts].yOff;
+            nelts++;
+        }
 
-        current.x += (elts[idx].xOff + formatEntry->gis[wstr[idx]].xOff);
-        current.y += (elts[idx].yOff + formatEntry->gis[wstr[idx]].yOff);
+        current.x += formatEntry->gis[wstr[idx]].xOff;
+        current.y += formatEntry->gis[wstr[idx]].yOff;
 
         rect.left   = desired.x - physdev->x11dev->dc_rect.left - formatEntry->gis[wstr[idx]].x;
         rect.top    = desired.y - physdev->x11dev->dc_rect.top - formatEntry->gis[wstr[idx]].y;
@@ -1405,7 +1542,7 @@ static BOOL xrenderdrv_ExtTextOut( PHYSDEV dev, INT x, INT y, UINT flags,
                             tile_pict,
                             pict,
                             formatEntry->font_format,
-                            0, 0, 0, 0, elts, count);
+                            0, 0, 0, 0, elts, nelts);
     HeapFree(GetProcessHeap(), 0, elts);
 
     LeaveCriticalSection(&xrender_cs);
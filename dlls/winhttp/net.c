@@ -72,6 +72,8 @@ static CRITICAL_SECTION cs_gethostbyname = { &critsect_debug, -1, 0, 0, 0, 0 };
 
 #endif
 
+static void flush_resolve_cache( void );
+
 /* translate a unix error code into a winsock error code */
 static int sock_get_error( int err )
 {
@@ -291,6 +293,7 @@ static BOOL ensure_cred_handle(void)
 
 void netconn_unload( void )
 {
+    flush_resolve_cache();
     if(cred_handle_initialized)
         FreeCredentialsHandle(&cred_handle);
     DeleteCriticalSection(&init_sechandle_cs);
@@ -381,7 +384,8 @@ netconn_t *netconn_create( hostdata_t *host, const struct sockaddr_storage *sock
     {
         WARN("unable to connect to host (%d)\n", res);
         set_last_error( res );
-        netconn_close( conn );
+        closesocket( conn->socket );
+        heap_free( conn );
         return NULL;
     }
     return conn;
@@ -399,7 +403,7 @@ BOOL netconn_close( netconn_t *conn )
         DeleteSecurityContext(&conn->ssl_ctx);
     }
     res = closesocket( conn->socket );
-    release_host( conn->host );
+    release_host_connection( conn->host );
     heap_free(conn);
     if (res == -1)
     {
@@ -871,42 +875,192 @@ static DWORD resolve_hostname( const WCHAR *hostnameW, INTERNET_PORT port, struc
 #endif
 }
 
-struct resolve_args
+static void set_sockaddr_port( struct sockaddr_storage *sa, INTERNET_PORT port )
+{
+    switch (sa->ss_family)
+    {
+    case AF_INET:
+        ((struct sockaddr_in *)sa)->sin_port = htons( port );
+        break;
+    case AF_INET6:
+        ((struct sockaddr_in6 *)sa)->sin6_port = htons( port );
+        break;
+    }
+}
+
+/* Resolved names are cached for a while, and lookups run on the thread pool
+ * so that concurrent requests for the same name share a single lookup. */
+
+#define RESOLVE_CACHE_MAX_ENTRIES  128
+#define RESOLVE_CACHE_TTL          (5 * 60 * 1000)
+#define RESOLVE_CACHE_NEGATIVE_TTL (30 * 1000)
+
+struct resolve_entry
 {
-    const WCHAR             *hostname;
-    INTERNET_PORT            port;
-    struct sockaddr_storage *sa;
+    struct list             entry;
+    LONG                    ref;
+    WCHAR                  *hostname;
+    HANDLE                  done;
+    BOOL                    pending;
+    DWORD                   error;
+    ULONGLONG               expires;
+    struct sockaddr_storage sa;
 };
 
-static DWORD CALLBACK resolve_proc( LPVOID arg )
+static struct list resolve_cache = LIST_INIT( resolve_cache );
+static unsigned int resolve_cache_count;
+static ULONG resolve_hits, resolve_misses, resolve_shared;
+
+static CRITICAL_SECTION resolve_cache_cs;
+static CRITICAL_SECTION_DEBUG resolve_cache_debug =
 {
-    struct resolve_args *ra = arg;
-    return resolve_hostname( ra->hostname, ra->port, ra->sa );
+    0, 0, &resolve_cache_cs,
+    { &resolve_cache_debug.ProcessLocksList, &resolve_cache_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": resolve_cache_cs") }
+};
+static CRITICAL_SECTION resolve_cache_cs = { &resolve_cache_debug, -1, 0, 0, 0, 0 };
+
+/* must be called with resolve_cache_cs held */
+static void release_resolve_entry( struct resolve_entry *entry )
+{
+    if (--entry->ref) return;
+    CloseHandle( entry->done );
+    heap_free( entry->hostname );
+    heap_free( entry );
 }
 
-BOOL netconn_resolve( WCHAR *hostname, INTERNET_PORT port, struct sockaddr_storage *sa, int timeout )
+/* must be called with resolve_cache_cs held */
+static void remove_resolve_entry( struct resolve_entry *entry )
 {
+    list_remove( &entry->entry );
+    resolve_cache_count--;
+    release_resolve_entry( entry );
+}
+
+/* must be called with resolve_cache_cs held */
+static void trim_resolve_cache( ULONGLONG now )
+{
+    struct resolve_entry *entry, *next;
+
+    LIST_FOR_EACH_ENTRY_SAFE_REV( entry, next, &resolve_cache, struct resolve_entry, entry )
+    {
+        if (entry->pending) continue;
+        if (entry->expires < now || resolve_cache_count >= RESOLVE_CACHE_MAX_ENTRIES)
+            remove_resolve_entry( entry );
+    }
+}
+
+static DWORD CALLBACK resolve_proc( LPVOID arg )
+{
+    struct resolve_entry *entry = arg;
+    struct sockaddr_storage sa;
     DWORD ret;
 
-    if (timeout)
+    ret = resolve_hostname( entry->hostname, 0, &sa );
+
+    EnterCriticalSection( &resolve_cache_cs );
+    entry->pending = FALSE;
+    entry->error   = ret;
+    if (!ret) entry->sa = sa;
+    if (ret == ERROR_WINHTTP_NAME_NOT_RESOLVED)
+        entry->expires = GetTickCount64() + RESOLVE_CACHE_NEGATIVE_TTL;
+    else if (!ret)
+        entry->expires = GetTickCount64() + RESOLVE_CACHE_TTL;
+    else
+        entry->expires = 0; /* don't cache other failures */
+    SetEvent( entry->done );
+    release_resolve_entry( entry );
+    LeaveCriticalSection( &resolve_cache_cs );
+    return 0;
+}
+
+/* returns a referenced cache entry for the host, starting a lookup if needed */
+static struct resolve_entry *get_resolve_entry( const WCHAR *hostname )
+{
+    struct resolve_entry *entry, *next;
+    ULONGLONG now = GetTickCount64();
+
+    EnterCriticalSection( &resolve_cache_cs );
+
+    LIST_FOR_EACH_ENTRY_SAFE( entry, next, &resolve_cache, struct resolve_entry, entry )
     {
-        DWORD status;
-        HANDLE thread;
-        struct resolve_args ra;
+        if (strcmpiW( entry->hostname, hostname )) continue;
+        if (!entry->pending && entry->expires < now)
+        {
+            remove_resolve_entry( entry );
+            break;
+        }
+        if (entry->pending) resolve_shared++;
+        else resolve_hits++;
+        TRACE("%s found in cache, hits %u misses %u shared %u\n", debugstr_w(hostname),
+              resolve_hits, resolve_misses, resolve_shared);
+        list_remove( &entry->entry );
+        list_add_head( &resolve_cache, &entry->entry );
+        entry->ref++;
+        LeaveCriticalSection( &resolve_cache_cs );
+        return entry;
+    }
 
-        ra.hostname = hostname;
-        ra.port     = port;
-        ra.sa       = sa;
+    resolve_misses++;
+    trim_resolve_cache( now );
 
-        thread = CreateThread( NULL, 0, resolve_proc, &ra, 0, NULL );
-        if (!thread) return FALSE;
+    if (!(entry = heap_alloc_zero( sizeof(*entry) ))) goto error;
+    entry->ref = 3; /* cache, caller and lookup */
+    entry->pending = TRUE;
+    if (!(entry->hostname = strdupW( hostname ))) goto error;
+    if (!(entry->done = CreateEventW( NULL, TRUE, FALSE, NULL ))) goto error;
+    if (!QueueUserWorkItem( resolve_proc, entry, WT_EXECUTEDEFAULT )) goto error;
 
-        status = WaitForSingleObject( thread, timeout );
-        if (status == WAIT_OBJECT_0) GetExitCodeThread( thread, &ret );
-        else ret = ERROR_WINHTTP_TIMEOUT;
-        CloseHandle( thread );
+    list_add_head( &resolve_cache, &entry->entry );
+    resolve_cache_count++;
+    LeaveCriticalSection( &resolve_cache_cs );
+    return entry;
+
+error:
+    LeaveCriticalSection( &resolve_cache_cs );
+    if (entry)
+    {
+        if (entry->done) CloseHandle( entry->done );
+        heap_free( entry->hostname );
+        heap_free( entry );
     }
-    else ret = resolve_hostname( hostname, port, sa );
+    return NULL;
+}
+
+static void flush_resolve_cache( void )
+{
+    struct resolve_entry *entry, *next;
+
+    EnterCriticalSection( &resolve_cache_cs );
+    LIST_FOR_EACH_ENTRY_SAFE( entry, next, &resolve_cache, struct resolve_entry, entry )
+        remove_resolve_entry( entry );
+    LeaveCriticalSection( &resolve_cache_cs );
+}
+
+BOOL netconn_resolve( WCHAR *hostname, INTERNET_PORT port, struct sockaddr_storage *sa, int timeout )
+{
+    struct resolve_entry *entry;
+    DWORD ret;
+
+    if (!(entry = get_resolve_entry( hostname )))
+    {
+        set_last_error( ERROR_OUTOFMEMORY );
+        return FALSE;
+    }
+
+    if (WaitForSingleObject( entry->done, timeout ? timeout : INFINITE ) == WAIT_OBJECT_0)
+    {
+        if (!(ret = entry->error))
+        {
+            *sa = entry->sa;
+            set_sockaddr_port( sa, port );
+        }
+    }
+    else ret = ERROR_WINHTTP_TIMEOUT;
+
+    EnterCriticalSection( &resolve_cache_cs );
+    release_resolve_entry( entry );
+    LeaveCriticalSection( &resolve_cache_cs );
 
     if (ret)
     {
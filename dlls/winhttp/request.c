@@ -1002,7 +1002,20 @@ static CRITICAL_SECTION_DEBUG connection_pool_debug =
 };
 static CRITICAL_SECTION connection_pool_cs = { &connection_pool_debug, -1, 0, 0, 0, 0 };
 
-static struct list connection_pool = LIST_INIT( connection_pool );
+/* hosts are hashed on name, port and security */
+#define CONNECTION_POOL_HASH_SIZE 64
+
+static struct list connection_pool[CONNECTION_POOL_HASH_SIZE];
+static BOOL connection_pool_initialized;
+static ULONG connection_pool_hits, connection_pool_misses;
+
+static unsigned int hash_host( const WCHAR *hostname, INTERNET_PORT port, BOOL secure )
+{
+    unsigned int hash = port ^ (secure ? 0x80000000 : 0);
+
+    while (*hostname) hash = hash * 31 + *hostname++;
+    return hash % CONNECTION_POOL_HASH_SIZE;
+}
 
 void release_host( hostdata_t *host )
 {
@@ -1018,11 +1031,21 @@ void release_host( hostdata_t *host )
     heap_free( host );
 }
 
+/* a connection to the host has been closed, or could not be opened */
+void release_host_connection( hostdata_t *host )
+{
+    EnterCriticalSection( &connection_pool_cs );
+    host->conn_count--;
+    WakeConditionVariable( &host->conn_available );
+    LeaveCriticalSection( &connection_pool_cs );
+    release_host( host );
+}
+
 static BOOL connection_collector_running;
 
 static DWORD WINAPI connection_collector(void *arg)
 {
-    unsigned int remaining_connections;
+    unsigned int i, remaining_connections;
     netconn_t *netconn, *next_netconn;
     hostdata_t *host, *next_host;
     ULONGLONG now;
@@ -1036,19 +1059,22 @@ static DWORD WINAPI connection_collector(void *arg)
 
         EnterCriticalSection(&connection_pool_cs);
 
-        LIST_FOR_EACH_ENTRY_SAFE(host, next_host, &connection_pool, hostdata_t, entry)
+        for (i = 0; i < CONNECTION_POOL_HASH_SIZE; i++)
         {
-            LIST_FOR_EACH_ENTRY_SAFE(netconn, next_netconn, &host->connections, netconn_t, entry)
+            LIST_FOR_EACH_ENTRY_SAFE(host, next_host, &connection_pool[i], hostdata_t, entry)
             {
-                if (netconn->keep_until < now)
+                LIST_FOR_EACH_ENTRY_SAFE(netconn, next_netconn, &host->connections, netconn_t, entry)
                 {
-                    TRACE("freeing %p\n", netconn);
-                    list_remove(&netconn->entry);
-                    netconn_close(netconn);
-                }
-                else
-                {
-                    remaining_connections++;
+                    if (netconn->keep_until < now)
+                    {
+                        TRACE("freeing %p\n", netconn);
+                        list_remove(&netconn->entry);
+                        netconn_close(netconn);
+                    }
+                    else
+                    {
+                        remaining_connections++;
+                    }
                 }
             }
         }
@@ -1069,6 +1095,7 @@ static void cache_connection( netconn_t *netconn )
 
     netconn->keep_until = GetTickCount64() + DEFAULT_KEEP_ALIVE_TIMEOUT;
     list_add_head( &netconn->host->connections, &netconn->entry );
+    WakeConditionVariable( &netconn->host->conn_available );
 
     if (!connection_collector_running)
     {
@@ -1092,6 +1119,49 @@ static void cache_connection( netconn_t *netconn )
     LeaveCriticalSection( &connection_pool_cs );
 }
 
+/* get an idle connection to the host, or reserve a new one if the per-server limit allows it */
+static BOOL get_pooled_connection( hostdata_t *host, DWORD max_conns, DWORD timeout, netconn_t **ret )
+{
+    ULONGLONG end = GetTickCount64() + timeout;
+    netconn_t *netconn = NULL;
+
+    EnterCriticalSection( &connection_pool_cs );
+    for (;;)
+    {
+        if (!list_empty( &host->connections ))
+        {
+            netconn = LIST_ENTRY( list_head( &host->connections ), netconn_t, entry );
+            list_remove( &netconn->entry );
+            break;
+        }
+        if (host->conn_count < max_conns)
+        {
+            host->conn_count++;
+            break;
+        }
+
+        TRACE("%u connections to %s:%u, waiting\n", host->conn_count, debugstr_w(host->hostname), host->port);
+        if (timeout != INFINITE)
+        {
+            ULONGLONG now = GetTickCount64();
+            if (now >= end || !SleepConditionVariableCS( &host->conn_available, &connection_pool_cs, end - now ))
+            {
+                LeaveCriticalSection( &connection_pool_cs );
+                set_last_error( ERROR_WINHTTP_TIMEOUT );
+                return FALSE;
+            }
+        }
+        else SleepConditionVariableCS( &host->conn_available, &connection_pool_cs, INFINITE );
+    }
+    if (netconn) connection_pool_hits++;
+    else connection_pool_misses++;
+    TRACE("pool hits %u misses %u\n", connection_pool_hits, connection_pool_misses);
+    LeaveCriticalSection( &connection_pool_cs );
+
+    *ret = netconn;
+    return TRUE;
+}
+
 static BOOL open_connection( request_t *request )
 {
     BOOL is_secure = request->hdr.flags & WINHTTP_FLAG_SECURE;
@@ -1100,16 +1170,24 @@ static BOOL open_connection( request_t *request )
     connect_t *connect;
     WCHAR *addressW = NULL;
     INTERNET_PORT port;
+    unsigned int i, bucket;
     DWORD len;
 
     if (request->netconn) goto done;
 
     connect = request->connect;
     port = connect->serverport ? connect->serverport : (request->hdr.flags & WINHTTP_FLAG_SECURE ? 443 : 80);
+    bucket = hash_host( connect->servername, port, is_secure );
 
     EnterCriticalSection( &connection_pool_cs );
 
-    LIST_FOR_EACH_ENTRY( iter, &connection_pool, hostdata_t, entry )
+    if (!connection_pool_initialized)
+    {
+        for (i = 0; i < CONNECTION_POOL_HASH_SIZE; i++) list_init( &connection_pool[i] );
+        connection_pool_initialized = TRUE;
+    }
+
+    LIST_FOR_EACH_ENTRY( iter, &connection_pool[bucket], hostdata_t, entry )
     {
         if (iter->port == port && !strcmpW( connect->servername, iter->hostname ) && !is_secure == !iter->secure)
         {
@@ -1126,10 +1204,12 @@ static BOOL open_connection( request_t *request )
             host->ref = 1;
             host->secure = is_secure;
             host->port = port;
+            host->conn_count = 0;
             list_init( &host->connections );
+            InitializeConditionVariable( &host->conn_available );
             if ((host->hostname = strdupW( connect->servername )))
             {
-                list_add_head( &connection_pool, &host->entry );
+                list_add_head( &connection_pool[bucket], &host->entry );
             }
             else
             {
@@ -1145,16 +1225,20 @@ static BOOL open_connection( request_t *request )
 
     for (;;)
     {
-        EnterCriticalSection( &connection_pool_cs );
-        if (!list_empty( &host->connections ))
+        if (!get_pooled_connection( host, connect->session->max_conns,
+                                    request->connect_timeout > 0 ? request->connect_timeout : INFINITE, &netconn ))
         {
-            netconn = LIST_ENTRY( list_head( &host->connections ), netconn_t, entry );
-            list_remove( &netconn->entry );
+            release_host( host );
+            return FALSE;
         }
-        LeaveCriticalSection( &connection_pool_cs );
         if (!netconn) break;
 
-        if (netconn_is_alive( netconn )) break;
+        if (netconn_is_alive( netconn ))
+        {
+            /* the connection holds its own reference */
+            release_host( host );
+            break;
+        }
         TRACE("connection %p no longer alive, closing\n", netconn);
         netconn_close( netconn );
         netconn = NULL;
@@ -1173,14 +1257,14 @@ static BOOL open_connection( request_t *request )
 
         if (!netconn_resolve( host->hostname, port, &connect->sockaddr, request->resolve_timeout ))
         {
-            release_host( host );
+            release_host_connection( host );
             return FALSE;
         }
         connect->resolved = TRUE;
 
         if (!(addressW = addr_to_str( &connect->sockaddr )))
         {
-            release_host( host );
+            release_host_connection( host );
             return FALSE;
         }
         len = strlenW( addressW ) + 1;
@@ -1191,7 +1275,7 @@ static BOOL open_connection( request_t *request )
     {
         if (!addressW && !(addressW = addr_to_str( &connect->sockaddr )))
         {
-            release_host( host );
+            release_host_connection( host );
             return FALSE;
         }
 
@@ -1202,7 +1286,7 @@ static BOOL open_connection( request_t *request )
         if (!(netconn = netconn_create( host, &connect->sockaddr, request->connect_timeout )))
         {
             heap_free( addressW );
-            release_host( host );
+            release_host_connection( host );
             return FALSE;
         }
         netconn_set_timeout( netconn, TRUE, request->send_timeout );
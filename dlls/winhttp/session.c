@@ -148,6 +148,17 @@ static BOOL session_query_option( object_header_t *hdr, DWORD option, LPVOID buf
         *(DWORD *)buffer = session->recv_timeout;
         *buflen = sizeof(DWORD);
         return TRUE;
+    case WINHTTP_OPTION_MAX_CONNS_PER_SERVER:
+        if (!buffer || *buflen < sizeof(DWORD))
+        {
+            *buflen = sizeof(DWORD);
+            set_last_error( ERROR_INSUFFICIENT_BUFFER );
+            return FALSE;
+        }
+
+        *(DWORD *)buffer = session->max_conns;
+        *buflen = sizeof(DWORD);
+        return TRUE;
     default:
         FIXME("unimplemented option %u\n", option);
         set_last_error( ERROR_INVALID_PARAMETER );
@@ -206,7 +217,13 @@ static BOOL session_set_option( object_header_t *hdr, DWORD option, LPVOID buffe
         session->unload_event = *(HANDLE *)buffer;
         return TRUE;
     case WINHTTP_OPTION_MAX_CONNS_PER_SERVER:
-        FIXME("WINHTTP_OPTION_MAX_CONNS_PER_SERVER: %d\n", *(DWORD *)buffer);
+        if (buflen != sizeof(DWORD))
+        {
+            set_last_error( ERROR_INSUFFICIENT_BUFFER );
+            return FALSE;
+        }
+        TRACE("WINHTTP_OPTION_MAX_CONNS_PER_SERVER: %u\n", *(DWORD *)buffer);
+        session->max_conns = *(DWORD *)buffer ? *(DWORD *)buffer : INFINITE;
         return TRUE;
     case WINHTTP_OPTION_MAX_CONNS_PER_1_0_SERVER:
         FIXME("WINHTTP_OPTION_MAX_CONNS_PER_1_0_SERVER: %d\n", *(DWORD *)buffer);
@@ -242,6 +259,7 @@ HINTERNET WINAPI WinHttpOpen( LPCWSTR agent, DWORD access, LPCWSTR proxy, LPCWST
     session->hdr.flags = flags;
     session->hdr.refs = 1;
     session->hdr.redirect_policy = WINHTTP_OPTION_REDIRECT_POLICY_DISALLOW_HTTPS_TO_HTTP;
+    session->max_conns = INFINITE;
     list_init( &session->hdr.children );
     session->resolve_timeout = DEFAULT_RESOLVE_TIMEOUT;
     session->connect_timeout = DEFAULT_CONNECT_TIMEOUT;
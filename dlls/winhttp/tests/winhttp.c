@@ -141,6 +141,18 @@ static void test_QueryOption(void)
     ok(feature == WINHTTP_OPTION_REDIRECT_POLICY_ALWAYS,
        "expected WINHTTP_OPTION_REDIRECT_POLICY_ALWAYS, got %#x\n", feature);
 
+    feature = 4;
+    SetLastError(0xdeadbeef);
+    ret = WinHttpSetOption(session, WINHTTP_OPTION_MAX_CONNS_PER_SERVER, &feature, sizeof(feature));
+    ok(ret, "failed to set max connections %u\n", GetLastError());
+
+    feature = 0xdeadbeef;
+    size = sizeof(feature);
+    SetLastError(0xdeadbeef);
+    ret = WinHttpQueryOption(session, WINHTTP_OPTION_MAX_CONNS_PER_SERVER, &feature, &size);
+    ok(ret, "failed to query option %u\n", GetLastError());
+    ok(feature == 4, "expected 4, got %u\n", feature);
+
     feature = WINHTTP_DISABLE_COOKIES;
     SetLastError(0xdeadbeef);
     ret = WinHttpSetOption(session, WINHTTP_OPTION_DISABLE_FEATURE, &feature, sizeof(feature));
@@ -1992,6 +2004,131 @@ static void test_resolve_timeout(void)
     WinHttpCloseHandle(ses);
 }
 
+struct resolve_test
+{
+    const WCHAR *host;
+    int port;
+    HANDLE start;
+    DWORD error;
+};
+
+static DWORD CALLBACK resolve_thread(LPVOID param)
+{
+    struct resolve_test *test = param;
+    HINTERNET ses, con, req;
+    BOOL ret;
+
+    WaitForSingleObject(test->start, INFINITE);
+
+    ses = WinHttpOpen(test_useragent, WINHTTP_ACCESS_TYPE_NO_PROXY, NULL, NULL, 0);
+    ok(ses != NULL, "failed to open session %u\n", GetLastError());
+
+    con = WinHttpConnect(ses, test->host, test->port, 0);
+    ok(con != NULL, "failed to open a connection %u\n", GetLastError());
+
+    req = WinHttpOpenRequest(con, NULL, NULL, NULL, NULL, NULL, 0);
+    ok(req != NULL, "failed to open a request %u\n", GetLastError());
+
+    SetLastError(0xdeadbeef);
+    ret = WinHttpSendRequest(req, NULL, 0, NULL, 0, 0, 0);
+    test->error = ret ? ERROR_SUCCESS : GetLastError();
+
+    WinHttpCloseHandle(req);
+    WinHttpCloseHandle(con);
+    WinHttpCloseHandle(ses);
+    return 0;
+}
+
+/* resolves the host from several threads at once, returns how many lookups failed with error */
+static int run_resolve_threads(const WCHAR *host, int port, DWORD error)
+{
+    struct resolve_test tests[8];
+    HANDLE threads[8], start;
+    int i, count = 0;
+
+    start = CreateEventW(NULL, TRUE, FALSE, NULL);
+    for (i = 0; i < 8; i++)
+    {
+        tests[i].host = host;
+        tests[i].port = port;
+        tests[i].start = start;
+        tests[i].error = 0xdeadbeef;
+        threads[i] = CreateThread(NULL, 0, resolve_thread, &tests[i], 0, NULL);
+        ok(threads[i] != NULL, "failed to create thread %u\n", GetLastError());
+    }
+    SetEvent(start);
+    WaitForMultipleObjects(8, threads, TRUE, 30000);
+
+    for (i = 0; i < 8; i++)
+    {
+        if (tests[i].error == error) count++;
+        CloseHandle(threads[i]);
+    }
+    CloseHandle(start);
+    return count;
+}
+
+static void test_resolve_cache(void)
+{
+    static const WCHAR nxdomain[] =
+        {'n','x','d','o','m','a','i','n','.','i','n','v','a','l','i','d',0};
+    struct sockaddr_in sa;
+    WSADATA wsa_data;
+    int len, count;
+    SOCKET s;
+
+    WSAStartup(MAKEWORD(2,2), &wsa_data);
+
+    /* requests only need to be sent, the listener never answers them */
+    s = socket(AF_INET, SOCK_STREAM, 0);
+    ok(s != INVALID_SOCKET, "failed to create socket %u\n", WSAGetLastError());
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_addr.S_un.S_addr = inet_addr("127.0.0.1");
+    ok(!bind(s, (struct sockaddr *)&sa, sizeof(sa)), "bind failed %u\n", WSAGetLastError());
+    len = sizeof(sa);
+    ok(!getsockname(s, (struct sockaddr *)&sa, &len), "getsockname failed %u\n", WSAGetLastError());
+    ok(!listen(s, SOMAXCONN), "listen failed %u\n", WSAGetLastError());
+
+    /* concurrent lookups of a name nobody resolved yet */
+    count = run_resolve_threads(localhostW, ntohs(sa.sin_port), ERROR_SUCCESS);
+    ok(count == 8, "%d requests succeeded\n", count);
+
+    /* and again, once the name is known */
+    count = run_resolve_threads(localhostW, ntohs(sa.sin_port), ERROR_SUCCESS);
+    ok(count == 8, "%d requests succeeded\n", count);
+
+    count = run_resolve_threads(nxdomain, ntohs(sa.sin_port), ERROR_SUCCESS);
+    if (count)
+    {
+        skip("nxdomain returned success. Broken ISP redirects?\n");
+        closesocket(s);
+        WSACleanup();
+        return;
+    }
+
+    /* a failed lookup is remembered for a while, every caller still gets the error */
+    count = run_resolve_threads(nxdomain, ntohs(sa.sin_port), ERROR_WINHTTP_NAME_NOT_RESOLVED);
+    ok(count == 8, "%d requests failed to resolve\n", count);
+
+    /* it doesn't affect other names */
+    count = run_resolve_threads(localhostW, ntohs(sa.sin_port), ERROR_SUCCESS);
+    ok(count == 8, "%d requests succeeded\n", count);
+
+    /* failed lookups are forgotten after 30 seconds, which is too long for a regular run */
+    if (winetest_interactive)
+    {
+        Sleep(31000);
+        count = run_resolve_threads(nxdomain, ntohs(sa.sin_port), ERROR_WINHTTP_NAME_NOT_RESOLVED);
+        ok(count == 8, "%d requests failed to resolve\n", count);
+        count = run_resolve_threads(localhostW, ntohs(sa.sin_port), ERROR_SUCCESS);
+        ok(count == 8, "%d requests succeeded\n", count);
+    }
+
+    closesocket(s);
+    WSACleanup();
+}
+
 static const char page1[] =
 "<HTML>\r\n"
 "<HEAD><TITLE>winhttp test page</TITLE></HEAD>\r\n"
@@ -4398,6 +4535,7 @@ START_TEST (winhttp)
     test_empty_headers_param();
     test_Timeouts();
     test_resolve_timeout();
+    test_resolve_cache();
     test_credentials();
     test_IWinHttpRequest_Invoke();
     test_WinHttpDetectAutoProxyConfigUrl();
@@ -103,6 +103,8 @@ typedef struct {
     INTERNET_PORT port;
     BOOL secure;
     struct list connections;
+    DWORD conn_count;                   /* open connections, idle or in use */
+    CONDITION_VARIABLE conn_available;  /* signaled when a connection is returned or closed */
 } hostdata_t;
 
 typedef struct
@@ -120,6 +122,7 @@ typedef struct
     LPWSTR proxy_password;
     struct list cookie_cache;
     HANDLE unload_event;
+    DWORD max_conns;   /* maximum number of connections per server */
 } session_t;
 
 typedef struct
@@ -315,6 +318,7 @@ BOOL set_server_for_hostname( connect_t *, LPCWSTR, INTERNET_PORT ) DECLSPEC_HID
 void destroy_authinfo( struct authinfo * ) DECLSPEC_HIDDEN;
 
 void release_host( hostdata_t *host ) DECLSPEC_HIDDEN;
+void release_host_connection( hostdata_t *host ) DECLSPEC_HIDDEN;
 
 extern HRESULT WinHttpRequest_create( void ** ) DECLSPEC_HIDDEN;
 void release_typelib( void ) DECLSPEC_HIDDEN;
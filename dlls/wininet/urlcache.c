@@ -186,6 +186,7 @@ typedef struct
     char *cache_prefix; /* string that has to be prefixed for this container to be used */
     LPWSTR path; /* path to url container directory */
     HANDLE mapping; /* handle of file mapping */
+    urlcache_header *header; /* view of the mapping, kept while the mapping is open */
     DWORD file_size; /* size of file when mapping was opened */
     HANDLE mutex; /* handle of mutex */
     DWORD default_entry_type;
@@ -372,6 +373,26 @@ static DWORD urlcache_create_hash_table(urlcache_header *header, entry_hash_tabl
     return ERROR_SUCCESS;
 }
 
+/***********************************************************************
+ *           cache_container_close_index (Internal)
+ *
+ *  Closes the index
+ *
+ * RETURNS
+ *    nothing
+ *
+ */
+static void cache_container_close_index(cache_container *pContainer)
+{
+    if (pContainer->header)
+    {
+        UnmapViewOfFile(pContainer->header);
+        pContainer->header = NULL;
+    }
+    CloseHandle(pContainer->mapping);
+    pContainer->mapping = NULL;
+}
+
 /***********************************************************************
  *           cache_container_create_object_name (Internal)
  *
@@ -455,7 +476,7 @@ static DWORD cache_container_set_size(cache_container *container, HANDLE file, D
         header->capacity_in_blocks = blocks_no;
 
         UnmapViewOfFile(header);
-        CloseHandle(container->mapping);
+        cache_container_close_index(container);
         container->mapping = mapping;
         container->file_size = file_size;
         return ERROR_SUCCESS;
@@ -543,7 +564,7 @@ static DWORD cache_container_set_size(cache_container *container, HANDLE file, D
     }
 
     UnmapViewOfFile(header);
-    CloseHandle(container->mapping);
+    cache_container_close_index(container);
     container->mapping = mapping;
     container->file_size = file_size;
     return ERROR_SUCCESS;
@@ -673,21 +694,6 @@ static DWORD cache_container_open_index(cache_container *container, DWORD blocks
     return ERROR_SUCCESS;
 }
 
-/***********************************************************************
- *           cache_container_close_index (Internal)
- *
- *  Closes the index
- *
- * RETURNS
- *    nothing
- *
- */
-static void cache_container_close_index(cache_container *pContainer)
-{
-    CloseHandle(pContainer->mapping);
-    pContainer->mapping = NULL;
-}
-
 static BOOL cache_containers_add(const char *cache_prefix, LPCWSTR path,
         DWORD default_entry_type, LPWSTR mutex_name)
 {
@@ -700,6 +706,7 @@ static BOOL cache_containers_add(const char *cache_prefix, LPCWSTR path,
     }
 
     pContainer->mapping = NULL;
+    pContainer->header = NULL;
     pContainer->file_size = 0;
     pContainer->default_entry_type = default_entry_type;
 
@@ -898,29 +905,28 @@ static BOOL cache_containers_enum(char *search_pattern, DWORD index, cache_conta
 static urlcache_header* cache_container_lock_index(cache_container *pContainer)
 {
     BYTE index;
-    LPVOID pIndexData;
     urlcache_header* pHeader;
     DWORD error;
 
     /* acquire mutex */
     WaitForSingleObject(pContainer->mutex, INFINITE);
 
-    pIndexData = MapViewOfFile(pContainer->mapping, FILE_MAP_WRITE, 0, 0, 0);
-
-    if (!pIndexData)
+    /* the view is kept mapped between calls, so that lookups don't have
+     * to map and unmap the whole index each time */
+    if (!pContainer->header &&
+        !(pContainer->header = MapViewOfFile(pContainer->mapping, FILE_MAP_WRITE, 0, 0, 0)))
     {
         ReleaseMutex(pContainer->mutex);
         ERR("Couldn't MapViewOfFile. Error: %d\n", GetLastError());
         return NULL;
     }
-    pHeader = (urlcache_header*)pIndexData;
+    pHeader = pContainer->header;
 
     /* file has grown - we need to remap to prevent us getting
      * access violations when we try and access beyond the end
      * of the memory mapped file */
     if (pHeader->size != pContainer->file_size)
     {
-        UnmapViewOfFile( pHeader );
         cache_container_close_index(pContainer);
         error = cache_container_open_index(pContainer, MIN_BLOCK_NO);
         if (error != ERROR_SUCCESS)
@@ -929,15 +935,15 @@ static urlcache_header* cache_container_lock_index(cache_container *pContainer)
             SetLastError(error);
             return NULL;
         }
-        pIndexData = MapViewOfFile(pContainer->mapping, FILE_MAP_WRITE, 0, 0, 0);
+        pContainer->header = MapViewOfFile(pContainer->mapping, FILE_MAP_WRITE, 0, 0, 0);
 
-        if (!pIndexData)
+        if (!pContainer->header)
         {
             ReleaseMutex(pContainer->mutex);
             ERR("Couldn't MapViewOfFile. Error: %d\n", GetLastError());
             return NULL;
         }
-        pHeader = (urlcache_header*)pIndexData;
+        pHeader = pContainer->header;
     }
 
     TRACE("Signature: %s, file size: %d bytes\n", pHeader->signature, pHeader->size);
@@ -956,9 +962,8 @@ static urlcache_header* cache_container_lock_index(cache_container *pContainer)
  */
 static BOOL cache_container_unlock_index(cache_container *pContainer, urlcache_header *pHeader)
 {
-    /* release mutex */
-    ReleaseMutex(pContainer->mutex);
-    return UnmapViewOfFile(pHeader);
+    /* release mutex, the view stays mapped until the index is closed */
+    return ReleaseMutex(pContainer->mutex);
 }
 
 /***********************************************************************
@@ -1175,7 +1180,8 @@ static BOOL urlcache_clean_leaked_entries(cache_container *container, urlcache_h
 static DWORD cache_container_clean_index(cache_container *container, urlcache_header **file_view)
 {
     urlcache_header *header = *file_view;
-    DWORD ret;
+    HANDLE old_mapping;
+    DWORD blocks_no, ret;
 
     TRACE("(%s %s)\n", debugstr_a(container->cache_prefix), debugstr_w(container->path));
 
@@ -1187,15 +1193,29 @@ static DWORD cache_container_clean_index(cache_container *container, urlcache_he
         return ERROR_NOT_ENOUGH_MEMORY;
     }
 
-    cache_container_close_index(container);
-    ret = cache_container_open_index(container, header->capacity_in_blocks*2);
-    if(ret != ERROR_SUCCESS)
+    /* keep the old view mapped until the resized index is available */
+    blocks_no = header->capacity_in_blocks*2;
+    old_mapping = container->mapping;
+    container->mapping = NULL;
+    container->header = NULL;
+
+    ret = cache_container_open_index(container, blocks_no);
+    if(ret == ERROR_SUCCESS) {
+        header = MapViewOfFile(container->mapping, FILE_MAP_WRITE, 0, 0, 0);
+        if(!header) {
+            ret = GetLastError();
+            cache_container_close_index(container);
+        }
+    }
+    if(ret != ERROR_SUCCESS) {
+        container->mapping = old_mapping;
+        container->header = *file_view;
         return ret;
-    header = MapViewOfFile(container->mapping, FILE_MAP_WRITE, 0, 0, 0);
-    if(!header)
-        return GetLastError();
+    }
 
     UnmapViewOfFile(*file_view);
+    CloseHandle(old_mapping);
+    container->header = header;
     *file_view = header;
     return ERROR_SUCCESS;
 }
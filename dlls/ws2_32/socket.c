@@ -131,6 +131,15 @@
 #ifdef HAVE_SYS_TIME_H
 # include <sys/time.h>
 #endif
+#ifdef HAVE_SYS_EPOLL_H
+# include <sys/epoll.h>
+#endif
+#ifdef HAVE_SYS_SENDFILE_H
+# include <sys/sendfile.h>
+#endif
+#ifdef HAVE_SYS_STAT_H
+# include <sys/stat.h>
+#endif
 
 #define NONAMELESSUNION
 #define NONAMELESSSTRUCT
@@ -157,6 +166,7 @@
 #include "wine/server.h"
 #include "wine/debug.h"
 #include "wine/exception.h"
+#include "wine/list.h"
 #include "wine/unicode.h"
 
 #if defined(linux) && !defined(IP_UNICAST_IF)
@@ -273,6 +283,26 @@ static CRITICAL_SECTION_DEBUG critsect_debug =
 };
 static CRITICAL_SECTION csWSgetXXXbyYYY = { &critsect_debug, -1, 0, 0, 0, 0 };
 
+/* critical section to protect the socket fd cache */
+static CRITICAL_SECTION sock_fd_section;
+static CRITICAL_SECTION_DEBUG sock_fd_section_debug =
+{
+    0, 0, &sock_fd_section,
+    { &sock_fd_section_debug.ProcessLocksList, &sock_fd_section_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": sock_fd_section") }
+};
+static CRITICAL_SECTION sock_fd_section = { &sock_fd_section_debug, -1, 0, 0, 0, 0 };
+
+/* critical section to protect the list of pending datagram receives */
+static CRITICAL_SECTION dgram_recv_section;
+static CRITICAL_SECTION_DEBUG dgram_recv_section_debug =
+{
+    0, 0, &dgram_recv_section,
+    { &dgram_recv_section_debug.ProcessLocksList, &dgram_recv_section_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": dgram_recv_section") }
+};
+static CRITICAL_SECTION dgram_recv_section = { &dgram_recv_section_debug, -1, 0, 0, 0, 0 };
+
 union generic_unix_sockaddr
 {
     struct sockaddr addr;
@@ -476,6 +506,7 @@ struct ws2_async_io
 {
     async_callback_t *callback; /* must be the first field */
     struct ws2_async_io *next;
+    DWORD size;                 /* allocated size */
 };
 
 struct ws2_async_shutdown
@@ -502,6 +533,9 @@ struct ws2_async
     DWORD                               flags;
     DWORD                              *lpFlags;
     WSABUF                             *control;
+    BOOL                                dgram;         /* plain receive on a datagram socket */
+    struct list                         dgram_entry;   /* entry in pending_dgram_recvs */
+    int                                 dgram_result;  /* datagram received by another async, -1 if none */
     unsigned int                        n_iovecs;
     unsigned int                        first_iovec;
     struct iovec                        iovec[1];
@@ -526,6 +560,7 @@ struct ws2_transmitfile_async
     struct ws2_async_io   io;
     char                  *buffer;
     HANDLE                file;
+    int                   file_fd;   /* unix fd of the file for sendfile, -1 if not used */
     DWORD                 file_read;
     DWORD                 file_bytes;
     DWORD                 bytes_per_send;
@@ -535,36 +570,6 @@ struct ws2_transmitfile_async
     struct ws2_async      write;
 };
 
-static struct ws2_async_io *async_io_freelist;
-
-static void release_async_io( struct ws2_async_io *io )
-{
-    for (;;)
-    {
-        struct ws2_async_io *next = async_io_freelist;
-        io->next = next;
-        if (InterlockedCompareExchangePointer( (void **)&async_io_freelist, io, next ) == next) return;
-    }
-}
-
-static struct ws2_async_io *alloc_async_io( DWORD size, async_callback_t callback )
-{
-    /* first free remaining previous fileinfos */
-
-    struct ws2_async_io *io = InterlockedExchangePointer( (void **)&async_io_freelist, NULL );
-
-    while (io)
-    {
-        struct ws2_async_io *next = io->next;
-        HeapFree( GetProcessHeap(), 0, io );
-        io = next;
-    }
-
-    io = HeapAlloc( GetProcessHeap(), 0, size );
-    if (io) io->callback = callback;
-    return io;
-}
-
 static NTSTATUS register_async( int type, HANDLE handle, struct ws2_async_io *async, HANDLE event,
                                 PIO_APC_ROUTINE apc, void *apc_context, IO_STATUS_BLOCK *io )
 {
@@ -604,6 +609,36 @@ typedef struct          /* WSAAsyncSelect() control struct */
 #define WS_MAX_UDP_DATAGRAM             1024
 static INT WINAPI WSA_DefaultBlockingHook( FARPROC x );
 
+/* state of a socket kept across calls, indexed by handle; entries don't hold
+ * any fd, they are checked against the unix socket whenever ntdll closed one
+ * of its cached fds since they were last used */
+struct sock_fd_entry
+{
+    BOOL         used;        /* entry is in use */
+    unsigned int generation;  /* ntdll fd cache generation when the entry was last checked */
+    dev_t        dev;         /* device and inode of the unix socket */
+    ino_t        ino;
+    int          type;        /* socket type, 0 if not known yet */
+    BOOL         bound;       /* socket is known to be bound */
+};
+
+static struct sock_fd_entry *sock_fd_cache;
+static unsigned int sock_fd_cache_size;
+
+#ifdef HAVE_SYS_EPOLL_H
+/* state of a unix fd in the per-thread epoll set */
+struct epoll_slot
+{
+    BOOL registered;       /* fd is part of the epoll set */
+    int unix_fd;           /* duplicate of the fd registered in the set */
+    unsigned int events;   /* registered events */
+    unsigned int wanted;   /* events wanted by the current call */
+    unsigned int revents;  /* events returned by epoll_wait */
+    unsigned int call;     /* last call that used this fd */
+    unsigned int ready;    /* last call that returned events for this fd */
+};
+#endif
+
 /* hostent's, servent's and protent's are stored in one buffer per thread,
  * as documented on MSDN for the functions that return any of the buffers */
 struct per_thread_data
@@ -613,7 +648,21 @@ struct per_thread_data
     struct WS_servent *se_buffer;
     struct WS_protoent *pe_buffer;
     struct pollfd *fd_cache;
+    BOOL *fd_needs_close;     /* entries of the poll array that must be closed after the call */
     unsigned int fd_count;
+    struct ws2_async_io *async_io_cache;  /* async blocks available for reuse */
+    unsigned int async_io_count;
+#ifdef HAVE_SYS_EPOLL_H
+    int epoll_fd;
+    unsigned int epoll_generation;  /* ntdll fd cache generation of the registered fds */
+    unsigned int epoll_call;
+    struct epoll_slot *epoll_slots;
+    unsigned int epoll_slot_count;
+    int *epoll_fds;          /* unix fds currently registered */
+    unsigned int epoll_fd_count;
+    unsigned int epoll_fd_size;
+    struct epoll_event *epoll_events;
+#endif
     int he_len;
     int se_len;
     int pe_len;
@@ -641,6 +690,9 @@ int WSAIOCTL_GetInterfaceCount(void);
 int WSAIOCTL_GetInterfaceName(int intNumber, char *intName);
 
 static void WS_AddCompletion( SOCKET sock, ULONG_PTR CompletionValue, NTSTATUS CompletionStatus, ULONG Information );
+#ifdef HAVE_SYS_EPOLL_H
+static void reset_epoll_set( struct per_thread_data *ptb );
+#endif
 
 #define MAP_OPTION(opt) { WS_##opt, opt }
 
@@ -1097,6 +1149,102 @@ static inline void release_sock_fd( SOCKET s, int fd )
     wine_server_release_fd( SOCKET2HANDLE(s), fd );
 }
 
+/* get the unix fd of a socket without duplicating the fd cached by ntdll, which
+ * is only valid as long as the socket handle is; it must be released with
+ * release_cached_sock_fd */
+static inline int get_cached_sock_fd( SOCKET s, int *needs_close )
+{
+    int fd;
+    if (set_error( wine_server_get_unix_fd( SOCKET2HANDLE(s), 0, &fd, needs_close ) ))
+        return -1;
+    return fd;
+}
+
+static inline void release_cached_sock_fd( SOCKET s, int fd, int needs_close )
+{
+    if (needs_close) release_sock_fd( s, fd );
+}
+
+/* get the entry of a socket along with its unix fd, see get_cached_sock_fd */
+/* must be called with sock_fd_section held */
+static struct sock_fd_entry *get_sock_fd_entry( SOCKET s, int *fd_ret, int *needs_close_ret )
+{
+    unsigned int idx = s >> 2, generation = wine_server_fd_cache_generation();
+    struct sock_fd_entry *entry = NULL;
+    int fd, needs_close;
+    struct stat st;
+
+    if ((fd = get_cached_sock_fd( s, &needs_close )) == -1) return NULL;
+
+    /* the fd of a handle cached by ntdll stays the same until the handle is closed */
+    if (idx < sock_fd_cache_size && sock_fd_cache[idx].used &&
+        sock_fd_cache[idx].generation == generation && !needs_close)
+    {
+        entry = &sock_fd_cache[idx];
+        goto done;
+    }
+
+    if (fstat( fd, &st ) == -1)
+    {
+        SetLastError( wsaErrno() );
+        release_cached_sock_fd( s, fd, needs_close );
+        return NULL;
+    }
+
+    if (idx >= sock_fd_cache_size)
+    {
+        unsigned int size = max( 64, max( idx + 1, sock_fd_cache_size * 2 ));
+
+        if (sock_fd_cache)
+            entry = HeapReAlloc( GetProcessHeap(), HEAP_ZERO_MEMORY, sock_fd_cache, size * sizeof(*entry) );
+        else
+            entry = HeapAlloc( GetProcessHeap(), HEAP_ZERO_MEMORY, size * sizeof(*entry) );
+        if (!entry)
+        {
+            release_cached_sock_fd( s, fd, needs_close );
+            SetLastError( ERROR_NOT_ENOUGH_MEMORY );
+            return NULL;
+        }
+        sock_fd_cache = entry;
+        sock_fd_cache_size = size;
+    }
+
+    entry = &sock_fd_cache[idx];
+    /* the handle may have been closed without closesocket() and reused */
+    if (!entry->used || entry->dev != st.st_dev || entry->ino != st.st_ino)
+    {
+        memset( entry, 0, sizeof(*entry) );
+        entry->used = TRUE;
+        entry->dev = st.st_dev;
+        entry->ino = st.st_ino;
+    }
+    entry->generation = generation;
+
+done:
+    *fd_ret = fd;
+    *needs_close_ret = needs_close;
+    return entry;
+}
+
+/* drop the entry of a socket, called when the handle is closed or its fd replaced */
+static void remove_sock_fd_entry( SOCKET s )
+{
+    unsigned int idx = s >> 2;
+
+    EnterCriticalSection( &sock_fd_section );
+    if (idx < sock_fd_cache_size) sock_fd_cache[idx].used = FALSE;
+    LeaveCriticalSection( &sock_fd_section );
+}
+
+static void flush_sock_fd_cache(void)
+{
+    unsigned int i;
+
+    EnterCriticalSection( &sock_fd_section );
+    for (i = 0; i < sock_fd_cache_size; i++) sock_fd_cache[i].used = FALSE;
+    LeaveCriticalSection( &sock_fd_section );
+}
+
 static void _enable_event( HANDLE s, unsigned int event,
                            unsigned int sstate, unsigned int cstate )
 {
@@ -1111,6 +1259,16 @@ static void _enable_event( HANDLE s, unsigned int event,
     SERVER_END_REQ;
 }
 
+/* set once the application has selected network events on a socket */
+static BOOL network_events_selected;
+
+/* re-enable a network event after the corresponding i/o succeeded; this is
+ * only needed once WSAEventSelect or WSAAsyncSelect have been used */
+static inline void _reenable_event( HANDLE s, unsigned int event )
+{
+    if (network_events_selected) _enable_event( s, event, 0, 0 );
+}
+
 static NTSTATUS _is_blocking(SOCKET s, BOOL *ret)
 {
     NTSTATUS status;
@@ -1302,11 +1460,91 @@ static void free_per_thread_data(void)
     HeapFree( GetProcessHeap(), 0, ptb->se_buffer );
     HeapFree( GetProcessHeap(), 0, ptb->pe_buffer );
     HeapFree( GetProcessHeap(), 0, ptb->fd_cache );
+    HeapFree( GetProcessHeap(), 0, ptb->fd_needs_close );
+    while (ptb->async_io_cache)
+    {
+        struct ws2_async_io *next = ptb->async_io_cache->next;
+        HeapFree( GetProcessHeap(), 0, ptb->async_io_cache );
+        ptb->async_io_cache = next;
+    }
+#ifdef HAVE_SYS_EPOLL_H
+    if (ptb->epoll_slots) reset_epoll_set( ptb );
+    HeapFree( GetProcessHeap(), 0, ptb->epoll_fds );
+    HeapFree( GetProcessHeap(), 0, ptb->epoll_events );
+#endif
 
     HeapFree( GetProcessHeap(), 0, ptb );
     NtCurrentTeb()->WinSockData = NULL;
 }
 
+/* async blocks up to this size are recycled through a per-thread cache */
+#define ASYNC_IO_BLOCK_SIZE  512
+#define ASYNC_IO_CACHE_MAX   32
+
+static struct ws2_async_io *async_io_freelist;
+
+/* release an async block from an async callback, it will be freed or recycled
+ * by the next alloc_async_io */
+static void release_async_io( struct ws2_async_io *io )
+{
+    for (;;)
+    {
+        struct ws2_async_io *next = async_io_freelist;
+        io->next = next;
+        if (InterlockedCompareExchangePointer( (void **)&async_io_freelist, io, next ) == next) return;
+    }
+}
+
+/* free an async block that was never queued, or whose async is done */
+static void free_async_io( struct ws2_async_io *io )
+{
+    struct per_thread_data *ptb = get_per_thread_data();
+
+    if (ptb && io->size == ASYNC_IO_BLOCK_SIZE && ptb->async_io_count < ASYNC_IO_CACHE_MAX)
+    {
+        io->next = ptb->async_io_cache;
+        ptb->async_io_cache = io;
+        ptb->async_io_count++;
+    }
+    else HeapFree( GetProcessHeap(), 0, io );
+}
+
+static struct ws2_async_io *alloc_async_io( DWORD size, async_callback_t callback )
+{
+    struct per_thread_data *ptb = get_per_thread_data();
+
+    /* first recycle the blocks released by previous asyncs */
+
+    struct ws2_async_io *io = InterlockedExchangePointer( (void **)&async_io_freelist, NULL );
+
+    while (io)
+    {
+        struct ws2_async_io *next = io->next;
+        free_async_io( io );
+        io = next;
+    }
+
+    if (size <= ASYNC_IO_BLOCK_SIZE)
+    {
+        if (ptb && (io = ptb->async_io_cache))
+        {
+            ptb->async_io_cache = io->next;
+            ptb->async_io_count--;
+            io->callback = callback;
+            return io;
+        }
+        size = ASYNC_IO_BLOCK_SIZE;
+    }
+
+    io = HeapAlloc( GetProcessHeap(), 0, size );
+    if (io)
+    {
+        io->callback = callback;
+        io->size = size;
+    }
+    return io;
+}
+
 /***********************************************************************
  *		DllMain (WS2_32.init)
  */
@@ -1662,7 +1900,7 @@ int WINAPI WSAStartup(WORD wVersionRequested, LPWSADATA lpWSAData)
 INT WINAPI WSACleanup(void)
 {
     if (num_startup) {
-        num_startup--;
+        if (!--num_startup) flush_sock_fd_cache();
         TRACE("pending cleanups: %d\n", num_startup);
         return 0;
     }
@@ -2394,6 +2632,119 @@ static int WS2_recv( int fd, struct ws2_async *wsa, int flags )
     return n;
 }
 
+/* overlapped receives on datagram sockets that are queued in the server, in the order they
+ * were queued; a datagram that wakes up the first one can fill the following ones too */
+static struct list pending_dgram_recvs = LIST_INIT( pending_dgram_recvs );
+
+#define DGRAM_RECV_BATCH  16
+
+static void add_pending_dgram_recv( struct ws2_async *wsa )
+{
+    wsa->dgram = TRUE;
+    wsa->dgram_result = -1;
+    EnterCriticalSection( &dgram_recv_section );
+    list_add_tail( &pending_dgram_recvs, &wsa->dgram_entry );
+    LeaveCriticalSection( &dgram_recv_section );
+}
+
+/* remove a receive that is done from the list, returns the size of the datagram
+ * another async received for it, or -1 */
+static int remove_pending_dgram_recv( struct ws2_async *wsa )
+{
+    int ret;
+
+    EnterCriticalSection( &dgram_recv_section );
+    list_remove( &wsa->dgram_entry );
+    ret = wsa->dgram_result;
+    wsa->dgram = FALSE;
+    LeaveCriticalSection( &dgram_recv_section );
+    return ret;
+}
+
+/* alert the asyncs that have been filled, so that their callback reports the result */
+static void alert_dgram_recvs( HANDLE handle, const client_ptr_t *iosbs, unsigned int count )
+{
+    SERVER_START_REQ( alert_async )
+    {
+        req->handle = wine_server_obj_handle( handle );
+        wine_server_add_data( req, iosbs, count * sizeof(*iosbs) );
+        wine_server_call( req );
+    }
+    SERVER_END_REQ;
+}
+
+#ifdef HAVE_RECVMMSG
+/* receive a datagram for an alerted async, and for the following receives on the
+ * same socket that are still waiting in the server queue if more datagrams are there */
+static int WS2_recv_dgrams( int fd, struct ws2_async *wsa )
+{
+    struct ws2_async *batch[DGRAM_RECV_BATCH], *other;
+    union generic_unix_sockaddr addr[DGRAM_RECV_BATCH];
+    struct mmsghdr msgs[DGRAM_RECV_BATCH];
+    client_ptr_t iosbs[DGRAM_RECV_BATCH];
+    unsigned int i, count = 1;
+    int n;
+
+    EnterCriticalSection( &dgram_recv_section );
+    if (wsa->dgram_result != -1)
+    {
+        LeaveCriticalSection( &dgram_recv_section );
+        return wsa->dgram_result;
+    }
+
+    batch[0] = wsa;
+    LIST_FOR_EACH_ENTRY( other, &pending_dgram_recvs, struct ws2_async, dgram_entry )
+    {
+        if (count == DGRAM_RECV_BATCH) break;
+        if (other == wsa || other->hSocket != wsa->hSocket || other->dgram_result != -1) continue;
+        batch[count++] = other;
+    }
+    if (count == 1)
+    {
+        LeaveCriticalSection( &dgram_recv_section );
+        return WS2_recv( fd, wsa, 0 );
+    }
+
+    memset( msgs, 0, count * sizeof(*msgs) );
+    for (i = 0; i < count; i++)
+    {
+        msgs[i].msg_hdr.msg_name = batch[i]->addr ? &addr[i] : NULL;
+        msgs[i].msg_hdr.msg_namelen = batch[i]->addr ? sizeof(addr[i]) : 0;
+        msgs[i].msg_hdr.msg_iov = batch[i]->iovec + batch[i]->first_iovec;
+        msgs[i].msg_hdr.msg_iovlen = batch[i]->n_iovecs - batch[i]->first_iovec;
+    }
+
+    while ((n = recvmmsg( fd, msgs, count, MSG_DONTWAIT, NULL )) == -1 && errno == EINTR);
+    if (n <= 0)
+    {
+        LeaveCriticalSection( &dgram_recv_section );
+        if (n == -1 && errno == ENOSYS) return WS2_recv( fd, wsa, 0 );
+        if (!n) errno = EAGAIN;
+        return -1;
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        if (batch[i]->addr && msgs[i].msg_hdr.msg_namelen)
+            ws_sockaddr_u2ws( &addr[i].addr, batch[i]->addr, batch[i]->addrlen.ptr );
+        if (!i) continue;
+        batch[i]->dgram_result = msgs[i].msg_len;
+        iosbs[i - 1] = wine_server_client_ptr( batch[i]->user_overlapped ?
+                                               (void *)batch[i]->user_overlapped : &batch[i]->local_iosb );
+    }
+    LeaveCriticalSection( &dgram_recv_section );
+
+    TRACE( "received %d datagrams for pending receives\n", n );
+    if (n > 1) alert_dgram_recvs( wsa->hSocket, iosbs, n - 1 );
+    return msgs[0].msg_len;
+}
+#else
+static inline int WS2_recv_dgrams( int fd, struct ws2_async *wsa )
+{
+    return WS2_recv( fd, wsa, 0 );
+}
+#endif
+
 /***********************************************************************
  *              WS2_async_recv          (INTERNAL)
  *
@@ -2402,7 +2753,7 @@ static int WS2_recv( int fd, struct ws2_async *wsa, int flags )
 static NTSTATUS WS2_async_recv( void *user, IO_STATUS_BLOCK *iosb, NTSTATUS status )
 {
     struct ws2_async *wsa = user;
-    int result = 0, fd;
+    int result = 0, filled, fd;
 
     switch (status)
     {
@@ -2410,12 +2761,13 @@ static NTSTATUS WS2_async_recv( void *user, IO_STATUS_BLOCK *iosb, NTSTATUS stat
         if ((status = wine_server_handle_to_fd( wsa->hSocket, FILE_READ_DATA, &fd, NULL ) ))
             break;
 
-        result = WS2_recv( fd, wsa, convert_flags(wsa->flags) );
+        if (wsa->dgram) result = WS2_recv_dgrams( fd, wsa );
+        else result = WS2_recv( fd, wsa, convert_flags(wsa->flags) );
         wine_server_release_fd( wsa->hSocket, fd );
         if (result >= 0)
         {
             status = STATUS_SUCCESS;
-            _enable_event( wsa->hSocket, FD_READ, 0, 0 );
+            _reenable_event( wsa->hSocket, FD_READ );
         }
         else
         {
@@ -2434,6 +2786,12 @@ static NTSTATUS WS2_async_recv( void *user, IO_STATUS_BLOCK *iosb, NTSTATUS stat
     }
     if (status != STATUS_PENDING)
     {
+        /* a datagram received for this async before it was cancelled is still reported */
+        if (wsa->dgram && (filled = remove_pending_dgram_recv( wsa )) != -1)
+        {
+            status = STATUS_SUCCESS;
+            result = filled;
+        }
         iosb->u.Status = status;
         iosb->Information = result;
         if (!wsa->completion_func)
@@ -2486,6 +2844,9 @@ static NTSTATUS WS2_async_accept( void *user, IO_STATUS_BLOCK *iosb, NTSTATUS st
         }
         SERVER_END_REQ;
 
+        /* the accepting socket now has a different unix fd */
+        if (!status) remove_sock_fd_entry( HANDLE2SOCKET(wsa->accept_socket) );
+
         if (status == STATUS_CANT_WAIT)
             return STATUS_PENDING;
 
@@ -2747,6 +3108,7 @@ SOCKET WINAPI WS_accept(SOCKET s, struct WS_sockaddr *addr, int *addrlen32)
         SERVER_END_REQ;
         if (!status)
         {
+            remove_sock_fd_entry( as );
             if (addr && addrlen32 && WS_getpeername(as, addr, addrlen32))
             {
                 WS_closesocket(as);
@@ -2853,6 +3215,7 @@ static BOOL WINAPI WS2_AcceptEx(SOCKET listener, SOCKET acceptor, PVOID dest, DW
         wsa->read->addr        = NULL;
         wsa->read->addrlen.ptr = NULL;
         wsa->read->control     = NULL;
+        wsa->read->dgram       = FALSE;
         wsa->read->n_iovecs    = 1;
         wsa->read->first_iovec = 0;
         wsa->read->completion_func = NULL;
@@ -2945,10 +3308,14 @@ static NTSTATUS WS2_transmitfile_getbuffer( int fd, struct ws2_transmitfile_asyn
     /* process the main file */
     if (wsa->file)
     {
-        DWORD bytes_per_send = wsa->bytes_per_send;
+        DWORD bytes_per_send;
         IO_STATUS_BLOCK iosb;
         NTSTATUS status;
 
+        /* the data is sent directly from the file by WS2_transmitfile_sendfile */
+        if (wsa->file_fd != -1) return STATUS_PENDING;
+
+        bytes_per_send = wsa->bytes_per_send;
         iosb.Information = 0;
         /* when the size of the transfer is limited ensure that we don't go past that limit */
         if (wsa->file_bytes != 0)
@@ -2992,6 +3359,60 @@ static NTSTATUS WS2_transmitfile_getbuffer( int fd, struct ws2_transmitfile_asyn
     return STATUS_SUCCESS;
 }
 
+/***********************************************************************
+ *     WS2_transmitfile_sendfile        (INTERNAL)
+ *
+ * Send the main file without copying it through a user space buffer.
+ */
+static NTSTATUS WS2_transmitfile_sendfile( int fd, struct ws2_transmitfile_async *wsa )
+{
+#ifdef HAVE_SYS_SENDFILE_H
+    IO_STATUS_BLOCK *iosb = (IO_STATUS_BLOCK *)wsa->write.user_overlapped;
+    size_t count = 0x7ffff000;  /* maximum transfer of a single call */
+    off_t offset;
+    ssize_t n;
+
+    if (wsa->file_bytes != 0)
+        count = min( count, wsa->file_bytes - wsa->file_read );
+
+    if (wsa->offset.QuadPart == FILE_USE_FILE_POINTER_POSITION)
+        n = sendfile( fd, wsa->file_fd, NULL, count );
+    else
+    {
+        offset = wsa->offset.QuadPart;
+        n = sendfile( fd, wsa->file_fd, &offset, count );
+    }
+
+    if (n == -1)
+    {
+        if (errno == EAGAIN || errno == EINTR) return STATUS_PENDING;
+        if (errno != EINVAL && errno != ENOSYS) return wsaErrStatus();
+
+        /* not supported for this file, use the buffered path */
+        WARN( "sendfile not supported, falling back to read/send\n" );
+        close( wsa->file_fd );
+        wsa->file_fd = -1;
+        return STATUS_PENDING;
+    }
+
+    if (wsa->offset.QuadPart != FILE_USE_FILE_POINTER_POSITION)
+        wsa->offset.QuadPart += n;
+    wsa->file_read += n;
+    if (iosb) iosb->Information += n;
+
+    if (!n || (wsa->file_bytes != 0 && wsa->file_read >= wsa->file_bytes))
+    {
+        /* continue on to the footer */
+        close( wsa->file_fd );
+        wsa->file_fd = -1;
+        wsa->file = NULL;
+    }
+    return STATUS_PENDING;
+#else
+    return STATUS_NOT_SUPPORTED;
+#endif
+}
+
 /***********************************************************************
  *     WS2_transmitfile_base            (INTERNAL)
  *
@@ -3002,7 +3423,9 @@ static NTSTATUS WS2_transmitfile_base( int fd, struct ws2_transmitfile_async *ws
     NTSTATUS status;
 
     status = WS2_transmitfile_getbuffer( fd, wsa );
-    if (status == STATUS_PENDING)
+    if (status == STATUS_PENDING && wsa->file_fd != -1 && wsa->write.first_iovec >= wsa->write.n_iovecs)
+        status = WS2_transmitfile_sendfile( fd, wsa );
+    else if (status == STATUS_PENDING)
     {
         IO_STATUS_BLOCK *iosb = (IO_STATUS_BLOCK *)wsa->write.user_overlapped;
         int n;
@@ -3041,10 +3464,25 @@ static NTSTATUS WS2_async_transmitfile( void *user, IO_STATUS_BLOCK *iosb, NTSTA
     }
 
     iosb->u.Status = status;
+    if (wsa->file_fd != -1) close( wsa->file_fd );
     release_async_io( &wsa->io );
     return status;
 }
 
+/* get a unix fd of a regular file to send it with sendfile, -1 if not possible */
+static int get_sendfile_fd( HANDLE file )
+{
+#ifdef HAVE_SYS_SENDFILE_H
+    struct stat st;
+    int fd;
+
+    if (wine_server_handle_to_fd( file, FILE_READ_DATA, &fd, NULL )) return -1;
+    if (!fstat( fd, &st ) && S_ISREG( st.st_mode )) return fd;
+    close( fd );
+#endif
+    return -1;
+}
+
 /***********************************************************************
  *     TransmitFile
  */
@@ -3101,6 +3539,7 @@ static BOOL WINAPI WS2_TransmitFile( SOCKET s, HANDLE h, DWORD file_bytes, DWORD
         memset(&wsa->buffers, 0x0, sizeof(wsa->buffers));
     wsa->buffer                = (char *)(wsa + 1);
     wsa->file                  = h;
+    wsa->file_fd               = h ? get_sendfile_fd( h ) : -1;
     wsa->file_read             = 0;
     wsa->file_bytes            = file_bytes;
     wsa->bytes_per_send        = bytes_per_send;
@@ -3126,7 +3565,11 @@ static BOOL WINAPI WS2_TransmitFile( SOCKET s, HANDLE h, DWORD file_bytes, DWORD
         iosb->Information = 0;
         status = register_async( ASYNC_TYPE_WRITE, SOCKET2HANDLE(s), &wsa->io,
                                  overlapped->hEvent, NULL, NULL, iosb );
-        if(status != STATUS_PENDING) HeapFree( GetProcessHeap(), 0, wsa );
+        if (status != STATUS_PENDING)
+        {
+            if (wsa->file_fd != -1) close( wsa->file_fd );
+            HeapFree( GetProcessHeap(), 0, wsa );
+        }
         release_sock_fd( s, fd );
         WSASetLastError( NtStatusToWSAError(status) );
         return FALSE;
@@ -3147,6 +3590,7 @@ static BOOL WINAPI WS2_TransmitFile( SOCKET s, HANDLE h, DWORD file_bytes, DWORD
 
     if (status != STATUS_SUCCESS)
         WSASetLastError( NtStatusToWSAError(status) );
+    if (wsa->file_fd != -1) close( wsa->file_fd );
     HeapFree( GetProcessHeap(), 0, wsa );
     return (status == STATUS_SUCCESS);
 }
@@ -3382,6 +3826,7 @@ int WINAPI WS_closesocket(SOCKET s)
         if (fd >= 0)
         {
             release_sock_fd(s, fd);
+            remove_sock_fd_entry(s);
             if (CloseHandle(SOCKET2HANDLE(s)))
                 res = 0;
         }
@@ -5157,7 +5602,93 @@ int WINAPI WS_recvfrom(SOCKET s, char *buf, INT len, int flags,
         return n;
 }
 
-/* allocate a poll array for the corresponding fd sets */
+/* get the per-thread poll array, resizing it if needed */
+static struct pollfd *get_poll_array( struct per_thread_data *ptb, unsigned int count )
+{
+    struct pollfd *fds;
+    BOOL *needs_close;
+
+    if (ptb->fd_count >= count) return ptb->fd_cache;
+
+    fds = HeapAlloc( GetProcessHeap(), 0, count * sizeof(fds[0]) );
+    needs_close = HeapAlloc( GetProcessHeap(), 0, count * sizeof(needs_close[0]) );
+    if (!fds || !needs_close)
+    {
+        HeapFree( GetProcessHeap(), 0, fds );
+        HeapFree( GetProcessHeap(), 0, needs_close );
+        SetLastError( ERROR_NOT_ENOUGH_MEMORY );
+        return NULL;
+    }
+    HeapFree( GetProcessHeap(), 0, ptb->fd_cache );
+    HeapFree( GetProcessHeap(), 0, ptb->fd_needs_close );
+    ptb->fd_cache = fds;
+    ptb->fd_needs_close = needs_close;
+    ptb->fd_count = count;
+    return fds;
+}
+
+/* fill a poll entry from the fd cached by ntdll for a socket, must be called with sock_fd_section held */
+static BOOL sock_to_poll( struct per_thread_data *ptb, unsigned int idx, SOCKET s, BOOL check_bound,
+                          short events )
+{
+    struct pollfd *pfd = &ptb->fd_cache[idx];
+    struct sock_fd_entry *entry;
+    int fd, needs_close;
+
+    if (!(entry = get_sock_fd_entry( s, &fd, &needs_close ))) return FALSE;
+
+    if (check_bound && !entry->bound) entry->bound = (is_fd_bound( fd, NULL, NULL ) == 1);
+    if (check_bound && !entry->bound && events == POLLOUT)
+    {
+        /* unbound datagram sockets are always writable */
+        if (!entry->type) entry->type = _get_fd_type( fd );
+        check_bound = (entry->type != SOCK_DGRAM);
+    }
+
+    pfd->revents = 0;
+    ptb->fd_needs_close[idx] = needs_close;
+    if (check_bound && !entry->bound)
+        release_cached_sock_fd( s, fd, needs_close );
+
+    if (check_bound && !entry->bound)
+    {
+        pfd->fd = -1;
+        pfd->events = 0;
+    }
+    else
+    {
+        pfd->fd = fd;
+        pfd->events = events;
+    }
+    return TRUE;
+}
+
+/* release the fds of a poll array that were not cached by ntdll */
+static void release_poll_fds( struct per_thread_data *ptb, const struct pollfd *fds, int count )
+{
+    int i;
+
+    for (i = 0; i < count; i++)
+        if (fds[i].fd != -1 && ptb->fd_needs_close[i]) close( fds[i].fd );
+}
+
+/* replace the fds cached by ntdll by duplicates for a plain poll() call, so that
+ * a socket closed by another thread can't make it wait on an unrelated file */
+static BOOL dup_poll_fds( struct per_thread_data *ptb, struct pollfd *fds, int count )
+{
+    int i, fd;
+
+    for (i = 0; i < count; i++)
+    {
+        if (fds[i].fd == -1 || ptb->fd_needs_close[i]) continue;
+        if ((fd = dup( fds[i].fd )) == -1) return FALSE;
+        fds[i].fd = fd;
+        ptb->fd_needs_close[i] = TRUE;
+    }
+    return TRUE;
+}
+
+/* fill the poll array for the corresponding fd sets, must be called with sock_fd_section held */
 static struct pollfd *fd_sets_to_poll( const WS_fd_set *readfds, const WS_fd_set *writefds,
                                        const WS_fd_set *exceptfds, int *count_ptr )
 {
@@ -5175,121 +5706,50 @@ static struct pollfd *fd_sets_to_poll( const WS_fd_set *readfds, const WS_fd_set
         return NULL;
     }
 
-    /* check if the cache can hold all descriptors, if not do the resizing */
-    if (ptb->fd_count < count)
-    {
-        if (!(fds = HeapAlloc(GetProcessHeap(), 0, count * sizeof(fds[0]))))
-        {
-            SetLastError( ERROR_NOT_ENOUGH_MEMORY );
-            return NULL;
-        }
-        HeapFree(GetProcessHeap(), 0, ptb->fd_cache);
-        ptb->fd_cache = fds;
-        ptb->fd_count = count;
-    }
-    else
-        fds = ptb->fd_cache;
+    if (!(fds = get_poll_array( ptb, count ))) return NULL;
 
     if (readfds)
         for (i = 0; i < readfds->fd_count; i++, j++)
-        {
-            fds[j].fd = get_sock_fd( readfds->fd_array[i], FILE_READ_DATA, NULL );
-            if (fds[j].fd == -1) goto failed;
-            fds[j].revents = 0;
-            if (is_fd_bound(fds[j].fd, NULL, NULL) == 1)
-            {
-                fds[j].events = POLLIN;
-            }
-            else
-            {
-                release_sock_fd( readfds->fd_array[i], fds[j].fd );
-                fds[j].fd = -1;
-                fds[j].events = 0;
-            }
-        }
+            if (!sock_to_poll( ptb, j, readfds->fd_array[i], TRUE, POLLIN )) goto failed;
     if (writefds)
         for (i = 0; i < writefds->fd_count; i++, j++)
-        {
-            fds[j].fd = get_sock_fd( writefds->fd_array[i], FILE_WRITE_DATA, NULL );
-            if (fds[j].fd == -1) goto failed;
-            fds[j].revents = 0;
-            if (is_fd_bound(fds[j].fd, NULL, NULL) == 1 ||
-                _get_fd_type(fds[j].fd) == SOCK_DGRAM)
-            {
-                fds[j].events = POLLOUT;
-            }
-            else
-            {
-                release_sock_fd( writefds->fd_array[i], fds[j].fd );
-                fds[j].fd = -1;
-                fds[j].events = 0;
-            }
-        }
+            if (!sock_to_poll( ptb, j, writefds->fd_array[i], TRUE, POLLOUT )) goto failed;
     if (exceptfds)
         for (i = 0; i < exceptfds->fd_count; i++, j++)
         {
-            fds[j].fd = get_sock_fd( exceptfds->fd_array[i], 0, NULL );
-            if (fds[j].fd == -1) goto failed;
-            fds[j].revents = 0;
-            if (is_fd_bound(fds[j].fd, NULL, NULL) == 1)
+            if (!sock_to_poll( ptb, j, exceptfds->fd_array[i], TRUE, POLLHUP )) goto failed;
+            if (fds[j].fd != -1)
             {
                 int oob_inlined = 0;
                 socklen_t olen = sizeof(oob_inlined);
 
-                fds[j].events = POLLHUP;
-
                 /* Check if we need to test for urgent data or not */
                 getsockopt(fds[j].fd, SOL_SOCKET, SO_OOBINLINE, (char*) &oob_inlined, &olen);
                 if (!oob_inlined)
                     fds[j].events |= POLLPRI;
             }
-            else
-            {
-                release_sock_fd( exceptfds->fd_array[i], fds[j].fd );
-                fds[j].fd = -1;
-                fds[j].events = 0;
-            }
         }
     return fds;
 
 failed:
-    count = j;
-    j = 0;
-    if (readfds)
-        for (i = 0; i < readfds->fd_count && j < count; i++, j++)
-            if (fds[j].fd != -1) release_sock_fd( readfds->fd_array[i], fds[j].fd );
-    if (writefds)
-        for (i = 0; i < writefds->fd_count && j < count; i++, j++)
-            if (fds[j].fd != -1) release_sock_fd( writefds->fd_array[i], fds[j].fd );
-    if (exceptfds)
-        for (i = 0; i < exceptfds->fd_count && j < count; i++, j++)
-            if (fds[j].fd != -1) release_sock_fd( exceptfds->fd_array[i], fds[j].fd );
+    release_poll_fds( ptb, fds, j );
     return NULL;
 }
 
-/* release the file descriptor obtained in fd_sets_to_poll */
+/* check that the sockets which reported a hangup still exist */
 /* must be called with the original fd_set arrays, before calling get_poll_results */
-static void release_poll_fds( const WS_fd_set *readfds, const WS_fd_set *writefds,
-                              const WS_fd_set *exceptfds, struct pollfd *fds )
+static void check_poll_hangups( const WS_fd_set *readfds, const WS_fd_set *writefds,
+                                const WS_fd_set *exceptfds, struct pollfd *fds )
 {
     unsigned int i, j = 0;
 
-    if (readfds)
-    {
-        for (i = 0; i < readfds->fd_count; i++, j++)
-            if (fds[j].fd != -1) release_sock_fd( readfds->fd_array[i], fds[j].fd );
-    }
-    if (writefds)
-    {
-        for (i = 0; i < writefds->fd_count; i++, j++)
-            if (fds[j].fd != -1) release_sock_fd( writefds->fd_array[i], fds[j].fd );
-    }
+    if (readfds) j += readfds->fd_count;
+    if (writefds) j += writefds->fd_count;
     if (exceptfds)
     {
         for (i = 0; i < exceptfds->fd_count; i++, j++)
         {
             if (fds[j].fd == -1) continue;
-            release_sock_fd( exceptfds->fd_array[i], fds[j].fd );
             if (fds[j].revents & POLLHUP)
             {
                 int fd = get_sock_fd( exceptfds->fd_array[i], 0, NULL );
@@ -5302,14 +5762,220 @@ static void release_poll_fds( const WS_fd_set *readfds, const WS_fd_set *writefd
     }
 }
 
-static int do_poll(struct pollfd *pollfds, int count, int timeout)
+#ifdef HAVE_SYS_EPOLL_H
+
+static BOOL grow_epoll_slots( struct per_thread_data *ptb, int fd )
+{
+    unsigned int size = max( 64, max( fd + 1, ptb->epoll_slot_count * 2 ));
+    struct epoll_slot *slots;
+
+    if (ptb->epoll_slots)
+        slots = HeapReAlloc( GetProcessHeap(), HEAP_ZERO_MEMORY, ptb->epoll_slots, size * sizeof(*slots) );
+    else
+        slots = HeapAlloc( GetProcessHeap(), HEAP_ZERO_MEMORY, size * sizeof(*slots) );
+    if (!slots) return FALSE;
+    ptb->epoll_slots = slots;
+    ptb->epoll_slot_count = size;
+    return TRUE;
+}
+
+static void reset_epoll_set( struct per_thread_data *ptb )
+{
+    unsigned int i;
+
+    for (i = 0; i < ptb->epoll_fd_count; i++) close( ptb->epoll_slots[ptb->epoll_fds[i]].unix_fd );
+    close( ptb->epoll_fd );
+    HeapFree( GetProcessHeap(), 0, ptb->epoll_slots );
+    ptb->epoll_slots = NULL;
+    ptb->epoll_slot_count = 0;
+    ptb->epoll_fd_count = 0;
+}
+
+static BOOL add_epoll_fd( struct per_thread_data *ptb, int fd )
+{
+    if (ptb->epoll_fd_count == ptb->epoll_fd_size)
+    {
+        unsigned int size = max( 64, ptb->epoll_fd_size * 2 );
+        struct epoll_event *events;
+        int *fds;
+
+        if (ptb->epoll_fds)
+            fds = HeapReAlloc( GetProcessHeap(), 0, ptb->epoll_fds, size * sizeof(*fds) );
+        else
+            fds = HeapAlloc( GetProcessHeap(), 0, size * sizeof(*fds) );
+        if (!fds) return FALSE;
+        ptb->epoll_fds = fds;
+
+        if (ptb->epoll_events)
+            events = HeapReAlloc( GetProcessHeap(), 0, ptb->epoll_events, size * sizeof(*events) );
+        else
+            events = HeapAlloc( GetProcessHeap(), 0, size * sizeof(*events) );
+        if (!events) return FALSE;
+        ptb->epoll_events = events;
+        ptb->epoll_fd_size = size;
+    }
+    ptb->epoll_fds[ptb->epoll_fd_count++] = fd;
+    return TRUE;
+}
+
+/* bring the per-thread epoll set in sync with a poll array, so that only
+ * the changes since the previous call require a system call */
+/* generation is the ntdll fd cache generation from before the fds were retrieved */
+static BOOL update_epoll_set( struct per_thread_data *ptb, const struct pollfd *fds, int count,
+                              unsigned int generation )
+{
+    struct epoll_slot *slot;
+    struct epoll_event ev;
+    unsigned int i, call;
+    int fd;
+
+    /* only the fds cached by ntdll live as long as their registration */
+    for (i = 0; i < count; i++)
+        if (fds[i].fd != -1 && ptb->fd_needs_close[i]) return FALSE;
+
+    /* the files registered with the numbers of closed fds are gone from the set,
+     * but their numbers may have been reused since, so start again from scratch */
+    if (ptb->epoll_slots && ptb->epoll_generation != generation) reset_epoll_set( ptb );
+
+    memset( &ev, 0, sizeof(ev) );
+    if (!ptb->epoll_slots)
+    {
+        if ((ptb->epoll_fd = epoll_create( 64 )) == -1) return FALSE;
+        fcntl( ptb->epoll_fd, F_SETFD, FD_CLOEXEC );
+        if (!grow_epoll_slots( ptb, 0 ))
+        {
+            close( ptb->epoll_fd );
+            return FALSE;
+        }
+    }
+    call = ++ptb->epoll_call;
+
+    /* merge the events of all entries using the same fd */
+    for (i = 0; i < count; i++)
+    {
+        if ((fd = fds[i].fd) == -1) continue;
+        if (fd >= ptb->epoll_slot_count && !grow_epoll_slots( ptb, fd )) return FALSE;
+        slot = &ptb->epoll_slots[fd];
+        if (slot->call != call)
+        {
+            slot->call = call;
+            slot->wanted = 0;
+        }
+        slot->wanted |= fds[i].events;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        if ((fd = fds[i].fd) == -1) continue;
+        slot = &ptb->epoll_slots[fd];
+        if (slot->registered && slot->events == slot->wanted) continue;
+
+        /* poll and epoll event bits are identical on Linux */
+        ev.events = slot->wanted;
+        ev.data.fd = fd;
+        if (slot->registered)
+        {
+            if (epoll_ctl( ptb->epoll_fd, EPOLL_CTL_MOD, slot->unix_fd, &ev ) == -1) goto failed;
+        }
+        else
+        {
+            /* register a duplicate, so that the registration doesn't depend on the lifetime
+             * of the fd cached by ntdll, which another thread may close at any time */
+            if ((slot->unix_fd = dup( fd )) == -1) goto failed;
+            fcntl( slot->unix_fd, F_SETFD, FD_CLOEXEC );
+            if (!add_epoll_fd( ptb, fd ))
+            {
+                close( slot->unix_fd );
+                goto failed;
+            }
+            slot->registered = TRUE;
+            if (epoll_ctl( ptb->epoll_fd, EPOLL_CTL_ADD, slot->unix_fd, &ev ) == -1) goto failed;
+        }
+        slot->events = slot->wanted;
+    }
+
+    /* remove the fds that are not part of this call */
+    for (i = 0; i < ptb->epoll_fd_count; i++)
+    {
+        fd = ptb->epoll_fds[i];
+        slot = &ptb->epoll_slots[fd];
+        if (slot->call == call) continue;
+        epoll_ctl( ptb->epoll_fd, EPOLL_CTL_DEL, slot->unix_fd, &ev );
+        close( slot->unix_fd );
+        slot->registered = FALSE;
+        ptb->epoll_fds[i--] = ptb->epoll_fds[--ptb->epoll_fd_count];
+    }
+    ptb->epoll_generation = generation;
+
+    /* a cached fd closed in the meantime may have had its number reused for an
+     * unrelated file before it was duplicated */
+    if (wine_server_fd_cache_generation() != generation)
+    {
+        reset_epoll_set( ptb );
+        return FALSE;
+    }
+    return TRUE;
+
+failed:
+    WARN( "epoll_ctl failed for fd %d: %s\n", fd, strerror(errno) );
+    reset_epoll_set( ptb );
+    return FALSE;
+}
+
+/* wait on the per-thread epoll set and map the results back into the poll array */
+static int wait_epoll_set( struct per_thread_data *ptb, struct pollfd *fds, int count, int timeout )
+{
+    unsigned int call = ptb->epoll_call;
+    struct epoll_slot *slot;
+    int i, ret;
+
+    if (!ptb->epoll_fd_count) return poll( fds, count, timeout );
+    if ((ret = epoll_wait( ptb->epoll_fd, ptb->epoll_events, ptb->epoll_fd_count, timeout )) <= 0)
+        return ret;
+
+    for (i = 0; i < ret; i++)
+    {
+        slot = &ptb->epoll_slots[ptb->epoll_events[i].data.fd];
+        slot->ready = call;
+        slot->revents = ptb->epoll_events[i].events;
+    }
+
+    for (i = ret = 0; i < count; i++)
+    {
+        if (fds[i].fd == -1) continue;
+        slot = &ptb->epoll_slots[fds[i].fd];
+        if (slot->ready != call) continue;
+        fds[i].revents = slot->revents & (fds[i].events | POLLERR | POLLHUP);
+        if (fds[i].revents) ret++;
+    }
+    return ret;
+}
+
+#else  /* HAVE_SYS_EPOLL_H */
+
+static inline BOOL update_epoll_set( struct per_thread_data *ptb, const struct pollfd *fds, int count,
+                                     unsigned int generation )
+{
+    return FALSE;
+}
+
+static inline int wait_epoll_set( struct per_thread_data *ptb, struct pollfd *fds, int count, int timeout )
+{
+    return -1;
+}
+
+#endif  /* HAVE_SYS_EPOLL_H */
+
+/* wait on the poll array, using the per-thread epoll set if ptb is not NULL */
+static int do_poll(struct pollfd *pollfds, int count, int timeout, struct per_thread_data *ptb)
 {
     struct timeval tv1, tv2;
     int ret, torig = timeout;
 
     if (timeout > 0) gettimeofday( &tv1, 0 );
 
-    while ((ret = poll( pollfds, count, timeout )) < 0)
+    while ((ret = ptb ? wait_epoll_set( ptb, pollfds, count, timeout )
+                      : poll( pollfds, count, timeout )) < 0)
     {
         if (errno != EINTR) break;
         if (timeout < 0) continue;
@@ -5379,23 +6045,37 @@ int WINAPI WS_select(int nfds, WS_fd_set *ws_readfds,
                      WS_fd_set *ws_writefds, WS_fd_set *ws_exceptfds,
                      const struct WS_timeval* ws_timeout)
 {
+    struct per_thread_data *ptb = get_per_thread_data();
+    unsigned int generation = wine_server_fd_cache_generation();
     struct pollfd *pollfds;
     int count, ret, timeout = -1;
+    BOOL use_epoll = FALSE;
 
     TRACE("read %p, write %p, excp %p timeout %p\n",
           ws_readfds, ws_writefds, ws_exceptfds, ws_timeout);
 
-    if (!(pollfds = fd_sets_to_poll( ws_readfds, ws_writefds, ws_exceptfds, &count )))
+    EnterCriticalSection( &sock_fd_section );
+    pollfds = fd_sets_to_poll( ws_readfds, ws_writefds, ws_exceptfds, &count );
+    LeaveCriticalSection( &sock_fd_section );
+    if (!pollfds) return SOCKET_ERROR;
+
+    if (update_epoll_set( ptb, pollfds, count, generation )) use_epoll = TRUE;
+    else if (!dup_poll_fds( ptb, pollfds, count ))
+    {
+        SetLastError( wsaErrno() );
+        release_poll_fds( ptb, pollfds, count );
         return SOCKET_ERROR;
+    }
 
     if (ws_timeout)
         timeout = (ws_timeout->tv_sec * 1000) + (ws_timeout->tv_usec + 999) / 1000;
 
-    ret = do_poll(pollfds, count, timeout);
-    release_poll_fds( ws_readfds, ws_writefds, ws_exceptfds, pollfds );
-
+    ret = do_poll(pollfds, count, timeout, use_epoll ? ptb : NULL);
     if (ret == -1) SetLastError(wsaErrno());
-    else ret = get_poll_results( ws_readfds, ws_writefds, ws_exceptfds, pollfds );
+    release_poll_fds( ptb, pollfds, count );
+    check_poll_hangups( ws_readfds, ws_writefds, ws_exceptfds, pollfds );
+
+    if (ret != -1) ret = get_poll_results( ws_readfds, ws_writefds, ws_exceptfds, pollfds );
     return ret;
 }
 
@@ -5404,8 +6084,11 @@ int WINAPI WS_select(int nfds, WS_fd_set *ws_readfds,
  */
 int WINAPI WSAPoll(WSAPOLLFD *wfds, ULONG count, int timeout)
 {
+    struct per_thread_data *ptb = get_per_thread_data();
+    unsigned int generation = wine_server_fd_cache_generation();
     int i, ret;
     struct pollfd *ufds;
+    BOOL use_epoll = FALSE;
 
     if (!count)
     {
@@ -5418,26 +6101,39 @@ int WINAPI WSAPoll(WSAPOLLFD *wfds, ULONG count, int timeout)
         return SOCKET_ERROR;
     }
 
-    if (!(ufds = HeapAlloc(GetProcessHeap(), 0, count * sizeof(ufds[0]))))
+    if (!(ufds = get_poll_array( ptb, count )))
     {
         SetLastError(WSAENOBUFS);
         return SOCKET_ERROR;
     }
 
+    EnterCriticalSection( &sock_fd_section );
     for (i = 0; i < count; i++)
     {
-        ufds[i].fd = get_sock_fd(wfds[i].fd, 0, NULL);
-        ufds[i].events = convert_poll_w2u(wfds[i].events);
-        ufds[i].revents = 0;
+        if (!sock_to_poll( ptb, i, wfds[i].fd, FALSE, convert_poll_w2u(wfds[i].events) ))
+        {
+            ufds[i].fd = -1;
+            ufds[i].revents = 0;
+        }
     }
+    LeaveCriticalSection( &sock_fd_section );
 
-    ret = do_poll(ufds, count, timeout);
+    if (update_epoll_set( ptb, ufds, count, generation )) use_epoll = TRUE;
+    else if (!dup_poll_fds( ptb, ufds, count ))
+    {
+        SetLastError( wsaErrno() );
+        release_poll_fds( ptb, ufds, count );
+        return SOCKET_ERROR;
+    }
+
+    ret = do_poll(ufds, count, timeout, use_epoll ? ptb : NULL);
+    if (ret == -1) SetLastError(wsaErrno());
+    release_poll_fds( ptb, ufds, count );
 
     for (i = 0; i < count; i++)
     {
         if (ufds[i].fd != -1)
         {
-            release_sock_fd(wfds[i].fd, ufds[i].fd);
             if (ufds[i].revents & POLLHUP)
             {
                 /* Check if the socket still exists */
@@ -5457,7 +6153,6 @@ int WINAPI WSAPoll(WSAPOLLFD *wfds, ULONG count, int timeout)
             wfds[i].revents = WS_POLLNVAL;
     }
 
-    HeapFree(GetProcessHeap(), 0, ufds);
     return ret;
 }
 
@@ -5605,7 +6300,7 @@ static int WS2_sendto( SOCKET s, LPWSABUF lpBuffers, DWORD dwBufferCount,
                the async is done. */
             _enable_event(SOCKET2HANDLE(s), FD_WRITE, 0, 0);
 
-            if (err != STATUS_PENDING) HeapFree( GetProcessHeap(), 0, wsa );
+            if (err != STATUS_PENDING) free_async_io( &wsa->io );
             SetLastError(NtStatusToWSAError( err ));
             return SOCKET_ERROR;
         }
@@ -5617,7 +6312,7 @@ static int WS2_sendto( SOCKET s, LPWSABUF lpBuffers, DWORD dwBufferCount,
         {
             if (cvalue) WS_AddCompletion( s, cvalue, STATUS_SUCCESS, n );
             if (lpOverlapped->hEvent) SetEvent( lpOverlapped->hEvent );
-            HeapFree( GetProcessHeap(), 0, wsa );
+            free_async_io( &wsa->io );
         }
         else NtQueueApcThread( GetCurrentThread(), (PNTAPCFUNC)ws2_async_apc,
                                (ULONG_PTR)wsa, (ULONG_PTR)iosb, 0 );
@@ -5687,13 +6382,13 @@ static int WS2_sendto( SOCKET s, LPWSABUF lpBuffers, DWORD dwBufferCount,
     TRACE(" -> %i bytes\n", bytes_sent);
 
     if (lpNumberOfBytesSent) *lpNumberOfBytesSent = bytes_sent;
-    if (wsa != &localwsa) HeapFree( GetProcessHeap(), 0, wsa );
+    if (wsa != &localwsa) free_async_io( &wsa->io );
     release_sock_fd( s, fd );
     SetLastError(ERROR_SUCCESS);
     return 0;
 
 error:
-    if (wsa != &localwsa) HeapFree( GetProcessHeap(), 0, wsa );
+    if (wsa != &localwsa) free_async_io( &wsa->io );
     release_sock_fd( s, fd );
     WARN(" -> ERROR %d\n", err);
     SetLastError(err);
@@ -7232,6 +7927,8 @@ int WINAPI WSAEventSelect(SOCKET s, WSAEVENT hEvent, LONG lEvent)
 
     TRACE("%04lx, hEvent %p, event %08x\n", s, hEvent, lEvent);
 
+    if (lEvent) network_events_selected = TRUE;
+
     SERVER_START_REQ( set_socket_event )
     {
         req->handle = wine_server_obj_handle( SOCKET2HANDLE(s) );
@@ -7301,6 +7998,8 @@ INT WINAPI WSAAsyncSelect(SOCKET s, HWND hWnd, UINT uMsg, LONG lEvent)
 
     TRACE("%04lx, hWnd %p, uMsg %08x, event %08x\n", s, hWnd, uMsg, lEvent);
 
+    if (lEvent) network_events_selected = TRUE;
+
     SERVER_START_REQ( set_socket_event )
     {
         req->handle = wine_server_obj_handle( SOCKET2HANDLE(s) );
@@ -7496,6 +8195,8 @@ SOCKET WINAPI WSASocketW(int af, int type, int protocol,
     if (ret)
     {
         TRACE("\tcreated %04lx\n", ret );
+        /* the handle value may have been used by a socket closed with CloseHandle */
+        remove_sock_fd_entry( ret );
         if (ipxptype > 0)
             set_ipx_packettype(ret, ipxptype);
 
@@ -7880,6 +8581,7 @@ static int WS2_recv_base( SOCKET s, LPWSABUF lpBuffers, DWORD dwBufferCount,
     wsa->addr        = lpFrom;
     wsa->addrlen.ptr = lpFromlen;
     wsa->control     = lpControlBuffer;
+    wsa->dgram       = FALSE;
     wsa->n_iovecs    = dwBufferCount;
     wsa->first_iovec = 0;
     for (i = 0; i < dwBufferCount; i++)
@@ -7919,6 +8621,10 @@ static int WS2_recv_base( SOCKET s, LPWSABUF lpBuffers, DWORD dwBufferCount,
 
             wsa->user_overlapped = lpOverlapped;
             wsa->completion_func = lpCompletionRoutine;
+
+            /* plain datagram receives can be filled together once they are queued */
+            if (n == -1 && !flags && !wsa->control && _get_fd_type( fd ) == SOCK_DGRAM)
+                add_pending_dgram_recv( wsa );
             release_sock_fd( s, fd );
 
             if (n == -1)
@@ -7933,7 +8639,11 @@ static int WS2_recv_base( SOCKET s, LPWSABUF lpBuffers, DWORD dwBufferCount,
                     err = register_async( ASYNC_TYPE_READ, wsa->hSocket, &wsa->io, lpOverlapped->hEvent,
                                           NULL, (void *)cvalue, iosb );
 
-                if (err != STATUS_PENDING) HeapFree( GetProcessHeap(), 0, wsa );
+                if (err != STATUS_PENDING)
+                {
+                    if (wsa->dgram) remove_pending_dgram_recv( wsa );
+                    free_async_io( &wsa->io );
+                }
                 SetLastError(NtStatusToWSAError( err ));
                 return SOCKET_ERROR;
             }
@@ -7944,11 +8654,11 @@ static int WS2_recv_base( SOCKET s, LPWSABUF lpBuffers, DWORD dwBufferCount,
             {
                 if (cvalue) WS_AddCompletion( s, cvalue, STATUS_SUCCESS, n );
                 if (lpOverlapped->hEvent) SetEvent( lpOverlapped->hEvent );
-                HeapFree( GetProcessHeap(), 0, wsa );
+                free_async_io( &wsa->io );
             }
             else NtQueueApcThread( GetCurrentThread(), (PNTAPCFUNC)ws2_async_apc,
                                    (ULONG_PTR)wsa, (ULONG_PTR)iosb, 0 );
-            _enable_event(SOCKET2HANDLE(s), FD_READ, 0, 0);
+            _reenable_event( SOCKET2HANDLE(s), FD_READ );
             return 0;
         }
 
@@ -7994,15 +8704,15 @@ static int WS2_recv_base( SOCKET s, LPWSABUF lpBuffers, DWORD dwBufferCount,
     }
 
     TRACE(" -> %i bytes\n", n);
-    if (wsa != &localwsa) HeapFree( GetProcessHeap(), 0, wsa );
+    if (wsa != &localwsa) free_async_io( &wsa->io );
     release_sock_fd( s, fd );
-    _enable_event(SOCKET2HANDLE(s), FD_READ, 0, 0);
+    _reenable_event( SOCKET2HANDLE(s), FD_READ );
     SetLastError(ERROR_SUCCESS);
 
     return 0;
 
 error:
-    if (wsa != &localwsa) HeapFree( GetProcessHeap(), 0, wsa );
+    if (wsa != &localwsa) free_async_io( &wsa->io );
     release_sock_fd( s, fd );
     WARN(" -> ERROR %d\n", err);
     SetLastError( err );
@@ -2278,6 +2278,162 @@ static void test_UDP(void)
     }
 }
 
+static void test_UDP_burst(void)
+{
+    struct sockaddr_in addr, from;
+    SOCKET src, dst;
+    char buf[64], expect[64];
+    u_long value = 1;
+    struct timeval timeout = {0, 0};
+    WSAOVERLAPPED ov[4];
+    struct sockaddr_in ov_from[4];
+    char ov_buf[4][64];
+    int ov_len[4];
+    WSABUF wsabuf;
+    DWORD bytes, flags;
+    fd_set readfds;
+    char *big;
+    int i, ret, len;
+
+    src = socket(AF_INET, SOCK_DGRAM, 0);
+    dst = socket(AF_INET, SOCK_DGRAM, 0);
+    ok(src != INVALID_SOCKET && dst != INVALID_SOCKET, "socket failed\n");
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    ret = bind(dst, (struct sockaddr *)&addr, sizeof(addr));
+    ok(!ret, "bind failed: %d\n", WSAGetLastError());
+    ret = bind(src, (struct sockaddr *)&addr, sizeof(addr));
+    ok(!ret, "bind failed: %d\n", WSAGetLastError());
+    len = sizeof(addr);
+    ret = getsockname(dst, (struct sockaddr *)&addr, &len);
+    ok(!ret, "getsockname failed: %d\n", WSAGetLastError());
+    ret = ioctlsocket(dst, FIONBIO, &value);
+    ok(!ret, "ioctlsocket failed: %d\n", WSAGetLastError());
+
+    /* datagrams are returned one by one, in order, with their source */
+    for (i = 0; i < 40; i++)
+    {
+        memset(buf, 'a' + i % 26, sizeof(buf));
+        ret = sendto(src, buf, 8 + i, 0, (struct sockaddr *)&addr, sizeof(addr));
+        ok(ret == 8 + i, "sendto %d returned %d\n", i, ret);
+    }
+    Sleep(100);
+
+    for (i = 0; i < 40; i++)
+    {
+        if (i == 5)
+        {
+            value = 0;
+            ret = ioctlsocket(dst, FIONREAD, &value);
+            ok(!ret, "ioctlsocket failed: %d\n", WSAGetLastError());
+            ok(value >= 8 + i, "got FIONREAD %u\n", value);
+
+            FD_ZERO(&readfds);
+            FD_SET(dst, &readfds);
+            ret = select(0, &readfds, NULL, NULL, &timeout);
+            ok(ret == 1, "select returned %d\n", ret);
+        }
+        len = sizeof(from);
+        memset(buf, 0, sizeof(buf));
+        ret = recvfrom(dst, buf, sizeof(buf), 0, (struct sockaddr *)&from, &len);
+        ok(ret == 8 + i, "recvfrom %d returned %d\n", i, ret);
+        memset(expect, 'a' + i % 26, sizeof(expect));
+        ok(!memcmp(buf, expect, 8 + i), "got wrong data for datagram %d\n", i);
+        ok(len == sizeof(from), "got len %d\n", len);
+    }
+
+    ret = recvfrom(dst, buf, sizeof(buf), 0, (struct sockaddr *)&from, &len);
+    ok(ret == SOCKET_ERROR && WSAGetLastError() == WSAEWOULDBLOCK,
+       "recvfrom returned %d, error %d\n", ret, WSAGetLastError());
+
+    /* datagrams larger than the buffers used so far are not truncated, whatever
+     * the receive function */
+    big = HeapAlloc(GetProcessHeap(), 0, 8192);
+    for (i = 0; i < 6; i++)
+    {
+        memset(big, 'a' + i, 8192);
+        ret = sendto(src, big, i < 3 ? 8 : 4000 + i, 0, (struct sockaddr *)&addr, sizeof(addr));
+        ok(ret == (i < 3 ? 8 : 4000 + i), "sendto %d returned %d\n", i, ret);
+    }
+    Sleep(100);
+    for (i = 0; i < 3; i++)
+    {
+        len = sizeof(from);
+        ret = recvfrom(dst, buf, sizeof(buf), 0, (struct sockaddr *)&from, &len);
+        ok(ret == 8, "recvfrom %d returned %d\n", i, ret);
+    }
+    if (pWSAPoll)
+    {
+        WSAPOLLFD fds[1];
+
+        fds[0].fd = dst;
+        fds[0].events = POLLRDNORM | POLLWRNORM;
+        fds[0].revents = 0;
+        ret = pWSAPoll(fds, 1, 0);
+        ok(ret == 1, "WSAPoll returned %d\n", ret);
+        ok(fds[0].revents == (POLLRDNORM | POLLWRNORM), "got revents %x\n", fds[0].revents);
+    }
+    memset(big, 0, 8192);
+    ret = recv(dst, big, 8192, MSG_PEEK);
+    ok(ret == 4003, "recv with MSG_PEEK returned %d\n", ret);
+    ok(big[0] == 'd' && big[4002] == 'd', "got wrong data\n");
+    memset(big, 0, 8192);
+    ret = recv(dst, big, 8192, 0);
+    ok(ret == 4003, "recv returned %d\n", ret);
+    ok(big[0] == 'd' && big[4002] == 'd', "got wrong data\n");
+    wsabuf.buf = big;
+    wsabuf.len = 8192;
+    flags = 0;
+    ret = WSARecv(dst, &wsabuf, 1, &bytes, &flags, NULL, NULL);
+    ok(!ret && bytes == 4004, "WSARecv returned %d, %u bytes\n", ret, bytes);
+    ok(big[0] == 'e' && big[4003] == 'e', "got wrong data\n");
+    len = sizeof(from);
+    ret = recvfrom(dst, big, 8192, 0, (struct sockaddr *)&from, &len);
+    ok(ret == 4005, "recvfrom returned %d\n", ret);
+    ok(big[0] == 'f' && big[4004] == 'f', "got wrong data\n");
+    HeapFree(GetProcessHeap(), 0, big);
+
+    /* pending overlapped receives are completed in order, each with its own datagram */
+    for (i = 0; i < 4; i++)
+    {
+        memset(&ov[i], 0, sizeof(ov[i]));
+        ov[i].hEvent = WSACreateEvent();
+        memset(ov_buf[i], 0, sizeof(ov_buf[i]));
+        wsabuf.buf = ov_buf[i];
+        wsabuf.len = sizeof(ov_buf[i]);
+        flags = 0;
+        ov_len[i] = sizeof(ov_from[i]);
+        ret = WSARecvFrom(dst, &wsabuf, 1, &bytes, &flags, (struct sockaddr *)&ov_from[i], &ov_len[i],
+                          &ov[i], NULL);
+        ok(ret == SOCKET_ERROR && WSAGetLastError() == ERROR_IO_PENDING,
+           "WSARecvFrom %d returned %d, error %d\n", i, ret, WSAGetLastError());
+    }
+    for (i = 0; i < 4; i++)
+    {
+        memset(buf, 'a' + i, sizeof(buf));
+        ret = sendto(src, buf, 10 + i, 0, (struct sockaddr *)&addr, sizeof(addr));
+        ok(ret == 10 + i, "sendto %d returned %d\n", i, ret);
+    }
+    for (i = 0; i < 4; i++)
+    {
+        ret = WaitForSingleObject(ov[i].hEvent, 1000);
+        ok(ret == WAIT_OBJECT_0, "wait %d returned %d\n", i, ret);
+        ret = WSAGetOverlappedResult(dst, &ov[i], &bytes, FALSE, &flags);
+        ok(ret && bytes == 10 + i, "receive %d got %d, %u bytes\n", i, ret, bytes);
+        memset(expect, 'a' + i, sizeof(expect));
+        ok(!memcmp(ov_buf[i], expect, 10 + i), "got wrong data for receive %d\n", i);
+        ok(ov_len[i] == sizeof(ov_from[i]), "got len %d for receive %d\n", ov_len[i], i);
+        ok(ov_from[i].sin_port == from.sin_port, "got port %u for receive %d\n",
+           ntohs(ov_from[i].sin_port), i);
+        WSACloseEvent(ov[i].hEvent);
+    }
+
+    closesocket(src);
+    closesocket(dst);
+}
+
 static DWORD WINAPI do_getservbyname( void *param )
 {
     struct {
@@ -4136,6 +4292,71 @@ todo_wine
 #undef FD_SET_ALL
 #undef FD_ZERO_ALL
 
+static void test_select_closed_socket(void)
+{
+    struct timeval select_timeout;
+    SOCKET src, dst, s;
+    fd_set readfds;
+    char buffer;
+    int i, ret;
+
+    for (i = 0; i < 2; i++)
+    {
+        ok(!tcp_socketpair(&src, &dst), "creating socket pair failed\n");
+
+        /* let select and WSAPoll see the socket before it is closed */
+        select_timeout.tv_sec = 0;
+        select_timeout.tv_usec = 0;
+        FD_ZERO(&readfds);
+        FD_SET(src, &readfds);
+        ret = select(0, &readfds, NULL, NULL, &select_timeout);
+        ok(ret == 0, "expected 0, got %d\n", ret);
+        if (pWSAPoll)
+        {
+            WSAPOLLFD fds[1];
+
+            fds[0].fd = src;
+            fds[0].events = POLLRDNORM;
+            fds[0].revents = 0xdead;
+            ret = pWSAPoll(fds, 1, 0);
+            ok(ret == 0, "expected 0, got %d\n", ret);
+        }
+
+        if (i)
+        {
+            ret = CloseHandle((HANDLE)src);
+            ok(ret, "CloseHandle failed: %d\n", GetLastError());
+        }
+        else
+        {
+            ret = closesocket(src);
+            ok(!ret, "closesocket failed: %d\n", WSAGetLastError());
+        }
+
+        /* the connection is really closed */
+        select_timeout.tv_sec = 1;
+        FD_ZERO(&readfds);
+        FD_SET(dst, &readfds);
+        ret = select(0, &readfds, NULL, NULL, &select_timeout);
+        ok(ret == 1, "test %d: expected 1, got %d\n", i, ret);
+        ret = recv(dst, &buffer, 1, 0);
+        ok(ret == 0 || broken(i && ret == SOCKET_ERROR) /* reset */,
+           "test %d: expected 0, got %d\n", i, ret);
+
+        /* a new socket which may reuse the handle is not mistaken for the old one */
+        s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        ok(s != INVALID_SOCKET, "socket failed: %d\n", WSAGetLastError());
+        select_timeout.tv_sec = 0;
+        FD_ZERO(&readfds);
+        FD_SET(s, &readfds);
+        ret = select(0, &readfds, NULL, NULL, &select_timeout);
+        ok(ret == 0, "test %d: expected 0, got %d\n", i, ret);
+        closesocket(s);
+
+        closesocket(dst);
+    }
+}
+
 static DWORD WINAPI AcceptKillThread(void *param)
 {
     select_thread_params *par = param;
@@ -10632,6 +10853,7 @@ START_TEST( sock )
     }
 
     test_UDP();
+    test_UDP_burst();
 
     test_getservbyname();
     test_WSASocket();
@@ -10647,6 +10869,7 @@ START_TEST( sock )
     test_errors();
     test_listen();
     test_select();
+    test_select_closed_socket();
     test_accept();
     test_getpeername();
     test_getsockname();
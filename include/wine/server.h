@@ -54,6 +54,8 @@ extern void CDECL wine_server_send_fd( int fd );
 extern int CDECL wine_server_fd_to_handle( int fd, unsigned int access, unsigned int attributes, HANDLE *handle );
 extern int CDECL wine_server_handle_to_fd( HANDLE handle, unsigned int access, int *unix_fd, unsigned int *options );
 extern void CDECL wine_server_release_fd( HANDLE handle, int unix_fd );
+extern int CDECL wine_server_get_unix_fd( HANDLE handle, unsigned int access, int *unix_fd, int *needs_close );
+extern unsigned int CDECL wine_server_fd_cache_generation(void);
 
 /* do a server call and set the last error code */
 static inline unsigned int wine_server_call_err( void *req_ptr )
@@ -707,6 +707,48 @@ struct rawinput_device
 };
 
 
+struct shared_window
+{
+    unsigned int   seq;
+    user_handle_t  handle;
+    user_handle_t  parent;
+    user_handle_t  owner;
+    process_id_t   pid;
+    thread_id_t    tid;
+    unsigned int   style;
+    unsigned int   ex_style;
+    unsigned int   id;
+    unsigned int   __pad[3];
+    rectangle_t    window;
+    rectangle_t    client;
+};
+
+#define SHARED_WINDOW_COUNT ((LAST_USER_HANDLE - FIRST_USER_HANDLE + 1) >> 1)
+
+struct window_pos_info
+{
+    user_handle_t  handle;
+    user_handle_t  previous;
+    unsigned short swp_flags;
+    unsigned short paint_flags;
+    unsigned int   __pad;
+    rectangle_t    window;
+    rectangle_t    client;
+    rectangle_t    visible;
+    rectangle_t    valid[2];
+};
+
+struct window_pos_result
+{
+    unsigned int   status;
+    unsigned int   new_style;
+    unsigned int   new_ex_style;
+    user_handle_t  surface_win;
+    int            needs_update;
+    int            __pad;
+};
+
+
 
 
 
@@ -2806,7 +2848,7 @@ struct add_atom_reply
 {
     struct reply_header __header;
     atom_t        atom;
-    char __pad_12[4];
+    int           pinned;
 };
 
 
@@ -2835,7 +2877,7 @@ struct find_atom_reply
 {
     struct reply_header __header;
     atom_t       atom;
-    char __pad_12[4];
+    int          pinned;
 };
 
 
@@ -2982,7 +3024,9 @@ struct send_message_request
     lparam_t        wparam;
     lparam_t        lparam;
     timeout_t       timeout;
+    unsigned int    serial;
     /* VARARG(data,message_data); */
+    char __pad_60[4];
 };
 struct send_message_reply
 {
@@ -3010,7 +3054,8 @@ enum message_type
     MSG_POSTED,
     MSG_HARDWARE,
     MSG_WINEVENT,
-    MSG_HOOK_LL
+    MSG_HOOK_LL,
+    MSG_OTHER_PROCESS_SHARED
 };
 #define SEND_MSG_ABORT_IF_HUNG  0x01
 
@@ -3039,6 +3084,26 @@ struct send_hardware_message_reply
 
 
 
+struct send_hardware_messages_request
+{
+    struct request_header __header;
+    unsigned int    flags;
+    /* VARARG(inputs,hw_inputs); */
+};
+struct send_hardware_messages_reply
+{
+    struct reply_header __header;
+    unsigned int    count;
+    int             wait;
+    int             prev_x;
+    int             prev_y;
+    int             new_x;
+    int             new_y;
+    /* VARARG(keystate,bytes); */
+};
+
+
+
 struct get_message_request
 {
     struct request_header __header;
@@ -3049,6 +3114,8 @@ struct get_message_request
     unsigned int    hw_id;
     unsigned int    wake_mask;
     unsigned int    changed_mask;
+    int             local_posted;
+    unsigned int    local_serial;
 };
 struct get_message_reply
 {
@@ -3068,6 +3135,32 @@ struct get_message_reply
 
 
 
+struct wake_posted_queue_request
+{
+    struct request_header __header;
+    thread_id_t     id;
+};
+struct wake_posted_queue_reply
+{
+    struct reply_header __header;
+};
+
+
+
+struct get_post_serial_request
+{
+    struct request_header __header;
+    char __pad_12[4];
+};
+struct get_post_serial_reply
+{
+    struct reply_header __header;
+    obj_handle_t    handle;
+    char __pad_12[4];
+};
+
+
+
 struct reply_message_request
 {
     struct request_header __header;
@@ -3223,6 +3316,19 @@ struct cancel_async_reply
 
 
 
+struct alert_async_request
+{
+    struct request_header __header;
+    obj_handle_t handle;
+    /* VARARG(iosbs,uints64); */
+};
+struct alert_async_reply
+{
+    struct reply_header __header;
+};
+
+
+
 struct get_async_result_request
 {
     struct request_header __header;
@@ -3448,6 +3554,20 @@ struct get_window_info_reply
 
 
 
+struct get_shared_window_table_request
+{
+    struct request_header __header;
+    char __pad_12[4];
+};
+struct get_shared_window_table_reply
+{
+    struct reply_header __header;
+    obj_handle_t   handle;
+    unsigned int   id;
+};
+
+
+
 struct set_window_info_request
 {
     struct request_header __header;
@@ -3594,6 +3714,19 @@ struct set_window_pos_reply
 #define SET_WINPOS_PIXEL_FORMAT  0x02
 
 
+struct set_window_positions_request
+{
+    struct request_header __header;
+    /* VARARG(positions,window_positions); */
+    char __pad_12[4];
+};
+struct set_window_positions_reply
+{
+    struct reply_header __header;
+    /* VARARG(results,window_pos_results); */
+};
+
+
 struct get_window_rectangles_request
 {
     struct request_header __header;
@@ -5685,7 +5818,10 @@ enum request
     REQ_send_message,
     REQ_post_quit_message,
     REQ_send_hardware_message,
+    REQ_send_hardware_messages,
     REQ_get_message,
+    REQ_wake_posted_queue,
+    REQ_get_post_serial,
     REQ_reply_message,
     REQ_accept_hardware_message,
     REQ_get_message_reply,
@@ -5696,6 +5832,7 @@ enum request
     REQ_set_serial_info,
     REQ_register_async,
     REQ_cancel_async,
+    REQ_alert_async,
     REQ_get_async_result,
     REQ_read,
     REQ_write,
@@ -5709,6 +5846,7 @@ enum request
     REQ_get_desktop_window,
     REQ_set_window_owner,
     REQ_get_window_info,
+    REQ_get_shared_window_table,
     REQ_set_window_info,
     REQ_set_parent,
     REQ_get_window_parents,
@@ -5716,6 +5854,7 @@ enum request
     REQ_get_window_children_from_point,
     REQ_get_window_tree,
     REQ_set_window_pos,
+    REQ_set_window_positions,
     REQ_get_window_rectangles,
     REQ_get_window_text,
     REQ_set_window_text,
@@ -5976,7 +6115,10 @@ union generic_request
     struct send_message_request send_message_request;
     struct post_quit_message_request post_quit_message_request;
     struct send_hardware_message_request send_hardware_message_request;
+    struct send_hardware_messages_request send_hardware_messages_request;
     struct get_message_request get_message_request;
+    struct wake_posted_queue_request wake_posted_queue_request;
+    struct get_post_serial_request get_post_serial_request;
     struct reply_message_request reply_message_request;
     struct accept_hardware_message_request accept_hardware_message_request;
     struct get_message_reply_request get_message_reply_request;
@@ -5987,6 +6129,7 @@ union generic_request
     struct set_serial_info_request set_serial_info_request;
     struct register_async_request register_async_request;
     struct cancel_async_request cancel_async_request;
+    struct alert_async_request alert_async_request;
     struct get_async_result_request get_async_result_request;
     struct read_request read_request;
     struct write_request write_request;
@@ -6000,6 +6143,7 @@ union generic_request
     struct get_desktop_window_request get_desktop_window_request;
     struct set_window_owner_request set_window_owner_request;
     struct get_window_info_request get_window_info_request;
+    struct get_shared_window_table_request get_shared_window_table_request;
     struct set_window_info_request set_window_info_request;
     struct set_parent_request set_parent_request;
     struct get_window_parents_request get_window_parents_request;
@@ -6007,6 +6151,7 @@ union generic_request
     struct get_window_children_from_point_request get_window_children_from_point_request;
     struct get_window_tree_request get_window_tree_request;
     struct set_window_pos_request set_window_pos_request;
+    struct set_window_positions_request set_window_positions_request;
     struct get_window_rectangles_request get_window_rectangles_request;
     struct get_window_text_request get_window_text_request;
     struct set_window_text_request set_window_text_request;
@@ -6265,7 +6410,10 @@ union generic_reply
     struct send_message_reply send_message_reply;
     struct post_quit_message_reply post_quit_message_reply;
     struct send_hardware_message_reply send_hardware_message_reply;
+    struct send_hardware_messages_reply send_hardware_messages_reply;
     struct get_message_reply get_message_reply;
+    struct wake_posted_queue_reply wake_posted_queue_reply;
+    struct get_post_serial_reply get_post_serial_reply;
     struct reply_message_reply reply_message_reply;
     struct accept_hardware_message_reply accept_hardware_message_reply;
     struct get_message_reply_reply get_message_reply_reply;
@@ -6276,6 +6424,7 @@ union generic_reply
     struct set_serial_info_reply set_serial_info_reply;
     struct register_async_reply register_async_reply;
     struct cancel_async_reply cancel_async_reply;
+    struct alert_async_reply alert_async_reply;
     struct get_async_result_reply get_async_result_reply;
     struct read_reply read_reply;
     struct write_reply write_reply;
@@ -6289,6 +6438,7 @@ union generic_reply
     struct get_desktop_window_reply get_desktop_window_reply;
     struct set_window_owner_reply set_window_owner_reply;
     struct get_window_info_reply get_window_info_reply;
+    struct get_shared_window_table_reply get_shared_window_table_reply;
     struct set_window_info_reply set_window_info_reply;
     struct set_parent_reply set_parent_reply;
     struct get_window_parents_reply get_window_parents_reply;
@@ -6296,6 +6446,7 @@ union generic_reply
     struct get_window_children_from_point_reply get_window_children_from_point_reply;
     struct get_window_tree_reply get_window_tree_reply;
     struct set_window_pos_reply set_window_pos_reply;
+    struct set_window_positions_reply set_window_positions_reply;
     struct get_window_rectangles_reply get_window_rectangles_reply;
     struct get_window_text_reply get_window_text_reply;
     struct set_window_text_reply set_window_text_reply;
@@ -6417,6 +6568,6 @@ union generic_reply
     struct terminate_job_reply terminate_job_reply;
 };
 
-#define SERVER_PROTOCOL_VERSION 535
+#define SERVER_PROTOCOL_VERSION 545
 
 #endif /* __WINE_WINE_SERVER_PROTOCOL_H */
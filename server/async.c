@@ -533,6 +533,32 @@ DECL_HANDLER(cancel_async)
     }
 }
 
+/* alert the pending asyncs on an object that use one of the given iosbs, so that their
+ * callback runs even though the object didn't signal any new event for them */
+DECL_HANDLER(alert_async)
+{
+    struct object *obj = get_handle_obj( current->process, req->handle, 0, NULL );
+    const client_ptr_t *iosbs = get_req_data();
+    data_size_t i, count = get_req_data_size() / sizeof(*iosbs);
+    struct async *async;
+
+    if (!obj) return;
+
+    for (i = 0; i < count; i++)
+    {
+        LIST_FOR_EACH_ENTRY( async, &current->process->asyncs, struct async, process_entry )
+        {
+            if (async->status != STATUS_PENDING || !async->queue) continue;
+            if (async->fd && get_fd_user( async->fd ) == obj && async->data.iosb == iosbs[i])
+            {
+                async_terminate( async, STATUS_ALERTED );
+                break;
+            }
+        }
+    }
+    release_object( obj );
+}
+
 /* get async result from associated iosb */
 DECL_HANDLER(get_async_result)
 {
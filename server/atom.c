@@ -389,7 +389,10 @@ DECL_HANDLER(add_atom)
 
     if (table)
     {
-        reply->atom = add_atom( table, &name );
+        struct atom_entry *entry;
+
+        if ((reply->atom = add_atom( table, &name )) && (entry = get_atom_entry( table, reply->atom )))
+            reply->pinned = entry->pinned;
         release_object( table );
     }
 }
@@ -413,7 +416,10 @@ DECL_HANDLER(find_atom)
 
     if (table)
     {
-        reply->atom = find_atom( table, &name );
+        struct atom_entry *entry;
+
+        if ((reply->atom = find_atom( table, &name )) && (entry = get_atom_entry( table, reply->atom )))
+            reply->pinned = entry->pinned;
         release_object( table );
     }
 }
@@ -478,7 +484,8 @@ DECL_HANDLER(empty_atom_table)
         for (i = 0; i <= table->last; i++)
         {
             entry = table->handles[i];
-            if (entry && (!entry->pinned || req->if_pinned))
+            /* pinned global atoms are cached by the clients, they must never go away */
+            if (entry && (!entry->pinned || (req->if_pinned && req->table)))
             {
                 if (entry->next) entry->next->prev = entry->prev;
                 if (entry->prev) entry->prev->next = entry->next;
@@ -80,6 +80,7 @@ struct message
     int                    x;         /* message position */
     int                    y;
     unsigned int           time;      /* message time */
+    unsigned int           serial;    /* serial of a posted message, to order it against client side messages */
     void                  *data;      /* message data for sent messages */
     unsigned int           data_size; /* size of message data */
     unsigned int           unique_id; /* unique id for nested hw message waits */
@@ -223,6 +224,12 @@ static const struct object_ops thread_input_ops =
 /* pointer to input structure of foreground thread */
 static unsigned int last_input_time;
 
+/* serial of the last posted message, shared read-only with the clients once they ask for it */
+/* it is never 0, which is used to request a new serial */
+static unsigned int post_serial_storage = 1;
+static unsigned int *post_serial = &post_serial_storage;
+static struct object *post_serial_mapping;
+
 static void queue_hardware_message( struct desktop *desktop, struct message *msg, int always_queue );
 static void free_message( struct message *msg );
 
@@ -601,6 +608,30 @@ static void store_message_result( struct message_result *res, lparam_t result, u
     else if (!res->receiver) free_result( res );
 }
 
+/* add a posted message to a queue in serial order; a zero serial assigns a new one */
+static void queue_posted_message( struct msg_queue *queue, struct message *msg, unsigned int serial )
+{
+    struct message *prev;
+
+    if (!serial)
+    {
+        if (!++*post_serial) ++*post_serial;
+        msg->serial = *post_serial;
+        list_add_tail( &queue->msg_list[POST_MESSAGE], &msg->entry );
+        return;
+    }
+
+    /* a message moved from a client side queue goes after the ones posted before it */
+    msg->serial = serial;
+    LIST_FOR_EACH_ENTRY_REV( prev, &queue->msg_list[POST_MESSAGE], struct message, entry )
+    {
+        if ((int)(prev->serial - serial) > 0) continue;
+        list_add_after( &prev->entry, &msg->entry );
+        return;
+    }
+    list_add_head( &queue->msg_list[POST_MESSAGE], &msg->entry );
+}
+
 /* free a message when deleting a queue or window */
 static void free_message( struct message *msg )
 {
@@ -778,9 +809,10 @@ static int match_window( user_handle_t win, user_handle_t msg_win )
     return is_child_window( win, msg_win );
 }
 
-/* retrieve a posted message */
+/* retrieve a posted message; if the client has a local one, only if its serial is not after it */
 static int get_posted_message( struct msg_queue *queue, user_handle_t win,
                                unsigned int first, unsigned int last, unsigned int flags,
+                               int local_posted, unsigned int local_serial,
                                struct get_message_reply *reply )
 {
     struct message *msg;
@@ -790,6 +822,7 @@ static int get_posted_message( struct msg_queue *queue, user_handle_t win,
     {
         if (!match_window( win, msg->win )) continue;
         if (!check_msg_filter( msg->msg, first, last )) continue;
+        if (local_posted && (int)(msg->serial - local_serial) > 0) return 0;
         goto found; /* found one */
     }
     return 0;
@@ -1392,7 +1425,7 @@ found:
     msg->data      = NULL;
     msg->data_size = 0;
 
-    list_add_tail( &hotkey->queue->msg_list[POST_MESSAGE], &msg->entry );
+    queue_posted_message( hotkey->queue, msg, 0 );
     set_queue_bits( hotkey->queue, QS_POSTMESSAGE|QS_ALLPOSTMESSAGE|QS_HOTKEY );
     hotkey->queue->hotkey_count++;
     return 1;
@@ -2101,7 +2134,7 @@ void post_message( user_handle_t win, unsigned int message, lparam_t wparam, lpa
 
         get_message_defaults( thread->queue, &msg->x, &msg->y, &msg->time );
 
-        list_add_tail( &thread->queue->msg_list[POST_MESSAGE], &msg->entry );
+        queue_posted_message( thread->queue, msg, 0 );
         set_queue_bits( thread->queue, QS_POSTMESSAGE|QS_ALLPOSTMESSAGE );
         if (message == WM_HOTKEY)
         {
@@ -2328,6 +2361,7 @@ DECL_HANDLER(send_message)
         switch(msg->type)
         {
         case MSG_OTHER_PROCESS:
+        case MSG_OTHER_PROCESS_SHARED:
         case MSG_ASCII:
         case MSG_UNICODE:
         case MSG_CALLBACK:
@@ -2342,7 +2376,8 @@ DECL_HANDLER(send_message)
             set_queue_bits( recv_queue, QS_SENDMESSAGE );
             break;
         case MSG_POSTED:
-            list_add_tail( &recv_queue->msg_list[POST_MESSAGE], &msg->entry );
+            /* only a thread of the same process can move its own posted messages */
+            queue_posted_message( recv_queue, msg, thread->process == current->process ? req->serial : 0 );
             set_queue_bits( recv_queue, QS_POSTMESSAGE|QS_ALLPOSTMESSAGE );
             if (msg->msg == WM_HOTKEY)
             {
@@ -2408,6 +2443,61 @@ DECL_HANDLER(send_hardware_message)
     release_object( desktop );
 }
 
+/* check whether a mouse input only moves the cursor to an absolute position */
+static int is_absolute_mouse_move( const hw_input_t *input )
+{
+    return input->type == INPUT_MOUSE &&
+           (input->mouse.flags & ~MOUSEEVENTF_VIRTUALDESK) == (MOUSEEVENTF_MOVE | MOUSEEVENTF_ABSOLUTE);
+}
+
+/* send a list of hardware messages to the thread queues */
+DECL_HANDLER(send_hardware_messages)
+{
+    const hw_input_t *input = get_req_data();
+    unsigned int i, count = get_req_data_size() / sizeof(*input);
+    struct desktop *desktop;
+    struct msg_queue *sender = get_current_queue();
+    data_size_t size = min( 256, get_reply_max_size() );
+    int coalesce;
+
+    if (!(desktop = get_thread_desktop( current, 0 ))) return;
+
+    reply->prev_x = desktop->cursor.x;
+    reply->prev_y = desktop->cursor.y;
+
+    /* intermediate cursor positions can only be observed through low-level hooks or raw input */
+    coalesce = !get_first_global_hook( WH_MOUSE_LL ) && !current->process->rawinput_mouse;
+
+    for (i = 0; i < count && !reply->wait; i++)
+    {
+        switch (input[i].type)
+        {
+        case INPUT_MOUSE:
+            if (coalesce && i + 1 < count && is_absolute_mouse_move( &input[i] ) &&
+                is_absolute_mouse_move( &input[i + 1] ))
+                continue;
+            reply->wait = queue_mouse_message( desktop, 0, &input[i], req->flags, sender );
+            break;
+        case INPUT_KEYBOARD:
+            reply->wait = queue_keyboard_message( desktop, 0, &input[i], req->flags, sender );
+            break;
+        case INPUT_HARDWARE:
+            queue_custom_hardware_message( desktop, 0, &input[i] );
+            break;
+        default:
+            set_error( STATUS_INVALID_PARAMETER );
+            break;
+        }
+        if (get_error()) break;
+    }
+    reply->count = i;
+
+    reply->new_x = desktop->cursor.x;
+    reply->new_y = desktop->cursor.y;
+    set_reply_data( desktop->keystate, size );
+    release_object( desktop );
+}
+
 /* post a quit message to the current queue */
 DECL_HANDLER(post_quit_message)
 {
@@ -2455,14 +2545,24 @@ DECL_HANDLER(get_message)
 
     /* then check for posted messages */
     if ((filter & QS_POSTMESSAGE) &&
-        get_posted_message( queue, get_win, req->get_first, req->get_last, req->flags, reply ))
+        get_posted_message( queue, get_win, req->get_first, req->get_last, req->flags,
+                            req->local_posted, req->local_serial, reply ))
         return;
 
     if ((filter & QS_HOTKEY) && queue->hotkey_count &&
         req->get_first <= WM_HOTKEY && req->get_last >= WM_HOTKEY &&
-        get_posted_message( queue, get_win, WM_HOTKEY, WM_HOTKEY, req->flags, reply ))
+        get_posted_message( queue, get_win, WM_HOTKEY, WM_HOTKEY, req->flags,
+                            req->local_posted, req->local_serial, reply ))
         return;
 
+    /* the client has a same-process posted message that comes before anything else */
+    if (req->local_posted)
+    {
+        get_message_defaults( queue, &reply->x, &reply->y, &reply->time );
+        set_error( STATUS_PENDING );
+        return;
+    }
+
     /* only check for quit messages if not posted messages pending */
     if ((filter & QS_POSTMESSAGE) && get_quit_message( queue, req->flags, reply ))
         return;
@@ -2510,6 +2610,42 @@ DECL_HANDLER(get_message)
 }
 
 
+/* wake up a thread of the current process for same-process posted messages */
+DECL_HANDLER(wake_posted_queue)
+{
+    struct thread *thread;
+    struct msg_queue *queue;
+
+    if (!(thread = get_thread_from_id( req->id ))) return;
+
+    if (thread->process != current->process) set_error( STATUS_ACCESS_DENIED );
+    else if ((queue = thread->queue))
+    {
+        /* only the changed bits are set, the messages themselves are kept by the client */
+        queue->changed_bits |= QS_POSTMESSAGE | QS_ALLPOSTMESSAGE;
+        if (is_signaled( queue )) wake_up( &queue->obj, 0 );
+    }
+    release_object( thread );
+}
+
+
+/* get a handle to the serial of the last posted message */
+DECL_HANDLER(get_post_serial)
+{
+    void *ptr;
+
+    if (!post_serial_mapping)
+    {
+        if (!(post_serial_mapping = create_server_mapping( sizeof(*post_serial), &ptr ))) return;
+        make_object_static( post_serial_mapping );
+        post_serial = ptr;
+        *post_serial = post_serial_storage;
+    }
+    reply->handle = alloc_handle_no_access_check( current->process, post_serial_mapping,
+                                                  SECTION_MAP_READ | SECTION_QUERY, 0 );
+}
+
+
 /* reply to a sent message */
 DECL_HANDLER(reply_message)
 {
@@ -246,7 +246,10 @@ DECL_HANDLER(get_process_idle_event);
 DECL_HANDLER(send_message);
 DECL_HANDLER(post_quit_message);
 DECL_HANDLER(send_hardware_message);
+DECL_HANDLER(send_hardware_messages);
 DECL_HANDLER(get_message);
+DECL_HANDLER(wake_posted_queue);
+DECL_HANDLER(get_post_serial);
 DECL_HANDLER(reply_message);
 DECL_HANDLER(accept_hardware_message);
 DECL_HANDLER(get_message_reply);
@@ -257,6 +260,7 @@ DECL_HANDLER(get_serial_info);
 DECL_HANDLER(set_serial_info);
 DECL_HANDLER(register_async);
 DECL_HANDLER(cancel_async);
+DECL_HANDLER(alert_async);
 DECL_HANDLER(get_async_result);
 DECL_HANDLER(read);
 DECL_HANDLER(write);
@@ -270,6 +274,7 @@ DECL_HANDLER(destroy_window);
 DECL_HANDLER(get_desktop_window);
 DECL_HANDLER(set_window_owner);
 DECL_HANDLER(get_window_info);
+DECL_HANDLER(get_shared_window_table);
 DECL_HANDLER(set_window_info);
 DECL_HANDLER(set_parent);
 DECL_HANDLER(get_window_parents);
@@ -277,6 +282,7 @@ DECL_HANDLER(get_window_children);
 DECL_HANDLER(get_window_children_from_point);
 DECL_HANDLER(get_window_tree);
 DECL_HANDLER(set_window_pos);
+DECL_HANDLER(set_window_positions);
 DECL_HANDLER(get_window_rectangles);
 DECL_HANDLER(get_window_text);
 DECL_HANDLER(set_window_text);
@@ -536,7 +542,10 @@ static const req_handler req_handlers[REQ_NB_REQUESTS] =
     (req_handler)req_send_message,
     (req_handler)req_post_quit_message,
     (req_handler)req_send_hardware_message,
+    (req_handler)req_send_hardware_messages,
     (req_handler)req_get_message,
+    (req_handler)req_wake_posted_queue,
+    (req_handler)req_get_post_serial,
     (req_handler)req_reply_message,
     (req_handler)req_accept_hardware_message,
     (req_handler)req_get_message_reply,
@@ -547,6 +556,7 @@ static const req_handler req_handlers[REQ_NB_REQUESTS] =
     (req_handler)req_set_serial_info,
     (req_handler)req_register_async,
     (req_handler)req_cancel_async,
+    (req_handler)req_alert_async,
     (req_handler)req_get_async_result,
     (req_handler)req_read,
     (req_handler)req_write,
@@ -560,6 +570,7 @@ static const req_handler req_handlers[REQ_NB_REQUESTS] =
     (req_handler)req_get_desktop_window,
     (req_handler)req_set_window_owner,
     (req_handler)req_get_window_info,
+    (req_handler)req_get_shared_window_table,
     (req_handler)req_set_window_info,
     (req_handler)req_set_parent,
     (req_handler)req_get_window_parents,
@@ -567,6 +578,7 @@ static const req_handler req_handlers[REQ_NB_REQUESTS] =
     (req_handler)req_get_window_children_from_point,
     (req_handler)req_get_window_tree,
     (req_handler)req_set_window_pos,
+    (req_handler)req_set_window_positions,
     (req_handler)req_get_window_rectangles,
     (req_handler)req_get_window_text,
     (req_handler)req_set_window_text,
@@ -1448,6 +1460,7 @@ C_ASSERT( sizeof(struct get_selector_entry_reply) == 24 );
 C_ASSERT( FIELD_OFFSET(struct add_atom_request, table) == 12 );
 C_ASSERT( sizeof(struct add_atom_request) == 16 );
 C_ASSERT( FIELD_OFFSET(struct add_atom_reply, atom) == 8 );
+C_ASSERT( FIELD_OFFSET(struct add_atom_reply, pinned) == 12 );
 C_ASSERT( sizeof(struct add_atom_reply) == 16 );
 C_ASSERT( FIELD_OFFSET(struct delete_atom_request, table) == 12 );
 C_ASSERT( FIELD_OFFSET(struct delete_atom_request, atom) == 16 );
@@ -1455,6 +1468,7 @@ C_ASSERT( sizeof(struct delete_atom_request) == 24 );
 C_ASSERT( FIELD_OFFSET(struct find_atom_request, table) == 12 );
 C_ASSERT( sizeof(struct find_atom_request) == 16 );
 C_ASSERT( FIELD_OFFSET(struct find_atom_reply, atom) == 8 );
+C_ASSERT( FIELD_OFFSET(struct find_atom_reply, pinned) == 12 );
 C_ASSERT( sizeof(struct find_atom_reply) == 16 );
 C_ASSERT( FIELD_OFFSET(struct get_atom_information_request, table) == 12 );
 C_ASSERT( FIELD_OFFSET(struct get_atom_information_request, atom) == 16 );
@@ -1503,7 +1517,8 @@ C_ASSERT( FIELD_OFFSET(struct send_message_request, msg) == 28 );
 C_ASSERT( FIELD_OFFSET(struct send_message_request, wparam) == 32 );
 C_ASSERT( FIELD_OFFSET(struct send_message_request, lparam) == 40 );
 C_ASSERT( FIELD_OFFSET(struct send_message_request, timeout) == 48 );
-C_ASSERT( sizeof(struct send_message_request) == 56 );
+C_ASSERT( FIELD_OFFSET(struct send_message_request, serial) == 56 );
+C_ASSERT( sizeof(struct send_message_request) == 64 );
 C_ASSERT( FIELD_OFFSET(struct post_quit_message_request, exit_code) == 12 );
 C_ASSERT( sizeof(struct post_quit_message_request) == 16 );
 C_ASSERT( FIELD_OFFSET(struct send_hardware_message_request, win) == 12 );
@@ -1516,6 +1531,15 @@ C_ASSERT( FIELD_OFFSET(struct send_hardware_message_reply, prev_y) == 16 );
 C_ASSERT( FIELD_OFFSET(struct send_hardware_message_reply, new_x) == 20 );
 C_ASSERT( FIELD_OFFSET(struct send_hardware_message_reply, new_y) == 24 );
 C_ASSERT( sizeof(struct send_hardware_message_reply) == 32 );
+C_ASSERT( FIELD_OFFSET(struct send_hardware_messages_request, flags) == 12 );
+C_ASSERT( sizeof(struct send_hardware_messages_request) == 16 );
+C_ASSERT( FIELD_OFFSET(struct send_hardware_messages_reply, count) == 8 );
+C_ASSERT( FIELD_OFFSET(struct send_hardware_messages_reply, wait) == 12 );
+C_ASSERT( FIELD_OFFSET(struct send_hardware_messages_reply, prev_x) == 16 );
+C_ASSERT( FIELD_OFFSET(struct send_hardware_messages_reply, prev_y) == 20 );
+C_ASSERT( FIELD_OFFSET(struct send_hardware_messages_reply, new_x) == 24 );
+C_ASSERT( FIELD_OFFSET(struct send_hardware_messages_reply, new_y) == 28 );
+C_ASSERT( sizeof(struct send_hardware_messages_reply) == 32 );
 C_ASSERT( FIELD_OFFSET(struct get_message_request, flags) == 12 );
 C_ASSERT( FIELD_OFFSET(struct get_message_request, get_win) == 16 );
 C_ASSERT( FIELD_OFFSET(struct get_message_request, get_first) == 20 );
@@ -1523,7 +1547,9 @@ C_ASSERT( FIELD_OFFSET(struct get_message_request, get_last) == 24 );
 C_ASSERT( FIELD_OFFSET(struct get_message_request, hw_id) == 28 );
 C_ASSERT( FIELD_OFFSET(struct get_message_request, wake_mask) == 32 );
 C_ASSERT( FIELD_OFFSET(struct get_message_request, changed_mask) == 36 );
-C_ASSERT( sizeof(struct get_message_request) == 40 );
+C_ASSERT( FIELD_OFFSET(struct get_message_request, local_posted) == 40 );
+C_ASSERT( FIELD_OFFSET(struct get_message_request, local_serial) == 44 );
+C_ASSERT( sizeof(struct get_message_request) == 48 );
 C_ASSERT( FIELD_OFFSET(struct get_message_reply, win) == 8 );
 C_ASSERT( FIELD_OFFSET(struct get_message_reply, msg) == 12 );
 C_ASSERT( FIELD_OFFSET(struct get_message_reply, wparam) == 16 );
@@ -1535,6 +1561,11 @@ C_ASSERT( FIELD_OFFSET(struct get_message_reply, time) == 44 );
 C_ASSERT( FIELD_OFFSET(struct get_message_reply, active_hooks) == 48 );
 C_ASSERT( FIELD_OFFSET(struct get_message_reply, total) == 52 );
 C_ASSERT( sizeof(struct get_message_reply) == 56 );
+C_ASSERT( FIELD_OFFSET(struct wake_posted_queue_request, id) == 12 );
+C_ASSERT( sizeof(struct wake_posted_queue_request) == 16 );
+C_ASSERT( sizeof(struct get_post_serial_request) == 16 );
+C_ASSERT( FIELD_OFFSET(struct get_post_serial_reply, handle) == 8 );
+C_ASSERT( sizeof(struct get_post_serial_reply) == 16 );
 C_ASSERT( FIELD_OFFSET(struct reply_message_request, remove) == 12 );
 C_ASSERT( FIELD_OFFSET(struct reply_message_request, result) == 16 );
 C_ASSERT( sizeof(struct reply_message_request) == 24 );
@@ -1579,6 +1610,8 @@ C_ASSERT( FIELD_OFFSET(struct cancel_async_request, handle) == 12 );
 C_ASSERT( FIELD_OFFSET(struct cancel_async_request, iosb) == 16 );
 C_ASSERT( FIELD_OFFSET(struct cancel_async_request, only_thread) == 24 );
 C_ASSERT( sizeof(struct cancel_async_request) == 32 );
+C_ASSERT( FIELD_OFFSET(struct alert_async_request, handle) == 12 );
+C_ASSERT( sizeof(struct alert_async_request) == 16 );
 C_ASSERT( FIELD_OFFSET(struct get_async_result_request, user_arg) == 16 );
 C_ASSERT( sizeof(struct get_async_result_request) == 24 );
 C_ASSERT( FIELD_OFFSET(struct get_async_result_reply, size) == 8 );
@@ -1663,6 +1696,10 @@ C_ASSERT( FIELD_OFFSET(struct get_window_info_reply, tid) == 20 );
 C_ASSERT( FIELD_OFFSET(struct get_window_info_reply, atom) == 24 );
 C_ASSERT( FIELD_OFFSET(struct get_window_info_reply, is_unicode) == 28 );
 C_ASSERT( sizeof(struct get_window_info_reply) == 32 );
+C_ASSERT( sizeof(struct get_shared_window_table_request) == 16 );
+C_ASSERT( FIELD_OFFSET(struct get_shared_window_table_reply, handle) == 8 );
+C_ASSERT( FIELD_OFFSET(struct get_shared_window_table_reply, id) == 12 );
+C_ASSERT( sizeof(struct get_shared_window_table_reply) == 16 );
 C_ASSERT( FIELD_OFFSET(struct set_window_info_request, flags) == 12 );
 C_ASSERT( FIELD_OFFSET(struct set_window_info_request, is_unicode) == 14 );
 C_ASSERT( FIELD_OFFSET(struct set_window_info_request, handle) == 16 );
@@ -1728,6 +1765,8 @@ C_ASSERT( FIELD_OFFSET(struct set_window_pos_reply, new_ex_style) == 12 );
 C_ASSERT( FIELD_OFFSET(struct set_window_pos_reply, surface_win) == 16 );
 C_ASSERT( FIELD_OFFSET(struct set_window_pos_reply, needs_update) == 20 );
 C_ASSERT( sizeof(struct set_window_pos_reply) == 24 );
+C_ASSERT( sizeof(struct set_window_positions_request) == 16 );
+C_ASSERT( sizeof(struct set_window_positions_reply) == 8 );
 C_ASSERT( FIELD_OFFSET(struct get_window_rectangles_request, handle) == 12 );
 C_ASSERT( FIELD_OFFSET(struct get_window_rectangles_request, relative) == 16 );
 C_ASSERT( sizeof(struct get_window_rectangles_request) == 24 );
@@ -504,6 +504,21 @@ static void dump_varargs_user_handles( const char *prefix, data_size_t size )
     remove_data( size );
 }
 
+static void dump_varargs_hw_inputs( const char *prefix, data_size_t size )
+{
+    const hw_input_t *input = cur_data;
+    data_size_t len = size / sizeof(*input);
+
+    fprintf( stderr,"%s{", prefix );
+    while (len > 0)
+    {
+        dump_hw_input( "", input++ );
+        if (--len) fputc( ',', stderr );
+    }
+    fputc( '}', stderr );
+    remove_data( size );
+}
+
 static void dump_varargs_bytes( const char *prefix, data_size_t size )
 {
     const unsigned char *data = cur_data;
@@ -857,6 +872,46 @@ static void dump_varargs_rectangles( const char *prefix, data_size_t size )
     remove_data( size );
 }
 
+static void dump_varargs_window_positions( const char *prefix, data_size_t size )
+{
+    const struct window_pos_info *pos = cur_data;
+    data_size_t len = size / sizeof(*pos);
+
+    fprintf( stderr,"%s{", prefix );
+    while (len > 0)
+    {
+        fprintf( stderr, "{handle=%08x,previous=%08x,swp_flags=%04x,paint_flags=%04x",
+                 pos->handle, pos->previous, pos->swp_flags, pos->paint_flags );
+        dump_rectangle( ",window=", &pos->window );
+        dump_rectangle( ",client=", &pos->client );
+        dump_rectangle( ",visible=", &pos->visible );
+        dump_rectangle( ",valid=", &pos->valid[0] );
+        fputc( '}', stderr );
+        pos++;
+        if (--len) fputc( ',', stderr );
+    }
+    fputc( '}', stderr );
+    remove_data( size );
+}
+
+static void dump_varargs_window_pos_results( const char *prefix, data_size_t size )
+{
+    const struct window_pos_result *result = cur_data;
+    data_size_t len = size / sizeof(*result);
+
+    fprintf( stderr,"%s{", prefix );
+    while (len > 0)
+    {
+        fprintf( stderr, "{status=%08x,new_style=%08x,new_ex_style=%08x,surface_win=%08x,needs_update=%d}",
+                 result->status, result->new_style, result->new_ex_style,
+                 result->surface_win, result->needs_update );
+        result++;
+        if (--len) fputc( ',', stderr );
+    }
+    fputc( '}', stderr );
+    remove_data( size );
+}
+
 static void dump_varargs_message_data( const char *prefix, data_size_t size )
 {
     /* FIXME: dump the structured data */
@@ -2623,6 +2678,7 @@ static void dump_add_atom_request( const struct add_atom_request *req )
 static void dump_add_atom_reply( const struct add_atom_reply *req )
 {
     fprintf( stderr, " atom=%04x", req->atom );
+    fprintf( stderr, ", pinned=%d", req->pinned );
 }
 
 static void dump_delete_atom_request( const struct delete_atom_request *req )
@@ -2640,6 +2696,7 @@ static void dump_find_atom_request( const struct find_atom_request *req )
 static void dump_find_atom_reply( const struct find_atom_reply *req )
 {
     fprintf( stderr, " atom=%04x", req->atom );
+    fprintf( stderr, ", pinned=%d", req->pinned );
 }
 
 static void dump_get_atom_information_request( const struct get_atom_information_request *req )
@@ -2737,6 +2794,7 @@ static void dump_send_message_request( const struct send_message_request *req )
     dump_uint64( ", wparam=", &req->wparam );
     dump_uint64( ", lparam=", &req->lparam );
     dump_timeout( ", timeout=", &req->timeout );
+    fprintf( stderr, ", serial=%08x", req->serial );
     dump_varargs_message_data( ", data=", cur_size );
 }
 
@@ -2762,6 +2820,23 @@ static void dump_send_hardware_message_reply( const struct send_hardware_message
     dump_varargs_bytes( ", keystate=", cur_size );
 }
 
+static void dump_send_hardware_messages_request( const struct send_hardware_messages_request *req )
+{
+    fprintf( stderr, " flags=%08x", req->flags );
+    dump_varargs_hw_inputs( ", inputs=", cur_size );
+}
+
+static void dump_send_hardware_messages_reply( const struct send_hardware_messages_reply *req )
+{
+    fprintf( stderr, " count=%08x", req->count );
+    fprintf( stderr, ", wait=%d", req->wait );
+    fprintf( stderr, ", prev_x=%d", req->prev_x );
+    fprintf( stderr, ", prev_y=%d", req->prev_y );
+    fprintf( stderr, ", new_x=%d", req->new_x );
+    fprintf( stderr, ", new_y=%d", req->new_y );
+    dump_varargs_bytes( ", keystate=", cur_size );
+}
+
 static void dump_get_message_request( const struct get_message_request *req )
 {
     fprintf( stderr, " flags=%08x", req->flags );
@@ -2771,6 +2846,8 @@ static void dump_get_message_request( const struct get_message_request *req )
     fprintf( stderr, ", hw_id=%08x", req->hw_id );
     fprintf( stderr, ", wake_mask=%08x", req->wake_mask );
     fprintf( stderr, ", changed_mask=%08x", req->changed_mask );
+    fprintf( stderr, ", local_posted=%d", req->local_posted );
+    fprintf( stderr, ", local_serial=%08x", req->local_serial );
 }
 
 static void dump_get_message_reply( const struct get_message_reply *req )
@@ -2788,6 +2865,20 @@ static void dump_get_message_reply( const struct get_message_reply *req )
     dump_varargs_message_data( ", data=", cur_size );
 }
 
+static void dump_wake_posted_queue_request( const struct wake_posted_queue_request *req )
+{
+    fprintf( stderr, " id=%04x", req->id );
+}
+
+static void dump_get_post_serial_request( const struct get_post_serial_request *req )
+{
+}
+
+static void dump_get_post_serial_reply( const struct get_post_serial_reply *req )
+{
+    fprintf( stderr, " handle=%04x", req->handle );
+}
+
 static void dump_reply_message_request( const struct reply_message_request *req )
 {
     fprintf( stderr, " remove=%d", req->remove );
@@ -2876,6 +2967,12 @@ static void dump_cancel_async_request( const struct cancel_async_request *req )
     fprintf( stderr, ", only_thread=%d", req->only_thread );
 }
 
+static void dump_alert_async_request( const struct alert_async_request *req )
+{
+    fprintf( stderr, " handle=%04x", req->handle );
+    dump_varargs_uints64( ", iosbs=", cur_size );
+}
+
 static void dump_get_async_result_request( const struct get_async_result_request *req )
 {
     dump_uint64( " user_arg=", &req->user_arg );
@@ -3037,6 +3134,16 @@ static void dump_get_window_info_reply( const struct get_window_info_reply *req
     fprintf( stderr, ", is_unicode=%d", req->is_unicode );
 }
 
+static void dump_get_shared_window_table_request( const struct get_shared_window_table_request *req )
+{
+}
+
+static void dump_get_shared_window_table_reply( const struct get_shared_window_table_reply *req )
+{
+    fprintf( stderr, " handle=%04x", req->handle );
+    fprintf( stderr, ", id=%08x", req->id );
+}
+
 static void dump_set_window_info_request( const struct set_window_info_request *req )
 {
     fprintf( stderr, " flags=%04x", req->flags );
@@ -3149,6 +3256,16 @@ static void dump_set_window_pos_reply( const struct set_window_pos_reply *req )
     fprintf( stderr, ", needs_update=%d", req->needs_update );
 }
 
+static void dump_set_window_positions_request( const struct set_window_positions_request *req )
+{
+    dump_varargs_window_positions( " positions=", cur_size );
+}
+
+static void dump_set_window_positions_reply( const struct set_window_positions_reply *req )
+{
+    dump_varargs_window_pos_results( " results=", cur_size );
+}
+
 static void dump_get_window_rectangles_request( const struct get_window_rectangles_request *req )
 {
     fprintf( stderr, " handle=%08x", req->handle );
@@ -4599,7 +4716,10 @@ static const dump_func req_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_send_message_request,
     (dump_func)dump_post_quit_message_request,
     (dump_func)dump_send_hardware_message_request,
+    (dump_func)dump_send_hardware_messages_request,
     (dump_func)dump_get_message_request,
+    (dump_func)dump_wake_posted_queue_request,
+    (dump_func)dump_get_post_serial_request,
     (dump_func)dump_reply_message_request,
     (dump_func)dump_accept_hardware_message_request,
     (dump_func)dump_get_message_reply_request,
@@ -4610,6 +4730,7 @@ static const dump_func req_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_set_serial_info_request,
     (dump_func)dump_register_async_request,
     (dump_func)dump_cancel_async_request,
+    (dump_func)dump_alert_async_request,
     (dump_func)dump_get_async_result_request,
     (dump_func)dump_read_request,
     (dump_func)dump_write_request,
@@ -4623,6 +4744,7 @@ static const dump_func req_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_get_desktop_window_request,
     (dump_func)dump_set_window_owner_request,
     (dump_func)dump_get_window_info_request,
+    (dump_func)dump_get_shared_window_table_request,
     (dump_func)dump_set_window_info_request,
     (dump_func)dump_set_parent_request,
     (dump_func)dump_get_window_parents_request,
@@ -4630,6 +4752,7 @@ static const dump_func req_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_get_window_children_from_point_request,
     (dump_func)dump_get_window_tree_request,
     (dump_func)dump_set_window_pos_request,
+    (dump_func)dump_set_window_positions_request,
     (dump_func)dump_get_window_rectangles_request,
     (dump_func)dump_get_window_text_request,
     (dump_func)dump_set_window_text_request,
@@ -4886,8 +5009,11 @@ static const dump_func reply_dumpers[REQ_NB_REQUESTS] = {
     NULL,
     NULL,
     (dump_func)dump_send_hardware_message_reply,
+    (dump_func)dump_send_hardware_messages_reply,
     (dump_func)dump_get_message_reply,
     NULL,
+    (dump_func)dump_get_post_serial_reply,
+    NULL,
     NULL,
     (dump_func)dump_get_message_reply_reply,
     (dump_func)dump_set_win_timer_reply,
@@ -4897,6 +5023,7 @@ static const dump_func reply_dumpers[REQ_NB_REQUESTS] = {
     NULL,
     NULL,
     NULL,
+    NULL,
     (dump_func)dump_get_async_result_reply,
     (dump_func)dump_read_reply,
     (dump_func)dump_write_reply,
@@ -4910,6 +5037,7 @@ static const dump_func reply_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_get_desktop_window_reply,
     (dump_func)dump_set_window_owner_reply,
     (dump_func)dump_get_window_info_reply,
+    (dump_func)dump_get_shared_window_table_reply,
     (dump_func)dump_set_window_info_reply,
     (dump_func)dump_set_parent_reply,
     (dump_func)dump_get_window_parents_reply,
@@ -4917,6 +5045,7 @@ static const dump_func reply_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_get_window_children_from_point_reply,
     (dump_func)dump_get_window_tree_reply,
     (dump_func)dump_set_window_pos_reply,
+    (dump_func)dump_set_window_positions_reply,
     (dump_func)dump_get_window_rectangles_reply,
     (dump_func)dump_get_window_text_reply,
     NULL,
@@ -5173,7 +5302,10 @@ static const char * const req_names[REQ_NB_REQUESTS] = {
     "send_message",
     "post_quit_message",
     "send_hardware_message",
+    "send_hardware_messages",
     "get_message",
+    "wake_posted_queue",
+    "get_post_serial",
     "reply_message",
     "accept_hardware_message",
     "get_message_reply",
@@ -5184,6 +5316,7 @@ static const char * const req_names[REQ_NB_REQUESTS] = {
     "set_serial_info",
     "register_async",
     "cancel_async",
+    "alert_async",
     "get_async_result",
     "read",
     "write",
@@ -5197,6 +5330,7 @@ static const char * const req_names[REQ_NB_REQUESTS] = {
     "get_desktop_window",
     "set_window_owner",
     "get_window_info",
+    "get_shared_window_table",
     "set_window_info",
     "set_parent",
     "get_window_parents",
@@ -5204,6 +5338,7 @@ static const char * const req_names[REQ_NB_REQUESTS] = {
     "get_window_children_from_point",
     "get_window_tree",
     "set_window_pos",
+    "set_window_positions",
     "get_window_rectangles",
     "get_window_text",
     "set_window_text",
@@ -77,6 +77,9 @@ struct desktop
     unsigned int         users;            /* processes and threads using this desktop */
     struct global_cursor cursor;           /* global cursor information */
     unsigned char        keystate[256];    /* asynchronous key state */
+    struct object       *shared_window_mapping; /* shared window table mapping */
+    struct shared_window *shared_windows;  /* shared window table, mapped read-only by the clients */
+    unsigned int         shared_window_table; /* id of the shared window table */
 };
 
 /* user handles functions */
@@ -33,6 +33,8 @@
 #include "winternl.h"
 
 #include "object.h"
+#include "file.h"
+#include "handle.h"
 #include "request.h"
 #include "thread.h"
 #include "process.h"
@@ -73,6 +75,11 @@ struct window
     rectangle_t      client_rect;     /* client rectangle (relative to parent client area) */
     struct region   *win_region;      /* region for shaped windows (relative to window rect) */
     struct region   *update_region;   /* update region (relative to window rect) */
+    struct region   *vis_cache;       /* cached visible region (relative to window) */
+    unsigned int     vis_cache_flags; /* DCX flags of the cached visible region */
+    unsigned int     vis_cache_serial;      /* serial of the top-level window tree when cached */
+    unsigned int     vis_cache_root_serial; /* serial of the desktop window when cached */
+    unsigned int     vis_serial;      /* changed whenever anything in this window tree moves */
     unsigned int     style;           /* window style */
     unsigned int     ex_style;        /* window extended style */
     unsigned int     id;              /* window id */
@@ -124,6 +131,48 @@ static struct window *taskman_window;
 #define WINPTR_TOPMOST   ((struct window *)3L)
 #define WINPTR_NOTOPMOST ((struct window *)4L)
 
+/* last serial assigned to a window tree, see invalidate_vis_cache */
+static unsigned int last_vis_serial;
+
+/* id of the last shared window table created, see get_shared_window_table */
+static unsigned int last_shared_window_table;
+
+/* publish the current state of a window in the shared window table of its desktop */
+static void update_shared_window( struct window *win )
+{
+    struct shared_window *entry;
+
+    if (!win->desktop->shared_windows) return;
+    entry = &win->desktop->shared_windows[((win->handle & 0xffff) - FIRST_USER_HANDLE) >> 1];
+
+    /* the sequence number is odd while the entry is being modified */
+    interlocked_xchg_add( (int *)&entry->seq, 1 );
+    entry->handle   = win->handle;
+    entry->parent   = win->parent ? win->parent->handle : 0;
+    entry->owner    = win->owner;
+    entry->pid      = win->thread ? get_process_id( win->thread->process ) : 0;
+    entry->tid      = win->thread ? get_thread_id( win->thread ) : 0;
+    entry->style    = win->style;
+    entry->ex_style = win->ex_style;
+    entry->id       = win->id;
+    entry->window   = win->window_rect;
+    entry->client   = win->client_rect;
+    interlocked_xchg_add( (int *)&entry->seq, 1 );
+}
+
+/* remove a window from the shared window table of its desktop */
+static void remove_shared_window( struct window *win )
+{
+    struct shared_window *entry;
+
+    if (!win->desktop->shared_windows) return;
+    entry = &win->desktop->shared_windows[((win->handle & 0xffff) - FIRST_USER_HANDLE) >> 1];
+
+    interlocked_xchg_add( (int *)&entry->seq, 1 );
+    entry->handle = 0;
+    interlocked_xchg_add( (int *)&entry->seq, 1 );
+}
+
 /* retrieve a pointer to a window from its handle */
 static inline struct window *get_window( user_handle_t handle )
 {
@@ -138,6 +187,20 @@ static inline int is_desktop_window( const struct window *win )
     return !win->parent;  /* only desktop windows have no parent */
 }
 
+/* get the top-level window whose tree contains a given window; top-level windows are
+ * not clipped against each other so a tree is the unit of visible region cache invalidation */
+static inline struct window *get_vis_cache_top( struct window *win )
+{
+    while (win->parent && !is_desktop_window( win->parent )) win = win->parent;
+    return win;
+}
+
+/* invalidate the cached visible regions of all windows in the tree of a given window */
+static inline void invalidate_vis_cache( struct window *win )
+{
+    get_vis_cache_top( win )->vis_serial = ++last_vis_serial;
+}
+
 /* get next window in Z-order list */
 static inline struct window *get_next_window( struct window *win )
 {
@@ -227,6 +290,8 @@ static void link_window( struct window *win, struct window *previous )
     }
 
     win->is_linked = 1;
+    invalidate_vis_cache( win );
+    update_shared_window( win );
 }
 
 /* change the parent of a window (or unlink the window if the new parent is NULL) */
@@ -244,6 +309,7 @@ static int set_parent_window( struct window *win, struct window *parent )
         }
     }
 
+    invalidate_vis_cache( win );
     if (parent)
     {
         win->parent = parent;
@@ -263,6 +329,8 @@ static int set_parent_window( struct window *win, struct window *parent )
         list_add_head( &win->parent->unlinked, &win->entry );
         win->is_linked = 0;
     }
+    invalidate_vis_cache( win );
+    update_shared_window( win );
     return 1;
 }
 
@@ -401,6 +469,7 @@ static void detach_window_thread( struct window *win )
     /* destroyed when the desktop ref count reaches zero */
     release_object( win->desktop );
     win->thread = NULL;
+    update_shared_window( win );
 }
 
 /* get the process owning the top window of a given desktop */
@@ -478,6 +547,8 @@ static struct window *create_window( struct window *parent, struct window *owner
     win->last_active    = win->handle;
     win->win_region     = NULL;
     win->update_region  = NULL;
+    win->vis_cache      = NULL;
+    win->vis_serial     = ++last_vis_serial;
     win->style          = 0;
     win->ex_style       = 0;
     win->id             = 0;
@@ -527,6 +598,7 @@ static struct window *create_window( struct window *parent, struct window *owner
     }
 
     current->desktop_users++;
+    update_shared_window( win );
     return win;
 
 failed:
@@ -948,6 +1020,13 @@ static inline void offset_rect( rectangle_t *rect, int offset_x, int offset_y )
 }
 
 
+/* check if a rectangle is empty */
+static inline int is_rect_empty( const rectangle_t *rect )
+{
+    return (rect->left >= rect->right || rect->top >= rect->bottom);
+}
+
+
 /* set the region to the client rect clipped by the window rect, in parent-relative coordinates */
 static void set_region_client_rect( struct region *region, struct window *win )
 {
@@ -968,7 +1047,7 @@ static inline struct window *get_top_clipping_window( struct window *win )
 
 
 /* compute the visible region of a window, in window coordinates */
-static struct region *get_visible_region( struct window *win, unsigned int flags )
+static struct region *compute_visible_region( struct window *win, unsigned int flags )
 {
     struct region *tmp = NULL, *region;
     int offset_x, offset_y;
@@ -1054,6 +1133,47 @@ error:
 }
 
 
+/* get the visible region of a window, in window coordinates, using the cached one if still valid */
+static struct region *get_visible_region( struct window *win, unsigned int flags )
+{
+    struct window *top;
+    struct region *region;
+
+    /* the desktop clips out all top-level windows, don't bother caching it */
+    if (is_desktop_window( win )) return compute_visible_region( win, flags );
+
+    flags &= DCX_PARENTCLIP | DCX_WINDOW | DCX_CLIPCHILDREN;
+    top = get_vis_cache_top( win );
+
+    if (win->vis_cache && win->vis_cache_flags == flags &&
+        win->vis_cache_serial == top->vis_serial &&
+        win->vis_cache_root_serial == top->parent->vis_serial)
+    {
+        if (!(region = create_empty_region())) return NULL;
+        if (copy_region( region, win->vis_cache )) return region;
+        free_region( region );
+        return NULL;
+    }
+
+    if (!(region = compute_visible_region( win, flags ))) return NULL;
+
+    if (!win->vis_cache) win->vis_cache = create_empty_region();
+    if (win->vis_cache && copy_region( win->vis_cache, region ))
+    {
+        win->vis_cache_flags       = flags;
+        win->vis_cache_serial      = top->vis_serial;
+        win->vis_cache_root_serial = top->parent->vis_serial;
+    }
+    else
+    {
+        if (win->vis_cache) free_region( win->vis_cache );
+        win->vis_cache = NULL;
+        clear_error();
+    }
+    return region;
+}
+
+
 /* clip all children with a custom pixel format out of the visible region */
 static struct region *clip_pixel_format_children( struct window *parent, struct region *parent_clip,
                                                   struct region *region, int offset_x, int offset_y )
@@ -1584,6 +1704,80 @@ static unsigned int get_window_update_flags( struct window *win, struct window *
 }
 
 
+/* parent exposures collected while several windows are moved together */
+struct deferred_expose
+{
+    struct window *parent;   /* parent window */
+    struct region *region;   /* exposed region in parent client coordinates */
+};
+
+static struct deferred_expose *deferred_exposes;
+static unsigned int deferred_expose_count;
+static unsigned int deferred_expose_size;
+static int defer_exposes;
+
+/* start collecting parent exposures instead of redrawing the parents right away */
+static void begin_deferred_expose(void)
+{
+    defer_exposes = 1;
+}
+
+/* redraw a parent for the area exposed by moving one of its children */
+static void expose_parent( struct window *parent, struct region *region )
+{
+    struct deferred_expose *expose;
+    unsigned int i;
+
+    if (defer_exposes)
+    {
+        for (i = 0; i < deferred_expose_count; i++)
+        {
+            if (deferred_exposes[i].parent != parent) continue;
+            if (union_region( deferred_exposes[i].region, deferred_exposes[i].region, region )) return;
+            break;
+        }
+        if (i == deferred_expose_count)
+        {
+            if (deferred_expose_count == deferred_expose_size)
+            {
+                unsigned int new_size = max( 16, deferred_expose_size * 2 );
+                if (!(expose = realloc( deferred_exposes, new_size * sizeof(*expose) ))) goto redraw;
+                deferred_exposes = expose;
+                deferred_expose_size = new_size;
+            }
+            expose = &deferred_exposes[deferred_expose_count];
+            if (!(expose->region = create_empty_region())) goto redraw;
+            if (!copy_region( expose->region, region ))
+            {
+                free_region( expose->region );
+                goto redraw;
+            }
+            expose->parent = parent;
+            deferred_expose_count++;
+            return;
+        }
+    }
+
+redraw:
+    redraw_window( parent, region, 0, RDW_INVALIDATE | RDW_ERASE | RDW_ALLCHILDREN );
+}
+
+/* redraw the parents once for everything that was exposed since begin_deferred_expose */
+static void end_deferred_expose(void)
+{
+    unsigned int i;
+
+    defer_exposes = 0;
+    for (i = 0; i < deferred_expose_count; i++)
+    {
+        redraw_window( deferred_exposes[i].parent, deferred_exposes[i].region, 0,
+                       RDW_INVALIDATE | RDW_ERASE | RDW_ALLCHILDREN );
+        free_region( deferred_exposes[i].region );
+    }
+    deferred_expose_count = 0;
+}
+
+
 /* expose the areas revealed by a vis region change on the window parent */
 /* returns the region exposed on the window itself (in client coordinates) */
 static struct region *expose_window( struct window *win, const rectangle_t *old_window_rect,
@@ -1622,7 +1816,7 @@ static struct region *expose_window( struct window *win, const rectangle_t *old_
             {
                 /* make it relative to parent */
                 offset_region( new_vis_rgn, old_window_rect->left, old_window_rect->top );
-                redraw_window( win->parent, new_vis_rgn, 0, RDW_INVALIDATE | RDW_ERASE | RDW_ALLCHILDREN );
+                expose_parent( win->parent, new_vis_rgn );
             }
         }
     }
@@ -1657,6 +1851,8 @@ static void set_window_pos( struct window *win, struct window *previous,
     if (!(swp_flags & SWP_NOZORDER) && win->parent) link_window( win, previous );
     if (swp_flags & SWP_SHOWWINDOW) win->style |= WS_VISIBLE;
     else if (swp_flags & SWP_HIDEWINDOW) win->style &= ~WS_VISIBLE;
+    invalidate_vis_cache( win );
+    update_shared_window( win );
 
     /* keep children at the same position relative to top right corner when the parent is mirrored */
     if (win->ex_style & WS_EX_LAYOUTRTL)
@@ -1670,6 +1866,7 @@ static void set_window_pos( struct window *win, struct window *previous,
             offset_rect( &child->window_rect, new_size - old_size, 0 );
             offset_rect( &child->visible_rect, new_size - old_size, 0 );
             offset_rect( &child->client_rect, new_size - old_size, 0 );
+            update_shared_window( child );
         }
     }
 
@@ -1812,6 +2009,7 @@ static void set_window_region( struct window *win, struct region *region, int re
 
     if (win->win_region) free_region( win->win_region );
     win->win_region = region;
+    invalidate_vis_cache( win );
 
     /* expose anything revealed by the change */
     if (old_vis_rgn && ((exposed_rgn = expose_window( win, &win->window_rect, old_vis_rgn ))))
@@ -1833,6 +2031,7 @@ void destroy_window( struct window *win )
     {
         struct region *vis_rgn = get_visible_region( win, DCX_WINDOW );
         win->style &= ~WS_VISIBLE;
+        invalidate_vis_cache( win );
         if (vis_rgn)
         {
             struct region *exposed_rgn = expose_window( win, &win->window_rect, vis_rgn );
@@ -1856,8 +2055,10 @@ void destroy_window( struct window *win )
     if (win == taskman_window) taskman_window = NULL;
     free_hotkeys( win->desktop, win->handle );
     cleanup_clipboard_window( win->desktop, win->handle );
+    remove_shared_window( win );
     free_user_handle( win->handle );
     destroy_properties( win );
+    invalidate_vis_cache( win );
     list_remove( &win->entry );
     if (is_desktop_window(win))
     {
@@ -1874,6 +2075,7 @@ void destroy_window( struct window *win )
     detach_window_thread( win );
     if (win->win_region) free_region( win->win_region );
     if (win->update_region) free_region( win->update_region );
+    if (win->vis_cache) free_region( win->vis_cache );
     if (win->class) release_class( win->class );
     free( win->text );
     memset( win, 0x55, sizeof(*win) + win->nb_extra_bytes - 1 );
@@ -1967,6 +2169,8 @@ DECL_HANDLER(get_desktop_window)
         {
             detach_window_thread( desktop->top_window );
             desktop->top_window->style  = WS_POPUP | WS_VISIBLE | WS_CLIPSIBLINGS | WS_CLIPCHILDREN;
+            invalidate_vis_cache( desktop->top_window );
+            update_shared_window( desktop->top_window );
         }
     }
 
@@ -1979,6 +2183,8 @@ DECL_HANDLER(get_desktop_window)
         {
             detach_window_thread( desktop->msg_window );
             desktop->msg_window->style = WS_POPUP | WS_CLIPSIBLINGS | WS_CLIPCHILDREN;
+            invalidate_vis_cache( desktop->msg_window );
+            update_shared_window( desktop->msg_window );
         }
     }
 
@@ -2014,6 +2220,7 @@ DECL_HANDLER(set_window_owner)
 
     reply->prev_owner = win->owner;
     reply->full_owner = win->owner = owner ? owner->handle : 0;
+    update_shared_window( win );
 }
 
 
@@ -2040,6 +2247,39 @@ DECL_HANDLER(get_window_info)
 }
 
 
+/* get a handle to the shared window table of the current thread desktop */
+/* the table only contains the windows of that desktop */
+DECL_HANDLER(get_shared_window_table)
+{
+    struct desktop *desktop;
+
+    if (!(desktop = get_thread_desktop( current, DESKTOP_READOBJECTS ))) return;
+
+    if (!desktop->shared_window_mapping)
+    {
+        user_handle_t handle = 0;
+        struct window *win;
+        void *ptr;
+
+        if ((desktop->shared_window_mapping = create_server_mapping( SHARED_WINDOW_COUNT *
+                                                                     sizeof(*desktop->shared_windows), &ptr )))
+        {
+            desktop->shared_windows = ptr;
+            desktop->shared_window_table = ++last_shared_window_table;
+            while ((win = next_user_handle( &handle, USER_WINDOW )))
+                if (win->desktop == desktop) update_shared_window( win );
+        }
+    }
+    if (desktop->shared_window_mapping)
+    {
+        reply->handle = alloc_handle_no_access_check( current->process, desktop->shared_window_mapping,
+                                                      SECTION_MAP_READ | SECTION_QUERY, 0 );
+        reply->id = desktop->shared_window_table;
+    }
+    release_object( desktop );
+}
+
+
 /* set some information in a window */
 DECL_HANDLER(set_window_info)
 {
@@ -2086,6 +2326,12 @@ DECL_HANDLER(set_window_info)
     if (req->flags & SET_WIN_USERDATA) win->user_data = req->user_data;
     if (req->flags & SET_WIN_EXTRA) memcpy( win->extra_bytes + req->extra_offset,
                                             &req->extra_value, req->extra_size );
+    if (req->flags & (SET_WIN_STYLE | SET_WIN_EXSTYLE))
+    {
+        invalidate_vis_cache( win );
+        update_shared_window( win );
+    }
+    else if (req->flags & SET_WIN_ID) update_shared_window( win );
 
     /* changing window style triggers a non-client paint */
     if (req->flags & SET_WIN_STYLE) win->paint_flags |= PAINT_NONCLIENT;
@@ -2218,19 +2464,21 @@ DECL_HANDLER(get_window_tree)
 
 
 /* set the position and Z order of a window */
-DECL_HANDLER(set_window_pos)
+static struct window *apply_window_pos( user_handle_t handle, user_handle_t prev_handle,
+                                        unsigned int flags, unsigned int paint_flags,
+                                        const rectangle_t *req_window, const rectangle_t *req_client,
+                                        const rectangle_t *req_visible, const rectangle_t *req_valid )
 {
-    rectangle_t window_rect, client_rect, visible_rect;
+    rectangle_t window_rect, client_rect, visible_rect, valid_rects[2];
     struct window *previous = NULL;
-    struct window *top, *win = get_window( req->handle );
-    unsigned int flags = req->swp_flags;
+    struct window *win = get_window( handle );
 
-    if (!win) return;
+    if (!win) return NULL;
     if (!win->parent) flags |= SWP_NOZORDER;  /* no Z order for the desktop */
 
     if (!(flags & SWP_NOZORDER))
     {
-        switch ((int)req->previous)
+        switch ((int)prev_handle)
         {
         case 0:   /* HWND_TOP */
             previous = WINPTR_TOP;
@@ -2245,12 +2493,12 @@ DECL_HANDLER(set_window_pos)
             previous = WINPTR_NOTOPMOST;
             break;
         default:
-            if (!(previous = get_window( req->previous ))) return;
+            if (!(previous = get_window( prev_handle ))) return NULL;
             /* previous must be a sibling */
             if (previous->parent != win->parent)
             {
                 set_error( STATUS_INVALID_PARAMETER );
-                return;
+                return NULL;
             }
             break;
         }
@@ -2261,16 +2509,15 @@ DECL_HANDLER(set_window_pos)
     if ((win->ex_style & WS_EX_LAYERED) && !win->is_layered) flags |= SWP_NOREDRAW;
 
     /* window rectangle must be ordered properly */
-    if (req->window.right < req->window.left || req->window.bottom < req->window.top)
+    if (req_window->right < req_window->left || req_window->bottom < req_window->top)
     {
         set_error( STATUS_INVALID_PARAMETER );
-        return;
+        return NULL;
     }
 
-    window_rect = visible_rect = req->window;
-    client_rect = req->client;
-    if (get_req_data_size() >= sizeof(rectangle_t))
-        memcpy( &visible_rect, get_req_data(), sizeof(rectangle_t) );
+    window_rect = *req_window;
+    client_rect = *req_client;
+    visible_rect = req_visible ? *req_visible : *req_window;
     if (win->parent && win->parent->ex_style & WS_EX_LAYOUTRTL)
     {
         mirror_rect( &win->parent->client_rect, &window_rect );
@@ -2278,13 +2525,12 @@ DECL_HANDLER(set_window_pos)
         mirror_rect( &win->parent->client_rect, &client_rect );
     }
 
-    win->paint_flags = (win->paint_flags & ~PAINT_CLIENT_FLAGS) | (req->paint_flags & PAINT_CLIENT_FLAGS);
+    win->paint_flags = (win->paint_flags & ~PAINT_CLIENT_FLAGS) | (paint_flags & PAINT_CLIENT_FLAGS);
     if (win->paint_flags & PAINT_HAS_PIXEL_FORMAT) update_pixel_format_flags( win );
 
-    if (get_req_data_size() >= 3 * sizeof(rectangle_t))
+    if (req_valid)
     {
-        rectangle_t valid_rects[2];
-        memcpy( valid_rects, (const rectangle_t *)get_req_data() + 1, 2 * sizeof(rectangle_t) );
+        memcpy( valid_rects, req_valid, 2 * sizeof(rectangle_t) );
         if (win->parent && win->parent->ex_style & WS_EX_LAYOUTRTL)
         {
             mirror_rect( &win->parent->client_rect, &valid_rects[0] );
@@ -2294,15 +2540,68 @@ DECL_HANDLER(set_window_pos)
     }
     else set_window_pos( win, previous, flags, &window_rect, &client_rect, &visible_rect, NULL );
 
+    return win;
+}
+
+/* get the window holding the surface that a window paints to */
+static user_handle_t get_window_surface_win( struct window *win, int *needs_update )
+{
+    struct window *top = get_top_clipping_window( win );
+
+    *needs_update = 0;
+    if (!is_visible( top ) || !(top->paint_flags & PAINT_HAS_SURFACE)) return 0;
+    *needs_update = !!(top->paint_flags & (PAINT_HAS_PIXEL_FORMAT | PAINT_PIXEL_FORMAT_CHILD));
+    return top->handle;
+}
+
+
+/* set the position of a window */
+DECL_HANDLER(set_window_pos)
+{
+    const rectangle_t *visible_rect = NULL, *valid_rects = NULL;
+    struct window *win;
+    int needs_update;
+
+    if (get_req_data_size() >= sizeof(rectangle_t)) visible_rect = get_req_data();
+    if (get_req_data_size() >= 3 * sizeof(rectangle_t)) valid_rects = visible_rect + 1;
+
+    if (!(win = apply_window_pos( req->handle, req->previous, req->swp_flags, req->paint_flags,
+                                  &req->window, &req->client, visible_rect, valid_rects )))
+        return;
+
     reply->new_style = win->style;
     reply->new_ex_style = win->ex_style;
+    if ((reply->surface_win = get_window_surface_win( win, &needs_update )))
+        reply->needs_update = needs_update;
+}
 
-    top = get_top_clipping_window( win );
-    if (is_visible( top ) && (top->paint_flags & PAINT_HAS_SURFACE))
+
+/* set the position of several windows, exposing their parents only once */
+DECL_HANDLER(set_window_positions)
+{
+    const struct window_pos_info *pos = get_req_data();
+    struct window_pos_result *results;
+    unsigned int i, count = get_req_data_size() / sizeof(*pos);
+    struct window *win;
+
+    if (!count || !(results = set_reply_data_size( count * sizeof(*results) ))) return;
+
+    begin_deferred_expose();
+    for (i = 0; i < count; i++, pos++)
     {
-        reply->surface_win = top->handle;
-        reply->needs_update = !!(top->paint_flags & (PAINT_HAS_PIXEL_FORMAT | PAINT_PIXEL_FORMAT_CHILD));
+        const rectangle_t *valid_rects = is_rect_empty( &pos->valid[0] ) ? NULL : pos->valid;
+
+        memset( &results[i], 0, sizeof(results[i]) );
+        win = apply_window_pos( pos->handle, pos->previous, pos->swp_flags, pos->paint_flags,
+                                &pos->window, &pos->client, &pos->visible, valid_rects );
+        results[i].status = get_error();
+        clear_error();
+        if (!win) continue;
+        results[i].new_style = win->style;
+        results[i].new_ex_style = win->ex_style;
+        results[i].surface_win = get_window_surface_win( win, &results[i].needs_update );
     }
+    end_deferred_expose();
 }
 
 
@@ -2643,6 +2942,7 @@ DECL_HANDLER(update_window_zorder)
         {
             list_remove( &win->entry );
             list_add_before( &ptr->entry, &win->entry );
+            invalidate_vis_cache( win );
         }
         break;
     }